@@ -0,0 +1,939 @@
+/***********************************************************************/
+/*                                                                     */
+/*  Bench.c : Mesure de cadius sur des images Prodos synthétiques.     */
+/*                                                                     */
+/***********************************************************************/
+/*                                                                     */
+/*  cadius_bench <cadius_path> <work_directory> [nb_run]               */
+/*                                                                     */
+/*  Crée dans work_directory des images .po reproductibles (même       */
+/*  contenu à chaque lancement) puis chronomètre LOAD, CATALOG,        */
+/*  CHECKVOLUME, ADDFOLDER, EXTRACTVOLUME, DELETEFOLDER et MOVEFOLDER. */
+/*  Chaque mesure est le meilleur temps sur nb_run lancements, avec    */
+/*  le pic de mémoire (RSS) du processus. POSIX uniquement.            */
+/*                                                                     */
+/***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "libcadius.h"
+
+#define BENCH_BLOCK_SIZE          512
+#define BENCH_ENTRY_LENGTH       0x27
+#define BENCH_ENTRIES_PER_BLOCK    13
+#define BENCH_FOLDER_MAX_BLOCK    512   /* 6655 entrées par dossier */
+#define BENCH_PATH_LENGTH        1024
+
+#define BENCH_VOLUME_NAME "BENCH"
+
+#define BENCH_DATE  ((20 << 9) | (1 << 5) | 1)   /* 01-Jan-2020 */
+#define BENCH_TIME  ((12 << 8) | 0)              /* 12:00 */
+
+/** Description d'une image synthétique **/
+struct bench_profile
+{
+  char *name;
+  int nb_block;
+
+  int depth;                /* Niveaux de dossiers sous la racine */
+  int nb_folder_child;      /* Sous-dossiers par dossier (la racine a au moins A et B) */
+  int nb_file_folder;       /* Fichiers par dossier (8 au plus à la racine) */
+  int file_size_min;
+  int file_size_max;
+  int sparse_percent;       /* Part des fichiers creux (1 block sur 4 alloué) */
+  int fragment_gap;         /* Blocks laissés libres après chaque fichier (0 -> N) */
+  int fill_percent;         /* On arrête de remplir l'image à ce taux */
+};
+
+static struct bench_profile bench_profile[] =
+{
+  /* name               blocks depth child files  size_min  size_max sparse gap fill */
+  {"140k-flat",           280,    1,    2,   12,      100,     1500,    0,   0,  60},
+  {"800k-deep",          1600,    6,    2,    3,      200,     4000,    0,   0,  60},
+  {"800k-small",         1600,    1,    3,  120,       16,      512,    0,   0,  60},
+  {"32m-flat-small",    65535,    1,    2, 3000,       16,      900,    0,   0,  60},
+  {"32m-deep",          65535,    5,    3,    8,      100,     8000,    0,   0,  60},
+  {"32m-tree",          65535,    1,    2,    3,  1500000,  3000000,    0,   0,  60},
+  {"32m-sparse",        65535,    1,    2,   20,   200000,  1500000,  100,   0,  60},
+  {"32m-fragmented",    65535,    2,    4,  100,      200,     6000,    0,   4,  60},
+  {NULL,                    0,    0,    0,    0,        0,        0,    0,   0,   0}
+};
+
+/** Image en cours de création **/
+struct gen_image
+{
+  int nb_block;
+  int nb_block_max;         /* Blocks utilisables (fill_percent) */
+  int next_block;           /* Allocation séquentielle */
+  int nb_used;
+  unsigned char *data;
+  unsigned char *tab_used;
+
+  unsigned int seed;
+  struct bench_profile *profile;
+
+  int nb_entry;
+  long long data_size;      /* Somme des EOF des fichiers */
+  int nb_entry_a;           /* Entrées de /BENCH/A, dossier compris (DELETEFOLDER, MOVEFOLDER) */
+};
+
+/** Dossier en cours de création **/
+struct gen_folder
+{
+  int is_volume;
+  int nb_block;
+  int tab_block[BENCH_FOLDER_MAX_BLOCK];
+  int nb_entry;             /* Entrées utilisées, en-tête compris */
+  int file_count;
+
+  int parent_block;         /* Entrée du dossier dans son parent */
+  int parent_index;
+  int parent_key_block;
+  char name[16];
+};
+
+/** Résultat d'une mesure **/
+struct bench_result
+{
+  double time_ms;           /* Meilleur temps */
+  long peak_rss_kb;         /* Plus gros pic */
+  int error;
+};
+
+static unsigned int GetRandom(unsigned int *);
+static int GetRandomRange(unsigned int *,int,int);
+static unsigned int GetNameSeed(char *);
+static void SetWord(unsigned char *,int);
+static int AllocateBlock(struct gen_image *);
+static unsigned char *GetFolderSlot(struct gen_image *,struct gen_folder *,int *,int *);
+static void SetEntry(unsigned char *,int,char *,int,int,int,int,int,int);
+static int AddFile(struct gen_image *,struct gen_folder *,char *,int);
+static int OpenFolder(struct gen_image *,struct gen_folder *,char *,struct gen_folder *);
+static void CloseFolder(struct gen_image *,struct gen_folder *);
+static int FillFolder(struct gen_image *,struct gen_folder *,int,int *);
+static int CreateImage(struct bench_profile *,char *,struct gen_image *);
+static int CreateHostFolder(struct bench_profile *,char *,long long *);
+static int WriteFile(char *,unsigned char *,int);
+static int RunCommand(char **,char *,char *,struct bench_result *,int);
+static int RunLoad(char *,struct bench_result *,int);
+static int CopyFile(char *,char *);
+static void RemoveFolder(char *);
+static double GetTime(void);
+static long GetPeakRss(struct rusage *);
+static void PrintResult(struct bench_profile *,char *,struct bench_result *,double,char *);
+
+/*****************************************************/
+/*  main() :  Fonction principale du banc de mesure. */
+/*****************************************************/
+int main(int argc, char *argv[])
+{
+  int nb_run, nb_error = 0;
+  long long host_size;
+  char *cadius_path, *work_path;
+  char image_path[BENCH_PATH_LENGTH], copy_path[BENCH_PATH_LENGTH], host_path[BENCH_PATH_LENGTH];
+  char output_path[BENCH_PATH_LENGTH];
+  char *command[8];
+  double image_mb;
+  struct gen_image image;
+  struct bench_result result;
+  struct bench_profile *profile;
+
+  /* Paramètres */
+  if(argc < 3)
+    {
+      printf("Usage : %s <cadius_path> <work_directory> [nb_run]\n",argv[0]);
+      return(1);
+    }
+  cadius_path = argv[1];
+  work_path = argv[2];
+  nb_run = (argc > 3) ? atoi(argv[3]) : 3;
+  if(nb_run < 1)
+    nb_run = 1;
+  if(mkdir(work_path,0755) && errno != EEXIST)
+    {
+      printf("  Error : Can't create folder '%s'.\n",work_path);
+      return(1);
+    }
+
+  printf("%-16s %-15s %10s %22s %11s\n","Profile","Command","Time (ms)","Throughput","Peak RSS");
+  for(profile=&bench_profile[0]; profile->name != NULL; profile++)
+    {
+      /** Image et dossier à ajouter **/
+      snprintf(image_path,sizeof(image_path),"%s/%s.po",work_path,profile->name);
+      snprintf(copy_path,sizeof(copy_path),"%s/%s_copy.po",work_path,profile->name);
+      snprintf(host_path,sizeof(host_path),"%s/%s_host",work_path,profile->name);
+      snprintf(output_path,sizeof(output_path),"%s/%s_extract",work_path,profile->name);
+      if(CreateImage(profile,image_path,&image) || CreateHostFolder(profile,host_path,&host_size))
+        {
+          printf("  Error : Can't create the files of profile '%s'.\n",profile->name);
+          nb_error++;
+          continue;
+        }
+      image_mb = (double) image.nb_block*BENCH_BLOCK_SIZE/(1024.0*1024.0);
+      printf("# %s : %d blocks, %d used, %d entries, %lld bytes of data\n",profile->name,image.nb_block,image.nb_used,image.nb_entry,image.data_size);
+
+      /** LOAD : chargement par libcadius dans un processus fils **/
+      nb_error += RunLoad(image_path,&result,nb_run);
+      PrintResult(profile,"LOAD",&result,image_mb,"MB/s");
+
+      /** CATALOG / CHECKVOLUME **/
+      command[0] = cadius_path;
+      command[1] = "CATALOG";
+      command[2] = image_path;
+      command[3] = NULL;
+      nb_error += RunCommand(command,NULL,NULL,&result,nb_run);
+      PrintResult(profile,"CATALOG",&result,image_mb,"MB/s");
+
+      command[1] = "CHECKVOLUME";
+      nb_error += RunCommand(command,NULL,NULL,&result,nb_run);
+      PrintResult(profile,"CHECKVOLUME",&result,image_mb,"MB/s");
+
+      /** ADDFOLDER (sur une copie) **/
+      command[1] = "ADDFOLDER";
+      command[2] = copy_path;
+      command[3] = "/" BENCH_VOLUME_NAME "/ADDED";
+      command[4] = host_path;
+      command[5] = NULL;
+      nb_error += RunCommand(command,image_path,NULL,&result,nb_run);
+      PrintResult(profile,"ADDFOLDER",&result,(double) host_size/(1024.0*1024.0),"MB/s");
+
+      /** EXTRACTVOLUME (dossier vidé avant chaque lancement) **/
+      command[1] = "EXTRACTVOLUME";
+      command[2] = image_path;
+      command[3] = output_path;
+      command[4] = NULL;
+      nb_error += RunCommand(command,NULL,output_path,&result,nb_run);
+      PrintResult(profile,"EXTRACTVOLUME",&result,(double) image.data_size/(1024.0*1024.0),"MB/s");
+
+      /** DELETEFOLDER / MOVEFOLDER (sur une copie) **/
+      command[1] = "DELETEFOLDER";
+      command[2] = copy_path;
+      command[3] = "/" BENCH_VOLUME_NAME "/A";
+      command[4] = NULL;
+      nb_error += RunCommand(command,image_path,NULL,&result,nb_run);
+      PrintResult(profile,"DELETEFOLDER",&result,(double) image.nb_entry_a,"entries/s");
+
+      command[1] = "MOVEFOLDER";
+      command[4] = "/" BENCH_VOLUME_NAME "/B";
+      command[5] = NULL;
+      nb_error += RunCommand(command,image_path,NULL,&result,nb_run);
+      PrintResult(profile,"MOVEFOLDER",&result,(double) image.nb_entry_a,"entries/s");
+
+      /* Les images restent dans work_directory */
+      unlink(copy_path);
+      RemoveFolder(host_path);
+    }
+
+  return((nb_error > 0) ? 1 : 0);
+}
+
+
+/*******************************************************************/
+/*  CreateImage() :  Construit et écrit l'image .po d'un profil.   */
+/*******************************************************************/
+static int CreateImage(struct bench_profile *profile, char *image_path, struct gen_image *image)
+{
+  int i, error, nb_bitmap_block, nb_entry;
+  unsigned char *header;
+  struct gen_folder *volume;
+
+  /* Init */
+  memset(image,0,sizeof(struct gen_image));
+  image->profile = profile;
+  image->nb_block = profile->nb_block;
+  image->nb_block_max = (int) ((long long) profile->nb_block*profile->fill_percent/100);
+  image->seed = GetNameSeed(profile->name);
+  image->data = (unsigned char *) calloc(profile->nb_block,BENCH_BLOCK_SIZE);
+  image->tab_used = (unsigned char *) calloc(profile->nb_block,sizeof(unsigned char));
+  volume = (struct gen_folder *) calloc(1,sizeof(struct gen_folder));
+  if(image->data == NULL || image->tab_used == NULL || volume == NULL)
+    {
+      free(image->data);
+      free(image->tab_used);
+      free(volume);
+      return(1);
+    }
+
+  /** Boot, Volume Directory (2-5) et Bitmap (6+) **/
+  nb_bitmap_block = (profile->nb_block+BENCH_BLOCK_SIZE*8-1)/(BENCH_BLOCK_SIZE*8);
+  image->next_block = 0;
+  for(i=0; i<6+nb_bitmap_block; i++)
+    AllocateBlock(image);
+  volume->is_volume = 1;
+  volume->nb_block = 4;
+  volume->nb_entry = 1;
+  for(i=0; i<4; i++)
+    {
+      volume->tab_block[i] = 2+i;
+      SetWord(&image->data[(2+i)*BENCH_BLOCK_SIZE+0x00],(i == 0) ? 0 : 2+i-1);
+      SetWord(&image->data[(2+i)*BENCH_BLOCK_SIZE+0x02],(i == 3) ? 0 : 2+i+1);
+    }
+
+  /** Fichiers et dossiers (s'arrête quand l'image est remplie) **/
+  nb_entry = 0;
+  FillFolder(image,volume,0,&nb_entry);
+
+  /** Volume Directory Header **/
+  header = &image->data[2*BENCH_BLOCK_SIZE+0x04];
+  header[0x00] = 0xF0 | (unsigned char) strlen(BENCH_VOLUME_NAME);
+  memcpy(&header[0x01],BENCH_VOLUME_NAME,strlen(BENCH_VOLUME_NAME));
+  SetWord(&header[0x18],BENCH_DATE);
+  SetWord(&header[0x1A],BENCH_TIME);
+  header[0x1C] = 0x05;
+  header[0x1D] = 0x00;
+  header[0x1E] = 0xC3;
+  header[0x1F] = BENCH_ENTRY_LENGTH;
+  header[0x20] = BENCH_ENTRIES_PER_BLOCK;
+  SetWord(&header[0x21],volume->file_count);
+  SetWord(&header[0x23],0x0006);
+  SetWord(&header[0x25],profile->nb_block);
+
+  /** Bitmap : 1 = libre **/
+  for(i=0; i<profile->nb_block; i++)
+    if(image->tab_used[i] == 0)
+      image->data[6*BENCH_BLOCK_SIZE+i/8] |= (0x80 >> (i%8));
+
+  /** Ecriture de l'image **/
+  error = WriteFile(image_path,image->data,profile->nb_block*BENCH_BLOCK_SIZE);
+
+  /* Libération mémoire (les processus fils n'en héritent pas) */
+  free(image->data);
+  free(image->tab_used);
+  free(volume);
+  image->data = NULL;
+  image->tab_used = NULL;
+
+  return(error);
+}
+
+
+/**************************************************************************/
+/*  FillFolder() :  Fichiers puis sous-dossiers d'un dossier. Renvoie 1   */
+/*                  quand l'image est remplie (les dossiers restent       */
+/*                  valides).                                             */
+/**************************************************************************/
+static int FillFolder(struct gen_image *image, struct gen_folder *folder, int level, int *nb_entry_rtn)
+{
+  int i, nb_file, nb_child, nb_open, size, nb_child_entry, error = 0;
+  char name[24];
+  struct gen_folder *tab_child;
+  struct bench_profile *profile = image->profile;
+
+  /** Sous-dossiers : tous créés avant d'être remplis (/BENCH/A et /BENCH/B existent toujours) **/
+  nb_child = (level < profile->depth) ? profile->nb_folder_child : 0;
+  if(level == 0 && nb_child < 2)
+    nb_child = 2;
+  tab_child = (struct gen_folder *) calloc((nb_child > 0) ? nb_child : 1,sizeof(struct gen_folder));
+  if(tab_child == NULL)
+    return(1);
+  for(nb_open=0; nb_open<nb_child; nb_open++)
+    {
+      if(level == 0)
+        snprintf(name,sizeof(name),"%c",'A'+nb_open);
+      else
+        snprintf(name,sizeof(name),"S%d",nb_open+1);
+      if(OpenFolder(image,folder,name,&tab_child[nb_open]))
+        {
+          error = 1;
+          break;
+        }
+      (*nb_entry_rtn)++;
+    }
+
+  /** Fichiers (la racine n'a que 51 entrées) **/
+  nb_file = (folder->is_volume && profile->nb_file_folder > 8) ? 8 : profile->nb_file_folder;
+  for(i=0; i<nb_file && error == 0; i++)
+    {
+      snprintf(name,sizeof(name),"F%d.BIN",i+1);
+      size = GetRandomRange(&image->seed,profile->file_size_min,profile->file_size_max);
+      error = AddFile(image,folder,name,size);
+      if(error == 0)
+        (*nb_entry_rtn)++;
+    }
+
+  /** Contenu des sous-dossiers **/
+  for(i=0; i<nb_open; i++)
+    {
+      nb_child_entry = 0;
+      if(error == 0)
+        error = FillFolder(image,&tab_child[i],level+1,&nb_child_entry);
+      CloseFolder(image,&tab_child[i]);
+      *nb_entry_rtn += nb_child_entry;
+      if(level == 0 && i == 0)
+        image->nb_entry_a = 1 + nb_child_entry;
+    }
+
+  free(tab_child);
+  return(error);
+}
+
+
+/********************************************************************/
+/*  AddFile() :  Ajoute un fichier Seedling, Sapling ou Tree. Les   */
+/*               fichiers creux n'ont qu'un block de données sur 4. */
+/********************************************************************/
+static int AddFile(struct gen_image *image, struct gen_folder *folder, char *name, int size)
+{
+  int i, k, nb_data, nb_alloc, nb_index, storage_type, key_block, index_block, data_block, length, is_sparse;
+  int slot_block, slot_index;
+  unsigned char *entry, *data;
+  struct bench_profile *profile = image->profile;
+
+  /* Taille maximale Prodos : 32768 blocks de données */
+  if(size > 32768*BENCH_BLOCK_SIZE)
+    size = 32768*BENCH_BLOCK_SIZE;
+  is_sparse = (GetRandomRange(&image->seed,1,100) <= profile->sparse_percent);
+  nb_data = (size == 0) ? 1 : (size+BENCH_BLOCK_SIZE-1)/BENCH_BLOCK_SIZE;
+  for(k=0, nb_alloc=0; k<nb_data; k++)
+    if(!is_sparse || k%4 == 0)
+      nb_alloc++;
+  nb_index = (nb_data == 1) ? 0 : (nb_data <= 256) ? 1 : 1 + (nb_data+255)/256;
+  storage_type = (nb_data == 1) ? 1 : (nb_data <= 256) ? 2 : 3;
+
+  /* Place disponible (+1 pour un éventuel block de dossier) */
+  if(image->nb_used+nb_alloc+nb_index+1 > image->nb_block_max || image->next_block+nb_alloc+nb_index+1 > image->nb_block)
+    return(1);
+  entry = GetFolderSlot(image,folder,&slot_block,&slot_index);
+  if(entry == NULL)
+    return(1);
+
+  /** Blocks : Master Index, puis pour chaque Index ses blocks de données **/
+  key_block = (nb_index == 0) ? 0 : AllocateBlock(image);
+  index_block = (storage_type == 2) ? key_block : 0;
+  for(k=0; k<nb_data; k++)
+    {
+      /* Index block de l'arbre */
+      if(storage_type == 3 && k%256 == 0)
+        {
+          index_block = AllocateBlock(image);
+          image->data[key_block*BENCH_BLOCK_SIZE+k/256] = (unsigned char) (index_block & 0xFF);
+          image->data[key_block*BENCH_BLOCK_SIZE+256+k/256] = (unsigned char) (index_block >> 8);
+        }
+
+      /* Block creux */
+      if(is_sparse && k%4 != 0)
+        continue;
+
+      /* Données pseudo-aléatoires jusqu'à l'EOF */
+      data_block = AllocateBlock(image);
+      data = &image->data[data_block*BENCH_BLOCK_SIZE];
+      length = (size - k*BENCH_BLOCK_SIZE > BENCH_BLOCK_SIZE) ? BENCH_BLOCK_SIZE : size - k*BENCH_BLOCK_SIZE;
+      for(i=0; i<length; i+=4)
+        {
+          unsigned int value = GetRandom(&image->seed);
+          memcpy(&data[i],&value,(length-i < 4) ? length-i : 4);
+        }
+
+      if(storage_type == 1)
+        key_block = data_block;
+      else
+        {
+          image->data[index_block*BENCH_BLOCK_SIZE+k%256] = (unsigned char) (data_block & 0xFF);
+          image->data[index_block*BENCH_BLOCK_SIZE+256+k%256] = (unsigned char) (data_block >> 8);
+        }
+    }
+
+  /** Entrée **/
+  SetEntry(entry,storage_type,name,0x06,key_block,nb_alloc+nb_index,size,0x2000,folder->tab_block[0]);
+  folder->file_count++;
+  image->nb_entry++;
+  image->data_size += size;
+
+  /* Espace libre laissé derrière le fichier */
+  if(profile->fragment_gap > 0)
+    {
+      image->next_block += GetRandomRange(&image->seed,0,profile->fragment_gap);
+      if(image->next_block > image->nb_block)
+        image->next_block = image->nb_block;
+    }
+
+  return(0);
+}
+
+
+/*********************************************************************/
+/*  OpenFolder() :  Réserve l'entrée et le Key Block d'un dossier.   */
+/*********************************************************************/
+static int OpenFolder(struct gen_image *image, struct gen_folder *parent, char *name, struct gen_folder *folder)
+{
+  /* Place disponible (entrée + Key Block + blocks à venir) */
+  if(image->nb_used+4 > image->nb_block_max || image->next_block+4 > image->nb_block)
+    return(1);
+
+  memset(folder,0,sizeof(struct gen_folder));
+  strcpy(folder->name,name);
+  if(GetFolderSlot(image,parent,&folder->parent_block,&folder->parent_index) == NULL)
+    return(1);
+  folder->parent_key_block = parent->tab_block[0];
+  folder->tab_block[0] = AllocateBlock(image);
+  folder->nb_block = 1;
+  folder->nb_entry = 1;
+
+  parent->file_count++;
+  image->nb_entry++;
+
+  return(0);
+}
+
+
+/*********************************************************************/
+/*  CloseFolder() :  Ecrit l'en-tête du dossier et son entrée dans   */
+/*                   le dossier parent.                              */
+/*********************************************************************/
+static void CloseFolder(struct gen_image *image, struct gen_folder *folder)
+{
+  unsigned char *header;
+
+  /** SubDirectory Header **/
+  header = &image->data[folder->tab_block[0]*BENCH_BLOCK_SIZE+0x04];
+  header[0x00] = 0xE0 | (unsigned char) strlen(folder->name);
+  memcpy(&header[0x01],folder->name,strlen(folder->name));
+  header[0x10] = 0x75;
+  SetWord(&header[0x18],BENCH_DATE);
+  SetWord(&header[0x1A],BENCH_TIME);
+  header[0x1E] = 0xC3;
+  header[0x1F] = BENCH_ENTRY_LENGTH;
+  header[0x20] = BENCH_ENTRIES_PER_BLOCK;
+  SetWord(&header[0x21],folder->file_count);
+  SetWord(&header[0x23],folder->parent_block);
+  header[0x25] = (unsigned char) (folder->parent_index+1);   /* 1->N */
+  header[0x26] = BENCH_ENTRY_LENGTH;
+
+  /** Entrée dans le parent **/
+  SetEntry(&image->data[folder->parent_block*BENCH_BLOCK_SIZE+0x04+folder->parent_index*BENCH_ENTRY_LENGTH],0x0D,folder->name,0x0F,
+           folder->tab_block[0],folder->nb_block,folder->nb_block*BENCH_BLOCK_SIZE,0x0000,folder->parent_key_block);
+}
+
+
+/*************************************************************************/
+/*  GetFolderSlot() :  Entrée libre d'un dossier (ajoute un block si le  */
+/*                     dossier est plein, sauf pour le Volume).          */
+/*************************************************************************/
+static unsigned char *GetFolderSlot(struct gen_image *image, struct gen_folder *folder, int *block_rtn, int *index_rtn)
+{
+  int block, last_block;
+
+  /* Nouveau block chaîné au dernier */
+  if(folder->nb_entry == folder->nb_block*BENCH_ENTRIES_PER_BLOCK)
+    {
+      if(folder->is_volume || folder->nb_block == BENCH_FOLDER_MAX_BLOCK)
+        return(NULL);
+      block = AllocateBlock(image);
+      if(block == 0)
+        return(NULL);
+      last_block = folder->tab_block[folder->nb_block-1];
+      SetWord(&image->data[block*BENCH_BLOCK_SIZE+0x00],last_block);
+      SetWord(&image->data[last_block*BENCH_BLOCK_SIZE+0x02],block);
+      folder->tab_block[folder->nb_block++] = block;
+    }
+
+  *block_rtn = folder->tab_block[folder->nb_entry/BENCH_ENTRIES_PER_BLOCK];
+  *index_rtn = folder->nb_entry%BENCH_ENTRIES_PER_BLOCK;
+  folder->nb_entry++;
+
+  return(&image->data[(*block_rtn)*BENCH_BLOCK_SIZE+0x04+(*index_rtn)*BENCH_ENTRY_LENGTH]);
+}
+
+
+/*****************************************************************/
+/*  SetEntry() :  Remplit une File Descriptive Entry (0x27).      */
+/*****************************************************************/
+static void SetEntry(unsigned char *entry, int storage_type, char *name, int file_type, int key_block, int blocks_used, int eof, int aux_type, int header_block)
+{
+  entry[0x00] = (unsigned char) ((storage_type << 4) | strlen(name));
+  memcpy(&entry[0x01],name,strlen(name));
+  entry[0x10] = (unsigned char) file_type;
+  SetWord(&entry[0x11],key_block);
+  SetWord(&entry[0x13],blocks_used);
+  entry[0x15] = (unsigned char) (eof & 0xFF);
+  entry[0x16] = (unsigned char) ((eof >> 8) & 0xFF);
+  entry[0x17] = (unsigned char) ((eof >> 16) & 0xFF);
+  SetWord(&entry[0x18],BENCH_DATE);
+  SetWord(&entry[0x1A],BENCH_TIME);
+  entry[0x1E] = 0xE3;
+  SetWord(&entry[0x1F],aux_type);
+  SetWord(&entry[0x21],BENCH_DATE);
+  SetWord(&entry[0x23],BENCH_TIME);
+  SetWord(&entry[0x25],header_block);
+}
+
+
+/*************************************************************/
+/*  AllocateBlock() :  Block suivant (0 si l'image est pleine). */
+/*************************************************************/
+static int AllocateBlock(struct gen_image *image)
+{
+  int block;
+
+  if(image->next_block >= image->nb_block)
+    return(0);
+
+  block = image->next_block++;
+  image->tab_used[block] = 1;
+  image->nb_used++;
+
+  return(block);
+}
+
+
+/************************************************************************/
+/*  CreateHostFolder() :  Dossier du disque pour ADDFOLDER (environ 10% */
+/*                        de l'image, la moitié dans un sous-dossier).  */
+/************************************************************************/
+static int CreateHostFolder(struct bench_profile *profile, char *host_path, long long *host_size_rtn)
+{
+  int i, j, nb_file, file_size, size, error;
+  unsigned int seed, value;
+  unsigned char *data;
+  char file_path[BENCH_PATH_LENGTH+32];
+
+  /* Init */
+  *host_size_rtn = 0;
+  nb_file = profile->nb_block/200;
+  nb_file = (nb_file < 4) ? 4 : (nb_file > 300) ? 300 : nb_file;
+  file_size = (int) ((long long) profile->nb_block*BENCH_BLOCK_SIZE/10/nb_file);
+  seed = GetNameSeed(profile->name) ^ 0x5A5A5A5A;
+  data = (unsigned char *) malloc(file_size*3/2+4);
+  if(data == NULL)
+    return(1);
+
+  /* Dossiers */
+  RemoveFolder(host_path);
+  snprintf(file_path,sizeof(file_path),"%s/SUB",host_path);
+  if(mkdir(host_path,0755) || mkdir(file_path,0755))
+    {
+      free(data);
+      return(1);
+    }
+
+  /** Fichiers **/
+  for(i=0, error=0; i<nb_file && error == 0; i++)
+    {
+      size = GetRandomRange(&seed,file_size/2,file_size*3/2);
+      for(j=0; j<size; j+=4)
+        {
+          value = GetRandom(&seed);
+          memcpy(&data[j],&value,4);
+        }
+      snprintf(file_path,sizeof(file_path),(i < nb_file/2) ? "%s/H%d.BIN" : "%s/SUB/H%d.BIN",host_path,i+1);
+      error = WriteFile(file_path,data,size);
+      *host_size_rtn += size;
+    }
+
+  free(data);
+  return(error);
+}
+
+
+/*****************************************************************/
+/*  RunCommand() :  Lance cadius nb_run fois, garde le meilleur  */
+/*                  temps et le plus gros pic mémoire.           */
+/*                  copy_source : copié sur command[2] avant     */
+/*                  chaque lancement, clean_path : vidé avant.   */
+/*****************************************************************/
+static int RunCommand(char **command, char *copy_source, char *clean_path, struct bench_result *result, int nb_run)
+{
+  int i, fd, status;
+  pid_t pid;
+  double start, time_ms;
+  struct rusage usage;
+
+  memset(result,0,sizeof(struct bench_result));
+  for(i=0; i<nb_run && result->error == 0; i++)
+    {
+      /** Préparation, non chronométrée **/
+      if(copy_source != NULL && CopyFile(copy_source,command[2]))
+        {
+          result->error = 1;
+          break;
+        }
+      if(clean_path != NULL)
+        {
+          RemoveFolder(clean_path);
+          mkdir(clean_path,0755);
+        }
+
+      /** Lancement **/
+      start = GetTime();
+      pid = fork();
+      if(pid < 0)
+        {
+          result->error = 1;
+          break;
+        }
+      if(pid == 0)
+        {
+          fd = open("/dev/null",O_WRONLY);
+          if(fd >= 0)
+            {
+              dup2(fd,1);
+              dup2(fd,2);
+              close(fd);
+            }
+          execv(command[0],command);
+          _exit(127);
+        }
+      if(wait4(pid,&status,0,&usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        result->error = 1;
+      time_ms = (GetTime()-start)*1000.0;
+
+      /* Meilleur temps, plus gros pic */
+      if(i == 0 || time_ms < result->time_ms)
+        result->time_ms = time_ms;
+      if(GetPeakRss(&usage) > result->peak_rss_kb)
+        result->peak_rss_kb = GetPeakRss(&usage);
+    }
+
+  if(clean_path != NULL)
+    RemoveFolder(clean_path);
+  return(result->error);
+}
+
+
+/*******************************************************************/
+/*  RunLoad() :  Chargement de l'image par cadius_OpenImage dans   */
+/*               un processus fils, chronométré par le fils.       */
+/*******************************************************************/
+static int RunLoad(char *image_path, struct bench_result *result, int nb_run)
+{
+  int i, fd, status, tube[2];
+  pid_t pid;
+  double start, time_ms;
+  struct rusage usage;
+  struct cadius_context *context;
+
+  memset(result,0,sizeof(struct bench_result));
+  for(i=0; i<nb_run && result->error == 0; i++)
+    {
+      if(pipe(tube))
+        {
+          result->error = 1;
+          break;
+        }
+      pid = fork();
+      if(pid < 0)
+        {
+          close(tube[0]);
+          close(tube[1]);
+          result->error = 1;
+          break;
+        }
+      if(pid == 0)
+        {
+          close(tube[0]);
+          fd = open("/dev/null",O_WRONLY);
+          if(fd >= 0)
+            {
+              dup2(fd,1);
+              close(fd);
+            }
+          start = GetTime();
+          context = cadius_OpenImage(image_path,0);
+          time_ms = (context == NULL) ? -1.0 : (GetTime()-start)*1000.0;
+          cadius_CloseImage(context);
+          if(write(tube[1],&time_ms,sizeof(double)) != sizeof(double))
+            _exit(1);
+          _exit(0);
+        }
+
+      /** Temps renvoyé par le fils **/
+      close(tube[1]);
+      if(read(tube[0],&time_ms,sizeof(double)) != sizeof(double) || time_ms < 0.0)
+        result->error = 1;
+      close(tube[0]);
+      if(wait4(pid,&status,0,&usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        result->error = 1;
+
+      if(i == 0 || time_ms < result->time_ms)
+        result->time_ms = time_ms;
+      if(GetPeakRss(&usage) > result->peak_rss_kb)
+        result->peak_rss_kb = GetPeakRss(&usage);
+    }
+
+  return(result->error);
+}
+
+
+/***************************************************************/
+/*  PrintResult() :  Ligne du tableau (amount : MB ou entrées). */
+/***************************************************************/
+static void PrintResult(struct bench_profile *profile, char *command, struct bench_result *result, double amount, char *unit)
+{
+  if(result->error)
+    printf("%-16s %-15s %10s\n",profile->name,command,"FAIL");
+  else
+    printf("%-16s %-15s %10.2f %12.1f %-9s %8.1f MB\n",profile->name,command,result->time_ms,
+           (result->time_ms > 0.0) ? amount*1000.0/result->time_ms : 0.0,unit,(double) result->peak_rss_kb/1024.0);
+  fflush(stdout);
+}
+
+
+/*******************************************************/
+/*  WriteFile() :  Ecrit un fichier sur disque.        */
+/*******************************************************/
+static int WriteFile(char *file_path, unsigned char *data, int length)
+{
+  FILE *fd;
+  int error;
+
+  fd = fopen(file_path,"wb");
+  if(fd == NULL)
+    return(1);
+  error = ((int) fwrite(data,1,length,fd) != length);
+  if(fclose(fd))
+    error = 1;
+
+  return(error);
+}
+
+
+/******************************************************/
+/*  CopyFile() :  Copie un fichier (image de travail). */
+/******************************************************/
+static int CopyFile(char *source_path, char *target_path)
+{
+  FILE *source, *target;
+  size_t length;
+  int error = 0;
+  unsigned char buffer[65536];
+
+  source = fopen(source_path,"rb");
+  if(source == NULL)
+    return(1);
+  target = fopen(target_path,"wb");
+  if(target == NULL)
+    {
+      fclose(source);
+      return(1);
+    }
+
+  while((length = fread(buffer,1,sizeof(buffer),source)) > 0)
+    if(fwrite(buffer,1,length,target) != length)
+      {
+        error = 1;
+        break;
+      }
+
+  fclose(source);
+  if(fclose(target))
+    error = 1;
+  return(error);
+}
+
+
+/**************************************************************/
+/*  RemoveFolder() :  Supprime un dossier et tout son contenu. */
+/**************************************************************/
+static void RemoveFolder(char *folder_path)
+{
+  DIR *folder;
+  struct dirent *entry;
+  struct stat entry_stat;
+  char entry_path[BENCH_PATH_LENGTH];
+
+  folder = opendir(folder_path);
+  if(folder == NULL)
+    return;
+
+  while((entry = readdir(folder)) != NULL)
+    {
+      if(!strcmp(entry->d_name,".") || !strcmp(entry->d_name,".."))
+        continue;
+      snprintf(entry_path,sizeof(entry_path),"%s/%s",folder_path,entry->d_name);
+      if(lstat(entry_path,&entry_stat) == 0 && S_ISDIR(entry_stat.st_mode))
+        RemoveFolder(entry_path);
+      else
+        unlink(entry_path);
+    }
+
+  closedir(folder);
+  rmdir(folder_path);
+}
+
+
+/*****************************************************/
+/*  GetTime() :  Horloge monotone, en secondes.      */
+/*****************************************************/
+static double GetTime(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return((double) now.tv_sec + (double) now.tv_nsec/1e9);
+}
+
+
+/************************************************************/
+/*  GetPeakRss() :  Pic de mémoire d'un processus, en KB.   */
+/************************************************************/
+static long GetPeakRss(struct rusage *usage)
+{
+#if defined(__APPLE__)
+  return(usage->ru_maxrss/1024);    /* En octets sous OS X */
+#else
+  return(usage->ru_maxrss);
+#endif
+}
+
+
+/**********************************************************/
+/*  GetRandom() :  Générateur xorshift32 (reproductible). */
+/**********************************************************/
+static unsigned int GetRandom(unsigned int *seed)
+{
+  unsigned int value = *seed;
+
+  value ^= value << 13;
+  value ^= value >> 17;
+  value ^= value << 5;
+  *seed = value;
+
+  return(value);
+}
+
+
+/********************************************************/
+/*  GetRandomRange() :  Valeur pseudo-aléatoire min-max. */
+/********************************************************/
+static int GetRandomRange(unsigned int *seed, int min, int max)
+{
+  return(min + (int) (GetRandom(seed) % (unsigned int) (max-min+1)));
+}
+
+
+/*********************************************************/
+/*  GetNameSeed() :  Graine tirée du nom (hash FNV-1a).  */
+/*********************************************************/
+static unsigned int GetNameSeed(char *name)
+{
+  unsigned int seed = 2166136261u;
+
+  for(; *name != '\0'; name++)
+    seed = (seed ^ (unsigned char) *name) * 16777619u;
+
+  return((seed == 0) ? 1 : seed);
+}
+
+
+/*************************************************/
+/*  SetWord() :  Ecrit une valeur 16 bit (LSB).   */
+/*************************************************/
+static void SetWord(unsigned char *data, int value)
+{
+  data[0] = (unsigned char) (value & 0xFF);
+  data[1] = (unsigned char) ((value >> 8) & 0xFF);
+}
+
+/***********************************************************************/
@@ -21,6 +21,12 @@
 #include "Dc_Prodos.h"
 #include "Dc_Memory.h"
 
+static void *GrowTable(void *,int *,int,size_t);
+static void mem_free_arena(struct memory_context *);
+
+static THREAD_LOCAL struct memory_context *current_context = NULL;   /* Listes du thread (libcadius) */
+static struct memory_context process_context;                        /* Listes par défaut (ligne de commande) */
+
 /***************************************************/
 /*  my_Memory() :  Gestion des ressources mémoire. */
 /***************************************************/
@@ -29,48 +35,22 @@ void my_Memory(int code, void *data, void *value)
   int i, index;
   char *path;
   char *message;
-  static int nb_entry;
-  static struct file_descriptive_entry *first_entry;
-  static struct file_descriptive_entry *last_entry;
-  static struct file_descriptive_entry **tab_entry;
+  void *new_tab;
   struct file_descriptive_entry *current_entry;
-  struct file_descriptive_entry *next_entry;
   struct file_descriptive_entry *delete_entry;
-  static int nb_directory;
-  static struct file_descriptive_entry *first_directory;
-  static struct file_descriptive_entry *last_directory;
-  static struct file_descriptive_entry **tab_directory;
   struct file_descriptive_entry *current_directory;
-  struct file_descriptive_entry *next_directory;
   struct file_descriptive_entry *delete_directory;
-  static int nb_filepath;
-  static struct file_path *first_filepath;
-  static struct file_path *last_filepath;
   struct file_path *current_filepath;
-  struct file_path *next_filepath;
-  static int nb_error;
-  static struct error *first_error;
-  static struct error *last_error;
   struct error *current_error;
-  struct error *next_error;
+  struct memory_context *context;
+
+  /* Listes du thread (cf my_SetMemoryContext), sinon celles du processus */
+  context = (current_context != NULL) ? current_context : &process_context;
 
   switch(code)
     {
       case MEMORY_INIT :
-        nb_entry = 0;
-        first_entry = NULL;
-        last_entry = NULL;
-        tab_entry = NULL;
-        nb_directory = 0;
-        first_directory = NULL;
-        last_directory = NULL;
-        tab_directory = NULL;
-        nb_filepath = 0;
-        first_filepath = NULL;
-        last_filepath = NULL;
-        nb_error = 0;
-        first_error = NULL;
-        last_error = NULL;
+        memset(context,0,sizeof(struct memory_context));
         break;
 
       case MEMORY_FREE :
@@ -78,6 +58,7 @@ void my_Memory(int code, void *data, void *value)
         my_Memory(MEMORY_FREE_DIRECTORY,NULL,NULL);
         my_Memory(MEMORY_FREE_FILE,NULL,NULL);
         my_Memory(MEMORY_FREE_ERROR,NULL,NULL);
+        mem_free_arena(context);
         break;
 
       /*********************************************/
@@ -88,44 +69,38 @@ void my_Memory(int code, void *data, void *value)
         if(current_entry == NULL)
           return;
 
+        /* Agrandit le tableau d'index */
+        new_tab = GrowTable(context->tab_entry,&context->nb_max_entry,context->nb_entry+1,sizeof(struct file_descriptive_entry *));
+        if(new_tab == NULL)
+          return;
+        context->tab_entry = (struct file_descriptive_entry **) new_tab;
+
         /* Ajoute à la fin de la liste */
-        if(first_entry == NULL)
-          first_entry = current_entry;
+        current_entry->next = NULL;
+        if(context->first_entry == NULL)
+          context->first_entry = current_entry;
         else
-          last_entry->next = current_entry;
-        last_entry = current_entry;
-        nb_entry++;
+          context->last_entry->next = current_entry;
+        context->last_entry = current_entry;
+        context->tab_entry[context->nb_entry++] = current_entry;
         break;
 
       case MEMORY_GET_ENTRY_NB :
-        *((int *)data) = nb_entry;
+        *((int *)data) = context->nb_entry;
         break;
 
       case MEMORY_GET_ENTRY :
         index = *((int *) data);
         *((struct file_descriptive_entry **) value) = NULL;
-        if(index <= 0 || index > nb_entry)
+        if(index <= 0 || index > context->nb_entry)
           return;
 
-        /* Recherche le index-nth entry */
-        for(i=1, current_entry = first_entry; i<index; i++)
-          current_entry = current_entry->next;
-        *((struct file_descriptive_entry **) value) = current_entry;
+        /* Accès direct au index-nth entry */
+        *((struct file_descriptive_entry **) value) = context->tab_entry[index-1];
         break;
 
       case MEMORY_BUILD_ENTRY_TAB :
-        /* Libération */
-        if(tab_entry)
-          free(tab_entry);
-
-        /* Allocation */
-        tab_entry = (struct file_descriptive_entry **) calloc(1+nb_entry,sizeof(struct file_descriptive_entry *));
-        if(tab_entry == NULL)
-          break;
-
-        /* Remplissage */
-        for(i=0, current_entry = first_entry; current_entry; i++,current_entry=current_entry->next)
-          tab_entry[i] = current_entry;
+        /* Le tableau est tenu à jour par MEMORY_ADD_ENTRY / MEMORY_REMOVE_ENTRY */
         break;
 
       case MEMORY_REMOVE_ENTRY :
@@ -133,54 +108,37 @@ void my_Memory(int code, void *data, void *value)
         if(delete_entry == NULL)
           break;
 
-        /* Cas particulier : 1 seule structure */
-        if(nb_entry == 1 && first_entry == delete_entry)
-          {
-            first_entry = NULL;
-            last_entry = NULL;
-            nb_entry = 0;
-          }
-        else if(first_entry == delete_entry)
-          {
-            /* En 1ère position */
-            first_entry = first_entry->next;
-            memmove(&tab_entry[0],&tab_entry[1],(nb_entry-1)*sizeof(struct file_descriptive_entry *));
-            nb_entry--;
-          }
-        else if(last_entry == delete_entry)
-          {
-            /* En dernière position */
-            tab_entry[nb_entry-2]->next = NULL;
-            last_entry = tab_entry[nb_entry-2];
-            nb_entry--;
-          }
+        /* Recherche l'entrée dans le tableau */
+        for(i=0; i<context->nb_entry; i++)
+          if(context->tab_entry[i] == delete_entry)
+            break;
+        if(i == context->nb_entry)
+          break;
+
+        /* Retire l'entrée de la liste chainée */
+        if(i == 0)
+          context->first_entry = delete_entry->next;
         else
-          {
-            /* Au milieu */
-            for(i=0; i<nb_entry; i++)
-              if(tab_entry[i] == delete_entry)
-                {
-                  tab_entry[i-1]->next = tab_entry[i]->next;
-                  memmove(&tab_entry[i],&tab_entry[i+1],(nb_entry-i-1)*sizeof(struct file_descriptive_entry *));
-                  nb_entry--;
-                  break;
-                }
-          }
+          context->tab_entry[i-1]->next = delete_entry->next;
+        if(i == context->nb_entry-1)
+          context->last_entry = (i == 0) ? NULL : context->tab_entry[i-1];
+        delete_entry->next = NULL;
+
+        /* Retire l'entrée du tableau */
+        memmove(&context->tab_entry[i],&context->tab_entry[i+1],(context->nb_entry-i-1)*sizeof(struct file_descriptive_entry *));
+        context->nb_entry--;
         break;
 
       case MEMORY_FREE_ENTRY :
-        for(current_entry = first_entry; current_entry; )
-          {
-            next_entry = current_entry->next;
-            mem_free_entry(current_entry);
-            current_entry = next_entry;
-          }
-        if(tab_entry)
-          free(tab_entry);
-        nb_entry = 0;
-        first_entry = NULL;
-        last_entry = NULL;
-        tab_entry = NULL;
+        for(i=0; i<context->nb_entry; i++)
+          mem_free_entry(context->tab_entry[i]);
+        if(context->tab_entry)
+          free(context->tab_entry);
+        context->nb_entry = 0;
+        context->nb_max_entry = 0;
+        context->first_entry = NULL;
+        context->last_entry = NULL;
+        context->tab_entry = NULL;
         break;
 
       /***********************************************/
@@ -191,44 +149,38 @@ void my_Memory(int code, void *data, void *value)
         if(current_directory == NULL)
           return;
 
+        /* Agrandit le tableau d'index */
+        new_tab = GrowTable(context->tab_directory,&context->nb_max_directory,context->nb_directory+1,sizeof(struct file_descriptive_entry *));
+        if(new_tab == NULL)
+          return;
+        context->tab_directory = (struct file_descriptive_entry **) new_tab;
+
         /* Ajoute à la fin de la liste */
-        if(first_directory == NULL)
-          first_directory = current_directory;
+        current_directory->next = NULL;
+        if(context->first_directory == NULL)
+          context->first_directory = current_directory;
         else
-          last_directory->next = current_directory;
-        last_directory = current_directory;
-        nb_directory++;
+          context->last_directory->next = current_directory;
+        context->last_directory = current_directory;
+        context->tab_directory[context->nb_directory++] = current_directory;
         break;
 
       case MEMORY_GET_DIRECTORY_NB :
-        *((int *)data) = nb_directory;
+        *((int *)data) = context->nb_directory;
         break;
 
       case MEMORY_GET_DIRECTORY :
         index = *((int *) data);
         *((struct file_descriptive_entry **) value) = NULL;
-        if(index <= 0 || index > nb_directory)
+        if(index <= 0 || index > context->nb_directory)
           return;
 
-        /* Recherche le index-nth directory */
-        for(i=1, current_directory = first_directory; i<index; i++)
-          current_directory = current_directory->next;
-        *((struct file_descriptive_entry **) value) = current_directory;
+        /* Accès direct au index-nth directory */
+        *((struct file_descriptive_entry **) value) = context->tab_directory[index-1];
         break;
 
       case MEMORY_BUILD_DIRECTORY_TAB :
-        /* Libération */
-        if(tab_directory)
-          free(tab_directory);
-
-        /* Allocation */
-        tab_directory = (struct file_descriptive_entry **) calloc(1+nb_directory,sizeof(struct file_descriptive_entry *));
-        if(tab_directory == NULL)
-          break;
-
-        /* Remplissage */
-        for(i=0, current_directory = first_directory; current_directory; i++,current_directory=current_directory->next)
-          tab_directory[i] = current_directory;
+        /* Le tableau est tenu à jour par MEMORY_ADD_DIRECTORY / MEMORY_REMOVE_DIRECTORY */
         break;
 
       case MEMORY_REMOVE_DIRECTORY :
@@ -236,54 +188,37 @@ void my_Memory(int code, void *data, void *value)
         if(delete_directory == NULL)
           break;
 
-        /* Cas particulier : 1 seule structure */
-        if(nb_directory == 1 && first_directory == delete_directory)
-          {
-            first_directory = NULL;
-            last_directory = NULL;
-            nb_directory = 0;
-          }
-        else if(first_directory == delete_directory)
-          {
-            /* En 1ère position */
-            first_directory = first_directory->next;
-            memmove(&tab_directory[0],&tab_directory[1],(nb_directory-1)*sizeof(struct file_descriptive_entry *));
-            nb_directory--;
-          }
-        else if(last_directory == delete_directory)
-          {
-            /* En dernière position */
-            tab_directory[nb_directory-2]->next = NULL;
-            last_directory = tab_directory[nb_directory-2];
-            nb_directory--;
-          }
+        /* Recherche le répertoire dans le tableau */
+        for(i=0; i<context->nb_directory; i++)
+          if(context->tab_directory[i] == delete_directory)
+            break;
+        if(i == context->nb_directory)
+          break;
+
+        /* Retire le répertoire de la liste chainée */
+        if(i == 0)
+          context->first_directory = delete_directory->next;
         else
-          {
-            /* Au milieu */
-            for(i=0; i<nb_directory; i++)
-              if(tab_directory[i] == delete_directory)
-                {
-                  tab_directory[i-1]->next = tab_directory[i]->next;
-                  memmove(&tab_directory[i],&tab_directory[i+1],(nb_directory-i-1)*sizeof(struct file_descriptive_entry *));
-                  nb_directory--;
-                  break;
-                }
-          }
+          context->tab_directory[i-1]->next = delete_directory->next;
+        if(i == context->nb_directory-1)
+          context->last_directory = (i == 0) ? NULL : context->tab_directory[i-1];
+        delete_directory->next = NULL;
+
+        /* Retire le répertoire du tableau */
+        memmove(&context->tab_directory[i],&context->tab_directory[i+1],(context->nb_directory-i-1)*sizeof(struct file_descriptive_entry *));
+        context->nb_directory--;
         break;
 
       case MEMORY_FREE_DIRECTORY :
-        for(current_directory = first_directory; current_directory; )
-          {
-            next_directory = current_directory->next;
-            mem_free_entry(current_directory);
-            current_directory = next_directory;
-          }
-        if(tab_directory)
-          free(tab_directory);
-        nb_directory = 0;
-        first_directory = NULL;
-        last_directory = NULL;
-        tab_directory = NULL;
+        for(i=0; i<context->nb_directory; i++)
+          mem_free_entry(context->tab_directory[i]);
+        if(context->tab_directory)
+          free(context->tab_directory);
+        context->nb_directory = 0;
+        context->nb_max_directory = 0;
+        context->first_directory = NULL;
+        context->last_directory = NULL;
+        context->tab_directory = NULL;
         break;
 
       /*******************************************/
@@ -292,6 +227,12 @@ void my_Memory(int code, void *data, void *value)
       case MEMORY_ADD_FILE :
         path = (char *) data;
 
+        /* Agrandit le tableau d'index */
+        new_tab = GrowTable(context->tab_filepath,&context->nb_max_filepath,context->nb_filepath+1,sizeof(struct file_path *));
+        if(new_tab == NULL)
+          return;
+        context->tab_filepath = (struct file_path **) new_tab;
+
         /* Allocation mémoire */
         current_filepath = (struct file_path *) calloc(1,sizeof(struct file_path));
         if(current_filepath == NULL)
@@ -306,40 +247,38 @@ void my_Memory(int code, void *data, void *value)
           }
 
         /* Ajoute à la fin de la liste */
-        if(first_filepath == NULL)
-          first_filepath = current_filepath;
+        if(context->first_filepath == NULL)
+          context->first_filepath = current_filepath;
         else
-          last_filepath->next = current_filepath;
-        last_filepath = current_filepath;
-        nb_filepath++;
+          context->last_filepath->next = current_filepath;
+        context->last_filepath = current_filepath;
+        context->tab_filepath[context->nb_filepath++] = current_filepath;
         break;
 
       case MEMORY_GET_FILE_NB :
-        *((int *)data) = nb_filepath;
+        *((int *)data) = context->nb_filepath;
         break;
 
       case MEMORY_GET_FILE :
         index = *((int *) data);
         *((struct file_path **) value) = NULL;
-        if(index <= 0 || index > nb_filepath)
+        if(index <= 0 || index > context->nb_filepath)
           return;
 
-        /* Recherche le index-nth entry */
-        for(i=1, current_filepath = first_filepath; i<index; i++)
-          current_filepath = current_filepath->next;
-        *((char **) value) = current_filepath->path;
+        /* Accès direct au index-nth entry */
+        *((char **) value) = context->tab_filepath[index-1]->path;
         break;
 
       case MEMORY_FREE_FILE :
-        for(current_filepath = first_filepath; current_filepath; )
-          {
-            next_filepath = current_filepath->next;
-            mem_free_filepath(current_filepath);
-            current_filepath = next_filepath;
-          }
-        nb_filepath = 0;
-        first_filepath = NULL;
-        last_filepath = NULL;
+        for(i=0; i<context->nb_filepath; i++)
+          mem_free_filepath(context->tab_filepath[i]);
+        if(context->tab_filepath)
+          free(context->tab_filepath);
+        context->nb_filepath = 0;
+        context->nb_max_filepath = 0;
+        context->first_filepath = NULL;
+        context->last_filepath = NULL;
+        context->tab_filepath = NULL;
         break;
 
       /***************************************/
@@ -348,54 +287,51 @@ void my_Memory(int code, void *data, void *value)
       case MEMORY_ADD_ERROR :
         message = (char *) data;
 
-        /* Allocation mémoire */
-        current_error = (struct error *) calloc(1,sizeof(struct error));
+        /* Agrandit le tableau d'index */
+        new_tab = GrowTable(context->tab_error,&context->nb_max_error,context->nb_error+1,sizeof(struct error *));
+        if(new_tab == NULL)
+          return;
+        context->tab_error = (struct error **) new_tab;
+
+        /* Allocation mémoire (arène du contexte) */
+        current_error = (struct error *) mem_alloc_arena(sizeof(struct error)+strlen(message)+1);
         if(current_error == NULL)
           return;
-        current_error->message = my_strdup(message);
-        if(current_error->message == NULL)
-          {
-            free(current_error);
-            return;
-          }
+        current_error->message = (char *) &current_error[1];
+        strcpy(current_error->message,message);
 
         /* Ajoute à la fin de la liste */
-        if(first_error == NULL)
-          first_error = current_error;
+        if(context->first_error == NULL)
+          context->first_error = current_error;
         else
-          last_error->next = current_error;
-        last_error = current_error;
-        nb_error++;
+          context->last_error->next = current_error;
+        context->last_error = current_error;
+        context->tab_error[context->nb_error++] = current_error;
         break;
 
       case MEMORY_GET_ERROR_NB :
-        *((int *)data) = nb_error;
+        *((int *)data) = context->nb_error;
         break;
 
       case MEMORY_GET_ERROR :
         index = *((int *) data);
         *((struct error **) value) = NULL;
-        if(index <= 0 || index > nb_error)
+        if(index <= 0 || index > context->nb_error)
           return;
 
-        /* Recherche le index-nth entry */
-        for(i=1, current_error = first_error; i<index; i++)
-          current_error = current_error->next;
-        *((struct error **) value) = current_error;
+        /* Accès direct au index-nth entry */
+        *((struct error **) value) = context->tab_error[index-1];
         break;
 
       case MEMORY_FREE_ERROR :
-        for(current_error = first_error; current_error; )
-          {
-            next_error = current_error->next;
-            if(current_error->message)
-              free(current_error->message);
-            free(current_error);
-            current_error = next_error;
-          }
-        nb_error = 0;
-        first_error = NULL;
-        last_error = NULL;
+        /* Les erreurs sont dans l'arène, libérée par MEMORY_FREE */
+        if(context->tab_error)
+          free(context->tab_error);
+        context->nb_error = 0;
+        context->nb_max_error = 0;
+        context->first_error = NULL;
+        context->last_error = NULL;
+        context->tab_error = NULL;
         break;
 
       default :
@@ -404,6 +340,147 @@ void my_Memory(int code, void *data, void *value)
 }
 
 
+/***************************************************************************/
+/*  my_SetMemoryContext() :  Choisit les listes utilisées par my_Memory()  */
+/*                           dans le thread courant (NULL : processus).    */
+/***************************************************************************/
+struct memory_context *my_SetMemoryContext(struct memory_context *context)
+{
+  struct memory_context *previous_context;
+
+  previous_context = current_context;
+  current_context = context;
+
+  /* Renvoie le contexte précédent, à remettre en place par l'appelant */
+  return(previous_context);
+}
+
+
+/***************************************************************/
+/*  mem_alloc_context() :  Allocation d'un jeu de listes vide. */
+/***************************************************************/
+struct memory_context *mem_alloc_context(void)
+{
+  return((struct memory_context *) calloc(1,sizeof(struct memory_context)));
+}
+
+
+/******************************************************************/
+/*  mem_free_context() :  Libère un jeu de listes et son contenu. */
+/******************************************************************/
+void mem_free_context(struct memory_context *context)
+{
+  struct memory_context *previous_context;
+
+  if(context == NULL)
+    return;
+
+  /* Libère les listes du contexte */
+  previous_context = my_SetMemoryContext(context);
+  my_Memory(MEMORY_FREE,NULL,NULL);
+  my_SetMemoryContext(previous_context);
+
+  free(context);
+}
+
+
+/***************************************************************************/
+/*  mem_alloc_arena() :  Allocation (mise à zéro) dans l'arène du contexte */
+/*                       courant. Pas de libération individuelle : tout    */
+/*                       est rendu par MEMORY_FREE.                        */
+/***************************************************************************/
+void *mem_alloc_arena(size_t size)
+{
+  size_t length;
+  void *data;
+  struct arena_block *current_block;
+  struct memory_context *context;
+
+  /* Listes du thread (cf my_SetMemoryContext), sinon celles du processus */
+  context = (current_context != NULL) ? current_context : &process_context;
+
+  /* Taille alignée */
+  size = (size + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+
+  /** Place dans le bloc courant **/
+  current_block = context->first_arena_block;
+  if(current_block != NULL && current_block->used + size <= current_block->length)
+    {
+      data = (unsigned char *) current_block + ARENA_HEADER_SIZE + current_block->used;
+      current_block->used += size;
+      return(data);
+    }
+
+  /** Nouveau bloc (mémoire déjà à zéro) **/
+  length = (size > ARENA_BLOCK_SIZE/4) ? size : ARENA_BLOCK_SIZE;
+  current_block = (struct arena_block *) calloc(1,ARENA_HEADER_SIZE+length);
+  if(current_block == NULL)
+    return(NULL);
+  current_block->length = length;
+  current_block->used = size;
+
+  /* Une grosse allocation ne remplace pas le bloc courant */
+  if(length == size && context->first_arena_block != NULL)
+    {
+      current_block->next = context->first_arena_block->next;
+      context->first_arena_block->next = current_block;
+    }
+  else
+    {
+      current_block->next = context->first_arena_block;
+      context->first_arena_block = current_block;
+    }
+
+  /* Renvoie le début du bloc */
+  return((unsigned char *) current_block + ARENA_HEADER_SIZE);
+}
+
+
+/*****************************************************************/
+/*  mem_free_arena() :  Libère tous les blocs de l'arène d'un    */
+/*                      contexte (entrées, tables, erreurs).     */
+/*****************************************************************/
+static void mem_free_arena(struct memory_context *context)
+{
+  struct arena_block *current_block;
+  struct arena_block *next_block;
+
+  for(current_block=context->first_arena_block; current_block!=NULL; current_block=next_block)
+    {
+      next_block = current_block->next;
+      free(current_block);
+    }
+  context->first_arena_block = NULL;
+}
+
+
+/*******************************************************************/
+/*  GrowTable() :  Agrandit un tableau d'index (capacité doublée). */
+/*******************************************************************/
+static void *GrowTable(void *tab, int *nb_max_rtn, int nb_needed, size_t element_size)
+{
+  int nb_max;
+  void *new_tab;
+
+  /* Assez de place */
+  if(nb_needed <= *nb_max_rtn)
+    return(tab);
+
+  /* Double la capacité */
+  nb_max = (*nb_max_rtn == 0) ? 256 : *nb_max_rtn;
+  while(nb_max < nb_needed)
+    nb_max *= 2;
+
+  new_tab = realloc(tab,nb_max*element_size);
+  if(new_tab == NULL)
+    return(NULL);
+  *nb_max_rtn = nb_max;
+
+  /* Renvoi le nouveau tableau */
+  return(new_tab);
+}
+
+
 /**********************************************************/
 /*  mem_free_param() :  Libération de la structure Param. */
 /**********************************************************/
@@ -414,6 +491,9 @@ void mem_free_param(struct parameter *param)
       if(param->image_file_path)
         free(param->image_file_path);
 
+      if(param->tab_image_file_path)
+        mem_free_list(param->nb_image,param->tab_image_file_path);
+
       if(param->prodos_file_path)
         free(param->prodos_file_path);
 
@@ -438,6 +518,9 @@ void mem_free_param(struct parameter *param)
       if(param->new_volume_name)
         free(param->new_volume_name);
 
+      if(param->script_file_path)
+        free(param->script_file_path);
+
       if(param->new_file_path)
         free(param->new_file_path);
 
@@ -37,11 +37,16 @@
 #define MEMORY_GET_ERROR            52
 #define MEMORY_FREE_ERROR           53
 
+#define ARENA_BLOCK_SIZE     65536   /* Taille d'un bloc de l'arène des métadonnées d'une image */
+#define ARENA_ALIGNMENT         16   /* Alignement des allocations dans l'arène */
+
 struct parameter
 {
   int action;
 
   char *image_file_path;
+  int nb_image;                   /* CATALOG, CHECKVOLUME, EXTRACTVOLUME */
+  char **tab_image_file_path;
   char *prodos_file_path;
   char *prodos_folder_path;
   char *output_directory_path;
@@ -58,7 +63,15 @@ struct parameter
   char *file_path;
   char *folder_path;
 
+  char *script_file_path;
+
   int verbose;
+  int nb_jobs;
+  int sync_image;
+  int use_cache;
+  int output_format;              /* FORMAT_TEXT, FORMAT_JSON, FORMAT_CSV (log.h) */
+  int show_stats;                 /* --stats */
+  char *stats_file_path;          /* --stats-file=<path> (dans argv) */
   bool output_apple_single;
   bool zero_case_bits;
 };
@@ -70,7 +83,52 @@ struct error
   struct error *next;
 };
 
+/** Bloc de l'arène : les allocations suivent l'entête **/
+struct arena_block
+{
+  size_t length;            /* Taille utile du bloc */
+  size_t used;              /* Octets déjà distribués */
+
+  struct arena_block *next;
+};
+
+#define ARENA_HEADER_SIZE  ((sizeof(struct arena_block) + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1))
+
+/** Listes gérées par my_Memory() : une par image ouverte dans le processus **/
+struct memory_context
+{
+  int nb_entry;
+  int nb_max_entry;
+  struct file_descriptive_entry *first_entry;
+  struct file_descriptive_entry *last_entry;
+  struct file_descriptive_entry **tab_entry;
+
+  int nb_directory;
+  int nb_max_directory;
+  struct file_descriptive_entry *first_directory;
+  struct file_descriptive_entry *last_directory;
+  struct file_descriptive_entry **tab_directory;
+
+  int nb_filepath;
+  int nb_max_filepath;
+  struct file_path *first_filepath;
+  struct file_path *last_filepath;
+  struct file_path **tab_filepath;
+
+  int nb_error;
+  int nb_max_error;
+  struct error *first_error;
+  struct error *last_error;
+  struct error **tab_error;
+
+  struct arena_block *first_arena_block;   /* Entrées, tables et erreurs de l'image, libérées en une fois */
+};
+
 void my_Memory(int,void *,void *);
+struct memory_context *my_SetMemoryContext(struct memory_context *);
+struct memory_context *mem_alloc_context(void);
+void mem_free_context(struct memory_context *);
+void *mem_alloc_arena(size_t);
 void mem_free_param(struct parameter *);
 
 /***********************************************************************/
\ No newline at end of file
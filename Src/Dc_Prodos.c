@@ -16,33 +16,82 @@
 #include "Dc_Memory.h"
 #include "os/os.h"
 #include "Dc_Prodos.h"
+#include "Prodos_Cache.h"
+#include "Dc_Stats.h"
 #include "log.h"
 
+static struct prodos_image *OpenProdosImage(char *,int);
+static int WriteProdosImage(struct prodos_image *);
 static struct volume_directory_header *ODSReadVolumeDirectoryHeader(unsigned char *);
 static struct sub_directory_header *ODSReadSubDirectoryHeader(unsigned char *);
 static void GetAllDirectoryFile(struct prodos_image *);
-static void GetOneSubDirectoryFile(struct prodos_image *,char *,struct file_descriptive_entry *);
-static void BuildStorageTypeAscii(BYTE,char *,char *);
-static void BuildFileTypeAscii(BYTE,char *);
-static void BuildAccessAscii(BYTE,char *);
+static void GetVolumeDirectoryFile(struct prodos_image *);
+static void GetOneSubDirectoryFile(struct prodos_image *,struct file_descriptive_entry *);
 static void BuildLowerCase(char *,WORD,char *);
 static int GetFileDataResourceSize(struct prodos_image *,struct file_descriptive_entry *);
-static int *BuildUsedBlockTable(int,int *,int,int *,int *);
+static int *BuildUsedBlockTable(int,int *,int,int *,int,int *);
+static int GetEntryTableSize(int);
 static int *BuildDirectoryUsedBlockTable(struct prodos_image *,struct file_descriptive_entry *,int *);
-static void DecodeExpandBitmapBlock(struct prodos_image *);
+static int DecodeExpandBitmapBlock(struct prodos_image *);
+static void BuildFreeExtentTree(struct prodos_image *);
+static void SetFreeExtentLeaf(struct prodos_image *,int);
+static void MergeFreeExtentNode(struct free_extent_node *,struct free_extent_node *,struct free_extent_node *,int);
+static void UpdateFreeExtentTree(struct prodos_image *,int);
+static int FindFreeExtent(struct prodos_image *,int);
+static int SetImageBlockFree(struct prodos_image *,int,int);
+static void WriteBitmapBlock(struct prodos_image *,int,int *);
 static unsigned char *GetEntryData(struct prodos_image *,int,int,int);
+static unsigned char *GetImageBlock(struct prodos_image *,int);
+static int AddEntryExtent(struct fork_extent **,int *,int *,int,int);
+static unsigned int HashEntryName(char *);
+static struct name_index *BuildNameIndex(int,struct file_descriptive_entry **,int,struct file_descriptive_entry **);
+static int AddNameIndex(struct name_index *,struct file_descriptive_entry *);
+static void RemoveNameIndex(struct name_index *,struct file_descriptive_entry *);
+static int WriteModifiedBlock(struct prodos_image *,int,int,struct dirty_run *,int);
+static int WriteImageRange(struct prodos_image *,int,int,int);
+static void ClearModifiedBlock(struct prodos_image *);
+static void MarkBlockModified(struct prodos_image *,int,int);
+static int compare_dirty_run(const void *,const void *);
 static void mem_free_subdirectory(struct sub_directory_header *);
+static void mem_free_name_index(struct name_index *);
+static struct folder_slot *NewFolderSlot(unsigned char *,int);
+static int AddFolderSlotBlock(struct folder_slot *,int,unsigned char *);
+static struct folder_slot *GetFolderSlot(struct prodos_image *,struct file_descriptive_entry *);
+static int FindFolderSlot(struct prodos_image *,struct folder_slot *,int *,int *);
+static void ReleaseFolderSlot(struct folder_slot *,int,int);
 
 /******************************************************/
 /*  LoadProdosImage() :  Charge un fichier image 2mg. */
 /******************************************************/
-struct prodos_image *LoadProdosImage(char *file_path)
+struct prodos_image *LoadProdosImage(char *file_path, int image_access)
+{
+  int previous_phase;
+  struct prodos_image *current_image;
+
+  /* Chrono --stats (Directory et Bitmap sont comptés à part) */
+  previous_phase = stats_EnterPhase(STATS_PHASE_LOAD);
+  current_image = OpenProdosImage(file_path,image_access);
+  stats_LeavePhase(previous_phase);
+
+  return(current_image);
+}
+
+
+/*******************************************************************/
+/*  OpenProdosImage() :  Mapping de l'image et décodage du volume. */
+/*******************************************************************/
+static struct prodos_image *OpenProdosImage(char *file_path, int image_access)
 {
   unsigned char *data_file;
-  int i, nb_block, data_length;
+  int i, error, nb_block, data_length, use_cache;
   struct prodos_image *current_image;
   unsigned char one_block[BLOCK_SIZE];
 
+  /* Le cache ne change que la façon de décoder une image en lecture */
+  use_cache = (image_access == IMAGE_ACCESS_CACHE);
+  if(use_cache)
+    image_access = IMAGE_ACCESS_READ;
+
   /* Allocation mémoire */
   current_image = (struct prodos_image *) calloc(1,sizeof(struct prodos_image));
   if(current_image == NULL)
@@ -87,14 +136,25 @@ struct prodos_image *LoadProdosImage(char *file_path)
       return(NULL);
     }
 
-  /** Chargement du fichier image en mémoire **/
-  data_file = LoadBinaryFile(file_path,&data_length);
-  if(data_file == NULL)
+  /** Mapping du fichier image en mémoire (seules les pages lues sont chargées) **/
+  /* Copie privée : le fichier ne change qu'au UpdateProdosImage */
+  current_image->image_access = image_access;
+  data_file = os_MapFile(file_path,&data_length);
+  if(data_file != NULL)
+    current_image->image_mapped = 1;
+  else
     {
-      logf_error("  Error, Impossible to load Image file : '%s'\n",file_path);
-      mem_free_image(current_image);
-      return(NULL);
+      /* Pas de mapping possible : chargement du fichier image en mémoire */
+      data_file = LoadBinaryFile(file_path,&data_length);
+      if(data_file == NULL)
+        {
+          logf_error("  Error, Impossible to load Image file : '%s'\n",file_path);
+          mem_free_image(current_image);
+          return(NULL);
+        }
     }
+  current_image->image_file_data = data_file;
+  current_image->image_file_length = data_length;
 
   /* Saut au dessus du header de l'image */
   data_file += current_image->image_header_size;
@@ -108,14 +168,6 @@ struct prodos_image *LoadProdosImage(char *file_path)
   current_image->nb_block = nb_block;
   current_image->image_data = data_file;
   current_image->image_length = data_length;
-  current_image->block_allocation_table = (int *) calloc(current_image->nb_block+8,sizeof(int));
-  if(current_image->block_allocation_table == NULL)
-    {
-      logf_error("  Error, Impossible to allocate memory to process image file.\n");
-      mem_free_image(current_image);
-      return(NULL);
-    }
-
   /* Tableau des blocks modifiés */
   current_image->block_modified = (unsigned char *) calloc(current_image->nb_block,sizeof(unsigned char));
   if(current_image->block_modified == NULL)
@@ -150,12 +202,37 @@ struct prodos_image *LoadProdosImage(char *file_path)
       return(NULL);
     }
 
+  /** En mode lazy, les répertoires seront décodés à la demande (LoadFolderEntries) **/
+  if(current_image->image_access == IMAGE_ACCESS_LAZY)
+    return(current_image);
+
+  /** Cache de l'arbre des fichiers, s'il correspond toujours à l'image **/
+  if(use_cache)
+    current_image->image_cache = LoadImageCache(current_image);
+
   /**************************************************************/
   /** Décodage des entrées du Volume Directory + Sub Directory **/
+  stats_EnterPhase(STATS_PHASE_DIRECTORY);
   GetAllDirectoryFile(current_image);
 
   /** Décodage du Block Allocation Table **/
-  DecodeExpandBitmapBlock(current_image);
+  stats_EnterPhase(STATS_PHASE_BITMAP);
+  error = DecodeExpandBitmapBlock(current_image);
+  stats_EnterPhase(STATS_PHASE_LOAD);
+  if(error)
+    {
+      mem_free_image(current_image);
+      return(NULL);
+    }
+
+  /** Cache absent ou incomplet : on l'écrit pour le prochain chargement **/
+  if(use_cache)
+    {
+      if(current_image->image_cache == NULL || current_image->image_cache->nb_miss > 0)
+        SaveImageCache(current_image);
+      mem_free_cache(current_image->image_cache);
+      current_image->image_cache = NULL;
+    }
 
   /* Renvoi */
   return(current_image);
@@ -167,42 +244,152 @@ struct prodos_image *LoadProdosImage(char *file_path)
 /************************************************************/
 int UpdateProdosImage(struct prodos_image *current_image)
 {
-  int i, nb_write;
-  FILE *fd;
+  int error, previous_phase;
+
+  /* Chrono --stats */
+  previous_phase = stats_EnterPhase(STATS_PHASE_FLUSH);
+  error = WriteProdosImage(current_image);
+  stats_LeavePhase(previous_phase);
+
+  return(error);
+}
+
+
+/****************************************************************/
+/*  WriteProdosImage() :  Ecrit les blocks modifiés de l'image. */
+/****************************************************************/
+static int WriteProdosImage(struct prodos_image *current_image)
+{
+  int i, fd, error, nb_dirty_run;
+  struct dirty_run *tab_dirty_run;
+  struct dirty_run all_block_run;
+
+  /** BATCH en cours : les blocks restent marqués, on écrira à la fin **/
+  if(current_image->update_deferred == 1)
+    return(0);
+
+  /** Plages de blocks modifiés, triées (liste incomplète : tous les blocks) **/
+  if(current_image->dirty_run_overflow == 1)
+    {
+      all_block_run.block = 0;
+      all_block_run.nb_block = current_image->nb_block;
+      tab_dirty_run = &all_block_run;
+      nb_dirty_run = 1;
+    }
+  else
+    {
+      tab_dirty_run = current_image->tab_dirty_run;
+      nb_dirty_run = current_image->nb_dirty_run;
+      qsort(tab_dirty_run,nb_dirty_run,sizeof(struct dirty_run),compare_dirty_run);
+    }
+  for(i=0; i<nb_dirty_run; i++)
+    STATS_ADD(STATS_BLOCK_FLUSH,tab_dirty_run[i].nb_block);
 
   /* Ouverture du fichier en écriture */
-  fd = fopen(current_image->image_file_path,"r+b");
-  if(fd == NULL)
+  fd = os_OpenFileWrite(current_image->image_file_path);
+  if(fd < 0)
     {
       logf_error("  Error : Impossible to open Prodos image '%s' for writing.\n",current_image->image_file_path);
       return(1);
     }
 
-  /** On va re-écrire tous les blocks mis à jour **/
-  for(i=0; i<current_image->nb_block; i++)
-    if(current_image->block_modified[i] == 1)
+  /** On écrit les blocks de données, puis la Bitmap et les Directory qui les référencent **/
+  error = WriteModifiedBlock(current_image,fd,nb_dirty_run,tab_dirty_run,BLOCK_MODIFIED_DATA);
+  if(error == 0)
+    error = WriteModifiedBlock(current_image,fd,nb_dirty_run,tab_dirty_run,BLOCK_MODIFIED_METADATA);
+
+  /* Attend que tout soit sur le disque */
+  if(error == 0 && current_image->image_sync == 1)
+    error = os_SyncFile(fd);
+
+  /* Fermeture du fichier */
+  if(os_CloseFile(fd))
+    error = 1;
+  if(error)
+    {
+      logf_error("  Error : Impossible to write Prodos image '%s'.\n",current_image->image_file_path);
+      return(1);
+    }
+
+  /* Indique que c'est fait */
+  ClearModifiedBlock(current_image);
+
+  /* OK */
+  return(0);
+}
+
+
+/***********************************************************************************/
+/*  WriteModifiedBlock() :  Ecrit les blocks modifiés d'un type (BLOCK_MODIFIED_*) */
+/*                          en une écriture par suite de blocks contigus.          */
+/***********************************************************************************/
+static int WriteModifiedBlock(struct prodos_image *current_image, int fd, int nb_dirty_run, struct dirty_run *tab_dirty_run, int modified_type)
+{
+  int i, block_number, first_block, nb_block;
+
+  /** Regroupe les blocks du type, à travers les plages qui se touchent **/
+  for(i=0,first_block=0,nb_block=0; i<nb_dirty_run; i++)
+    for(block_number=tab_dirty_run[i].block; block_number<tab_dirty_run[i].block+tab_dirty_run[i].nb_block; block_number++)
       {
-        /* Se Positionne */
-        fseek(fd,(long)(i*BLOCK_SIZE+current_image->image_header_size),SEEK_SET);
+        if(current_image->block_modified[block_number] != modified_type)
+          continue;
 
-        /* Ecrit le block */
-        nb_write = fwrite(&current_image->image_data[i*BLOCK_SIZE],1,BLOCK_SIZE,fd);
+        /* Prolonge la suite en cours */
+        if(nb_block > 0 && first_block+nb_block == block_number)
+          {
+            nb_block++;
+            continue;
+          }
 
-        /* Indique que c'est fait */
-        current_image->block_modified[i] = 0;
+        /* Ecrit la suite précédente */
+        if(nb_block > 0)
+          if(WriteImageRange(current_image,fd,first_block,nb_block))
+            return(1);
+        first_block = block_number;
+        nb_block = 1;
       }
 
-  /* On se place à la fin */
-  fseek(fd,0L,SEEK_END);
+  /* Dernière suite */
+  if(nb_block > 0)
+    return(WriteImageRange(current_image,fd,first_block,nb_block));
 
-  /* Fermeture du fichier */
-  fclose(fd);
-
-  /* OK */
   return(0);
 }
 
 
+/**************************************************************************/
+/*  WriteImageRange() :  Ecrit une suite de blocks dans le fichier image. */
+/**************************************************************************/
+static int WriteImageRange(struct prodos_image *current_image, int fd, int first_block, int nb_block)
+{
+  int offset;
+
+  /* Position dans le fichier (header compris) */
+  offset = current_image->image_header_size + first_block*BLOCK_SIZE;
+
+  /* Le buffer de l'image a la même organisation que le fichier */
+  return(os_WriteFileAt(fd,&current_image->image_data[first_block*BLOCK_SIZE],nb_block*BLOCK_SIZE,offset));
+}
+
+
+/***************************************************************/
+/*  ClearModifiedBlock() :  Vide la liste des blocks modifiés. */
+/***************************************************************/
+static void ClearModifiedBlock(struct prodos_image *current_image)
+{
+  int i;
+
+  if(current_image->dirty_run_overflow == 1)
+    memset(current_image->block_modified,0,current_image->nb_block);
+  else
+    for(i=0; i<current_image->nb_dirty_run; i++)
+      memset(&current_image->block_modified[current_image->tab_dirty_run[i].block],0,current_image->tab_dirty_run[i].nb_block);
+
+  current_image->nb_dirty_run = 0;
+  current_image->dirty_run_overflow = 0;
+}
+
+
 /****************************************************************************************/
 /*  ODSReadVolumeDirectoryHeader() :  Décodage d'une structure volume_directory_header. */
 /****************************************************************************************/
@@ -268,8 +455,6 @@ static struct volume_directory_header *ODSReadVolumeDirectoryHeader(unsigned cha
   volume_header->struct_size = offset;
 
   /* Valeurs Ascii */
-  BuildStorageTypeAscii(volume_header->storage_type,volume_header->storage_type_ascii,volume_header->storage_type_ascii_short);
-  BuildAccessAscii(volume_header->access,volume_header->access_ascii);
 
   /* Nom LowerCase */
   BuildLowerCase(volume_header->volume_name,volume_header->lowercase,volume_header->volume_name_case);
@@ -340,8 +525,6 @@ static struct sub_directory_header *ODSReadSubDirectoryHeader(unsigned char *blo
   directory_header->struct_size = offset;
 
   /* Valeurs Ascii */
-  BuildStorageTypeAscii(directory_header->storage_type,directory_header->storage_type_ascii,directory_header->storage_type_ascii_short);
-  BuildAccessAscii(directory_header->access,directory_header->access_ascii);
 
   /* Nom LowerCase */
   BuildLowerCase(directory_header->subdir_name,directory_header->lowercase,directory_header->subdir_name_case);
@@ -354,14 +537,15 @@ static struct sub_directory_header *ODSReadSubDirectoryHeader(unsigned char *blo
 /**************************************************************************************/
 /*  ODSReadFileDescriptiveEntry() :  Décodage d'une structure file_descriptive_entry. */
 /**************************************************************************************/
-struct file_descriptive_entry *ODSReadFileDescriptiveEntry(struct prodos_image *current_image, char *folder_path, unsigned char *block_data)
+struct file_descriptive_entry *ODSReadFileDescriptiveEntry(struct prodos_image *current_image, struct file_descriptive_entry *parent_directory, unsigned char *block_data)
 {
   int offset, error;
-  WORD date_word, time_word;
   struct file_descriptive_entry *file_entry;
 
+  STATS_ADD(STATS_ENTRY_DECODED,1);
+
   /* Allocation mémoire */
-  file_entry = (struct file_descriptive_entry *) calloc(1,sizeof(struct file_descriptive_entry));
+  file_entry = (struct file_descriptive_entry *) mem_alloc_arena(sizeof(struct file_descriptive_entry));
   if(file_entry == NULL)
     {
       logf_error("  Error : Impossible to allocate memory to process file descriptive entry.\n");
@@ -384,11 +568,9 @@ struct file_descriptive_entry *ODSReadFileDescriptiveEntry(struct prodos_image *
   offset += 2;
   file_entry->eof_location = block_data[offset] + 256*block_data[offset+1] + 65536*block_data[offset+2];
   offset += 3;
-  date_word = GetWordValue(block_data,offset);
-  GetProdosDate(date_word,&file_entry->file_creation_date);
+  file_entry->file_creation_date = GetWordValue(block_data,offset);
   offset += 2;
-  time_word = GetWordValue(block_data,offset);
-  GetProdosTime(time_word,&file_entry->file_creation_time);
+  file_entry->file_creation_time = GetWordValue(block_data,offset);
   offset += 2;
   file_entry->lowercase = GetWordValue(block_data,offset);             /* GS/OS : minVersion & 0x80 */
   file_entry->version_created = GetByteValue(block_data,offset);
@@ -399,11 +581,9 @@ struct file_descriptive_entry *ODSReadFileDescriptiveEntry(struct prodos_image *
   offset++;
   memcpy(&file_entry->file_aux_type,&block_data[offset],sizeof(WORD));
   offset += 2;
-  date_word = GetWordValue(block_data,offset);
-  GetProdosDate(date_word,&file_entry->file_modification_date);
+  file_entry->file_modification_date = GetWordValue(block_data,offset);
   offset += 2;
-  time_word = GetWordValue(block_data,offset);
-  GetProdosTime(time_word,&file_entry->file_modification_time);
+  file_entry->file_modification_time = GetWordValue(block_data,offset);
   offset += 2;
   file_entry->header_pointer_block = GetWordValue(block_data,offset);
   offset += 2;
@@ -411,30 +591,24 @@ struct file_descriptive_entry *ODSReadFileDescriptiveEntry(struct prodos_image *
   /* Taille de la structure ODS */
   file_entry->struct_size = offset;
 
-  /* Valeurs Ascii */
-  BuildStorageTypeAscii(file_entry->storage_type,file_entry->storage_type_ascii,file_entry->storage_type_ascii_short);
-  BuildFileTypeAscii(file_entry->file_type,file_entry->file_type_ascii);
-  BuildAccessAscii(file_entry->access,file_entry->access_ascii);
-
-  /* Nom LowerCase */
+  /* Nom LowerCase (les autres valeurs Ascii sont produites par Prodos_Dump.c) */
   BuildLowerCase(file_entry->file_name,file_entry->lowercase,file_entry->file_name_case);
 
-  /* Chemin complet */
-  file_entry->file_path = (char *) calloc(strlen(folder_path) + 1 + strlen(file_entry->file_name_case) + 1,sizeof(char));
-  if(file_entry->file_path == NULL)
-    {
-      logf_error("  Error : Impossible to allocate memory for 'file_path' value.\n");
-      mem_free_entry(file_entry);
-      return(NULL);
-    }
-  sprintf(file_entry->file_path,"%s/%s",folder_path,file_entry->file_name_case);
+  /* Dossier parent (le chemin complet est reconstruit à la demande par GetEntryPath) */
+  file_entry->parent_directory = parent_directory;
 
-  /** Taille des données + Liste des blocs utilisés **/
-  error = GetFileDataResourceSize(current_image,file_entry);
-  if(error)
+  /** Taille des données + Liste des blocs utilisés (inutile en lecture seule lazy) **/
+  if(current_image->image_access != IMAGE_ACCESS_LAZY)
     {
-      mem_free_entry(file_entry);
-      return(NULL);
+      if(current_image->image_cache != NULL && GetCacheEntry(current_image->image_cache,file_entry) == 0)
+        error = 0;
+      else
+        error = GetFileDataResourceSize(current_image,file_entry);
+      if(error)
+        {
+          mem_free_entry(file_entry);
+          return(NULL);
+        }
     }
 
   /* Renvoi la structure */
@@ -442,18 +616,90 @@ struct file_descriptive_entry *ODSReadFileDescriptiveEntry(struct prodos_image *
 }
 
 
+/***********************************************************************************/
+/*  GetEntryPath() :  Construit le chemin complet d'une entrée depuis ses parents. */
+/***********************************************************************************/
+char *GetEntryPath(struct prodos_image *current_image, struct file_descriptive_entry *current_entry, char *entry_path)
+{
+  int position, length;
+  char *name;
+
+  /* On remplit le buffer par la fin : /NOM, puis les dossiers parents, puis le volume */
+  position = ENTRY_PATH_LENGTH-1;
+  entry_path[position] = '\0';
+  while(1)
+    {
+      if(current_entry != NULL)
+        name = current_entry->file_name_case;
+      else
+        name = current_image->volume_header->volume_name_case;
+      length = (int) strlen(name);
+
+      /* Chemin trop long : on ne garde que la fin */
+      if(length+1 > position)
+        break;
+      position -= length;
+      memcpy(&entry_path[position],name,length);
+      entry_path[--position] = '/';
+
+      if(current_entry == NULL)
+        break;
+      current_entry = current_entry->parent_directory;
+    }
+
+  /* Replace le chemin au début du buffer */
+  memmove(entry_path,&entry_path[position],ENTRY_PATH_LENGTH-position);
+
+  /* Renvoie le chemin */
+  return(entry_path);
+}
+
+
 /**************************************************************************/
 /*  GetAllDirectoryFile() :  Lecture des Directory + SubDirectory + File. */
 /**************************************************************************/
 static void GetAllDirectoryFile(struct prodos_image *current_image)
+{
+  int i, nb_directory;
+  struct file_descriptive_entry *current_directory;
+
+  /**  Volume Directory  **/
+  GetVolumeDirectoryFile(current_image);
+
+  /************************************/
+  /**  Tous les autres Subdirectory  **/
+  my_Memory(MEMORY_GET_DIRECTORY_NB,&nb_directory,NULL);
+  for(i=1; i<=nb_directory; i++)
+    {
+      my_Memory(MEMORY_GET_DIRECTORY,&i,&current_directory);
+      if(current_directory->processed == 0)
+        {
+          /** Traite les entrées de ce SubDirectory **/
+          GetOneSubDirectoryFile(current_image,current_directory);
+          current_directory->processed = 1;
+
+          /* Si de nouveaux SubDir ont été ajoutés */
+          my_Memory(MEMORY_GET_DIRECTORY_NB,&nb_directory,NULL);
+        }
+    }
+
+  /** Tableaux de pointeurs **/
+  my_Memory(MEMORY_BUILD_ENTRY_TAB,NULL,NULL);
+  my_Memory(MEMORY_BUILD_DIRECTORY_TAB,NULL,NULL);
+}
+
+
+/**************************************************************************/
+/*  GetVolumeDirectoryFile() :  Récupère les entrées du Volume Directory. */
+/**************************************************************************/
+static void GetVolumeDirectoryFile(struct prodos_image *current_image)
 {
   int i, offset, nb_file, nb_directory, first_time, block_number;
   struct file_descriptive_entry *current_entry;
-  struct file_descriptive_entry *current_directory;
   struct file_descriptive_entry *first_file;
   struct file_descriptive_entry *first_directory;
+  struct folder_slot *free_slot;
   unsigned char one_block[BLOCK_SIZE];
-  char volume_path[256];
 
   /* Init */
   first_time = 1;
@@ -461,20 +707,24 @@ static void GetAllDirectoryFile(struct prodos_image *current_image)
   nb_directory = 0;
   first_file = NULL;
   first_directory = NULL;
-  sprintf(volume_path,"/%s",current_image->volume_header->volume_name_case);
 
   /*******************************************/
   /**  Volume Directory (Block 2+suivants)  **/
   block_number = 2;
   GetBlockData(current_image,block_number,one_block);
   offset = current_image->volume_header->struct_size;
+  /* Image modifiable : les entrées effacées sont relevées au passage (AllocateFolderEntry) */
+  free_slot = (current_image->image_access == IMAGE_ACCESS_WRITE) ? NewFolderSlot(one_block,1) : NULL;
   while(block_number)
     {
+      if(free_slot != NULL && AddFolderSlotBlock(free_slot,block_number,one_block))
+        free_slot = NULL;
+
       /* On analyse toutes les entrées de ce block */
       for(i=0; i<current_image->volume_header->entries_per_block-first_time; i++, offset += current_image->volume_header->entry_length)
         {
           /* Récupère l'entrée */
-          current_entry = ODSReadFileDescriptiveEntry(current_image,volume_path,&one_block[offset]);
+          current_entry = ODSReadFileDescriptiveEntry(current_image,NULL,&one_block[offset]);
           if(current_entry == NULL)
             continue;
           current_entry->depth = 1;
@@ -520,7 +770,7 @@ static void GetAllDirectoryFile(struct prodos_image *current_image)
   current_image->nb_file = nb_file;
   if(current_image->nb_file > 0)
     {
-      current_image->tab_file = (struct file_descriptive_entry **) calloc(nb_file,sizeof(struct file_descriptive_entry *));
+      current_image->tab_file = (struct file_descriptive_entry **) mem_alloc_arena(GetEntryTableSize(nb_file)*sizeof(struct file_descriptive_entry *));
       if(current_image->tab_file != NULL)
         for(i=0,current_entry=first_file; i<nb_file; i++,current_entry=current_entry->next)
           current_image->tab_file[i] = current_entry;
@@ -529,46 +779,30 @@ static void GetAllDirectoryFile(struct prodos_image *current_image)
   current_image->nb_directory = nb_directory;
   if(current_image->nb_directory > 0)
     {
-      current_image->tab_directory = (struct file_descriptive_entry **) calloc(nb_directory,sizeof(struct file_descriptive_entry *));
+      current_image->tab_directory = (struct file_descriptive_entry **) mem_alloc_arena(GetEntryTableSize(nb_directory)*sizeof(struct file_descriptive_entry *));
       if(current_image->tab_directory != NULL)
         for(i=0,current_entry=first_directory; i<nb_directory; i++,current_entry=current_entry->next)
           current_image->tab_directory[i] = current_entry;
       qsort(current_image->tab_directory,nb_directory,sizeof(struct file_descriptive_entry *),compare_entry);
     }
 
-  /************************************/
-  /**  Tous les autres Subdirectory  **/
-  my_Memory(MEMORY_GET_DIRECTORY_NB,&nb_directory,NULL);
-  for(i=1; i<=nb_directory; i++)
-    {
-      my_Memory(MEMORY_GET_DIRECTORY,&i,&current_directory);
-      if(current_directory->processed == 0)
-        {
-          /** Traite les entrées de ce SubDirectory **/
-          GetOneSubDirectoryFile(current_image,current_directory->file_path,current_directory);
-          current_directory->processed = 1;
-
-          /* Si de nouveaux SubDir ont été ajoutés */
-          my_Memory(MEMORY_GET_DIRECTORY_NB,&nb_directory,NULL);
-        }
-    }
-
-  /** Tableaux de pointeurs **/
-  my_Memory(MEMORY_BUILD_ENTRY_TAB,NULL,NULL);
-  my_Memory(MEMORY_BUILD_DIRECTORY_TAB,NULL,NULL);
+  /* Le Volume Directory est décodé */
+  current_image->free_slot = free_slot;
+  current_image->directory_processed = 1;
 }
 
 
 /************************************************************************/
 /*  GetOneSubDirectoryFile() :  Récupère les entrées d'un SubDirectory. */
 /************************************************************************/
-static void GetOneSubDirectoryFile(struct prodos_image *current_image, char *folder_path, struct file_descriptive_entry *current_directory)
+static void GetOneSubDirectoryFile(struct prodos_image *current_image, struct file_descriptive_entry *current_directory)
 {
   int i, offset, first_time, depth, block_number, nb_file, nb_directory;
   struct sub_directory_header *directory_header;
   struct file_descriptive_entry *current_entry;
   struct file_descriptive_entry *first_file;
   struct file_descriptive_entry *first_directory;
+  struct folder_slot *free_slot;
   unsigned char one_block[BLOCK_SIZE];
 
   /* Init */
@@ -584,13 +818,18 @@ static void GetOneSubDirectoryFile(struct prodos_image *current_image, char *fol
   GetBlockData(current_image,block_number,one_block);
   directory_header = ODSReadSubDirectoryHeader(one_block);
   offset = directory_header->struct_size;
+  /* Image modifiable : les entrées effacées sont relevées au passage (AllocateFolderEntry) */
+  free_slot = (current_image->image_access == IMAGE_ACCESS_WRITE) ? NewFolderSlot(one_block,0) : NULL;
   while(block_number)
     {
+      if(free_slot != NULL && AddFolderSlotBlock(free_slot,block_number,one_block))
+        free_slot = NULL;
+
       /* On analyse toutes les entrées de ce block */
       for(i=0; i<directory_header->entries_per_block-first_time; i++, offset += directory_header->entry_length)
         {
           /* Récupère l'entrée */
-          current_entry = ODSReadFileDescriptiveEntry(current_image,folder_path,&one_block[offset]);
+          current_entry = ODSReadFileDescriptiveEntry(current_image,current_directory,&one_block[offset]);
           if(current_entry == NULL)
             continue;
           current_entry->depth = depth;
@@ -636,7 +875,7 @@ static void GetOneSubDirectoryFile(struct prodos_image *current_image, char *fol
   current_directory->nb_file = nb_file;
   if(current_directory->nb_file > 0)
     {
-      current_directory->tab_file = (struct file_descriptive_entry **) calloc(nb_file,sizeof(struct file_descriptive_entry *));
+      current_directory->tab_file = (struct file_descriptive_entry **) mem_alloc_arena(GetEntryTableSize(nb_file)*sizeof(struct file_descriptive_entry *));
       if(current_directory->tab_file != NULL)
         for(i=0,current_entry=first_file; i<nb_file; i++,current_entry=current_entry->next)
           current_directory->tab_file[i] = current_entry;
@@ -645,23 +884,55 @@ static void GetOneSubDirectoryFile(struct prodos_image *current_image, char *fol
   current_directory->nb_directory = nb_directory;
   if(current_directory->nb_directory > 0)
     {
-      current_directory->tab_directory = (struct file_descriptive_entry **) calloc(nb_directory,sizeof(struct file_descriptive_entry *));
+      current_directory->tab_directory = (struct file_descriptive_entry **) mem_alloc_arena(GetEntryTableSize(nb_directory)*sizeof(struct file_descriptive_entry *));
       if(current_directory->tab_directory != NULL)
         for(i=0,current_entry=first_directory; i<nb_directory; i++,current_entry=current_entry->next)
           current_directory->tab_directory[i] = current_entry;
       qsort(current_directory->tab_directory,nb_directory,sizeof(struct file_descriptive_entry *),compare_entry);
     }
 
+  current_directory->free_slot = free_slot;
+
   /* Libération du SubDirectory Header */
   mem_free_subdirectory(directory_header);
 }
 
 
+/****************************************************************************/
+/*  LoadFolderEntries() :  Décode à la demande les entrées d'un répertoire. */
+/****************************************************************************/
+void LoadFolderEntries(struct prodos_image *current_image, struct file_descriptive_entry *folder_entry)
+{
+  int previous_phase;
+
+  /* Hors mode lazy, tous les répertoires ont été décodés au chargement */
+  if(current_image->image_access != IMAGE_ACCESS_LAZY)
+    return;
+
+  previous_phase = stats_EnterPhase(STATS_PHASE_DIRECTORY);
+  if(folder_entry == NULL)
+    {
+      /** Volume Directory **/
+      if(current_image->directory_processed == 0)
+        GetVolumeDirectoryFile(current_image);
+    }
+  else if(folder_entry->processed == 0)
+    {
+      /** SubDirectory : on ne lit que les blocs de ce répertoire **/
+      GetOneSubDirectoryFile(current_image,folder_entry);
+      folder_entry->processed = 1;
+    }
+  stats_LeavePhase(previous_phase);
+}
+
+
 /******************************************************************/
 /*  GetBlockData() :  Récupère les données d'un block de l'image. */
 /******************************************************************/
 void GetBlockData(struct prodos_image *current_image, int block_number, unsigned char *block_data_rtn)
 {
+  STATS_ADD(STATS_BLOCK_READ,1);
+
   /* Vérifie les limites */
   if(block_number >= current_image->nb_block)
     {
@@ -679,6 +950,28 @@ void GetBlockData(struct prodos_image *current_image, int block_number, unsigned
 /***************************************************************/
 void SetBlockData(struct prodos_image *current_image, int block_number, unsigned char *block_data)
 {
+  STATS_ADD(STATS_BLOCK_WRITE,1);
+
+  /* Vérifie les limites */
+  if(block_number >= current_image->nb_block)
+    return;
+
+  /* Ecrit les data */
+  memcpy(&current_image->image_data[block_number*BLOCK_SIZE],block_data,BLOCK_SIZE);
+
+  /* Marque le block comme ayant été modifié */
+  MarkBlockModified(current_image,block_number,BLOCK_MODIFIED_DATA);
+}
+
+
+/*****************************************************************************/
+/*  SetMetadataBlockData() :  Ecrit un block de Bitmap ou de Directory. Il   */
+/*                            sera écrit sur disque après les données.       */
+/*****************************************************************************/
+void SetMetadataBlockData(struct prodos_image *current_image, int block_number, unsigned char *block_data)
+{
+  STATS_ADD(STATS_BLOCK_WRITE,1);
+
   /* Vérifie les limites */
   if(block_number >= current_image->nb_block)
     return;
@@ -687,7 +980,55 @@ void SetBlockData(struct prodos_image *current_image, int block_number, unsigned
   memcpy(&current_image->image_data[block_number*BLOCK_SIZE],block_data,BLOCK_SIZE);
 
   /* Marque le block comme ayant été modifié */
-  current_image->block_modified[block_number] = 1;
+  MarkBlockModified(current_image,block_number,BLOCK_MODIFIED_METADATA);
+}
+
+
+/***************************************************************************/
+/*  MarkBlockModified() :  Ajoute un block à la liste des blocks modifiés. */
+/***************************************************************************/
+static void MarkBlockModified(struct prodos_image *current_image, int block_number, int modified_type)
+{
+  int nb_dirty_run_max;
+  struct dirty_run *last_run;
+  struct dirty_run *tab_dirty_run;
+
+  /* Déjà dans la liste : seul le type change */
+  if(current_image->block_modified[block_number] != 0 || current_image->dirty_run_overflow == 1)
+    {
+      current_image->block_modified[block_number] = (unsigned char) modified_type;
+      return;
+    }
+  current_image->block_modified[block_number] = (unsigned char) modified_type;
+
+  /** Prolonge la dernière plage **/
+  if(current_image->nb_dirty_run > 0)
+    {
+      last_run = &current_image->tab_dirty_run[current_image->nb_dirty_run-1];
+      if(last_run->block+last_run->nb_block == block_number)
+        {
+          last_run->nb_block++;
+          return;
+        }
+    }
+
+  /** Nouvelle plage **/
+  if(current_image->nb_dirty_run == current_image->nb_dirty_run_max)
+    {
+      nb_dirty_run_max = (current_image->nb_dirty_run_max == 0) ? DIRTY_RUN_STEP : 2*current_image->nb_dirty_run_max;
+      tab_dirty_run = (struct dirty_run *) realloc(current_image->tab_dirty_run,nb_dirty_run_max*sizeof(struct dirty_run));
+      if(tab_dirty_run == NULL)
+        {
+          /* Plus de mémoire : UpdateProdosImage() parcourra tous les blocks */
+          current_image->dirty_run_overflow = 1;
+          return;
+        }
+      current_image->tab_dirty_run = tab_dirty_run;
+      current_image->nb_dirty_run_max = nb_dirty_run_max;
+    }
+  current_image->tab_dirty_run[current_image->nb_dirty_run].block = block_number;
+  current_image->tab_dirty_run[current_image->nb_dirty_run].nb_block = 1;
+  current_image->nb_dirty_run++;
 }
 
 
@@ -798,211 +1139,36 @@ WORD BuildProdosCase(char *file_name)
 }
 
 
-/********************************************************************************/
-/*  BuildStorageTypeAscii() :  Construction de la valeur Ascii du Storage Type. */
-/********************************************************************************/
-static void BuildStorageTypeAscii(BYTE storage_type, char *ascii_rtn, char *ascii_short_rtn)
+/****************************************************************************/
+/*  GetFileDataResourceSize() :  Récupère la taille occupée par le fichier. */
+/****************************************************************************/
+static int GetFileDataResourceSize(struct prodos_image *current_image, struct file_descriptive_entry *file_entry)
 {
-  if((storage_type & 0x0F) == 0x00)
-    {
-      strcpy(ascii_rtn,"Deleted");
-      strcpy(ascii_short_rtn,"Del ");
-    }
-  else if((storage_type & 0x0F) == 0x01)
+  int i, nb_block, nb_data_block, nb_resource_block, data_block_used, resource_block_used, index_block, nb_index_block, nb_used_block_data, nb_used_block_resource;
+  BYTE data_storage_type, resource_storage_type;
+  WORD data_key_block, resource_key_block;
+  int *tab_block = NULL;
+  int *tab_index_block = NULL;
+  int *tab_used_block_data;
+  int *tab_used_block_resource;
+  unsigned char extended_block[BLOCK_SIZE];
+  char entry_path[ENTRY_PATH_LENGTH];
+
+  if (!file_entry) return(0);
+
+  if((file_entry->storage_type & 0x0F) == 0x00)
     {
-      strcpy(ascii_rtn,"Seedling (1 data block)");
-      strcpy(ascii_short_rtn,"Seed");
+      /* Fichier effacé */
+      file_entry->data_block = 0;
+      file_entry->data_size = 0;
+      file_entry->resource_block = 0;
+      file_entry->resource_size = 0;
+      file_entry->nb_used_block = 0;
+
+      /* OK */
+      return(0);
     }
-  else if((storage_type & 0x0F) == 0x02)
-    {
-      strcpy(ascii_rtn,"Sapling (2-256 data blocks)");
-      strcpy(ascii_short_rtn,"Sapl");
-    }
-  else if((storage_type & 0x0F) == 0x03)
-    {
-      strcpy(ascii_rtn,"Tree (257-32768 data blocks)");
-      strcpy(ascii_short_rtn,"Tree");
-    }
-  else if((storage_type & 0x0F) == 0x05)
-    {
-      strcpy(ascii_rtn,"Extended");
-      strcpy(ascii_short_rtn,"Fork");
-    }
-  else if((storage_type & 0x0F) == 0x0D)
-    {
-      strcpy(ascii_rtn,"Subdirectory");
-      strcpy(ascii_short_rtn,"Dir ");
-    }
-  else if((storage_type & 0x0F) == 0x0E)
-    {
-      strcpy(ascii_rtn,"Reserved for Subdirectory Header entry");
-      strcpy(ascii_short_rtn,"    ");
-    }
-  else if((storage_type & 0x0F) == 0x0F)
-    {
-      strcpy(ascii_rtn,"Reserved for Volume Directory Header entry");
-      strcpy(ascii_short_rtn,"    ");
-    }
-  else
-    {
-      sprintf(ascii_rtn,"Unkown value (%02X)",storage_type & 0x0F);
-      sprintf(ascii_short_rtn,"?%02X?",storage_type & 0x0F);
-    }
-}
-
-
-/**************************************************************************/
-/*  BuildFileTypeAscii() :  Construction de la valeur Ascii du File Type. */
-/**************************************************************************/
-static void BuildFileTypeAscii(BYTE file_type, char *ascii_rtn)
-{
-  if(file_type == 0x00)
-    strcpy(ascii_rtn,"UNK");
-  else if(file_type == 0x01)
-    strcpy(ascii_rtn,"BAD");
-  else if(file_type == 0x04)
-    strcpy(ascii_rtn,"TXT");
-  else if(file_type == 0x06)
-    strcpy(ascii_rtn,"BIN");
-  else if(file_type == 0x0F)
-    strcpy(ascii_rtn,"DIR");
-  else if(file_type == 0x19)
-    strcpy(ascii_rtn,"ADB");
-  else if(file_type == 0x1A)
-    strcpy(ascii_rtn,"AWP");
-  else if(file_type == 0x1B)
-    strcpy(ascii_rtn,"ASP");
-  else if(file_type == 0x42)
-    strcpy(ascii_rtn,"FTD");
-  else if(file_type == 0x50)
-    strcpy(ascii_rtn,"GWP");
-  else if(file_type == 0x52)
-    strcpy(ascii_rtn,"GDB");
-  else if(file_type == 0x5A)
-    strcpy(ascii_rtn,"CFG");
-  else if(file_type == 0x5E)
-    strcpy(ascii_rtn,"DVU");
-  else if(file_type == 0xB0)
-    strcpy(ascii_rtn,"SRC");
-  else if(file_type == 0xB3)
-    strcpy(ascii_rtn,"S16");
-  else if(file_type == 0xB5)
-    strcpy(ascii_rtn,"EXE");
-  else if(file_type == 0xB6)
-    strcpy(ascii_rtn,"PIF");
-  else if(file_type == 0xB7)
-    strcpy(ascii_rtn,"TIF");
-  else if(file_type == 0xB8)
-    strcpy(ascii_rtn,"NDA");
-  else if(file_type == 0xB9)
-    strcpy(ascii_rtn,"CDA");
-  else if(file_type == 0xBA)
-    strcpy(ascii_rtn,"TOL");
-  else if(file_type == 0xBB)
-    strcpy(ascii_rtn,"DVR");
-  else if(file_type == 0xBC)
-    strcpy(ascii_rtn,"LDF");
-  else if(file_type == 0xBD)
-    strcpy(ascii_rtn,"FST");
-  else if(file_type == 0xBF)
-    strcpy(ascii_rtn,"DOC");
-  else if(file_type == 0xC0)
-    strcpy(ascii_rtn,"PNT");
-  else if(file_type == 0xC1)
-    strcpy(ascii_rtn,"PIC");
-  else if(file_type == 0xC2)
-    strcpy(ascii_rtn,"ANI");
-  else if(file_type == 0xC7)
-    strcpy(ascii_rtn,"CDV");
-  else if(file_type == 0xC8)
-    strcpy(ascii_rtn,"FON");
-  else if(file_type == 0xC9)
-    strcpy(ascii_rtn,"FND");
-  else if(file_type == 0xCA)
-    strcpy(ascii_rtn,"ICN");
-  else if(file_type == 0xD5)
-    strcpy(ascii_rtn,"MUS");
-  else if(file_type == 0xD6)
-    strcpy(ascii_rtn,"INS");
-  else if(file_type == 0xD8)
-    strcpy(ascii_rtn,"SND");
-  else if(file_type == 0xE0)
-    strcpy(ascii_rtn,"LBR");
-  else if(file_type == 0xEF)
-    strcpy(ascii_rtn,"PAS");
-  else if(file_type == 0xF0)
-    strcpy(ascii_rtn,"CMD");
-  else if(file_type == 0xF9)
-    strcpy(ascii_rtn,"OS ");
-  else if(file_type == 0xFC)
-    strcpy(ascii_rtn,"BAS");
-  else if(file_type == 0xFD)
-    strcpy(ascii_rtn,"VAR");
-  else if(file_type == 0xFE)
-    strcpy(ascii_rtn,"REL");
-  else if(file_type == 0xFF)
-    strcpy(ascii_rtn,"SYS");
-  else
-    sprintf(ascii_rtn,"$%02X",file_type);
-}
-
-
-/*********************************************************************/
-/*  BuildAccessAscii() :  Construction de la valeur Ascii de Access. */
-/*********************************************************************/
-static void BuildAccessAscii(BYTE access, char *ascii_rtn)
-{
-  strcpy(ascii_rtn,"");
-
-  /* Read */
-  strcat(ascii_rtn,(access & 0x01) == 0x01 ? "R" : " ");
-
-  /* Write */
-  strcat(ascii_rtn,(access & 0x02) == 0x02 ? "W" : " ");
-
-  /* Changed since Last Backup */
-  strcat(ascii_rtn,(access & 0x20) == 0x20 ? "B" : " ");
-
-  /* Rename */
-  strcat(ascii_rtn,(access & 0x40) == 0x40 ? "N" : " ");
-
-  /* Destroy */
-  strcat(ascii_rtn,(access & 0x80) == 0x80 ? "D" : " ");
-
-  /* Hidden (GS/OS) */
-  strcat(ascii_rtn,(access & 0x04) == 0x04 ? "H" : " ");
-}
-
-
-/****************************************************************************/
-/*  GetFileDataResourceSize() :  Récupère la taille occupée par le fichier. */
-/****************************************************************************/
-static int GetFileDataResourceSize(struct prodos_image *current_image, struct file_descriptive_entry *file_entry)
-{
-  int i, nb_block, nb_data_block, nb_resource_block, data_block_used, resource_block_used, index_block, nb_index_block, nb_used_block_data, nb_used_block_resource;
-  BYTE data_storage_type, resource_storage_type;
-  WORD data_key_block, resource_key_block;
-  int *tab_block = NULL;
-  int *tab_index_block = NULL;
-  int *tab_used_block_data;
-  int *tab_used_block_resource;
-  unsigned char extended_block[BLOCK_SIZE];
-
-  if (!file_entry) return(0);
-
-  if((file_entry->storage_type & 0x0F) == 0x00)
-    {
-      /* Fichier effacé */
-      file_entry->data_block = 0;
-      file_entry->data_size = 0;
-      file_entry->resource_block = 0;
-      file_entry->resource_size = 0;
-      file_entry->nb_used_block = 0;
-
-      /* OK */
-      return(0);
-    }
-  else if((file_entry->storage_type & 0x0F) == 0x0D)
+  else if((file_entry->storage_type & 0x0F) == 0x0D)
     {
       /** Subdirectory **/
       file_entry->data_block = 0;
@@ -1091,10 +1257,10 @@ static int GetFileDataResourceSize(struct prodos_image *current_image, struct fi
               file_entry->nb_sparse++;
 
           if(tab_block[0] == 0)
-            logf_error("  Warning : Block 0 is sparse in file: '%s'.\n", file_entry->file_path);
+            logf_error("  Warning : Block 0 is sparse in file: '%s'.\n", GetEntryPath(current_image,file_entry,entry_path));
 
           /* Table des blocs utilisés */
-          file_entry->tab_used_block = BuildUsedBlockTable(nb_block,tab_block,nb_index_block,tab_index_block,&file_entry->nb_used_block);
+          file_entry->tab_used_block = BuildUsedBlockTable(nb_block,tab_block,nb_index_block,tab_index_block,1,&file_entry->nb_used_block);
           if(file_entry->tab_used_block == NULL)
             {
               free(tab_block);
@@ -1184,10 +1350,10 @@ static int GetFileDataResourceSize(struct prodos_image *current_image, struct fi
               file_entry->nb_sparse++;
 
           if(tab_block[0] == 0)
-            logf_error("  Warning : Block 0 is sparse in data fork of file: '%s'.\n", file_entry->file_path);
+            logf_error("  Warning : Block 0 is sparse in data fork of file: '%s'.\n", GetEntryPath(current_image,file_entry,entry_path));
 
           /* Table des blocs utilisés (Data) */
-          tab_used_block_data = BuildUsedBlockTable(nb_block,tab_block,nb_index_block,tab_index_block,&nb_used_block_data);
+          tab_used_block_data = BuildUsedBlockTable(nb_block,tab_block,nb_index_block,tab_index_block,0,&nb_used_block_data);
           if(tab_used_block_data == NULL)
             {
               free(tab_block);
@@ -1257,10 +1423,10 @@ static int GetFileDataResourceSize(struct prodos_image *current_image, struct fi
               file_entry->nb_sparse++;
 
           if(tab_block[0] == 0)
-            logf_error("  Warning : Block 0 is sparse in resource fork of file: '%s'.\n", file_entry->file_path);
+            logf_error("  Warning : Block 0 is sparse in resource fork of file: '%s'.\n", GetEntryPath(current_image,file_entry,entry_path));
 
           /* Table des blocs utilisés (Resource) */
-          tab_used_block_resource = BuildUsedBlockTable(nb_block,tab_block,nb_index_block,tab_index_block,&nb_used_block_resource);
+          tab_used_block_resource = BuildUsedBlockTable(nb_block,tab_block,nb_index_block,tab_index_block,0,&nb_used_block_resource);
           if(tab_used_block_resource == NULL)
             {
               free(tab_block);
@@ -1275,7 +1441,7 @@ static int GetFileDataResourceSize(struct prodos_image *current_image, struct fi
 
           /** Table des blocs utilisés (Data+Resource+Index) **/
           file_entry->nb_used_block = 0;
-          file_entry->tab_used_block = (int *) calloc(1+nb_used_block_data+nb_used_block_resource,sizeof(int));
+          file_entry->tab_used_block = (int *) mem_alloc_arena((1+nb_used_block_data+nb_used_block_resource)*sizeof(int));
           if(file_entry->tab_used_block == NULL)
             {
               logf_error("  Error : Impossible to allocate memory for 'tab_used_block' table.\n");
@@ -1306,14 +1472,19 @@ static int GetFileDataResourceSize(struct prodos_image *current_image, struct fi
 
 /*************************************************************************************/
 /*  BuildUsedBlockTable() :  Création de la table des blocs utilisés par un fichier. */
+/*                           in_arena : table de l'entrée (arène de l'image), sinon  */
+/*                           table temporaire à libérer par l'appelant.              */
 /*************************************************************************************/
-static int *BuildUsedBlockTable(int nb_data_block, int *tab_data_block, int nb_index_block, int *tab_index_block, int *nb_used_block_rtn)
+static int *BuildUsedBlockTable(int nb_data_block, int *tab_data_block, int nb_index_block, int *tab_index_block, int in_arena, int *nb_used_block_rtn)
 {
   int i, nb_used_block;
   int *tab_used_block;
 
   /* Allocation de la table */
-  tab_used_block = (int *) calloc(nb_data_block+nb_index_block,sizeof(int));
+  if(in_arena)
+    tab_used_block = (int *) mem_alloc_arena((nb_data_block+nb_index_block)*sizeof(int));
+  else
+    tab_used_block = (int *) calloc(nb_data_block+nb_index_block,sizeof(int));
   if(tab_used_block == NULL)
     {
       logf_error("  Error : Impossible to allocate memory for 'tab_used_block' table.\n");
@@ -1356,7 +1527,7 @@ static int *BuildDirectoryUsedBlockTable(struct prodos_image *current_image, str
   nb_used_block = file_entry->blocks_used;
 
   /* Allocation mémoire */
-  tab_used_block = (int *) calloc(nb_used_block,sizeof(int *));
+  tab_used_block = (int *) mem_alloc_arena(nb_used_block*sizeof(int));
   if(tab_used_block == NULL)
     {
       logf_error("  Error : Impossible to allocate memory for 'tab_used_block' table.\n");
@@ -1388,56 +1559,262 @@ static int *BuildDirectoryUsedBlockTable(struct prodos_image *current_image, str
 /**********************************************************************/
 /*  DecodeExpandBitmapBlock() :  Décode la zone 1-bitmap => 8-bitmap. */
 /**********************************************************************/
-static void DecodeExpandBitmapBlock(struct prodos_image *current_image)
+static int DecodeExpandBitmapBlock(struct prodos_image *current_image)
 {
-  int i, j, k, l, nb_block, nb_free_block, nb_byte;
+  int i, offset, nb_free_block;
   unsigned char block_data[BLOCK_SIZE];
 
   /* Init */
   nb_free_block = 0;
 
-  /* Nombre de block nécessaires pour stocker la table */
-  nb_block = GetContainerNumber(current_image->nb_block,BLOCK_SIZE*8);
-
-  /* Nombre d'octets nécessaires dans le dernier block */
-  if((nb_block*BLOCK_SIZE*8) != current_image->nb_block)
+  /** Allocation mémoire de la bitmap et de son index **/
+  current_image->nb_bitmap_word = GetContainerNumber(current_image->nb_block,BITMAP_WORD_BIT);
+  for(current_image->nb_free_extent_leaf=1; current_image->nb_free_extent_leaf<current_image->nb_bitmap_word; )
+    current_image->nb_free_extent_leaf *= 2;
+  current_image->block_allocation_table = (uint64_t *) calloc(current_image->nb_bitmap_word+1,sizeof(uint64_t));
+  current_image->free_extent_tree = (struct free_extent_node *) calloc(2*current_image->nb_free_extent_leaf,sizeof(struct free_extent_node));
+  if(current_image->block_allocation_table == NULL || current_image->free_extent_tree == NULL)
     {
-      nb_byte = (current_image->nb_block - ((nb_block-1)*BLOCK_SIZE*8)) / 8;
-	  if(nb_byte * 8 != (current_image->nb_block - ((nb_block-1)*BLOCK_SIZE*8)))
-		nb_byte++;
+      logf_error("  Error, Impossible to allocate memory to process image file.\n");
+      return(1);
     }
+
+  /** Remplissage (depuis le cache s'il y en a un) **/
+  if(current_image->image_cache != NULL && GetCacheBitmap(current_image->image_cache,current_image) == 0)
+    nb_free_block = current_image->nb_free_block;
   else
-    nb_byte = BLOCK_SIZE;
+    {
+      for(i=0; i<current_image->nb_block; i++)
+        {
+          /* Lecture du block de la Bitmap disque */
+          offset = i % (BLOCK_SIZE*8);
+          if(offset == 0)
+            GetBlockData(current_image,current_image->volume_header->bitmap_block+i/(BLOCK_SIZE*8),block_data);
+
+          /* Décode les block libres / occupés */
+          if((block_data[offset/8] >> (7-(offset%8))) & 0x01)
+            {
+              current_image->block_allocation_table[i/BITMAP_WORD_BIT] |= ((uint64_t) 1) << (i%BITMAP_WORD_BIT);
+              nb_free_block++;
+            }
+        }
+    }
+
+  /* Nombre de bloc libres */
+  current_image->nb_free_block = nb_free_block;
+
+  /** Construction de l'index des zones libres **/
+  BuildFreeExtentTree(current_image);
+
+  /* OK */
+  return(0);
+}
+
+
+/*************************************************************************/
+/*  BuildFreeExtentTree() :  Construit l'index des zones libres complet. */
+/*************************************************************************/
+static void BuildFreeExtentTree(struct prodos_image *current_image)
+{
+  int i, level, span;
+  struct free_extent_node *tree = current_image->free_extent_tree;
+
+  /** Feuilles : un mot de la bitmap **/
+  for(i=0; i<current_image->nb_free_extent_leaf; i++)
+    SetFreeExtentLeaf(current_image,i);
+
+  /** Noeuds internes, niveau par niveau **/
+  for(level=current_image->nb_free_extent_leaf/2, span=BITMAP_WORD_BIT; level>=1; level/=2, span*=2)
+    for(i=level; i<2*level; i++)
+      MergeFreeExtentNode(&tree[i],&tree[2*i],&tree[2*i+1],span);
+}
+
+
+/********************************************************************/
+/*  SetFreeExtentLeaf() :  Calcule le résumé d'un mot de la bitmap. */
+/********************************************************************/
+static void SetFreeExtentLeaf(struct prodos_image *current_image, int word_index)
+{
+  int i, run;
+  uint64_t word;
+  struct free_extent_node *leaf;
 
-  /** Remplissage **/
-  for(l=0,i=0; i<nb_block; i++)
+  /* Feuille de l'arbre (les mots après la fin de l'image sont occupés) */
+  leaf = &current_image->free_extent_tree[current_image->nb_free_extent_leaf+word_index];
+  word = (word_index < current_image->nb_bitmap_word) ? current_image->block_allocation_table[word_index] : 0;
+
+  /** Plus longue suite de blocs libres + suite de fin **/
+  leaf->max = 0;
+  for(i=0, run=0; i<BITMAP_WORD_BIT; i++)
     {
-      /* Lecture du block */
-      GetBlockData(current_image,current_image->volume_header->bitmap_block+i,block_data);
+      if((word >> i) & 0x01)
+        {
+          run++;
+          if(run > leaf->max)
+            leaf->max = run;
+        }
+      else
+        run = 0;
+    }
+  leaf->suffix = run;
+
+  /** Suite de début **/
+  for(i=0; i<BITMAP_WORD_BIT && ((word >> i) & 0x01); i++)
+    ;
+  leaf->prefix = i;
+}
+
+
+/********************************************************************/
+/*  MergeFreeExtentNode() :  Calcule un noeud à partir de ses fils. */
+/********************************************************************/
+static void MergeFreeExtentNode(struct free_extent_node *node, struct free_extent_node *left, struct free_extent_node *right, int span)
+{
+  node->prefix = (left->prefix == span) ? span + right->prefix : left->prefix;
+  node->suffix = (right->suffix == span) ? span + left->suffix : right->suffix;
+  node->max = (left->max > right->max) ? left->max : right->max;
+  if(left->suffix + right->prefix > node->max)
+    node->max = left->suffix + right->prefix;
+}
+
+
+/***********************************************************************/
+/*  UpdateFreeExtentTree() :  Met à jour l'index après modif d'un mot. */
+/***********************************************************************/
+static void UpdateFreeExtentTree(struct prodos_image *current_image, int word_index)
+{
+  int node, span;
+  struct free_extent_node *tree = current_image->free_extent_tree;
+
+  /* Feuille */
+  SetFreeExtentLeaf(current_image,word_index);
+
+  /* On remonte jusqu'à la racine */
+  for(node=(current_image->nb_free_extent_leaf+word_index)/2, span=BITMAP_WORD_BIT; node>=1; node/=2, span*=2)
+    MergeFreeExtentNode(&tree[node],&tree[2*node],&tree[2*node+1],span);
+}
 
-      /* Décodage */
-      for(j=0; j<((i == nb_block-1)?nb_byte:BLOCK_SIZE); j++)
-	    {
-          for(k=7; k>=0; k--)
-		    {
-              /* Décode les block libres / occupés */
-              current_image->block_allocation_table[l] = (block_data[j] >> k) & 0x01;
-              nb_free_block += current_image->block_allocation_table[l];
-              l++;
 
-              /* Fin des blocks ? */
-			  if(l == current_image->nb_block)
-                break;
-		    }
+/*******************************************************************/
+/*  FindFreeExtent() :  Recherche la 1ère suite de X blocs libres. */
+/*******************************************************************/
+static int FindFreeExtent(struct prodos_image *current_image, int nb_block)
+{
+  int i, node, span, first_block, run;
+  uint64_t word;
+  struct free_extent_node *tree = current_image->free_extent_tree;
+
+  /* Aucune suite assez longue */
+  if(tree[1].max < nb_block)
+    return(-1);
+
+  /** Descente dans l'arbre : on privilégie toujours la zone la plus basse **/
+  node = 1;
+  first_block = 0;
+  span = current_image->nb_free_extent_leaf*BITMAP_WORD_BIT;
+  while(node < current_image->nb_free_extent_leaf)
+    {
+      span /= 2;
+      if(tree[2*node].max >= nb_block)
+        node = 2*node;
+      else if(tree[2*node].suffix + tree[2*node+1].prefix >= nb_block)
+        return(first_block + span - tree[2*node].suffix);    /* A cheval sur les 2 fils */
+      else
+        {
+          node = 2*node+1;
+          first_block += span;
+        }
+    }
 
-          /* Fin des blocks ? */
-          if(l == current_image->nb_block)
-            break;
-		}
+  /** Feuille : recherche dans le mot **/
+  word = current_image->block_allocation_table[node-current_image->nb_free_extent_leaf];
+  for(i=0, run=0; i<BITMAP_WORD_BIT; i++)
+    {
+      run = ((word >> i) & 0x01) ? run+1 : 0;
+      if(run == nb_block)
+        return(first_block + i - nb_block + 1);
     }
 
-  /* Nombre de bloc libres */
-  current_image->nb_free_block = nb_free_block;
+  /* Index incohérent */
+  return(-1);
+}
+
+
+/******************************************************************/
+/*  IsImageBlockFree() :  Indique si un block est libre (bitmap). */
+/******************************************************************/
+int IsImageBlockFree(struct prodos_image *current_image, int block_number)
+{
+  if(block_number < 0 || block_number >= current_image->nb_block)
+    return(0);
+
+  return((int) ((current_image->block_allocation_table[block_number/BITMAP_WORD_BIT] >> (block_number%BITMAP_WORD_BIT)) & 0x01));
+}
+
+
+/****************************************************************************/
+/*  SetImageBlockFree() :  Change l'état d'un block dans la bitmap mémoire. */
+/****************************************************************************/
+static int SetImageBlockFree(struct prodos_image *current_image, int block_number, int is_free)
+{
+  uint64_t mask;
+
+  /* Le block 0 (boot) n'est jamais libéré */
+  if(block_number <= 0 || block_number >= current_image->nb_block)
+    return(0);
+
+  /* Déjà dans cet état */
+  if(IsImageBlockFree(current_image,block_number) == is_free)
+    return(0);
+
+  mask = ((uint64_t) 1) << (block_number%BITMAP_WORD_BIT);
+  if(is_free)
+    current_image->block_allocation_table[block_number/BITMAP_WORD_BIT] |= mask;
+  else
+    current_image->block_allocation_table[block_number/BITMAP_WORD_BIT] &= ~mask;
+
+  /* Modifié */
+  return(1);
+}
+
+
+/************************************************************************************/
+/*  WriteBitmapBlock() :  Recopie l'état de X blocks dans les blocks Bitmap disque. */
+/************************************************************************************/
+static void WriteBitmapBlock(struct prodos_image *current_image, int nb_block, int *tab_block)
+{
+  int i, offset, bitmap_index, current_index;
+  unsigned char mask;
+  unsigned char bitmap_block[BLOCK_SIZE];
+
+  /** On ne lit / écrit que les blocks Bitmap concernés **/
+  for(i=0, current_index=-1; i<nb_block; i++)
+    {
+      if(tab_block[i] <= 0 || tab_block[i] >= current_image->nb_block)
+        continue;
+
+      /* Change de block Bitmap */
+      bitmap_index = tab_block[i] / (BLOCK_SIZE*8);
+      if(bitmap_index != current_index)
+        {
+          if(current_index != -1)
+            SetMetadataBlockData(current_image,current_image->volume_header->bitmap_block+current_index,&bitmap_block[0]);
+          GetBlockData(current_image,current_image->volume_header->bitmap_block+bitmap_index,&bitmap_block[0]);
+          current_index = bitmap_index;
+        }
+
+      /* 1 : Libre / 0 : Occupé */
+      offset = tab_block[i] % (BLOCK_SIZE*8);
+      mask = (0x01 << (7-(offset%8)));
+      if(IsImageBlockFree(current_image,tab_block[i]))
+        bitmap_block[offset/8] |= mask;
+      else
+        bitmap_block[offset/8] &= ~mask;
+    }
+
+  /* Dernier block Bitmap modifié */
+  if(current_index != -1)
+    SetMetadataBlockData(current_image,current_image->volume_header->bitmap_block+current_index,&bitmap_block[0]);
 }
 
 
@@ -1458,6 +1835,24 @@ int compare_entry(const void *data_1, const void *data_2)
 }
 
 
+/**********************************************************************/
+/*  compare_dirty_run() : Fonction de comparaison pour le Quick Sort  */
+/**********************************************************************/
+static int compare_dirty_run(const void *data_1, const void *data_2)
+{
+  struct dirty_run *run_1 = (struct dirty_run *) data_1;
+  struct dirty_run *run_2 = (struct dirty_run *) data_2;
+
+  /* Comparaison des numéros de block (les plages ne se recouvrent pas) */
+  if(run_1->block == run_2->block)
+    return(0);
+  else if(run_1->block < run_2->block)
+    return(-1);
+  else
+    return(1);
+}
+
+
 /***************************************************************/
 /*  GetProdosFile() :  Recherche l'entrée d'un fichier Prodos. */
 /***************************************************************/
@@ -1465,7 +1860,7 @@ struct file_descriptive_entry *GetProdosFile(struct prodos_image *current_image,
 {
   struct file_descriptive_entry *current_entry;
   struct file_descriptive_entry *current_directory_entry;
-  int i, is_volume_name, is_root_name;
+  int is_volume_name, is_root_name;
   char *begin;
   char *end;
   char name[1024];
@@ -1510,26 +1905,10 @@ struct file_descriptive_entry *GetProdosFile(struct prodos_image *current_image,
         }
       else if(is_root_name == 1)
         {
-          /* Nom du Dossier à la racine */
-          if(begin != NULL)
-            {
-              for(i=0; i<current_image->nb_directory; i++)
-                if(!my_stricmp(current_image->tab_directory[i]->file_name,name))
-                  {
-                    current_entry = current_image->tab_directory[i];
-                    break;
-                  }
-            }
-          else
-            {
-              /* Nom du Fichier à la racine */
-              for(i=0; i<current_image->nb_file; i++)
-                if(!my_stricmp(current_image->tab_file[i]->file_name,name))
-                  {
-                    current_entry = current_image->tab_file[i];
-                    break;
-                  }
-            }
+          /* Nom du Dossier (ou du Fichier en fin de chemin) à la racine */
+          current_entry = FindFolderEntry(current_image,NULL,name);
+          if(current_entry != NULL && ((current_entry->storage_type & 0x0F) == 0x0D) != (begin != NULL))
+            current_entry = NULL;
 
           /* Rien trouvé : Erreur */
           if(current_entry == NULL)
@@ -1543,28 +1922,11 @@ struct file_descriptive_entry *GetProdosFile(struct prodos_image *current_image,
         {
           /* Recherche dans un dossier */
           current_directory_entry = current_entry;
-          current_entry = NULL;
 
-          /* Nom du Dossier */
-          if(begin != NULL)
-            {
-              for(i=0; i<current_directory_entry->nb_directory; i++)
-                if(!my_stricmp(current_directory_entry->tab_directory[i]->file_name,name))
-                  {
-                    current_entry = current_directory_entry->tab_directory[i];
-                    break;
-                  }
-            }
-          else
-            {
-              /* Nom du Fichier */
-              for(i=0; i<current_directory_entry->nb_file; i++)
-                if(!my_stricmp(current_directory_entry->tab_file[i]->file_name,name))
-                  {
-                    current_entry = current_directory_entry->tab_file[i];
-                    break;
-                  }
-            }
+          /* Nom du Dossier (ou du Fichier en fin de chemin) */
+          current_entry = FindFolderEntry(current_image,current_directory_entry,name);
+          if(current_entry != NULL && ((current_entry->storage_type & 0x0F) == 0x0D) != (begin != NULL))
+            current_entry = NULL;
 
           /* Rien trouvé : Erreur */
           if(current_entry == NULL)
@@ -1601,7 +1963,7 @@ struct file_descriptive_entry *GetProdosFolder(struct prodos_image *current_imag
 {
   struct file_descriptive_entry *current_entry;
   struct file_descriptive_entry *current_directory_entry;
-  int i, is_volume_name, is_root_name;
+  int is_volume_name, is_root_name;
   char *begin;
   char *end;
   char name[1024];
@@ -1648,12 +2010,9 @@ struct file_descriptive_entry *GetProdosFolder(struct prodos_image *current_imag
       else if(is_root_name == 1)
         {
           /* Nom du Dossier à la racine */
-          for(i=0; i<current_image->nb_directory; i++)
-            if(!my_stricmp(current_image->tab_directory[i]->file_name,name))
-              {
-                current_entry = current_image->tab_directory[i];
-                break;
-              }
+          current_entry = FindFolderEntry(current_image,NULL,name);
+          if(current_entry != NULL && (current_entry->storage_type & 0x0F) != 0x0D)
+            current_entry = NULL;
 
           /* Rien trouvé : Erreur */
           if(current_entry == NULL)
@@ -1668,15 +2027,11 @@ struct file_descriptive_entry *GetProdosFolder(struct prodos_image *current_imag
         {
           /* Recherche dans un dossier */
           current_directory_entry = current_entry;
-          current_entry = NULL;
 
           /* Nom du Dossier */
-          for(i=0; i<current_directory_entry->nb_directory; i++)
-            if(!my_stricmp(current_directory_entry->tab_directory[i]->file_name,name))
-              {
-                current_entry = current_directory_entry->tab_directory[i];
-                break;
-              }
+          current_entry = FindFolderEntry(current_image,current_directory_entry,name);
+          if(current_entry != NULL && (current_entry->storage_type & 0x0F) != 0x0D)
+            current_entry = NULL;
 
           /* Rien trouvé : Erreur */
           if(current_entry == NULL)
@@ -1813,106 +2168,371 @@ int GetDataFile(struct prodos_image *current_image, struct file_descriptive_entr
 /*******************************************************************/
 static unsigned char *GetEntryData(struct prodos_image *current_image, int type_entry, int key_block, int total_data_size)
 {
-  int i, data_size, offset, nb_data_block, nb_index_block;
-  int *tab_data_block;
-  int *tab_index_block;
+  int i, data_size, offset, nb_extent;
+  struct fork_extent *tab_extent;
   unsigned char *data;
-  unsigned char data_block[BLOCK_SIZE];
 
   /** Memory Allocation **/
   data = (unsigned char *) calloc(1,total_data_size);
   if(data == NULL)
     return(NULL);
 
-  /* Liste des block du fichier */
-  tab_data_block = GetEntryBlock(current_image,type_entry,key_block,total_data_size,&nb_data_block,&tab_index_block,&nb_index_block);
-  if(tab_data_block == NULL)
-    return(NULL);
-
-  /** Récupération des données **/
-  for(i=0, offset=0; i<nb_data_block; i++)
+  /* Liste des suites de blocs du fichier */
+  tab_extent = GetEntryExtent(current_image,type_entry,key_block,total_data_size,&nb_extent);
+  if(tab_extent == NULL)
     {
-      /* Récupération des données du block (vide si le block = 0) */
-      if(tab_data_block[i] == 0)
-        memset(&data_block[0],0,512);
-      else
-        GetBlockData(current_image,tab_data_block[i],&data_block[0]);
+      free(data);
+      return(NULL);
+    }
 
-      /* Taille valide des Data de ce block (ajustement pour le dernier) */
-      data_size = (i==nb_data_block-1)?total_data_size-((nb_data_block-1)*BLOCK_SIZE):BLOCK_SIZE;
-      if(data_size > BLOCK_SIZE)
-        data_size = BLOCK_SIZE;
+  /** Récupération des données : une copie par suite de blocs (les trous restent à zéro) **/
+  for(i=0, offset=0; i<nb_extent && offset<total_data_size; i++)
+    {
+      data_size = tab_extent[i].nb_block*BLOCK_SIZE;
+      if(data_size > total_data_size-offset)
+        data_size = total_data_size-offset;
 
-      /* Place les données dans la structure */
-      memcpy(&data[offset],data_block,data_size);
+      if(tab_extent[i].block != 0)
+        memcpy(&data[offset],&current_image->image_data[tab_extent[i].block*BLOCK_SIZE],data_size);
       offset += data_size;
     }
 
   /* Libération mémoire */
-  free(tab_data_block);
-  if(tab_index_block)
-    free(tab_index_block);
+  free(tab_extent);
 
   /* Renvoi les data */
   return(data);
 }
 
 
-/****************************************************************/
-/*  GetEntryBlock() :  Renvoie la liste des blocs d'un fichier. */
-/****************************************************************/
-int *GetEntryBlock(struct prodos_image *current_image, int type_entry, int key_block, int total_data_size, int *nb_data_block_rtn, int **tab_index_block_rtn, int *nb_index_block_rtn)
+/*************************************************************************/
+/*  GetExtentFile() :  Localise les données d'un fichier dans l'image,   */
+/*                     sans les copier (suites de blocs data/resource).  */
+/*************************************************************************/
+int GetExtentFile(struct prodos_image *current_image, struct file_descriptive_entry *current_entry, struct prodos_file *current_file)
 {
-  int i, j, k, nb_data, nb_index, block_number, nb_data_block, nb_index_block;
-  int *tab_data_block;
-  int *tab_index_block;
-  unsigned char index_block[BLOCK_SIZE];
-  unsigned char master_block[BLOCK_SIZE];
-
-  /* Init */
-  *nb_data_block_rtn = 0;
-  *tab_index_block_rtn = NULL;
-  *nb_index_block_rtn = 0;
-  nb_index_block = 0;
-
-  /* Nombre de block théorique (Taille fichier / BLOCK_SIZE) */
-  nb_data_block = GetContainerNumber(total_data_size,BLOCK_SIZE);
-  if(nb_data_block == 0 && key_block !=0 && type_entry == TYPE_ENTRY_SEEDLING)
-    nb_data_block = 1;
+  int storage_type, data_storage_type, data_key_block, data_eof;
+  int resource_storage_type, resource_key_block, resource_eof;
+  unsigned char extended_block[BLOCK_SIZE];
 
-  /* Allocation mémoire : Nombre de block Index */
-  tab_index_block = (int *) calloc(256+1,sizeof(int));
-  if(tab_index_block == NULL)
-    {
-      logf_error("  Error : Impossible to allocate memory for 'tab_index_block' table.\n");
-      return(NULL);
-    }
+  storage_type = current_entry->storage_type & 0x0F;
 
-  /* Allocation mémoire : Nombre de block Data */
-  tab_data_block = (int *) calloc(nb_data_block+1,sizeof(int));
-  if(tab_data_block == NULL)
-    {
-      logf_error("  Error : Impossible to allocate memory for 'tab_data_block' table.\n");
-      free(tab_index_block);
-      return(NULL);
-    }
-  if(nb_data_block == 0)
+  /*** Seedling, Sapling, Tree : le type d'entrée est le storage type ***/
+  if(storage_type == TYPE_ENTRY_SEEDLING || storage_type == TYPE_ENTRY_SAPLING || storage_type == TYPE_ENTRY_TREE)
     {
-      *tab_index_block_rtn = tab_index_block;
-      return(tab_data_block);
+      current_file->tab_data_extent = GetEntryExtent(current_image,storage_type,current_entry->key_pointer_block,current_entry->eof_location,&current_file->nb_data_extent);
+      if(current_file->tab_data_extent == NULL)
+        return(1);
+      current_file->data_length = current_entry->eof_location;
     }
-
-  /*** Récupère les numero de Block valides ***/
-  if(type_entry == TYPE_ENTRY_SEEDLING)
-    tab_data_block[0] = key_block;
-  else if(type_entry == TYPE_ENTRY_SAPLING)
+  /*** Extended : Data + Resource Fork ***/
+  else if(storage_type == TYPE_ENTRY_EXTENDED)
     {
-      /** Index Block **/
-      GetBlockData(current_image,key_block,&index_block[0]);
-      tab_index_block[nb_index_block++] = key_block;
+      /** Extended Block **/
+      GetBlockData(current_image,current_entry->key_pointer_block,&extended_block[0]);
 
-      /** Extrait les numéros de Block **/
-      for(i=0,k=0; i<((nb_data_block>256)?256:nb_data_block); i++)
+      /** Data Fork : Mini Directory Entry **/
+      data_storage_type = GetByteValue(extended_block,0) & 0x0F;
+      data_key_block = GetWordValue(extended_block,1);
+      data_eof = extended_block[5] + 256*extended_block[5+1] + 65536*extended_block[5+2];
+      if(data_eof > 0)
+        {
+          current_file->data_length = data_eof;
+          if(data_storage_type == TYPE_ENTRY_SEEDLING || data_storage_type == TYPE_ENTRY_SAPLING || data_storage_type == TYPE_ENTRY_TREE)
+            current_file->tab_data_extent = GetEntryExtent(current_image,data_storage_type,data_key_block,data_eof,&current_file->nb_data_extent);
+          if(current_file->tab_data_extent == NULL)
+            return(1);
+        }
+
+      /** Resource Fork : Mini Directory Entry **/
+      resource_storage_type = GetByteValue(extended_block,256+0) & 0x0F;
+      resource_key_block = GetWordValue(extended_block,256+1);
+      resource_eof = extended_block[256+5] + 256*extended_block[256+5+1] + 65536*extended_block[256+5+2];
+
+      /* HFS Finder information */
+      memcpy(current_file->resource_finderinfo_1,&extended_block[8],18);
+      memcpy(current_file->resource_finderinfo_2,&extended_block[26],18);
+
+      if(resource_eof > 0)
+        {
+          current_file->resource_length = resource_eof;
+          if(resource_storage_type == TYPE_ENTRY_SEEDLING || resource_storage_type == TYPE_ENTRY_SAPLING || resource_storage_type == TYPE_ENTRY_TREE)
+            current_file->tab_resource_extent = GetEntryExtent(current_image,resource_storage_type,resource_key_block,resource_eof,&current_file->nb_resource_extent);
+          if(current_file->tab_resource_extent == NULL)
+            return(1);
+        }
+    }
+
+  /* OK */
+  return(0);
+}
+
+
+/****************************************************************************/
+/*  GetEntryExtent() :  Renvoie les suites de blocs contigus d'un fichier.  */
+/*                      Un bloc 0 (ou hors de l'image) est un trou : zéros. */
+/****************************************************************************/
+struct fork_extent *GetEntryExtent(struct prodos_image *current_image, int type_entry, int key_block, int total_data_size, int *nb_extent_rtn)
+{
+  int i, j, error, nb_data, nb_index, block_number, nb_data_block, nb_extent_max;
+  unsigned char *index_block;
+  unsigned char *master_block;
+  struct fork_extent *tab_extent;
+
+  /* Init */
+  *nb_extent_rtn = 0;
+  error = 0;
+
+  /* Nombre de block théorique (Taille fichier / BLOCK_SIZE) */
+  nb_data_block = GetContainerNumber(total_data_size,BLOCK_SIZE);
+  if(nb_data_block == 0 && key_block !=0 && type_entry == TYPE_ENTRY_SEEDLING)
+    nb_data_block = 1;
+
+  /* Allocation mémoire */
+  nb_extent_max = 16;
+  tab_extent = (struct fork_extent *) calloc(nb_extent_max,sizeof(struct fork_extent));
+  if(tab_extent == NULL)
+    {
+      logf_error("  Error : Impossible to allocate memory for 'tab_extent' table.\n");
+      return(NULL);
+    }
+  if(nb_data_block == 0)
+    return(tab_extent);
+
+  /*** Récupère les numero de Block valides ***/
+  if(type_entry == TYPE_ENTRY_SEEDLING)
+    error = AddEntryExtent(&tab_extent,nb_extent_rtn,&nb_extent_max,current_image->nb_block,key_block);
+  else if(type_entry == TYPE_ENTRY_SAPLING)
+    {
+      /** Index Block (lu en place) **/
+      index_block = GetImageBlock(current_image,key_block);
+
+      /** Extrait les numéros de Block (au delà de 256 : trous) **/
+      for(i=0; i<nb_data_block && error == 0; i++)
+        {
+          block_number = (index_block != NULL && i < INDEX_PER_BLOCK) ? index_block[i] + 256*index_block[BLOCK_SIZE/2+i] : 0;
+          error = AddEntryExtent(&tab_extent,nb_extent_rtn,&nb_extent_max,current_image->nb_block,block_number);
+        }
+    }
+  else if(type_entry == TYPE_ENTRY_TREE)
+    {
+      /** Master Index Block **/
+      master_block = GetImageBlock(current_image,key_block);
+
+      /* Nombre de Index Block pour ce fichier */
+      nb_index = GetContainerNumber(nb_data_block,INDEX_PER_BLOCK);
+
+      /** Récupère les numéros de Block **/
+      for(j=0; j<nb_index && error == 0; j++)
+        {
+          /** Index Block **/
+          block_number = (master_block != NULL) ? master_block[j] + 256*master_block[BLOCK_SIZE/2+j] : 0;
+          index_block = (block_number == 0) ? NULL : GetImageBlock(current_image,block_number);
+
+          /* Nombre de Data block dans cet Index Block */
+          nb_data = (j == nb_index-1) ? (nb_data_block - (nb_index-1)*INDEX_PER_BLOCK) : INDEX_PER_BLOCK;
+
+          /** Data Block de cet Index Block **/
+          for(i=0; i<nb_data && error == 0; i++)
+            {
+              block_number = (index_block != NULL) ? index_block[i] + 256*index_block[BLOCK_SIZE/2+i] : 0;
+              error = AddEntryExtent(&tab_extent,nb_extent_rtn,&nb_extent_max,current_image->nb_block,block_number);
+            }
+        }
+    }
+
+  /* Erreur d'allocation */
+  if(error)
+    {
+      logf_error("  Error : Impossible to allocate memory for 'tab_extent' table.\n");
+      free(tab_extent);
+      *nb_extent_rtn = 0;
+      return(NULL);
+    }
+
+  /* Renvoi le tableau */
+  return(tab_extent);
+}
+
+
+/********************************************************************/
+/*  AddEntryExtent() :  Ajoute un bloc, prolonge la dernière suite  */
+/*                      si il la continue.                          */
+/********************************************************************/
+static int AddEntryExtent(struct fork_extent **tab_extent, int *nb_extent, int *nb_extent_max, int nb_image_block, int block_number)
+{
+  struct fork_extent *last_extent;
+  struct fork_extent *new_tab_extent;
+
+  /* Hors de l'image : lu comme des zéros (cf GetBlockData) */
+  if(block_number >= nb_image_block)
+    block_number = 0;
+
+  /** Prolonge la suite précédente **/
+  if(*nb_extent > 0)
+    {
+      last_extent = &(*tab_extent)[*nb_extent-1];
+      if((block_number == 0 && last_extent->block == 0) ||
+         (block_number != 0 && last_extent->block != 0 && last_extent->block + last_extent->nb_block == block_number))
+        {
+          last_extent->nb_block++;
+          return(0);
+        }
+    }
+
+  /** Nouvelle suite **/
+  if(*nb_extent == *nb_extent_max)
+    {
+      new_tab_extent = (struct fork_extent *) realloc(*tab_extent,2*(*nb_extent_max)*sizeof(struct fork_extent));
+      if(new_tab_extent == NULL)
+        return(1);
+      *tab_extent = new_tab_extent;
+      *nb_extent_max *= 2;
+    }
+  (*tab_extent)[*nb_extent].block = block_number;
+  (*tab_extent)[*nb_extent].nb_block = 1;
+  (*nb_extent)++;
+
+  return(0);
+}
+
+
+/*********************************************************************/
+/*  GetImageBlock() :  Pointeur sur un bloc de l'image (NULL si hors */
+/*                     de l'image, GetBlockData le lirait à zéro).   */
+/*********************************************************************/
+static unsigned char *GetImageBlock(struct prodos_image *current_image, int block_number)
+{
+  if(block_number < 0 || block_number >= current_image->nb_block)
+    return(NULL);
+
+  return(&current_image->image_data[block_number*BLOCK_SIZE]);
+}
+
+
+/**********************************************************************/
+/*  CreateExtentFile() :  Ecrit un fork sur disque directement depuis */
+/*                        l'image, sans buffer intermédiaire.         */
+/**********************************************************************/
+int CreateExtentFile(char *file_path, struct prodos_image *current_image, int nb_extent, struct fork_extent *tab_extent, int length)
+{
+  int error;
+  FILE *fd;
+
+  /* Suppression du fichier */
+  os_DeleteFile(file_path);
+
+  /* Création du fichier */
+  fd = fopen(file_path,"wb");
+  if(fd == NULL)
+    return(1);
+
+  /** Ecriture des données **/
+  error = WriteExtentData(fd,current_image,nb_extent,tab_extent,length);
+  if(error)
+    {
+      fclose(fd);
+      return(2);
+    }
+
+  /* Fermeture du fichier */
+  fclose(fd);
+
+  /* OK */
+  return(0);
+}
+
+
+/*******************************************************************/
+/*  WriteExtentData() :  Ecrit un fork dans un fichier déjà ouvert, */
+/*                       une écriture par suite de blocs.          */
+/*******************************************************************/
+int WriteExtentData(FILE *fd, struct prodos_image *current_image, int nb_extent, struct fork_extent *tab_extent, int length)
+{
+  int i, data_size, hole_size, offset, nb_write;
+  static const unsigned char zero_block[BLOCK_SIZE];
+
+  /** Ecriture des données : une écriture par suite de blocs **/
+  for(i=0, offset=0; i<nb_extent && offset<length; i++)
+    {
+      data_size = tab_extent[i].nb_block*BLOCK_SIZE;
+      if(data_size > length-offset)
+        data_size = length-offset;
+
+      if(tab_extent[i].block != 0)
+        nb_write = (int) fwrite(&current_image->image_data[tab_extent[i].block*BLOCK_SIZE],1,data_size,fd);
+      else
+        for(nb_write=0; nb_write<data_size; nb_write+=hole_size)
+          {
+            hole_size = (data_size-nb_write > BLOCK_SIZE) ? BLOCK_SIZE : data_size-nb_write;
+            if((int) fwrite(zero_block,1,hole_size,fd) != hole_size)
+              break;
+          }
+      if(nb_write != data_size)
+        return(1);
+      offset += data_size;
+    }
+
+  /* OK */
+  return(0);
+}
+
+
+/****************************************************************/
+/*  GetEntryBlock() :  Renvoie la liste des blocs d'un fichier. */
+/****************************************************************/
+int *GetEntryBlock(struct prodos_image *current_image, int type_entry, int key_block, int total_data_size, int *nb_data_block_rtn, int **tab_index_block_rtn, int *nb_index_block_rtn)
+{
+  int i, j, k, nb_data, nb_index, block_number, nb_data_block, nb_index_block;
+  int *tab_data_block;
+  int *tab_index_block;
+  unsigned char index_block[BLOCK_SIZE];
+  unsigned char master_block[BLOCK_SIZE];
+
+  /* Init */
+  *nb_data_block_rtn = 0;
+  *tab_index_block_rtn = NULL;
+  *nb_index_block_rtn = 0;
+  nb_index_block = 0;
+
+  /* Nombre de block théorique (Taille fichier / BLOCK_SIZE) */
+  nb_data_block = GetContainerNumber(total_data_size,BLOCK_SIZE);
+  if(nb_data_block == 0 && key_block !=0 && type_entry == TYPE_ENTRY_SEEDLING)
+    nb_data_block = 1;
+
+  /* Allocation mémoire : Nombre de block Index */
+  tab_index_block = (int *) calloc(256+1,sizeof(int));
+  if(tab_index_block == NULL)
+    {
+      logf_error("  Error : Impossible to allocate memory for 'tab_index_block' table.\n");
+      return(NULL);
+    }
+
+  /* Allocation mémoire : Nombre de block Data */
+  tab_data_block = (int *) calloc(nb_data_block+1,sizeof(int));
+  if(tab_data_block == NULL)
+    {
+      logf_error("  Error : Impossible to allocate memory for 'tab_data_block' table.\n");
+      free(tab_index_block);
+      return(NULL);
+    }
+  if(nb_data_block == 0)
+    {
+      *tab_index_block_rtn = tab_index_block;
+      return(tab_data_block);
+    }
+
+  /*** Récupère les numero de Block valides ***/
+  if(type_entry == TYPE_ENTRY_SEEDLING)
+    tab_data_block[0] = key_block;
+  else if(type_entry == TYPE_ENTRY_SAPLING)
+    {
+      /** Index Block **/
+      GetBlockData(current_image,key_block,&index_block[0]);
+      tab_index_block[nb_index_block++] = key_block;
+
+      /** Extrait les numéros de Block **/
+      for(i=0,k=0; i<((nb_data_block>256)?256:nb_data_block); i++)
         tab_data_block[k++] = index_block[i] + 256*index_block[BLOCK_SIZE/2+i];
     }
   else if(type_entry == TYPE_ENTRY_TREE)
@@ -1959,13 +2579,10 @@ int *GetEntryBlock(struct prodos_image *current_image, int type_entry, int key_b
 /****************************************************************/
 int *AllocateImageBlock(struct prodos_image *current_image, int nb_block)
 {
-  int i, j, nb_free_block, first_free_block, nb_bitmap_block, modified, total_modified, offset;
+  int i, j, first_free_block, word_index;
   int *tab_block;
-  unsigned char mask;
-  unsigned char bitmap_block[BLOCK_SIZE];
 
-  /* Init */
-  first_free_block = 0;
+  STATS_ADD(STATS_ALLOCATE_CALL,1);
 
   /* Pas assez de place ! */
   if(current_image->nb_free_block < nb_block)
@@ -1982,26 +2599,9 @@ int *AllocateImageBlock(struct prodos_image *current_image, int nb_block)
       return(NULL);
     }
 
-  /** 1ère passe, on recherche les X blocs consécutifs **/
-  for(i=0,nb_free_block=0; i<=current_image->nb_block-nb_block; i++)
-    {
-      if(current_image->block_allocation_table[i] == 1)
-        {
-          if(nb_free_block == 0)
-            first_free_block = i;
-          nb_free_block++;
-          if(nb_free_block == nb_block)
-            break;
-        }
-      else
-        {
-          nb_free_block = 0;
-          first_free_block = 0;
-        }
-    }
-
-  /* On a trouvé ! */
-  if(first_free_block != 0)
+  /** 1ère passe, on recherche les X blocs consécutifs (index des zones libres) **/
+  first_free_block = FindFreeExtent(current_image,nb_block);
+  if(first_free_block > 0)
     {
       /* Blocs séquentiels */
       for(i=0; i<nb_block; i++)
@@ -2010,60 +2610,96 @@ int *AllocateImageBlock(struct prodos_image *current_image, int nb_block)
   else
     {
       /* On prend ce qui est disponible */
-        for(i=0,j=0; i<current_image->nb_block-nb_block; i++)
-          if(current_image->block_allocation_table[i] == 1)
-            {
-              tab_block[j++] = i;
-              if(j == nb_block)
-                break;
-            }
+      for(i=0,j=0; i<current_image->nb_bitmap_word && j<nb_block; i++)
+        if(current_image->block_allocation_table[i] != 0)
+          for(word_index=0; word_index<BITMAP_WORD_BIT && j<nb_block; word_index++)
+            if(IsImageBlockFree(current_image,i*BITMAP_WORD_BIT+word_index))
+              tab_block[j++] = i*BITMAP_WORD_BIT+word_index;
     }
 
   /**********************************************/
   /** On modifie la Table d'allocation mémoire **/
-  for(i=0; i<nb_block; i++)
-    current_image->block_allocation_table[tab_block[i]] = 0;
-  current_image->nb_free_block -= nb_block;
+  for(i=0, word_index=-1; i<nb_block; i++)
+    {
+      if(SetImageBlockFree(current_image,tab_block[i],0))
+        current_image->nb_free_block--;
+
+      /* Mise à jour de l'index des zones libres (1 fois par mot) */
+      if(tab_block[i]/BITMAP_WORD_BIT != word_index)
+        {
+          if(word_index != -1)
+            UpdateFreeExtentTree(current_image,word_index);
+          word_index = tab_block[i]/BITMAP_WORD_BIT;
+        }
+    }
+  if(word_index != -1)
+    UpdateFreeExtentTree(current_image,word_index);
 
   /****************************************************/
   /** Marque les blocs occupés dans la BitMap disque **/
-  nb_bitmap_block = GetContainerNumber(current_image->nb_block,BLOCK_SIZE*8);
-  total_modified = 0;
-  for(i=0; i<nb_bitmap_block; i++)
-    {
-      /* Bitmap block */
-      GetBlockData(current_image,current_image->volume_header->bitmap_block+i,&bitmap_block[0]);
-      modified = 0;
+  WriteBitmapBlock(current_image,nb_block,tab_block);
+  STATS_ADD(STATS_BLOCK_ALLOCATED,nb_block);
 
-      /** Passe en revue les blocs utilisés **/
-      for(j=0; j<nb_block; j++)
-        if((tab_block[j] >= i*8*BLOCK_SIZE) && (tab_block[j] < (i+1)*8*BLOCK_SIZE))
-          {
-            offset = tab_block[j] - i*8*BLOCK_SIZE;
-            mask = (0x01 << (7-(offset%8)));
-            if((bitmap_block[offset/8] | mask) == bitmap_block[offset/8])
-              {
-                bitmap_block[offset/8] -= mask;    /* 0 : Occupé */
-                modified = 1;
-                total_modified++;
-              }
+  /* OK */
+  return(tab_block);
+}
 
-            /* Pas besoin de tout parcourir */
-            if(total_modified == nb_block)
-              break;
+
+/************************************************************/
+/*  FreeImageBlock() :  Libère X block dans l'image Prodos. */
+/************************************************************/
+void FreeImageBlock(struct prodos_image *current_image, int nb_block, int *tab_block)
+{
+  int i, word_index;
+
+  /** On modifie la Table d'allocation mémoire **/
+  for(i=0, word_index=-1; i<nb_block; i++)
+    if(SetImageBlockFree(current_image,tab_block[i],1))
+      {
+        current_image->nb_free_block++;
+
+        /* Mise à jour de l'index des zones libres (1 fois par mot si les blocs sont triés) */
+        if(tab_block[i]/BITMAP_WORD_BIT != word_index)
+          {
+            if(word_index != -1)
+              UpdateFreeExtentTree(current_image,word_index);
+            word_index = tab_block[i]/BITMAP_WORD_BIT;
           }
+      }
+  if(word_index != -1)
+    UpdateFreeExtentTree(current_image,word_index);
 
-      /* Modifie le block Bitmap */
-      if(modified)
-        SetBlockData(current_image,current_image->volume_header->bitmap_block+i,&bitmap_block[0]);
+  /** Marque les blocs libres dans la BitMap disque **/
+  WriteBitmapBlock(current_image,nb_block,tab_block);
+}
 
-      /* Pas besoin de tout parcourir */
-      if(total_modified == nb_block)
-        break;
-    }
 
-  /* OK */
-  return(tab_block);
+/**************************************************************************/
+/*  ResetImageBitmap() :  Tous les blocs à partir de X deviennent libres. */
+/**************************************************************************/
+void ResetImageBitmap(struct prodos_image *current_image, int first_free_block)
+{
+  int i, nb_bitmap_block;
+  unsigned char bitmap_block[BLOCK_SIZE];
+
+  /** Bitmap mémoire **/
+  memset(current_image->block_allocation_table,0,current_image->nb_bitmap_word*sizeof(uint64_t));
+  for(i=first_free_block; i<current_image->nb_block; i++)
+    current_image->block_allocation_table[i/BITMAP_WORD_BIT] |= ((uint64_t) 1) << (i%BITMAP_WORD_BIT);
+  current_image->nb_free_block = current_image->nb_block - first_free_block;
+  BuildFreeExtentTree(current_image);
+
+  /** Bitmap disque : on ré-écrit tous les blocks **/
+  nb_bitmap_block = GetContainerNumber(current_image->nb_block,BLOCK_SIZE*8);
+  for(i=0; i<nb_bitmap_block*BLOCK_SIZE*8; i++)
+    {
+      if(i % (BLOCK_SIZE*8) == 0)
+        memset(bitmap_block,0,BLOCK_SIZE);
+      if(IsImageBlockFree(current_image,i))
+        bitmap_block[(i%(BLOCK_SIZE*8))/8] |= (0x01 << (7-(i%8)));
+      if(i % (BLOCK_SIZE*8) == BLOCK_SIZE*8-1)
+        SetMetadataBlockData(current_image,current_image->volume_header->bitmap_block+i/(BLOCK_SIZE*8),&bitmap_block[0]);
+    }
 }
 
 
@@ -2072,55 +2708,29 @@ int *AllocateImageBlock(struct prodos_image *current_image, int nb_block)
 /******************************************************************************************************/
 int AllocateFolderEntry(struct prodos_image *current_image, struct file_descriptive_entry *folder_entry, WORD *directory_block_number_rtn, BYTE *directory_entry_number_rtn, WORD *header_block_number_rtn)
 {
-  int i, j, offset, nb_entry, entry_length, block_used, eof;
-  int current_block_number, previous_block_number, next_block_number, new_block_number, parent_directory_block_number;
+  int offset, block_used, eof, directory_block_number, directory_entry_number;
+  int previous_block_number, new_block_number, parent_directory_block_number;
   int *tab_block;
-  unsigned char storage_type;
+  struct folder_slot *free_slot;
   unsigned char directory_block[BLOCK_SIZE];
 
-  /*** Charge les blocs de ce Dossier ***/
-  current_block_number = (folder_entry == NULL) ? 2 : folder_entry->key_pointer_block;   /* Bloc 2 pour la racine du Volume */
-  *header_block_number_rtn = current_block_number;
-
-  /* Lecture du 1er block de ce Directory ou du volume */
-  GetBlockData(current_image,current_block_number,&directory_block[0]);
-
-  /* Nombre d'entrées */
-  entry_length = (int) directory_block[(folder_entry == NULL) ? VOLUME_ENTRYLENGTH_OFFSET : DIRECTORY_ENTRYLENGTH_OFFSET];       /* 0x27 */
-  nb_entry = (int) directory_block[(folder_entry == NULL) ? VOLUME_ENTRIESPERBLOCK_OFFSET : DIRECTORY_ENTRIESPERBLOCK_OFFSET];   /* 0x0D */
+  /* Bloc 2 pour la racine du Volume */
+  *header_block_number_rtn = (folder_entry == NULL) ? 2 : folder_entry->key_pointer_block;
 
-  /** On va passer en revue tous les block de ce Directory **/
-  for(i=0; current_block_number != 0; i++)
+  /*** Entrées libres de ce Dossier (relevées au chargement, sinon au 1er ajout) ***/
+  free_slot = GetFolderSlot(current_image,folder_entry);
+  if(free_slot == NULL)
     {
-      /* Récupère les données du bloc */
-      if(i > 0)
-        GetBlockData(current_image,current_block_number,&directory_block[0]); /* Le 1er bloc a déjà été récupéré */
-      previous_block_number = GetWordValue(directory_block,0);
-      next_block_number = GetWordValue(directory_block,2);
-
-      /* Recherche une entrée effacée */
-      for(j=0; j<nb_entry; j++)
-        {
-          /* Header */
-          if(j == 0 && i == 0)
-            continue;
-
-          /* Début de l'entrée */
-          offset = 4 + j*entry_length;
-
-          /* Entrée vide ? */
-          storage_type = directory_block[offset+FILE_STORAGETYPE_OFFSET];
-          if(storage_type == 0x00)
-            {
-              *directory_block_number_rtn = (WORD) current_block_number;
-              *directory_entry_number_rtn = (BYTE) j+1;
-              return(0);
-            }
-        }
+      logf_error("  Error : Impossible to allocate memory.\n");
+      return(1);
+    }
 
-      /* Bloc suivant */
-      previous_block_number = current_block_number;
-      current_block_number = next_block_number;
+  /** 1ère entrée effacée dans l'ordre des blocs **/
+  if(FindFolderSlot(current_image,free_slot,&directory_block_number,&directory_entry_number) == 0)
+    {
+      *directory_block_number_rtn = (WORD) directory_block_number;
+      *directory_entry_number_rtn = (BYTE) directory_entry_number;
+      return(0);
     }
 
   /*** On va allouer un bloc de plus à ce Dossier ***/
@@ -2138,14 +2748,16 @@ int AllocateFolderEntry(struct prodos_image *current_image, struct file_descript
   new_block_number = tab_block[0];
   free(tab_block);
 
-  /** Next : Modifie le bloc précédent **/
+  /** Next : Modifie le dernier bloc du Dossier **/
+  previous_block_number = free_slot->tab_block[free_slot->nb_block-1];
+  GetBlockData(current_image,previous_block_number,&directory_block[0]);
   SetWordValue(&directory_block[0],0x02,(WORD)new_block_number);     /* current->next = new */
-  SetBlockData(current_image,previous_block_number,&directory_block[0]);
+  SetMetadataBlockData(current_image,previous_block_number,&directory_block[0]);
 
   /** Previous : Attache le bloc au Dossier **/
   memset(&directory_block[0],0,BLOCK_SIZE);
   SetWordValue(&directory_block[0],0x00,(WORD)previous_block_number); /* new->previous = current */
-  SetBlockData(current_image,new_block_number,&directory_block[0]);
+  SetMetadataBlockData(current_image,new_block_number,&directory_block[0]);
 
   /** Met à jour BlockUsed dans l'entrée décrivant le Dossier **/
   parent_directory_block_number = folder_entry->block_location;
@@ -2163,7 +2775,23 @@ int AllocateFolderEntry(struct prodos_image *current_image, struct file_descript
   Set24bitValue(&directory_block[0],offset+0x15,eof);
 
   /* Enregistre le Bloc */
-  SetBlockData(current_image,parent_directory_block_number,&directory_block[0]);
+  SetMetadataBlockData(current_image,parent_directory_block_number,&directory_block[0]);
+
+  /** L'entrée en mémoire doit connaître ce bloc (DELETEFOLDER ou CHECKVOLUME dans le même processus) **/
+  tab_block = (int *) mem_alloc_arena((folder_entry->nb_used_block+1)*sizeof(int));
+  if(tab_block != NULL)
+    {
+      if(folder_entry->nb_used_block > 0)
+        memcpy(tab_block,folder_entry->tab_used_block,folder_entry->nb_used_block*sizeof(int));
+      folder_entry->tab_used_block = tab_block;
+      folder_entry->tab_used_block[folder_entry->nb_used_block++] = new_block_number;
+    }
+  folder_entry->blocks_used = block_used;
+  folder_entry->eof_location = eof;
+
+  /* Toutes ses entrées sont libres, la 1ère est rendue ici */
+  memset(&directory_block[0],0,BLOCK_SIZE);
+  AddFolderSlotBlock(free_slot,new_block_number,&directory_block[0]);
 
   /* Ok */
   *directory_block_number_rtn = (WORD) new_block_number;
@@ -2172,6 +2800,172 @@ int AllocateFolderEntry(struct prodos_image *current_image, struct file_descript
 }
 
 
+/*******************************************************************************/
+/*  NewFolderSlot() :  Liste vide des entrées libres d'un répertoire, selon la */
+/*                     taille des entrées indiquée par son bloc clé.           */
+/*******************************************************************************/
+static struct folder_slot *NewFolderSlot(unsigned char *key_block_data, int is_volume)
+{
+  struct folder_slot *free_slot;
+
+  free_slot = (struct folder_slot *) mem_alloc_arena(sizeof(struct folder_slot));
+  if(free_slot == NULL)
+    return(NULL);
+
+  free_slot->entry_length = key_block_data[is_volume ? VOLUME_ENTRYLENGTH_OFFSET : DIRECTORY_ENTRYLENGTH_OFFSET];          /* 0x27 */
+  free_slot->entries_per_block = key_block_data[is_volume ? VOLUME_ENTRIESPERBLOCK_OFFSET : DIRECTORY_ENTRIESPERBLOCK_OFFSET];  /* 0x0D */
+
+  /* Valeurs hors norme : les entrées restent dans le bloc et dans le masque */
+  if(free_slot->entry_length == 0)
+    free_slot->entry_length = 0x27;
+  if(4 + free_slot->entries_per_block*free_slot->entry_length > BLOCK_SIZE)
+    free_slot->entries_per_block = (BLOCK_SIZE-4)/free_slot->entry_length;
+  if(free_slot->entries_per_block > FOLDER_SLOT_MAX_ENTRY)
+    free_slot->entries_per_block = FOLDER_SLOT_MAX_ENTRY;
+
+  return(free_slot);
+}
+
+
+/*****************************************************************************/
+/*  AddFolderSlotBlock() :  Ajoute le bloc suivant du répertoire et relève   */
+/*                          ses entrées effacées (header exclu du bloc clé). */
+/*****************************************************************************/
+static int AddFolderSlotBlock(struct folder_slot *free_slot, int block_number, unsigned char *block_data)
+{
+  int j, nb_block_max;
+  int *tab_block;
+  uint32_t free_mask, *tab_free;
+
+  /** Agrandit les tables (dans l'arène, les anciennes y restent) **/
+  if(free_slot->nb_block == free_slot->nb_block_max)
+    {
+      nb_block_max = (free_slot->nb_block_max == 0) ? FOLDER_SLOT_MIN_BLOCK : 2*free_slot->nb_block_max;
+      tab_block = (int *) mem_alloc_arena(nb_block_max*sizeof(int));
+      tab_free = (uint32_t *) mem_alloc_arena(nb_block_max*sizeof(uint32_t));
+      if(tab_block == NULL || tab_free == NULL)
+        return(1);
+      if(free_slot->nb_block > 0)
+        {
+          memcpy(tab_block,free_slot->tab_block,free_slot->nb_block*sizeof(int));
+          memcpy(tab_free,free_slot->tab_free,free_slot->nb_block*sizeof(uint32_t));
+        }
+      free_slot->tab_block = tab_block;
+      free_slot->tab_free = tab_free;
+      free_slot->nb_block_max = nb_block_max;
+    }
+
+  /** Entrées effacées de ce bloc **/
+  for(j=(free_slot->nb_block == 0) ? 1 : 0, free_mask=0; j<free_slot->entries_per_block; j++)
+    if(block_data[4+j*free_slot->entry_length+FILE_STORAGETYPE_OFFSET] == 0x00)
+      free_mask |= (uint32_t) 1 << j;
+
+  free_slot->tab_block[free_slot->nb_block] = block_number;
+  free_slot->tab_free[free_slot->nb_block] = free_mask;
+  free_slot->nb_block++;
+
+  return(0);
+}
+
+
+/****************************************************************************/
+/*  GetFolderSlot() :  Entrées libres d'un répertoire, relevées en suivant  */
+/*                     la chaîne de ses blocs si ce n'est pas déjà fait.    */
+/****************************************************************************/
+static struct folder_slot *GetFolderSlot(struct prodos_image *current_image, struct file_descriptive_entry *folder_entry)
+{
+  int nb_block, block_number;
+  unsigned char *block_data;
+  struct folder_slot **free_slot_ptr;
+
+  free_slot_ptr = (folder_entry == NULL) ? &current_image->free_slot : &folder_entry->free_slot;
+  if(*free_slot_ptr != NULL)
+    return(*free_slot_ptr);
+
+  /** Bloc clé : taille des entrées **/
+  block_number = (folder_entry == NULL) ? 2 : folder_entry->key_pointer_block;
+  block_data = GetImageBlock(current_image,block_number);
+  if(block_data == NULL)
+    return(NULL);
+  *free_slot_ptr = NewFolderSlot(block_data,(folder_entry == NULL));
+  if(*free_slot_ptr == NULL)
+    return(NULL);
+
+  /** Tous les blocs de la chaîne (bornée : une chaîne corrompue peut boucler) **/
+  for(nb_block=0; block_data != NULL && nb_block<current_image->nb_block; nb_block++)
+    {
+      if(AddFolderSlotBlock(*free_slot_ptr,block_number,block_data))
+        {
+          *free_slot_ptr = NULL;
+          return(NULL);
+        }
+      block_number = GetWordValue(block_data,2);
+      block_data = (block_number == 0) ? NULL : GetImageBlock(current_image,block_number);
+    }
+
+  return(*free_slot_ptr);
+}
+
+
+/*****************************************************************************/
+/*  FindFolderSlot() :  1ère entrée effacée du répertoire. Les candidates    */
+/*                      occupées depuis (ajout, renommage) sont retirées.    */
+/*****************************************************************************/
+static int FindFolderSlot(struct prodos_image *current_image, struct folder_slot *free_slot, int *block_number_rtn, int *entry_number_rtn)
+{
+  int i, j;
+  unsigned char *block_data;
+
+  for(; free_slot->first_free < free_slot->nb_block; free_slot->first_free++)
+    {
+      i = free_slot->first_free;
+      block_data = GetImageBlock(current_image,free_slot->tab_block[i]);
+      while(free_slot->tab_free[i] != 0)
+        {
+          /* Plus petit bit à 1 */
+          for(j=0; (free_slot->tab_free[i] & ((uint32_t) 1 << j)) == 0; j++)
+            ;
+
+          /* Toujours effacée dans l'image ? (l'entrée rendue reste candidate tant qu'elle n'est pas écrite) */
+          if(block_data != NULL && block_data[4+j*free_slot->entry_length+FILE_STORAGETYPE_OFFSET] == 0x00)
+            {
+              *block_number_rtn = free_slot->tab_block[i];
+              *entry_number_rtn = j+1;
+              return(0);
+            }
+          free_slot->tab_free[i] &= ~((uint32_t) 1 << j);
+        }
+    }
+
+  /* Répertoire plein */
+  return(1);
+}
+
+
+/*************************************************************************/
+/*  ReleaseFolderSlot() :  L'entrée retirée du répertoire redevient une  */
+/*                         candidate pour FindFolderSlot.                */
+/*************************************************************************/
+static void ReleaseFolderSlot(struct folder_slot *free_slot, int block_number, int entry_offset)
+{
+  int i, j;
+
+  j = (entry_offset-4)/free_slot->entry_length;
+  if(entry_offset < 4 || j >= free_slot->entries_per_block)
+    return;
+
+  /* Les ajouts se font en fin de répertoire : on cherche depuis la fin */
+  for(i=free_slot->nb_block-1; i>=0; i--)
+    if(free_slot->tab_block[i] == block_number)
+      {
+        free_slot->tab_free[i] |= (uint32_t) 1 << j;
+        if(i < free_slot->first_free)
+          free_slot->first_free = i;
+        return;
+      }
+}
+
+
 /**************************************************************/
 /*  CheckProdosName() :  Vérifie si un nom Prodos est valide. */
 /**************************************************************/
@@ -2208,6 +3002,7 @@ void GetCurrentDate(WORD *now_date_rtn, WORD *now_time_rtn)
 {
   time_t clock;
   struct tm source_date_epoch_tm;
+  struct tm now_tm;
   struct tm *p;
   WORD now_date, now_time;
   WORD year, month, day;
@@ -2221,7 +3016,11 @@ void GetCurrentDate(WORD *now_date_rtn, WORD *now_time_rtn)
   } else {
     /* Récupère l'heure actuelle */
     time(&clock);
-    p = localtime(&clock);
+#ifdef BUILD_POSIX
+    p = localtime_r(&clock,&now_tm);
+#else
+    p = localtime(&clock);   /* Buffer propre à chaque thread sous Win32 */
+#endif
   }
   year = (WORD) p->tm_year;
   if(year > 100)
@@ -2248,7 +3047,7 @@ void GetCurrentDate(WORD *now_date_rtn, WORD *now_time_rtn)
 /***********************************************************/
 int UpdateEntryTable(int action, int *nb_entry_rtn, struct file_descriptive_entry ***tab_entry_rtn, struct file_descriptive_entry *current_entry)
 {
-  int i, nb_entry;
+  int i, nb_entry, first, last, middle;
   struct file_descriptive_entry **tab_entry;
   struct file_descriptive_entry **tab_new;
 
@@ -2259,21 +3058,30 @@ int UpdateEntryTable(int action, int *nb_entry_rtn, struct file_descriptive_entr
   /** On ajoute une entrée de la table **/
   if(action == UPDATE_ADD)
     {
-      /* Allocation mémoire de la nouvelle table */
-      tab_new = (struct file_descriptive_entry **) calloc(nb_entry+1,sizeof(struct file_descriptive_entry *));
-      if(tab_new == NULL)
-        return(1);
-
-      /* Met les valeurs */
-      for(i=0; i<nb_entry; i++)
-        tab_new[i] = tab_entry[i];
-      tab_new[i] = current_entry;
+      /* Agrandit la table (capacité doublée dans l'arène, cf GetEntryTableSize) */
+      tab_new = tab_entry;
+      if(nb_entry+1 > GetEntryTableSize(nb_entry))
+        {
+          tab_new = (struct file_descriptive_entry **) mem_alloc_arena(GetEntryTableSize(nb_entry+1)*sizeof(struct file_descriptive_entry *));
+          if(tab_new == NULL)
+            return(1);
+          if(nb_entry > 0)
+            memcpy(tab_new,tab_entry,nb_entry*sizeof(struct file_descriptive_entry *));
+        }
 
-      /* Tri */
-      qsort(tab_new,nb_entry+1,sizeof(struct file_descriptive_entry *),compare_entry);
+      /* Recherche dichotomique de la place (la table est triée) */
+      for(first=0,last=nb_entry; first<last; )
+        {
+          middle = (first+last)/2;
+          if(compare_entry(&tab_new[middle],&current_entry) <= 0)
+            first = middle+1;
+          else
+            last = middle;
+        }
 
-      /* Libération de l'ancienne table */
-      free(tab_entry);
+      /* Insère l'entrée */
+      memmove(&tab_new[first+1],&tab_new[first],(nb_entry-first)*sizeof(struct file_descriptive_entry *));
+      tab_new[first] = current_entry;
 
       /* Renvoi la nouvelle */
       *tab_entry_rtn = tab_new;
@@ -2322,6 +3130,243 @@ int UpdateEntryTable(int action, int *nb_entry_rtn, struct file_descriptive_entr
 }
 
 
+/**********************************************************************************/
+/*  GetEntryTableSize() :  Capacité allouée pour une table de nb_entry entrées :  */
+/*                         puissance de 2 : la table n'est recopiée dans l'arène  */
+/*                         que lorsque nb_entry dépasse une puissance de 2.       */
+/**********************************************************************************/
+static int GetEntryTableSize(int nb_entry)
+{
+  int nb_entry_max;
+
+  if(nb_entry <= 0)
+    return(0);
+
+  for(nb_entry_max=4; nb_entry_max<nb_entry; nb_entry_max*=2)
+    ;
+
+  return(nb_entry_max);
+}
+
+
+/*****************************************************************************/
+/*  FindFolderEntry() :  Recherche un nom dans un répertoire (ou la racine). */
+/*****************************************************************************/
+struct file_descriptive_entry *FindFolderEntry(struct prodos_image *current_image, struct file_descriptive_entry *folder_entry, char *name)
+{
+  int slot, mask;
+  struct name_index **name_index_ptr;
+  struct name_index *name_index;
+
+  /* Décode le répertoire si besoin */
+  LoadFolderEntries(current_image,folder_entry);
+
+  /** Construit l'index à la première recherche **/
+  name_index_ptr = (folder_entry == NULL) ? &current_image->name_index : &folder_entry->name_index;
+  if(*name_index_ptr == NULL)
+    {
+      if(folder_entry == NULL)
+        *name_index_ptr = BuildNameIndex(current_image->nb_file,current_image->tab_file,current_image->nb_directory,current_image->tab_directory);
+      else
+        *name_index_ptr = BuildNameIndex(folder_entry->nb_file,folder_entry->tab_file,folder_entry->nb_directory,folder_entry->tab_directory);
+      if(*name_index_ptr == NULL)
+        {
+          logf_error("  Error : Impossible to allocate memory.\n");
+          return(NULL);
+        }
+    }
+  name_index = *name_index_ptr;
+  if(name_index->nb_entry == 0)
+    return(NULL);
+
+  /** Sondage linéaire à partir du hash du nom **/
+  mask = name_index->nb_slot - 1;
+  for(slot=HashEntryName(name)&mask; name_index->tab_slot[slot] != NULL; slot=(slot+1)&mask)
+    if(!my_stricmp(name_index->tab_slot[slot]->file_name,name))
+      return(name_index->tab_slot[slot]);
+
+  /* Pas trouvé */
+  return(NULL);
+}
+
+
+/********************************************************************************/
+/*  UpdateFolderEntry() :  Ajoute/Retire une entrée d'un répertoire en mémoire. */
+/********************************************************************************/
+int UpdateFolderEntry(struct prodos_image *current_image, struct file_descriptive_entry *folder_entry, int action, struct file_descriptive_entry *current_entry)
+{
+  int error, is_directory;
+  int *nb_entry;
+  struct file_descriptive_entry ***tab_entry;
+  struct name_index **name_index_ptr;
+  struct folder_slot *free_slot;
+
+  /** Table des fichiers ou des dossiers du répertoire **/
+  is_directory = ((current_entry->storage_type & 0x0F) == 0x0D);
+  if(folder_entry == NULL)
+    {
+      nb_entry = is_directory ? &current_image->nb_directory : &current_image->nb_file;
+      tab_entry = is_directory ? &current_image->tab_directory : &current_image->tab_file;
+      name_index_ptr = &current_image->name_index;
+      free_slot = current_image->free_slot;
+    }
+  else
+    {
+      nb_entry = is_directory ? &folder_entry->nb_directory : &folder_entry->nb_file;
+      tab_entry = is_directory ? &folder_entry->tab_directory : &folder_entry->tab_file;
+      name_index_ptr = &folder_entry->name_index;
+      free_slot = (folder_entry->delete_folder_depth == 0) ? folder_entry->free_slot : NULL;   /* Dossier supprimé ensuite */
+    }
+
+  /* Met à jour la table triée */
+  error = UpdateEntryTable(action,nb_entry,tab_entry,current_entry);
+  if(error)
+    return(1);
+
+  /** L'entrée retirée (suppression, déplacement) libère sa place dans le répertoire **/
+  if(action == UPDATE_REMOVE && free_slot != NULL)
+    ReleaseFolderSlot(free_slot,current_entry->block_location,current_entry->entry_offset);
+
+  /** Met à jour l'index des noms (s'il a déjà été construit) **/
+  if(*name_index_ptr == NULL)
+    return(0);
+  if(action == UPDATE_ADD)
+    {
+      error = AddNameIndex(*name_index_ptr,current_entry);
+      if(error)
+        {
+          /* Il sera reconstruit à la prochaine recherche */
+          mem_free_name_index(*name_index_ptr);
+          *name_index_ptr = NULL;
+        }
+    }
+  else
+    RemoveNameIndex(*name_index_ptr,current_entry);
+
+  /* OK */
+  return(0);
+}
+
+
+/********************************************************************/
+/*  HashEntryName() :  Hash d'un nom Prodos, insensible à la casse. */
+/********************************************************************/
+static unsigned int HashEntryName(char *name)
+{
+  unsigned int hash = 2166136261u;
+
+  /* FNV-1a sur le nom en majuscule */
+  for(; *name != '\0'; name++)
+    hash = (hash ^ (unsigned char) toupper((unsigned char) *name)) * 16777619u;
+
+  return(hash);
+}
+
+
+/********************************************************************/
+/*  BuildNameIndex() :  Construit l'index des noms d'un répertoire. */
+/********************************************************************/
+static struct name_index *BuildNameIndex(int nb_file, struct file_descriptive_entry **tab_file, int nb_directory, struct file_descriptive_entry **tab_directory)
+{
+  int i, error;
+  struct name_index *name_index;
+
+  /* Allocation mémoire */
+  name_index = (struct name_index *) calloc(1,sizeof(struct name_index));
+  if(name_index == NULL)
+    return(NULL);
+
+  /** Fichiers et dossiers partagent le même espace de noms **/
+  for(i=0, error=0; i<nb_file && error == 0; i++)
+    error = AddNameIndex(name_index,tab_file[i]);
+  for(i=0; i<nb_directory && error == 0; i++)
+    error = AddNameIndex(name_index,tab_directory[i]);
+  if(error)
+    {
+      mem_free_name_index(name_index);
+      return(NULL);
+    }
+
+  /* Renvoie l'index */
+  return(name_index);
+}
+
+
+/***************************************************************/
+/*  AddNameIndex() :  Ajoute une entrée dans l'index des noms. */
+/***************************************************************/
+static int AddNameIndex(struct name_index *name_index, struct file_descriptive_entry *current_entry)
+{
+  int i, slot, mask, nb_slot;
+  struct file_descriptive_entry **tab_slot;
+
+  /** Agrandit la table pour rester au plus à moitié pleine **/
+  if(2*(name_index->nb_entry+1) > name_index->nb_slot)
+    {
+      nb_slot = (name_index->nb_slot == 0) ? NAME_INDEX_MIN_SLOT : 2*name_index->nb_slot;
+      tab_slot = (struct file_descriptive_entry **) calloc(nb_slot,sizeof(struct file_descriptive_entry *));
+      if(tab_slot == NULL)
+        return(1);
+
+      /* Replace les entrées existantes */
+      mask = nb_slot - 1;
+      for(i=0; i<name_index->nb_slot; i++)
+        if(name_index->tab_slot[i] != NULL)
+          {
+            for(slot=HashEntryName(name_index->tab_slot[i]->file_name)&mask; tab_slot[slot] != NULL; slot=(slot+1)&mask)
+              ;
+            tab_slot[slot] = name_index->tab_slot[i];
+          }
+
+      if(name_index->tab_slot)
+        free(name_index->tab_slot);
+      name_index->tab_slot = tab_slot;
+      name_index->nb_slot = nb_slot;
+    }
+
+  /** Place l'entrée dans la 1ère case libre **/
+  mask = name_index->nb_slot - 1;
+  for(slot=HashEntryName(current_entry->file_name)&mask; name_index->tab_slot[slot] != NULL; slot=(slot+1)&mask)
+    ;
+  name_index->tab_slot[slot] = current_entry;
+  name_index->nb_entry++;
+
+  /* OK */
+  return(0);
+}
+
+
+/****************************************************************/
+/*  RemoveNameIndex() :  Retire une entrée de l'index des noms. */
+/****************************************************************/
+static void RemoveNameIndex(struct name_index *name_index, struct file_descriptive_entry *current_entry)
+{
+  int slot, next, home, mask;
+
+  if(name_index->nb_entry == 0)
+    return;
+
+  /* Recherche la case de l'entrée */
+  mask = name_index->nb_slot - 1;
+  for(slot=HashEntryName(current_entry->file_name)&mask; name_index->tab_slot[slot] != current_entry; slot=(slot+1)&mask)
+    if(name_index->tab_slot[slot] == NULL)
+      return;
+
+  /** Remonte les entrées suivantes de la chaîne pour ne pas laisser de trou **/
+  for(next=(slot+1)&mask; name_index->tab_slot[next] != NULL; next=(next+1)&mask)
+    {
+      /* Une entrée peut remonter si sa case d'origine n'est pas dans ]slot,next] */
+      home = HashEntryName(name_index->tab_slot[next]->file_name)&mask;
+      if((slot < next) ? (home <= slot || home > next) : (home <= slot && home > next))
+        {
+          name_index->tab_slot[slot] = name_index->tab_slot[next];
+          slot = next;
+        }
+    }
+  name_index->tab_slot[slot] = NULL;
+  name_index->nb_entry--;
+}
+
 /****************************************************************************************/
 /*  mem_free_subdirectory() :  Libération mémoire de la structure sub_directory_header. */
 /****************************************************************************************/
@@ -2334,6 +3379,20 @@ static void mem_free_subdirectory(struct sub_directory_header *directory_header)
 }
 
 
+/****************************************************************************/
+/*  mem_free_name_index() :  Libération mémoire de la structure name_index. */
+/****************************************************************************/
+static void mem_free_name_index(struct name_index *name_index)
+{
+  if(name_index)
+    {
+      if(name_index->tab_slot)
+        free(name_index->tab_slot);
+
+      free(name_index);
+    }
+}
+
 /*************************************************************************/
 /*  mem_free_image() :  Libération mémoire de la structure prodos_image. */
 /*************************************************************************/
@@ -2344,12 +3403,30 @@ void mem_free_image(struct prodos_image *current_image)
       if(current_image->image_file_path)
         free(current_image->image_file_path);
 
+      mem_free_cache(current_image->image_cache);
+
+      if(current_image->image_file_data)
+        {
+          if(current_image->image_mapped == 1)
+            os_UnmapFile(current_image->image_file_data,current_image->image_file_length);
+          else
+            free(current_image->image_file_data);
+        }
+
       if(current_image->block_modified)
         free(current_image->block_modified);
 
+      if(current_image->tab_dirty_run)
+        free(current_image->tab_dirty_run);
+
       if(current_image->block_allocation_table)
         free(current_image->block_allocation_table);
 
+      if(current_image->free_extent_tree)
+        free(current_image->free_extent_tree);
+
+      mem_free_name_index(current_image->name_index);
+
       if(current_image->block_usage_type)
         free(current_image->block_usage_type);
 
@@ -2368,19 +3445,9 @@ void mem_free_entry(struct file_descriptive_entry *current_entry)
 {
   if(current_entry)
     {
-      if(current_entry->file_path)
-        free(current_entry->file_path);
-
-      if(current_entry->tab_file)
-        free(current_entry->tab_file);
-
-      if(current_entry->tab_directory)
-        free(current_entry->tab_directory);
-
-      if(current_entry->tab_used_block)
-        free(current_entry->tab_used_block);
-
-      free(current_entry);
+      /* L'entrée, ses tables et sa liste de blocs sont dans l'arène (MEMORY_FREE) */
+      mem_free_name_index(current_entry->name_index);
+      current_entry->name_index = NULL;
     }
 }
 
@@ -2392,11 +3459,22 @@ void mem_free_file(struct prodos_file *current_file)
 {
   if(current_file)
     {
-      if(current_file->data)
-        free(current_file->data);
+      /* Data et Resource sont dans le fichier AppleSingle */
+      if(current_file->input_file_data)
+        {
+          if(current_file->input_mapped == 1)
+            os_UnmapFile(current_file->input_file_data,current_file->input_file_length);
+          else
+            free(current_file->input_file_data);
+        }
+      else
+        {
+          if(current_file->data)
+            free(current_file->data);
 
-      if(current_file->resource)
-        free(current_file->resource);
+          if(current_file->resource)
+            free(current_file->resource);
+        }
 
       if(current_file->file_name)
         free(current_file->file_name);
@@ -2410,6 +3488,18 @@ void mem_free_file(struct prodos_file *current_file)
       if(current_file->tab_resource_block)
         free(current_file->tab_resource_block);
 
+      if(current_file->data_fd)
+        fclose(current_file->data_fd);
+
+      if(current_file->resource_fd)
+        fclose(current_file->resource_fd);
+
+      if(current_file->tab_data_extent)
+        free(current_file->tab_data_extent);
+
+      if(current_file->tab_resource_extent)
+        free(current_file->tab_resource_extent);
+
       free(current_file);
     }
 }
@@ -17,12 +17,31 @@
 #define IMAGE_HDV           2   /* HDV */
 #define IMAGE_PO            3   /*  PO */
 
+#define IMAGE_ACCESS_READ   0   /* Image en lecture seule */
+#define IMAGE_ACCESS_WRITE  1   /* Image modifiable, le fichier n'est écrit que par UpdateProdosImage */
+#define IMAGE_ACCESS_LAZY   2   /* Lecture seule, répertoires décodés à la demande */
+#define IMAGE_ACCESS_CACHE  3   /* IMAGE_ACCESS_READ + tailles, blocs et bitmap repris de <image>.cadius-idx */
+
 #define BLOCK_SIZE       512    /* Taille d'un block */
 #define INDEX_PER_BLOCK  256    /* Nombre d'index de block dans un block */
 
+#define BITMAP_WORD_BIT   64    /* Nombre de blocks décrits par un mot de la bitmap mémoire */
+
 #define UPDATE_ADD     1
 #define UPDATE_REMOVE  2
 
+#define BLOCK_MODIFIED_DATA      1   /* Block de données ou d'index : écrit en premier */
+#define BLOCK_MODIFIED_METADATA  2   /* Block de Bitmap ou de Directory : écrit après les données */
+
+#define DIRTY_RUN_STEP  256   /* Taille initiale de la liste des plages de blocks modifiés */
+
+#define NAME_INDEX_MIN_SLOT  16   /* Taille initiale de l'index des noms d'un répertoire */
+
+#define FOLDER_SLOT_MIN_BLOCK   4   /* Taille initiale de la liste des blocs d'un répertoire (entrées libres) */
+#define FOLDER_SLOT_MAX_ENTRY  32   /* Entrées par bloc suivies (1 bit chacune) */
+
+#define ENTRY_PATH_LENGTH  1024   /* Taille du buffer recevant le chemin d'une entrée (GetEntryPath) */
+
 #define TYPE_ENTRY_SEEDLING  1
 #define TYPE_ENTRY_SAPLING   2
 #define TYPE_ENTRY_TREE      3
@@ -52,6 +71,49 @@ struct prodos_time
 #define BLOCK_TYPE_FILE    4
 #define BLOCK_TYPE_FOLDER  5
 
+/** Suite de blocs contigus d'un fork dans l'image (block = 0 : trou, lu comme des zéros) **/
+struct fork_extent
+{
+  int block;
+  int nb_block;
+};
+
+/** Suite de blocs contigus modifiés depuis la dernière écriture de l'image **/
+struct dirty_run
+{
+  int block;
+  int nb_block;
+};
+
+/** Résumé des blocs libres d'une zone de la bitmap (noeud de l'index) **/
+struct free_extent_node
+{
+  int prefix;    /* Nombre de blocs libres au début de la zone */
+  int suffix;    /* Nombre de blocs libres à la fin de la zone */
+  int max;       /* Plus longue suite de blocs libres dans la zone */
+};
+
+struct name_index
+{
+  int nb_entry;
+  int nb_slot;                                 /* Puissance de 2, au plus à moitié pleine */
+  struct file_descriptive_entry **tab_slot;    /* Adressage ouvert, sondage linéaire */
+};
+
+/** Entrées libres d'un répertoire : 1 bit par entrée candidate, relue dans l'image avant d'être rendue **/
+struct folder_slot
+{
+  int entry_length;
+  int entries_per_block;
+
+  int nb_block;               /* Blocs du répertoire dans l'ordre de la chaîne, le dernier est celui qu'on prolonge */
+  int nb_block_max;
+  int *tab_block;
+  uint32_t *tab_free;         /* Par bloc, bit j : entrée j+1 libre */
+
+  int first_free;             /* Aucune entrée libre dans les blocs qui précèdent */
+};
+
 struct prodos_image
 {
   char *image_file_path;
@@ -64,12 +126,29 @@ struct prodos_image
   int nb_block;
   int nb_free_block;
 
-  unsigned char *block_modified;     /* Tableau des blocks modifiés */
+  int image_access;                /* IMAGE_ACCESS_READ / IMAGE_ACCESS_WRITE / IMAGE_ACCESS_LAZY */
+  int image_mapped;                /* 1 si le fichier est mappé en mémoire (mmap) */
+  unsigned char *image_file_data;  /* Début du fichier (header compris) */
+  int image_file_length;
+
+  int directory_processed;         /* Volume Directory décodé (IMAGE_ACCESS_LAZY) */
+  struct image_cache *image_cache; /* Cache valide, pendant le chargement (IMAGE_ACCESS_CACHE) */
+  int update_deferred;             /* 1 pendant un BATCH : UpdateProdosImage() n'écrit rien */
+
+  unsigned char *block_modified;     /* Tableau des blocks modifiés (BLOCK_MODIFIED_*) */
+  int nb_dirty_run;                  /* Blocks modifiés regroupés en plages, dans l'ordre des écritures */
+  int nb_dirty_run_max;
+  struct dirty_run *tab_dirty_run;
+  int dirty_run_overflow;            /* 1 : liste incomplète (mémoire), on parcourt block_modified */
+  int image_sync;                    /* 1 : attend que les blocks soient sur le disque (--sync) */
 
   struct volume_directory_header *volume_header;
 
-  /* Version integer de la bitmap */
-  int *block_allocation_table;  
+  /* Bitmap mémoire (1 bit par bloc, 1=libre) + index des zones libres */
+  uint64_t *block_allocation_table;
+  int nb_bitmap_word;
+  struct free_extent_node *free_extent_tree;   /* Arbre binaire, feuille = 1 mot de la bitmap */
+  int nb_free_extent_leaf;
 
   int *block_usage_type;       /* Type de données de chaque bloc (pour le CHECK_VOLUME) */
   void **block_usage_object;   /* Objet lié à chaque bloc (pour le CHECK_VOLUME) */
@@ -81,6 +160,9 @@ struct prodos_image
   int nb_directory;         /* Liste des répertoires de ce répertoire */
   struct file_descriptive_entry **tab_directory;
 
+  struct name_index *name_index;   /* Index des noms (fichiers + répertoires), construit à la 1ère recherche */
+  struct folder_slot *free_slot;   /* Entrées libres du Volume Directory (chargement en écriture ou 1er ajout) */
+
   /** Statistiques **/
   int nb_extract_file;
   int nb_extract_folder;
@@ -106,8 +188,6 @@ struct volume_directory_header
   int next_block;
 
   BYTE storage_type;
-  char storage_type_ascii[50];
-  char storage_type_ascii_short[10];
 
   int name_length;
   char volume_name[16];
@@ -124,7 +204,6 @@ struct volume_directory_header
   int min_version;
 
   BYTE access;
-  char access_ascii[50];
 
   int entry_length;
   int entries_per_block;
@@ -151,9 +230,7 @@ struct sub_directory_header
   int next_block;
 
   BYTE storage_type;
-  char storage_type_ascii[50];
-  char storage_type_ascii_short[10];
-  
+
   int name_length;
   char subdir_name[16];
   char subdir_name_case[16];
@@ -166,7 +243,6 @@ struct sub_directory_header
   int min_version;
 
   BYTE access;
-  char access_ascii[50];
 
   int entry_length;         /* Constante : 27 */
   int entries_per_block;    /* Constante : 0D */
@@ -186,35 +262,29 @@ struct sub_directory_header
 struct file_descriptive_entry
 {
   BYTE storage_type;
-  char storage_type_ascii[50];
-  char storage_type_ascii_short[10];
 
   int name_length;
   char file_name[16];
   char file_name_case[16];
   WORD lowercase;                                 /* GS/OS */
 
-  char *file_path;         /* Chemin du ficher dans l'image */
-
   BYTE file_type;
   WORD file_aux_type;
-  char file_type_ascii[50];
 
   int key_pointer_block;   /* Block contenant les données */
   int blocks_used;
   int eof_location;        /* Taille du fichier en Byte */
 
-  struct prodos_date file_creation_date;
-  struct prodos_time file_creation_time;
+  WORD file_creation_date;      /* Date et heure Prodos compactées (texte : GetProdosDate/GetProdosTime) */
+  WORD file_creation_time;
 
-  struct prodos_date file_modification_date;
-  struct prodos_time file_modification_time;
+  WORD file_modification_date;
+  WORD file_modification_time;
 
   int version_created;
   int min_version;
 
   BYTE access;
-  char access_ascii[50];
 
   /* Répartition des données du fichier */
   int data_size;
@@ -244,6 +314,9 @@ struct file_descriptive_entry
   int nb_directory;         /* Liste des répertoires de ce répertoire */
   struct file_descriptive_entry **tab_directory;
 
+  struct name_index *name_index;   /* Index des noms (fichiers + répertoires), construit à la 1ère recherche */
+  struct folder_slot *free_slot;   /* Entrées libres du répertoire (chargement en écriture ou 1er ajout) */
+
   int delete_folder_depth;  /* Ce répertoire doit être supprimé (niveau de profondeur) */
 
   struct file_descriptive_entry *next;
@@ -278,6 +351,20 @@ struct prodos_file
   unsigned char resource_finderinfo_1[18];
   unsigned char resource_finderinfo_2[18];
 
+  unsigned char *input_file_data;           /* Fichier AppleSingle mappé ou chargé (ADD) : data et resource pointent dedans */
+  int input_file_length;
+  int input_mapped;
+
+  FILE *data_fd;                            /* Data lues bloc par bloc depuis le disque (ADD) */
+  int data_fd_offset;
+  FILE *resource_fd;
+  int resource_fd_offset;
+
+  int nb_data_extent;                       /* Data laissées dans l'image (GetExtentFile) */
+  struct fork_extent *tab_data_extent;
+  int nb_resource_extent;                   /* Resource laissées dans l'image (GetExtentFile) */
+  struct fork_extent *tab_resource_extent;
+
   unsigned char type;
   WORD aux_type;
   unsigned char version_create;
@@ -296,15 +383,22 @@ struct prodos_file
   struct file_descriptive_entry *entry;
 };
 
-struct prodos_image *LoadProdosImage(char *);
-struct file_descriptive_entry *ODSReadFileDescriptiveEntry(struct prodos_image *,char *,unsigned char *);
+struct prodos_image *LoadProdosImage(char *,int);
+struct file_descriptive_entry *ODSReadFileDescriptiveEntry(struct prodos_image *,struct file_descriptive_entry *,unsigned char *);
+char *GetEntryPath(struct prodos_image *,struct file_descriptive_entry *,char *);
 int UpdateProdosImage(struct prodos_image *);
+void LoadFolderEntries(struct prodos_image *,struct file_descriptive_entry *);
 struct file_descriptive_entry *GetProdosFile(struct prodos_image *,char *);
 struct file_descriptive_entry *GetProdosFolder(struct prodos_image *,char *,int);
 int *GetEntryBlock(struct prodos_image *,int,int,int,int *,int **,int *);
 int GetDataFile(struct prodos_image *,struct file_descriptive_entry *,struct prodos_file *);
+struct fork_extent *GetEntryExtent(struct prodos_image *,int,int,int,int *);
+int GetExtentFile(struct prodos_image *,struct file_descriptive_entry *,struct prodos_file *);
+int CreateExtentFile(char *,struct prodos_image *,int,struct fork_extent *,int);
+int WriteExtentData(FILE *,struct prodos_image *,int,struct fork_extent *,int);
 void GetBlockData(struct prodos_image *,int,unsigned char *);
 void SetBlockData(struct prodos_image *,int,unsigned char *);
+void SetMetadataBlockData(struct prodos_image *,int,unsigned char *);
 void GetProdosDate(WORD,struct prodos_date *);
 void GetProdosTime(WORD,struct prodos_time *);
 WORD BuildProdosDate(int,int,int);
@@ -313,8 +407,13 @@ WORD BuildProdosCase(char *);
 int CheckProdosName(char *);
 void GetCurrentDate(WORD *,WORD *);
 int *AllocateImageBlock(struct prodos_image *,int);
+void FreeImageBlock(struct prodos_image *,int,int *);
+int IsImageBlockFree(struct prodos_image *,int);
+void ResetImageBitmap(struct prodos_image *,int);
 int AllocateFolderEntry(struct prodos_image *,struct file_descriptive_entry *,WORD *, BYTE *,WORD *);
 int UpdateEntryTable(int,int *,struct file_descriptive_entry ***,struct file_descriptive_entry *);
+struct file_descriptive_entry *FindFolderEntry(struct prodos_image *,struct file_descriptive_entry *,char *);
+int UpdateFolderEntry(struct prodos_image *,struct file_descriptive_entry *,int,struct file_descriptive_entry *);
 int compare_entry(const void *,const void *);
 void mem_free_image(struct prodos_image *);
 void mem_free_entry(struct file_descriptive_entry *);
@@ -11,6 +11,12 @@
 #include <string.h>
 #include <ctype.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 #include "Dc_Shared.h"
 #include "Dc_Memory.h"
 #include "File_AppleSingle.h"
@@ -71,6 +77,79 @@ unsigned char *LoadBinaryFile(char *file_path, int *data_length_rtn)
 }
 
 
+/***********************************************************************/
+/*  IsZeroData() :  Indique si une zone mémoire ne contient que des 0. */
+/***********************************************************************/
+int IsZeroData(unsigned char *data, int length)
+{
+  int i = 0;
+
+  /** On accumule (OR) la zone par mots SIMD, puis on teste une seule fois **/
+#if defined(__AVX2__)
+  __m256i acc = _mm256_setzero_si256();
+  for(; i+32<=length; i+=32)
+    acc = _mm256_or_si256(acc,_mm256_loadu_si256((const __m256i *) &data[i]));
+  if(!_mm256_testz_si256(acc,acc))
+    return(0);
+#elif defined(__SSE2__) || defined(_M_X64)
+  __m128i acc = _mm_setzero_si128();
+  for(; i+16<=length; i+=16)
+    acc = _mm_or_si128(acc,_mm_loadu_si128((const __m128i *) &data[i]));
+  if(_mm_movemask_epi8(_mm_cmpeq_epi8(acc,_mm_setzero_si128())) != 0xFFFF)
+    return(0);
+#else
+  uint64_t acc = 0, word;
+  for(; i+8<=length; i+=8)
+    {
+      memcpy(&word,&data[i],8);
+      acc |= word;
+    }
+  if(acc != 0)
+    return(0);
+#endif
+
+  /* Fin de la zone */
+  for(; i<length; i++)
+    if(data[i] != 0)
+      return(0);
+
+  return(1);
+}
+
+
+/************************************************************************/
+/*  OpenBinaryFile() :  Ouvre un fichier en lecture, renvoie sa taille. */
+/************************************************************************/
+FILE *OpenBinaryFile(char *file_path, int *data_length_rtn)
+{
+  FILE *fd;
+  long file_size;
+
+  /* Init */
+  *data_length_rtn = 0;
+
+  /* Ouverture du fichier */
+  fd = fopen(file_path,"rb");
+  if(fd == NULL)
+    return(NULL);
+
+  /* Taille du fichier */
+  fseek(fd,0L,SEEK_END);
+  file_size = ftell(fd);
+  fseek(fd,0L,SEEK_SET);
+  if(file_size < 0)
+    {
+      fclose(fd);
+      return(NULL);
+    }
+
+  /* Au delà de 2 Go, la taille reste de toute façon hors des limites Prodos */
+  *data_length_rtn = (file_size > 0x7FFFFFFF) ? 0x7FFFFFFF : (int) file_size;
+
+  return(fd);
+}
+
+
 /*************************************************************/
 /*  LoadTextFile() :  Récupération des données d'un fichier. */
 /*************************************************************/
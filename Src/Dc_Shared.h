@@ -9,6 +9,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdio.h>
 
 typedef unsigned char BYTE;
 typedef uint16_t WORD;
@@ -25,6 +26,7 @@ struct file_path
 
 unsigned char *LoadTextFile(char *,int *);
 unsigned char *LoadBinaryFile(char *,int *);
+FILE *OpenBinaryFile(char *,int *);
 int Get24bitValue(unsigned char *,int);
 int GetWordValue(unsigned char *,int);
 int GetByteValue(unsigned char *,int);
@@ -40,6 +42,7 @@ char *mh_stristr(char *,char *);
 int mh_stricmp(char *,char *);
 char **BuildUniqueListFromFile(char *,int *);
 int GetContainerNumber(int,int);
+int IsZeroData(unsigned char *,int);
 void mem_free_list(int,char **);
 void mem_free_filepath(struct file_path *);
 
@@ -0,0 +1,171 @@
+/***********************************************************************/
+/*                                                                     */
+/*  Dc_Stats.c : Compteurs et chronos par phase de l'option --stats.   */
+/*                                                                     */
+/***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Dc_Shared.h"
+#include "os/os.h"
+#include "Dc_Stats.h"
+
+THREAD_LOCAL struct stats_counter stats_thread = { {0}, {0.0}, STATS_PHASE_NONE, 0.0 };
+
+/** Totaux de tous les threads **/
+static struct
+{
+  int enabled;
+  int print;
+  char *file_path;
+  double start;
+  void *lock;
+  int64_t tab_counter[STATS_NB_COUNTER];
+  double tab_phase_time[STATS_NB_PHASE];
+} stats_total;
+
+static const char *stats_phase_name[STATS_NB_PHASE] = {"load","directory","bitmap","operation","flush"};
+static const char *stats_counter_name[STATS_NB_COUNTER] = {"block_read","block_write","block_flush","allocate_call","block_allocated","entry_decoded","byte_extracted","byte_added"};
+
+static void stats_Report(void);
+static void stats_WriteFile(char *,double);
+
+/******************************************************************/
+/*  stats_Enable() :  Active les chronos, le rapport est fait à   */
+/*                    la sortie (stderr et/ou fichier json).      */
+/******************************************************************/
+void stats_Enable(int print, char *file_path)
+{
+  if(stats_total.enabled)
+    return;
+
+  /* Le verrou ne sert qu'à cumuler les threads */
+  stats_total.lock = os_CreateLock();
+  if(stats_total.lock == NULL)
+    return;
+  stats_total.file_path = (file_path == NULL) ? NULL : strdup(file_path);
+  stats_total.print = print;
+  stats_total.start = os_GetTime();
+  stats_total.enabled = 1;
+
+  atexit(stats_Report);
+}
+
+
+/*******************************************************************/
+/*  stats_EnterPhase() :  Le temps écoulé va à la phase en cours,  */
+/*                        puis on passe à la nouvelle phase.       */
+/*******************************************************************/
+int stats_EnterPhase(int phase)
+{
+  int previous_phase;
+  double now;
+
+  if(!stats_total.enabled)
+    return(STATS_PHASE_NONE);
+
+  now = os_GetTime();
+  previous_phase = stats_thread.phase;
+  if(previous_phase != STATS_PHASE_NONE)
+    stats_thread.tab_phase_time[previous_phase] += now - stats_thread.phase_start;
+  stats_thread.phase = phase;
+  stats_thread.phase_start = now;
+
+  return(previous_phase);
+}
+
+
+/*******************************************************************/
+/*  stats_LeavePhase() :  Revient à la phase renvoyée par Enter.   */
+/*******************************************************************/
+void stats_LeavePhase(int previous_phase)
+{
+  stats_EnterPhase(previous_phase);
+}
+
+
+/***************************************************************************/
+/*  stats_MergeThread() :  Ajoute les compteurs du thread aux totaux (fin  */
+/*                         d'un thread de os_RunThreads, sortie du main).  */
+/***************************************************************************/
+void stats_MergeThread(void)
+{
+  int i, phase;
+
+  if(!stats_total.enabled)
+    return;
+
+  /* La phase en cours est comptée jusqu'ici et continue */
+  phase = stats_EnterPhase(STATS_PHASE_NONE);
+  stats_EnterPhase(phase);
+
+  os_Lock(stats_total.lock);
+  for(i=0; i<STATS_NB_COUNTER; i++)
+    stats_total.tab_counter[i] += stats_thread.tab_counter[i];
+  for(i=0; i<STATS_NB_PHASE; i++)
+    stats_total.tab_phase_time[i] += stats_thread.tab_phase_time[i];
+  os_Unlock(stats_total.lock);
+
+  memset(stats_thread.tab_counter,0,sizeof(stats_thread.tab_counter));
+  memset(stats_thread.tab_phase_time,0,sizeof(stats_thread.tab_phase_time));
+}
+
+
+/*****************************************************************/
+/*  stats_Report() :  Rapport de fin (atexit), sur stderr pour   */
+/*                    ne pas se mêler à la sortie de la commande. */
+/*****************************************************************/
+static void stats_Report(void)
+{
+  int i;
+  double wall_time;
+
+  /* Le thread principal */
+  stats_MergeThread();
+  wall_time = os_GetTime() - stats_total.start;
+
+  if(stats_total.print)
+    {
+      fprintf(stderr,"  - Stats :\n");
+      for(i=0; i<STATS_NB_PHASE; i++)
+        fprintf(stderr,"    %-16s %12.3f ms\n",stats_phase_name[i],stats_total.tab_phase_time[i]*1000.0);
+      fprintf(stderr,"    %-16s %12.3f ms\n","wall",wall_time*1000.0);
+      for(i=0; i<STATS_NB_COUNTER; i++)
+        fprintf(stderr,"    %-16s %12lld\n",stats_counter_name[i],(long long) stats_total.tab_counter[i]);
+    }
+
+  if(stats_total.file_path != NULL)
+    stats_WriteFile(stats_total.file_path,wall_time);
+}
+
+
+/*****************************************************************/
+/*  stats_WriteFile() :  Ecrit les totaux dans un fichier json.  */
+/*****************************************************************/
+static void stats_WriteFile(char *file_path, double wall_time)
+{
+  int i;
+  FILE *fd;
+
+  fd = fopen(file_path,"w");
+  if(fd == NULL)
+    {
+      fprintf(stderr,"  Error : Can't create stats file '%s'.\n",file_path);
+      return;
+    }
+
+  fprintf(fd,"{\"wall_ms\":%.3f,\"phase_ms\":{",wall_time*1000.0);
+  for(i=0; i<STATS_NB_PHASE; i++)
+    fprintf(fd,"%s\"%s\":%.3f",(i == 0) ? "" : ",",stats_phase_name[i],stats_total.tab_phase_time[i]*1000.0);
+  fprintf(fd,"},\"counters\":{");
+  for(i=0; i<STATS_NB_COUNTER; i++)
+    fprintf(fd,"%s\"%s\":%lld",(i == 0) ? "" : ",",stats_counter_name[i],(long long) stats_total.tab_counter[i]);
+  fprintf(fd,"}}\n");
+
+  if(fclose(fd))
+    fprintf(stderr,"  Error : Can't write stats file '%s'.\n",file_path);
+}
+
+/***********************************************************************/
@@ -0,0 +1,53 @@
+/***********************************************************************/
+/*                                                                     */
+/*  Dc_Stats.h : Header pour les compteurs et chronos de --stats.      */
+/*                                                                     */
+/***********************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "os/os.h"
+
+/** Phases chronométrées (exclusives : une phase imbriquée suspend la précédente) **/
+#define STATS_PHASE_NONE          -1
+#define STATS_PHASE_LOAD           0     /* Ouverture / mapping de l'image, Volume Header */
+#define STATS_PHASE_DIRECTORY      1     /* Décodage des Directory (chargement ou à la demande) */
+#define STATS_PHASE_BITMAP         2     /* Décodage de la Bitmap */
+#define STATS_PHASE_OPERATION      3     /* La commande elle-même */
+#define STATS_PHASE_FLUSH          4     /* Ecriture des blocks modifiés */
+#define STATS_NB_PHASE             5
+
+/** Compteurs **/
+#define STATS_BLOCK_READ           0     /* GetBlockData */
+#define STATS_BLOCK_WRITE          1     /* SetBlockData, SetMetadataBlockData */
+#define STATS_BLOCK_FLUSH          2     /* Blocks écrits par UpdateProdosImage */
+#define STATS_ALLOCATE_CALL        3     /* AllocateImageBlock */
+#define STATS_BLOCK_ALLOCATED      4
+#define STATS_ENTRY_DECODED        5     /* File Descriptive Entries */
+#define STATS_BYTE_EXTRACTED       6     /* Data + Resource écrits sur disque */
+#define STATS_BYTE_ADDED           7     /* Data + Resource ajoutés à l'image */
+#define STATS_NB_COUNTER           8
+
+/** Compteurs et chronos d'un thread, cumulés à la fin du thread **/
+struct stats_counter
+{
+  int64_t tab_counter[STATS_NB_COUNTER];
+  double tab_phase_time[STATS_NB_PHASE];   /* Secondes */
+
+  int phase;                               /* Phase en cours (STATS_PHASE_NONE) */
+  double phase_start;
+};
+
+extern THREAD_LOCAL struct stats_counter stats_thread;
+
+/* Toujours compté (un accès au thread), affiché seulement avec --stats */
+#define STATS_ADD(counter,value)  (stats_thread.tab_counter[(counter)] += (int64_t) (value))
+
+void stats_Enable(int,char *);
+int stats_EnterPhase(int);
+void stats_LeavePhase(int);
+void stats_MergeThread(void);
+
+/***********************************************************************/
@@ -1,3 +1,7 @@
+#include <ctype.h>
+#include <stddef.h>
+#include <time.h>
+
 #include "File_AppleSingle.h"
 #include "log.h"
 #include "os/os.h"
@@ -15,111 +19,101 @@ static uint16_t as_field16(uint16_t num)
 }
 
 /**
- * Is this an AppleSingle file?
- * @brief ASIsAppleSingle
+ * Read a big-endian field in place (the buffer may not be aligned)
+ * @brief as_read32
  * @param buf
  * @return
  */
-bool ASIsAppleSingle(unsigned char *buf, size_t buflen)
+static uint32_t as_read32(unsigned char *buf)
 {
-  if (buflen < sizeof(AS_MAGIC)) return false;
-  int buf_magic;
-  memcpy(&buf_magic, buf, sizeof(AS_MAGIC));
-  buf_magic = as_field32(buf_magic);
+  uint32_t num;
+  memcpy(&num, buf, sizeof(num));
+  return as_field32(num);
+}
 
-  return buf_magic == AS_MAGIC;
+static uint16_t as_read16(unsigned char *buf)
+{
+  uint16_t num;
+  memcpy(&num, buf, sizeof(num));
+  return as_field16(num);
 }
 
 /**
- * Parse header out of raw data buffer.
- * @brief ASParseHeader
- * @param buf The buffer
+ * Is this an AppleSingle file?
+ * @brief ASIsAppleSingle
+ * @param buf
  * @return
  */
-struct as_file_header *ASParseHeader(unsigned char *buf, size_t buflen)
+bool ASIsAppleSingle(unsigned char *buf, size_t buflen)
 {
-  if (buflen < sizeof(as_file_header)) return NULL;
-  struct as_file_header *header = malloc(sizeof(as_file_header));
-  if (!header) return NULL;
-  struct as_file_header *buf_header = (as_file_header *) buf;
-
-  header->magic = as_field32(buf_header->magic);
-  header->version = as_field32(buf_header->version);
-  header->num_entries = as_field16(buf_header->num_entries);
+  if (buflen < sizeof(AS_MAGIC)) return false;
 
-  return header;
+  return as_read32(buf) == AS_MAGIC;
 }
 
 /**
- * @brief ASParseProdosEntry
- * @param entry_buf  The entry buffer
- * @return
+ * Read the number of entries from the header, in place.
+ * @brief ASGetNumEntries
+ * @param buf The buffer
+ * @return The number of entries, -1 if the buffer can't hold the header
+ *         and the entry table
  */
-struct as_prodos_info *ASParseProdosEntry(unsigned char *entry_buf, size_t buflen)
+int ASGetNumEntries(unsigned char *buf, size_t buflen)
 {
-  if (buflen < sizeof(as_prodos_info)) return NULL;
-  struct as_prodos_info *prodos_entry = malloc(sizeof(as_prodos_info));
-  if (!prodos_entry) return NULL;
-  struct as_prodos_info *buf_prodos_entry = (as_prodos_info *) entry_buf;
+  if (buflen < sizeof(as_file_header)) return -1;
 
-  prodos_entry->access = as_field16(buf_prodos_entry->access);
-  prodos_entry->filetype = as_field16(buf_prodos_entry->filetype);
-  prodos_entry->auxtype = as_field32(buf_prodos_entry->auxtype);
+  int num_entries = as_read16(buf + offsetof(as_file_header, num_entries));
+  if (buflen < sizeof(as_file_header) + num_entries * sizeof(as_file_entry)) return -1;
 
-  return prodos_entry;
+  return num_entries;
 }
 
 /**
- * Read headers and return a list of as_file_entry pointers.
- * @brief ASGetEntries
+ * Read one entry of the entry table, in place, and check that its data
+ * lies inside the buffer.
+ * @brief ASGetEntry
  * @param buf
- * @return
+ * @param index      Entry index (< ASGetNumEntries)
+ * @param entry_rtn  The entry, in host byte order
+ * @return false if the entry points outside the buffer
  */
-struct as_file_entry *ASGetEntries(struct as_file_header *header, unsigned char *buf, size_t buflen)
+bool ASGetEntry(unsigned char *buf, size_t buflen, int index, as_file_entry *entry_rtn)
 {
-  if (!header)
-  {
-    logf_error("      Error: Invalid AppleSingle file!\n");
-    return NULL;
-  }
-
-  size_t entries_length = header->num_entries * sizeof(as_file_entry);
-  if (buflen < sizeof(as_file_header) + entries_length) return NULL;
-
-  struct as_file_entry *entries = malloc(entries_length);
-  struct as_file_entry *buf_entries = (as_file_entry *) (buf + sizeof(as_file_header));
+  unsigned char *entry_buf = buf + sizeof(as_file_header) + index * sizeof(as_file_entry);
 
-  memcpy(entries, buf_entries, header->num_entries * sizeof(as_file_entry));
+  entry_rtn->entry_id = as_read32(entry_buf + offsetof(as_file_entry, entry_id));
+  entry_rtn->offset = as_read32(entry_buf + offsetof(as_file_entry, offset));
+  entry_rtn->length = as_read32(entry_buf + offsetof(as_file_entry, length));
 
-  if (IS_LITTLE_ENDIAN)
-    for (int i = 0; i < header->num_entries; ++i)
-    {
-      entries[i].entry_id = swap32(entries[i].entry_id);
-      entries[i].offset = swap32(entries[i].offset);
-      entries[i].length = swap32(entries[i].length);
-    }
-
-  return entries;
+  return entry_rtn->offset <= buflen && entry_rtn->length <= buflen - entry_rtn->offset;
 }
 
 /**
- * Grab data from data entry and place in prodos_file.
+ * Point the data fork of prodos_file at the data entry (no copy, the
+ * buffer has to outlive the file).
  * @brief ASDecorateDataFork
  * @param current_file     The current file
  * @param data             The data
  * @param data_fork_entry  The data fork entry
  */
-void ASDecorateDataFork(struct prodos_file *current_file, unsigned char *data, size_t datalen, as_file_entry *data_fork_entry)
+void ASDecorateDataFork(struct prodos_file *current_file, unsigned char *data, as_file_entry *data_fork_entry)
 {
-  if (data_fork_entry->entry_id != data_fork) return;
-  if (datalen < data_fork_entry->offset + data_fork_entry->length) return;
-
-  unsigned char *data_entry = malloc(data_fork_entry->length);
-  memcpy(data_entry, data + data_fork_entry->offset, data_fork_entry->length);
-  current_file->data = data_entry;
+  current_file->data = data + data_fork_entry->offset;
   current_file->data_length = data_fork_entry->length;
+}
 
-  return;
+/**
+ * Point the resource fork of prodos_file at the resource entry (no copy).
+ * @brief ASDecorateResourceFork
+ * @param current_file         The current file
+ * @param data                 The data
+ * @param resource_fork_entry  The resource fork entry
+ */
+void ASDecorateResourceFork(struct prodos_file *current_file, unsigned char *data, as_file_entry *resource_fork_entry)
+{
+  current_file->resource = data + resource_fork_entry->offset;
+  current_file->resource_length = resource_fork_entry->length;
+  current_file->has_resource = 1;
 }
 
 /**
@@ -130,100 +124,243 @@ void ASDecorateDataFork(struct prodos_file *current_file, unsigned char *data, s
  * @param data          The data
  * @param prodos_entry  The prodos entry
  */
-void ASDecorateProdosFileInfo(struct prodos_file *current_file, unsigned char *data, size_t datalen, as_file_entry *prodos_entry)
+void ASDecorateProdosFileInfo(struct prodos_file *current_file, unsigned char *data, as_file_entry *prodos_entry)
+{
+  if (prodos_entry->length < sizeof(as_prodos_info)) return;
+
+  unsigned char *info = data + prodos_entry->offset;
+  current_file->access = (unsigned char) as_read16(info + offsetof(as_prodos_info, access));
+  current_file->type = (unsigned char) as_read16(info + offsetof(as_prodos_info, filetype));
+  current_file->aux_type = (WORD) as_read32(info + offsetof(as_prodos_info, auxtype));
+}
+
+/**
+ * Convert an AppleSingle date (seconds since 2000-01-01 00:00 GMT) to
+ * a ProDOS date and time, in local time like the dates of host files.
+ * @brief ASGetProdosDate
+ * @param as_date
+ * @param date_rtn
+ * @param time_rtn
+ * @return false if the date is unknown
+ */
+static bool ASGetProdosDate(uint32_t as_date, WORD *date_rtn, WORD *time_rtn)
+{
+  if (as_date == AS_DATE_UNKNOWN) return false;
+
+  time_t date = (time_t) AS_DATE_EPOCH + (int32_t) as_date;
+  struct tm *local_time = localtime(&date);
+  if (local_time == NULL) return false;
+
+  *date_rtn = BuildProdosDate(local_time->tm_mday, local_time->tm_mon + 1, local_time->tm_year + 1900);
+  *time_rtn = BuildProdosTime(local_time->tm_min, local_time->tm_hour);
+  return true;
+}
+
+/**
+ * Read the creation and modification dates and place in prodos_file.
+ * @brief ASDecorateFileDates
+ * @param current_file  The current file
+ * @param data          The data
+ * @param dates_entry   The file dates entry
+ */
+void ASDecorateFileDates(struct prodos_file *current_file, unsigned char *data, as_file_entry *dates_entry)
 {
-  if (prodos_entry->entry_id != prodos_file_info) return;
-  if (datalen < prodos_entry->offset + prodos_entry->length) return;
+  if (dates_entry->length < sizeof(as_file_dates)) return;
 
-  struct as_prodos_info *info_meta = ASParseProdosEntry(
-    data + prodos_entry->offset,
-    prodos_entry->length
+  unsigned char *dates = data + dates_entry->offset;
+  ASGetProdosDate(
+    as_read32(dates + offsetof(as_file_dates, create)),
+    &current_file->file_creation_date,
+    &current_file->file_creation_time
   );
+  ASGetProdosDate(
+    as_read32(dates + offsetof(as_file_dates, modify)),
+    &current_file->file_modification_date,
+    &current_file->file_modification_time
+  );
+}
 
-  if (!info_meta) return;
+/**
+ * Use the real name as ProDOS name, if it is a valid one.
+ * @brief ASDecorateRealName
+ * @param current_file  The current file
+ * @param data          The data
+ * @param name_entry    The real name entry
+ */
+void ASDecorateRealName(struct prodos_file *current_file, unsigned char *data, as_file_entry *name_entry)
+{
+  char name[16];
 
-  current_file->access = info_meta->access;
-  current_file->type = info_meta->filetype;
-  current_file->aux_type = info_meta->auxtype;
+  if (name_entry->length == 0 || name_entry->length >= sizeof(name)) return;
+  memcpy(name, data + name_entry->offset, name_entry->length);
+  name[name_entry->length] = '\0';
+  if (!CheckProdosName(name)) return;
 
-  return;
+  char *file_name = strdup(name);
+  char *file_name_case = strdup(name);
+  if (!file_name || !file_name_case)
+  {
+    free(file_name);
+    free(file_name_case);
+    return;
+  }
+  for (int i = 0; file_name[i] != '\0'; ++i) file_name[i] = toupper(file_name[i]);
+
+  free(current_file->file_name);
+  free(current_file->file_name_case);
+  current_file->file_name = file_name;
+  current_file->file_name_case = file_name_case;
 }
 
 /**
  * Parse AppleSingle header and write attributes into prodos_file
- * struct
+ * struct. The forks are views into data, which has to stay valid
+ * until the file is released.
  * @brief ASDecorateProdosFile
  * @param current_file
  * @param data
+ * @return 0, or 1 if the header or an entry lies outside the buffer
  */
-void ASDecorateProdosFile(struct prodos_file *current_file, unsigned char *data, size_t datalen)
+int ASDecorateProdosFile(struct prodos_file *current_file, unsigned char *data, size_t datalen)
 {
-    struct as_file_header *header = ASParseHeader(data, datalen);
-    struct as_file_entry *entries = ASGetEntries(header, data, datalen);
+    struct as_file_entry entry;
+
+    int num_entries = ASGetNumEntries(data, datalen);
+    if (num_entries < 0)
+    {
+      logf_error("      Error: Invalid AppleSingle file!\n");
+      return 1;
+    }
+
+    // No data fork entry : the data fork is empty
+    current_file->data = NULL;
+    current_file->data_length = 0;
 
-    for (int i = 0; i < header->num_entries; ++i)
-      switch(entries[i].entry_id)
+    for (int i = 0; i < num_entries; ++i)
+    {
+      if (!ASGetEntry(data, datalen, i, &entry))
+      {
+        logf_error("      Error: AppleSingle entry ID %d is out of the file!\n", entry.entry_id);
+        return 1;
+      }
+
+      switch(entry.entry_id)
       {
         case data_fork:
-          ASDecorateDataFork(current_file, data, datalen, &entries[i]);
+          ASDecorateDataFork(current_file, data, &entry);
+          break;
+        case resource_fork:
+          ASDecorateResourceFork(current_file, data, &entry);
+          break;
+        case real_name:
+          ASDecorateRealName(current_file, data, &entry);
+          break;
+        case file_dates_info:
+          ASDecorateFileDates(current_file, data, &entry);
           break;
         case prodos_file_info:
-          ASDecorateProdosFileInfo(current_file, data, datalen, &entries[i]);
+          ASDecorateProdosFileInfo(current_file, data, &entry);
           break;
         default:
-          logf_info("        Entry ID %d unsupported, ignoring!\n", entries[i].entry_id);
+          logf_info("        Entry ID %d unsupported, ignoring!\n", entry.entry_id);
           logf_info("        (See https://tools.ietf.org/html/rfc1740 for ID lookup)\n");
           break;
       }
-    return;
+    }
+    return 0;
+}
+
+/**
+ * Write a fork, from its buffer when the file was read in memory, else
+ * straight from its block runs in the image
+ *
+ * @brief ASWriteFork
+ * @param fd             The output file
+ * @param current_image  The image holding the fork blocks
+ * @param data           The fork buffer, or NULL
+ * @param nb_extent      Number of block runs
+ * @param tab_extent     The block runs
+ * @param length         The fork length
+ * @return 0 on success
+ */
+static int ASWriteFork(FILE *fd, struct prodos_image *current_image, unsigned char *data, int nb_extent, struct fork_extent *tab_extent, int length)
+{
+  if (length == 0) return 0;
+  if (data) return fwrite(data, 1, length, fd) != (size_t) length;
+  return WriteExtentData(fd, current_image, nb_extent, tab_extent, length);
 }
 
-struct as_from_prodos ASFromProdosFile(struct prodos_file *file)
+/**
+ * Write an AppleSingle file from a ProDOS file. The header and the entry
+ * list are computed first (32-bit offsets and lengths), then the data fork,
+ * the resource fork (if any) and the ProDOS file info are written one after
+ * the other, the forks straight from the image blocks: the file is never
+ * assembled in memory.
+ *
+ * @brief ASCreateProdosFile
+ * @param file_path      The output file path
+ * @param current_image  The image holding the fork blocks
+ * @param file           The file (GetExtentFile or GetDataFile)
+ * @return 0 on success, 1 if the file can't be created, 2 if a write failed
+ */
+int ASCreateProdosFile(char *file_path, struct prodos_image *current_image, struct prodos_file *file)
 {
-  struct as_file_header *as_header = malloc(sizeof(as_file_header));
+  unsigned char header[sizeof(as_file_header) + 3 * sizeof(as_file_entry)];
+  struct as_file_header *as_header = (as_file_header *) header;
+  struct as_file_entry *entries = (as_file_entry *) (header + sizeof(as_file_header));
+  struct as_prodos_info prodos_info;
+  uint16_t num_entries = 0;
+  uint32_t offset;
+  int error;
+  FILE *fd;
+
+  // Data fork, resource fork if there is one, ProDOS file info
+  bool has_resource = file->resource_length > 0;
+  size_t header_length = sizeof(as_file_header) + (has_resource ? 3 : 2) * sizeof(as_file_entry);
+
+  memset(header, 0, sizeof(header));
   as_header->magic = as_field32(AS_MAGIC);
-  for (int i = 0; i < 4; ++i) as_header->filler[i] = 0;
   as_header->version = as_field32(0x00020000);
-  as_header->num_entries = as_field16(2);
 
-  uint32_t header_offset = sizeof(as_file_header) + (2 * sizeof(as_file_entry));
-  struct as_file_entry *data_entry = malloc(sizeof(as_file_entry));
-  data_entry->entry_id = as_field32(data_fork);
-  data_entry->length = as_field32(file->data_length);
-  data_entry->offset = as_field32(header_offset);
+  offset = (uint32_t) header_length;
+  entries[num_entries].entry_id = as_field32(data_fork);
+  entries[num_entries].offset = as_field32(offset);
+  entries[num_entries].length = as_field32((uint32_t) file->data_length);
+  offset += (uint32_t) file->data_length;
+  num_entries++;
 
-  uint32_t prodos_entry_offset = header_offset + file->data_length;
-  struct as_file_entry *prodos_entry = malloc(sizeof(as_file_entry));
-  prodos_entry->entry_id = as_field32(prodos_file_info);
-  prodos_entry->length = as_field32(sizeof(as_prodos_info));
-  prodos_entry->offset = as_field32(prodos_entry_offset);
-
-  struct as_prodos_info *prodos_info = malloc(sizeof(as_prodos_info));
-  prodos_info->access = as_field16(file->entry->access);
-  prodos_info->filetype = as_field16(file->entry->file_type);
-  prodos_info->auxtype = as_field32(file->entry->file_aux_type);
-
-  uint32_t payload_size = prodos_entry_offset + sizeof(as_prodos_info);
-  unsigned char *payload = malloc(payload_size);
-  unsigned char *seek = payload;
-
-  memcpy(seek, as_header, sizeof(as_file_header));
-  seek += sizeof(as_file_header);
+  if (has_resource)
+  {
+    entries[num_entries].entry_id = as_field32(resource_fork);
+    entries[num_entries].offset = as_field32(offset);
+    entries[num_entries].length = as_field32((uint32_t) file->resource_length);
+    offset += (uint32_t) file->resource_length;
+    num_entries++;
+  }
 
-  memcpy(seek, data_entry, sizeof(as_file_entry));
-  seek += sizeof(as_file_entry);
+  entries[num_entries].entry_id = as_field32(prodos_file_info);
+  entries[num_entries].offset = as_field32(offset);
+  entries[num_entries].length = as_field32(sizeof(as_prodos_info));
+  num_entries++;
 
-  memcpy(seek, prodos_entry, sizeof(as_file_entry));
-  seek += sizeof(as_file_entry);
+  as_header->num_entries = as_field16(num_entries);
 
-  memcpy(seek, file->data, file->data_length);
-  seek += file->data_length;
+  prodos_info.access = as_field16(file->entry->access);
+  prodos_info.filetype = as_field16(file->entry->file_type);
+  prodos_info.auxtype = as_field32(file->entry->file_aux_type);
 
-  memcpy(seek, prodos_info, sizeof(as_prodos_info));
+  os_DeleteFile(file_path);
+  fd = fopen(file_path, "wb");
+  if (!fd) return 1;
 
-  struct as_from_prodos as_file; 
-  as_file.length = payload_size;
-  as_file.data = payload;
+  error = fwrite(header, 1, header_length, fd) != header_length;
+  if (!error)
+    error = ASWriteFork(fd, current_image, file->data, file->nb_data_extent, file->tab_data_extent, file->data_length);
+  if (!error && has_resource)
+    error = ASWriteFork(fd, current_image, file->resource, file->nb_resource_extent, file->tab_resource_extent, file->resource_length);
+  if (!error)
+    error = fwrite(&prodos_info, 1, sizeof(as_prodos_info), fd) != sizeof(as_prodos_info);
 
-  return as_file;
+  if (fclose(fd)) error = 1;
+  return error ? 2 : 0;
 }
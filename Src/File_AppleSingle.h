@@ -20,6 +20,10 @@
 const unsigned static int AS_MAGIC;
 #define IS_LITTLE_ENDIAN 'APPL' == (uint32_t) 0x4150504C
 
+// Dates are seconds since 2000-01-01 00:00 GMT (946684800 in Unix time)
+#define AS_DATE_EPOCH 946684800
+#define AS_DATE_UNKNOWN (uint32_t) 0x80000000
+
 #pragma pack(push, 1)
 
 typedef struct as_file_header
@@ -62,22 +66,26 @@ typedef struct as_prodos_info
   DWORD auxtype;
 } as_prodos_info;
 
-typedef struct as_from_prodos
+typedef struct as_file_dates
 {
-  uint16_t length;
-  unsigned char *data;
-} as_from_prodos;
+  DWORD create;
+  DWORD modify;
+  DWORD backup;
+  DWORD access;
+} as_file_dates;
 
 #pragma pack(pop)
 
 bool ASIsAppleSingle(unsigned char *buf, size_t buflen);
 
-struct as_file_header *ASParseHeader(unsigned char *buf, size_t buflen);
-struct as_prodos_info *ASParseProdosEntry(unsigned char *entry_buf, size_t buflen);
-struct as_file_entry *ASGetEntries(struct as_file_header *header, unsigned char *buf, size_t buflen);
+int ASGetNumEntries(unsigned char *buf, size_t buflen);
+bool ASGetEntry(unsigned char *buf, size_t buflen, int index, as_file_entry *entry_rtn);
 
-void ASDecorateDataFork(struct prodos_file *current_file, unsigned char *data, size_t datalen, as_file_entry *data_fork_entry);
-void ASDeocrateProdosFileInfo(struct prodos_file *current_file, unsigned char *data, size_t datalen, as_file_entry *prodos_entry);
-void ASDecorateProdosFile(struct prodos_file *current_file, unsigned char *data, size_t datalen);
+void ASDecorateDataFork(struct prodos_file *current_file, unsigned char *data, as_file_entry *data_fork_entry);
+void ASDecorateResourceFork(struct prodos_file *current_file, unsigned char *data, as_file_entry *resource_fork_entry);
+void ASDecorateProdosFileInfo(struct prodos_file *current_file, unsigned char *data, as_file_entry *prodos_entry);
+void ASDecorateFileDates(struct prodos_file *current_file, unsigned char *data, as_file_entry *dates_entry);
+void ASDecorateRealName(struct prodos_file *current_file, unsigned char *data, as_file_entry *name_entry);
+int ASDecorateProdosFile(struct prodos_file *current_file, unsigned char *data, size_t datalen);
 
-struct as_from_prodos ASFromProdosFile(struct prodos_file *file);
+int ASCreateProdosFile(char *file_path, struct prodos_image *current_image, struct prodos_file *file);
@@ -28,6 +28,7 @@
 #include "Prodos_Create.h"
 #include "Prodos_Add.h"
 #include "Prodos_Source.h"
+#include "Dc_Stats.h"
 #include "log.h"
 
 #define ACTION_CATALOG           10
@@ -60,17 +61,66 @@
 #define ACTION_INDENT_FILE       82
 #define ACTION_OUTDENT_FILE      83
 
+#define ACTION_BATCH             90
+
 #define ERROR_HELP                1
 #define ERROR_PARAM               2
 #define ERROR_LOAD                3
 #define ERROR_GET                 4
 #define ERROR_EXTRACT             5
 #define ERROR_ADD                 6
+#define ERROR_BATCH               7
+#define ERROR_MODIFY              8
+
+#define BATCH_LINE_LENGTH      1024
+#define BATCH_MAX_WORD           16
+
+#define MAX_JOBS                 64
 
 int apply_global_flags(struct parameter*, int, char**);
 void apply_command_flags(struct parameter*, int, int, char**);
 void usage(char *);
 struct parameter *GetParamLine(int,char *[]);
+int IsImageAction(int);
+int RunImageAction(struct prodos_image *,struct parameter *);
+int SplitBatchLine(char *,char **,int);
+int RunBatchScript(struct prodos_image *,char *,struct parameter *);
+int ProcessImage(struct parameter *,char *,char *,int);
+int RunImagePool(struct parameter *);
+static void ImagePoolThread(void *);
+static int GetGlobalFlagSize(int,int,char **);
+static int GetOutputFormat(int,char **);
+static int GetImageList(struct parameter *,int,char **,int);
+static char *BuildImageOutputPath(char *,char *);
+static int compare_path(const void *,const void *);
+static int compare_string(const void *,const void *);
+
+/** Une image de CATALOG, CHECKVOLUME ou EXTRACTVOLUME sur plusieurs images **/
+struct image_job
+{
+  char *image_file_path;
+  char *output_directory_path;
+
+  int error;
+  int done;
+
+  logbuffer output;           /* Messages de l'image, affichés dans l'ordre */
+};
+
+struct image_pool
+{
+  struct parameter *param;
+
+  int nb_job;
+  struct image_job *tab_job;
+
+  int next_job;               /* Dernière image prise par un thread */
+  int next_output;            /* Prochaine image à afficher */
+  void *output_lock;
+};
+
+/* GetParamLine() décode une ligne de BATCH : une erreur n'affiche pas usage() */
+static int param_batch_line = 0;
 
 /****************************************************/
 /*  main() :  Fonction principale de l'application. */
@@ -83,8 +133,12 @@ int main(int argc, char *argv[])
   struct prodos_image *current_image;
   struct file_descriptive_entry *folder_entry;
 
-  /* Message Information */
-  logf("%s v 1.4.6 (c) Brutal Deluxe 2011-2013.\n",argv[0]);
+  /* La sortie stdout bufferisée est écrite à la fin (cf log_flush) */
+  atexit(log_flush);
+
+  /* Message Information (pas dans un rapport json / csv) */
+  if(GetOutputFormat(argc,argv) != FORMAT_JSON && GetOutputFormat(argc,argv) != FORMAT_CSV)
+    logf("%s v 1.4.6 (c) Brutal Deluxe 2011-2013.\n",argv[0]);
 
   /* Vérification des paramètres */
   if(argc < 3)
@@ -101,38 +155,20 @@ int main(int argc, char *argv[])
   if(param == NULL)
     return(ERROR_PARAM);
 
-  /** Actions **/
-  if(param->action == ACTION_CATALOG)
-    {
-      /* Information */
-      logf_info("  - Catalog volume '%s'\n",param->image_file_path);
-
-      /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
-      if(current_image == NULL)
-        return(ERROR_LOAD);
-
-      /** Affichage du contenu de l'image **/
-      DumpProdosImage(current_image,param->verbose);
+  /* --stats : tout ce qui n'est pas chargement ou écriture compte pour la commande */
+  stats_EnterPhase(STATS_PHASE_OPERATION);
 
-      /* Libération mémoire */
-      mem_free_image(current_image);
-    }
-  else if(param->action == ACTION_CHECK_VOLUME)
+  /** Actions **/
+  if(param->action == ACTION_CATALOG || param->action == ACTION_CHECK_VOLUME || param->action == ACTION_EXTRACT_VOLUME)
     {
-      /* Information */
-      logf_info("  - Check volume '%s'\n",param->image_file_path);
-
-      /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
-      if(current_image == NULL)
-        return(ERROR_LOAD);
-
-      /** Affichage des informations sur le contenu de l'image **/
-      CheckProdosImage(current_image,param->verbose);
-
-      /* Libération mémoire */
-      mem_free_image(current_image);
+      /* En-tête CSV commun à toutes les images */
+      if(param->output_format == FORMAT_CSV && param->action == ACTION_CATALOG)
+        DumpCatalogCsvHeader();
+      else if(param->output_format == FORMAT_CSV && param->action == ACTION_CHECK_VOLUME)
+        CheckVolumeCsvHeader();
+
+      /** Une ou plusieurs images **/
+      application_error = RunImagePool(param);
     }
   else if(param->action == ACTION_EXTRACT_FILE)
     {
@@ -141,7 +177,7 @@ int main(int argc, char *argv[])
       if (param->output_apple_single)logf_info("    - Creating AppleSingle file!\n");
 
       /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
+      current_image = LoadProdosImage(param->image_file_path,IMAGE_ACCESS_LAZY);
       if(current_image == NULL)
         return(ERROR_LOAD);
 
@@ -163,7 +199,7 @@ int main(int argc, char *argv[])
       if (param->output_apple_single)logf_info("    - Creating AppleSingle files!\n");
 
       /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
+      current_image = LoadProdosImage(param->image_file_path,IMAGE_ACCESS_LAZY);
       if(current_image == NULL)
         return(ERROR_LOAD);
 
@@ -177,7 +213,8 @@ int main(int argc, char *argv[])
         current_image,
         folder_entry,
         param->output_directory_path,
-        param->output_apple_single
+        param->output_apple_single,
+        param->nb_jobs
       );
 
       /* Stat */
@@ -187,228 +224,554 @@ int main(int argc, char *argv[])
       /* Libération mémoire */
       mem_free_image(current_image);
     }
-  else if(param->action == ACTION_EXTRACT_VOLUME)
+  else if(IsImageAction(param->action))
     {
       /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
+      current_image = LoadProdosImage(param->image_file_path,IMAGE_ACCESS_WRITE);
       if(current_image == NULL)
         return(ERROR_LOAD);
+      current_image->image_sync = param->sync_image;
+
+      /** Modifie l'image **/
+      application_error = RunImageAction(current_image,param);
 
+      /* Libération mémoire */
+      mem_free_image(current_image);
+    }
+  else if(param->action == ACTION_CREATE_VOLUME)
+    {
       /* Information */
-      logf_info("  - Extract volume '%s' :\n",current_image->volume_header->volume_name_case);
-      if (param->output_apple_single)logf_info("    - Creating AppleSingle files!\n");
+      logf_info("  - Create volume '%s' :\n",param->image_file_path);
 
-      /** Extrait les fichiers du volume **/
-      ExtractVolumeFiles(
-        current_image,
-        param->output_directory_path,
-        param->output_apple_single
+      /** Création de l'image 2mg **/
+      current_image = CreateProdosVolume(
+        param->image_file_path,
+        param->new_volume_name,
+        param->new_volume_size_kb,
+        param->zero_case_bits
       );
 
-      /* Stat */
-      logf("    => File(s) : %d,  Folder(s) : %d,  Error(s) : %d\n",current_image->nb_extract_file,current_image->nb_extract_folder,current_image->nb_extract_error);
-      if (current_image->nb_extract_error > 0) application_error = ERROR_EXTRACT;
+      if(current_image == NULL)
+        return(ERROR_LOAD);
 
       /* Libération mémoire */
       mem_free_image(current_image);
     }
-  else if(param->action == ACTION_RENAME_FILE)
+  else if(param->action == ACTION_BATCH)
     {
-      /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
+      /** Charge l'image 2mg une seule fois **/
+      current_image = LoadProdosImage(param->image_file_path,IMAGE_ACCESS_WRITE);
       if(current_image == NULL)
         return(ERROR_LOAD);
+      current_image->image_sync = param->sync_image;
 
       /* Information */
-      logf_info("  - Rename file '%s' as '%s' :\n",param->prodos_file_path,param->new_file_name);
+      logf_info("  - Batch '%s' on volume '%s' :\n",param->script_file_path,current_image->volume_header->volume_name_case);
 
-      /** Renome le fichier **/
-      RenameProdosFile(current_image,param->prodos_file_path,param->new_file_name);
+      /** Exécute les commandes du script, l'image n'est écrite qu'à la fin **/
+      current_image->update_deferred = 1;
+      application_error = RunBatchScript(current_image,argv[0],param);
+      current_image->update_deferred = 0;
+
+      /** Ecrit les blocks modifiés, seulement si toutes les commandes ont réussi **/
+      if(application_error == 0 && UpdateProdosImage(current_image))
+        application_error = ERROR_BATCH;
 
       /* Libération mémoire */
       mem_free_image(current_image);
     }
-  else if(param->action == ACTION_RENAME_FOLDER)
+  else if(param->action == ACTION_CLEAR_HIGH_BIT)
     {
-      /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
-      if(current_image == NULL)
-        return(ERROR_LOAD);
+      /** Construit la liste des fichiers **/
+      filepath_tab = BuildFileList(param->file_path,&nb_filepath);
 
-      /* Information */
-      logf_info("  - Rename folder '%s' as '%s' :\n",param->prodos_folder_path,param->new_folder_name);
+      /** Met à 0 le bit 7 des octets du fichier **/
+      for(i=0; i<nb_filepath; i++)
+        {
+          logf_info("  - Clear High bit for file '%s'\n",filepath_tab[i]);
+          ClearFileHighBit(filepath_tab[i]);
+        }
 
-      /** Renome le dossier **/
-      RenameProdosFolder(current_image,param->prodos_folder_path,param->new_folder_name);
+      /* Libération mémoire */
+      mem_free_list(nb_filepath,filepath_tab);
+    }
+  else if(param->action == ACTION_SET_HIGH_BIT)
+    {
+      /** Construit la liste des fichiers **/
+      filepath_tab = BuildFileList(param->file_path,&nb_filepath);
+
+      /** Met à 1 le bit 7 des octets du fichier **/
+      for(i=0; i<nb_filepath; i++)
+        {
+          logf_info("  - Set High bit for file '%s'\n",filepath_tab[i]);
+          SetFileHighBit(filepath_tab[i]);
+        }
 
       /* Libération mémoire */
-      mem_free_image(current_image);
+      mem_free_list(nb_filepath,filepath_tab);
     }
-  else if(param->action == ACTION_RENAME_VOLUME)
+  else if(param->action == ACTION_INDENT_FILE)
+    {
+      /** Construit la liste des fichiers **/
+      filepath_tab = BuildFileList(param->file_path,&nb_filepath);
+
+      /** Indente les lignes de code du fichier **/
+      for(i=0; i<nb_filepath; i++)
+        {
+          logf_info("  - Indent file '%s'\n",filepath_tab[i]);
+          IndentFile(filepath_tab[i]);
+        }
+
+      /* Libération mémoire */
+      mem_free_list(nb_filepath,filepath_tab);
+    }
+  else if(param->action == ACTION_OUTDENT_FILE)
     {
+      /** Construit la liste des fichiers **/
+      filepath_tab = BuildFileList(param->file_path,&nb_filepath);
+
+      /** Dé-Indente les lignes de code du fichier **/
+      for(i=0; i<nb_filepath; i++)
+        {
+          logf_info("  - Outdent file '%s'\n",filepath_tab[i]);
+          OutdentFile(filepath_tab[i]);
+        }
+
+      /* Libération mémoire */
+      mem_free_list(nb_filepath,filepath_tab);
+    }
+
+  /* Libération mémoire */
+  mem_free_param(param);
+  my_Memory(MEMORY_FREE,NULL,NULL);
+
+  /* return final error code, if any */
+  return(application_error);
+}
+
+/*************************************************************************/
+/*  ProcessImage() :  CATALOG, CHECKVOLUME ou EXTRACTVOLUME d'une image. */
+/*************************************************************************/
+int ProcessImage(struct parameter *param, char *image_file_path, char *output_directory_path, int nb_jobs)
+{
+  int application_error = 0;
+  struct prodos_image *current_image;
+
+  if(param->action == ACTION_CATALOG)
+    {
+      /* Information */
+      logf_info("  - Catalog volume '%s'\n",image_file_path);
+
       /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
+      current_image = LoadProdosImage(image_file_path,(param->use_cache) ? IMAGE_ACCESS_CACHE : IMAGE_ACCESS_READ);
       if(current_image == NULL)
         return(ERROR_LOAD);
 
-      /* Information */
-      logf_info("  - Rename volume '%s' as '%s' :\n",current_image->volume_header->volume_name_case,param->new_volume_name);
-
-      /** Renome le volume **/
-      RenameProdosVolume(current_image,param->new_volume_name);
+      /** Affichage du contenu de l'image **/
+      DumpProdosImage(current_image,param->verbose,param->output_format);
 
       /* Libération mémoire */
       mem_free_image(current_image);
     }
-  else if(param->action == ACTION_MOVE_FILE)
+  else if(param->action == ACTION_CHECK_VOLUME)
     {
+      /* Information */
+      logf_info("  - Check volume '%s'\n",image_file_path);
+
       /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
+      current_image = LoadProdosImage(image_file_path,(param->use_cache) ? IMAGE_ACCESS_CACHE : IMAGE_ACCESS_READ);
       if(current_image == NULL)
         return(ERROR_LOAD);
 
-      /* Information */
-      logf_info("  - Move file '%s' to folder '%s' :\n",param->prodos_file_path,param->new_file_path);
-
-      /** Déplace le fichier **/
-      MoveProdosFile(current_image,param->prodos_file_path,param->new_file_path);
+      /** Affichage des informations sur le contenu de l'image **/
+      CheckProdosImage(current_image,param->verbose,param->output_format);
 
       /* Libération mémoire */
       mem_free_image(current_image);
     }
-  else if(param->action == ACTION_MOVE_FOLDER)
+  else if(param->action == ACTION_EXTRACT_VOLUME)
     {
       /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
+      current_image = LoadProdosImage(image_file_path,(param->use_cache) ? IMAGE_ACCESS_CACHE : IMAGE_ACCESS_READ);
       if(current_image == NULL)
         return(ERROR_LOAD);
 
       /* Information */
-      logf_info("  - Move folder '%s' to '%s' :\n",param->prodos_folder_path,param->new_folder_path);
+      logf_info("  - Extract volume '%s' :\n",current_image->volume_header->volume_name_case);
+      if (param->output_apple_single)logf_info("    - Creating AppleSingle files!\n");
 
-      /** Déplace le dossier **/
-      MoveProdosFolder(current_image,param->prodos_folder_path,param->new_folder_path);
+      /** Extrait les fichiers du volume **/
+      ExtractVolumeFiles(
+        current_image,
+        output_directory_path,
+        param->output_apple_single,
+        nb_jobs
+      );
+
+      /* Stat */
+      logf("    => File(s) : %d,  Folder(s) : %d,  Error(s) : %d\n",current_image->nb_extract_file,current_image->nb_extract_folder,current_image->nb_extract_error);
+      if (current_image->nb_extract_error > 0) application_error = ERROR_EXTRACT;
 
       /* Libération mémoire */
       mem_free_image(current_image);
     }
-  else if(param->action == ACTION_DELETE_FILE)
+
+  return(application_error);
+}
+
+
+/**
+ * Run CATALOG, CHECKVOLUME or EXTRACTVOLUME on every image of the command
+ * line. A single image is processed as before, with --jobs used by the
+ * extraction. Several images are spread over min(--jobs, nb_image) threads,
+ * each one with its own my_Memory lists. The messages of an image are kept
+ * in memory and printed once every previous image has been printed, so the
+ * output is the same as running cadius once per image. EXTRACTVOLUME writes
+ * each image in a sub-folder of the output directory named after the image.
+ *
+ * @brief RunImagePool
+ * @param param
+ * @return 0 if every image succeeded, else the first error code
+ */
+int RunImagePool(struct parameter *param)
+{
+  int i, j, nb_thread, length, suffix, previous_phase, application_error = 0;
+  char *output_path;
+  struct image_job **tab_sorted;
+  struct image_pool pool;
+
+  /** Une seule image : pas de buffer **/
+  if(param->nb_image == 1)
+    return(ProcessImage(param,param->tab_image_file_path[0],param->output_directory_path,param->nb_jobs));
+
+  /* Init */
+  memset(&pool,0,sizeof(struct image_pool));
+  pool.param = param;
+  pool.nb_job = param->nb_image;
+  pool.next_job = -1;
+  pool.tab_job = (struct image_job *) calloc(pool.nb_job,sizeof(struct image_job));
+  tab_sorted = (struct image_job **) calloc(pool.nb_job,sizeof(struct image_job *));
+  pool.output_lock = os_CreateLock();
+  if(pool.tab_job == NULL || tab_sorted == NULL || pool.output_lock == NULL)
     {
-      /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
-      if(current_image == NULL)
-        return(ERROR_LOAD);
+      logf_error("  Error : Impossible to allocate memory.\n");
+      free(pool.tab_job);
+      free(tab_sorted);
+      os_FreeLock(pool.output_lock);
+      return(ERROR_PARAM);
+    }
+
+  /** Une image par job **/
+  for(i=0; i<pool.nb_job; i++)
+    {
+      pool.tab_job[i].image_file_path = param->tab_image_file_path[i];
+      if(param->action == ACTION_EXTRACT_VOLUME)
+        {
+          pool.tab_job[i].output_directory_path = BuildImageOutputPath(param->output_directory_path,param->tab_image_file_path[i]);
+          if(pool.tab_job[i].output_directory_path == NULL)
+            {
+              logf_error("  Error : Impossible to allocate memory.\n");
+              application_error = ERROR_PARAM;
+              break;
+            }
+        }
+      tab_sorted[i] = &pool.tab_job[i];
+    }
+
+  /** Deux images de même nom ne doivent pas partager le même dossier **/
+  if(application_error == 0 && param->action == ACTION_EXTRACT_VOLUME)
+    {
+      qsort(tab_sorted,pool.nb_job,sizeof(struct image_job *),compare_path);
+      for(i=1; i<pool.nb_job && application_error == 0; i++)
+        {
+          if(strcmp(tab_sorted[i]->output_directory_path,tab_sorted[i-1]->output_directory_path))
+            continue;
+
+          /* Renomme le dossier en xxx_2, xxx_3... */
+          for(j=i,suffix=2; j<pool.nb_job && !strcmp(tab_sorted[j]->output_directory_path,tab_sorted[i-1]->output_directory_path); j++)
+            {
+              length = strlen(tab_sorted[j]->output_directory_path);
+              output_path = (char *) calloc(length+16,sizeof(char));
+              if(output_path == NULL)
+                {
+                  logf_error("  Error : Impossible to allocate memory.\n");
+                  application_error = ERROR_PARAM;
+                  break;
+                }
+              memcpy(output_path,tab_sorted[j]->output_directory_path,length-1);
+              sprintf(&output_path[length-1],"_%d%c",suffix++,FOLDER_CHARACTER[0]);
+              free(tab_sorted[j]->output_directory_path);
+              tab_sorted[j]->output_directory_path = output_path;
+            }
+          i = j;
+        }
+    }
+
+  /** Traitement des images **/
+  if(application_error == 0)
+    {
+      nb_thread = (param->nb_jobs < pool.nb_job) ? param->nb_jobs : pool.nb_job;
+      if(nb_thread == 1)
+        ImagePoolThread(&pool);
+      else
+        {
+          /* --stats : les phases sont celles des threads, cumulées */
+          previous_phase = stats_EnterPhase(STATS_PHASE_NONE);
+          os_RunThreads(nb_thread,ImagePoolThread,&pool);
+          stats_LeavePhase(previous_phase);
+        }
+
+      /* Premier code d'erreur */
+      for(i=0; i<pool.nb_job; i++)
+        if(pool.tab_job[i].error)
+          {
+            application_error = pool.tab_job[i].error;
+            break;
+          }
+    }
+
+  /* Libération mémoire */
+  for(i=0; i<pool.nb_job; i++)
+    {
+      free(pool.tab_job[i].output_directory_path);
+      free(pool.tab_job[i].output.data);
+    }
+  free(pool.tab_job);
+  free(tab_sorted);
+  os_FreeLock(pool.output_lock);
+
+  return(application_error);
+}
 
+
+/****************************************************************/
+/*  ImagePoolThread() :  Traite les images tant qu'il en reste. */
+/****************************************************************/
+static void ImagePoolThread(void *data)
+{
+  int index, previous_phase;
+  struct image_job *job;
+  struct memory_context *context, *previous_context;
+  struct image_pool *pool = (struct image_pool *) data;
+
+  while((index = os_AtomicIncrement(&pool->next_job)) < pool->nb_job)
+    {
+      job = &pool->tab_job[index];
+
+      /** Listes my_Memory et messages propres à l'image **/
+      context = mem_alloc_context();
+      if(context == NULL)
+        {
+          logf_error("  Error : Impossible to allocate memory.\n");
+          job->error = ERROR_LOAD;
+        }
+      else
+        {
+          previous_context = my_SetMemoryContext(context);
+          log_set_buffer(&job->output);
+
+          previous_phase = stats_EnterPhase(STATS_PHASE_OPERATION);
+          job->error = ProcessImage(pool->param,job->image_file_path,job->output_directory_path,1);
+          stats_LeavePhase(previous_phase);
+
+          log_set_buffer(NULL);
+          my_SetMemoryContext(previous_context);
+          mem_free_context(context);
+        }
+
+      /** Affiche les images terminées, dans l'ordre **/
+      os_Lock(pool->output_lock);
+      log_flush();
+      job->done = 1;
+      while(pool->next_output < pool->nb_job && pool->tab_job[pool->next_output].done)
+        {
+          job = &pool->tab_job[pool->next_output++];
+          if(job->output.length > 0)
+            fwrite(job->output.data,1,job->output.length,stdout);
+          free(job->output.data);
+          memset(&job->output,0,sizeof(logbuffer));
+        }
+      fflush(stdout);
+      os_Unlock(pool->output_lock);
+    }
+}
+
+
+/**********************************************************************/
+/*  BuildImageOutputPath() :  Dossier de sortie propre à une image    */
+/*                            (output_directory/NOM_IMAGE/).          */
+/**********************************************************************/
+static char *BuildImageOutputPath(char *output_directory_path, char *image_file_path)
+{
+  int i, length;
+  char *name, *extension, *output_path;
+
+  /* Nom de l'image sans son chemin ni son extension */
+  name = image_file_path;
+  for(i=0; image_file_path[i] != '\0'; i++)
+    if(image_file_path[i] == '/' || image_file_path[i] == '\\')
+      name = &image_file_path[i+1];
+  extension = strrchr(name,'.');
+  length = (extension == NULL || extension == name) ? (int) strlen(name) : (int) (extension - name);
+
+  output_path = (char *) calloc(strlen(output_directory_path)+length+3,sizeof(char));
+  if(output_path == NULL)
+    return(NULL);
+
+  strcpy(output_path,output_directory_path);
+  if(strlen(output_path) > 0 && output_path[strlen(output_path)-1] != '/' && output_path[strlen(output_path)-1] != '\\')
+    strcat(output_path,FOLDER_CHARACTER);
+  strncat(output_path,name,length);
+  strcat(output_path,FOLDER_CHARACTER);
+
+  return(output_path);
+}
+
+
+/**********************************************************/
+/*  compare_path() :  Tri des jobs par dossier de sortie. */
+/**********************************************************/
+static int compare_path(const void *data_1, const void *data_2)
+{
+  struct image_job *job_1 = *((struct image_job **) data_1);
+  struct image_job *job_2 = *((struct image_job **) data_2);
+
+  return(strcmp(job_1->output_directory_path,job_2->output_directory_path));
+}
+
+
+/****************************************************/
+/*  compare_string() :  Tri des chemins des images. */
+/****************************************************/
+static int compare_string(const void *data_1, const void *data_2)
+{
+  return(strcmp(*((char **) data_1),*((char **) data_2)));
+}
+
+
+/*********************************************************************/
+/*  IsImageAction() :  Commande modifiant une image déjà existante ? */
+/*********************************************************************/
+int IsImageAction(int action)
+{
+  return(action == ACTION_RENAME_FILE || action == ACTION_RENAME_FOLDER || action == ACTION_RENAME_VOLUME ||
+         action == ACTION_MOVE_FILE || action == ACTION_MOVE_FOLDER ||
+         action == ACTION_DELETE_FILE || action == ACTION_DELETE_FOLDER || action == ACTION_DELETE_VOLUME ||
+         action == ACTION_ADD_FILE || action == ACTION_ADD_FOLDER || action == ACTION_REPLACE_FILE ||
+         action == ACTION_CREATE_FOLDER);
+}
+
+
+/*******************************************************************/
+/*  RunImageAction() :  Applique une commande à une image chargée. */
+/*******************************************************************/
+int RunImageAction(struct prodos_image *current_image, struct parameter *param)
+{
+  int application_error = 0;
+
+  /* Les compteurs ne concernent que la commande en cours */
+  current_image->nb_add_file = 0;
+  current_image->nb_add_folder = 0;
+  current_image->nb_add_error = 0;
+
+  if(param->action == ACTION_RENAME_FILE)
+    {
+      /* Information */
+      logf_info("  - Rename file '%s' as '%s' :\n",param->prodos_file_path,param->new_file_name);
+
+      /** Renome le fichier **/
+      if(RenameProdosFile(current_image,param->prodos_file_path,param->new_file_name))
+        application_error = ERROR_MODIFY;
+    }
+  else if(param->action == ACTION_RENAME_FOLDER)
+    {
+      /* Information */
+      logf_info("  - Rename folder '%s' as '%s' :\n",param->prodos_folder_path,param->new_folder_name);
+
+      /** Renome le dossier **/
+      if(RenameProdosFolder(current_image,param->prodos_folder_path,param->new_folder_name))
+        application_error = ERROR_MODIFY;
+    }
+  else if(param->action == ACTION_RENAME_VOLUME)
+    {
+      /* Information */
+      logf_info("  - Rename volume '%s' as '%s' :\n",current_image->volume_header->volume_name_case,param->new_volume_name);
+
+      /** Renome le volume **/
+      if(RenameProdosVolume(current_image,param->new_volume_name))
+        application_error = ERROR_MODIFY;
+    }
+  else if(param->action == ACTION_MOVE_FILE)
+    {
+      /* Information */
+      logf_info("  - Move file '%s' to folder '%s' :\n",param->prodos_file_path,param->new_file_path);
+
+      /** Déplace le fichier **/
+      if(MoveProdosFile(current_image,param->prodos_file_path,param->new_file_path))
+        application_error = ERROR_MODIFY;
+    }
+  else if(param->action == ACTION_MOVE_FOLDER)
+    {
+      /* Information */
+      logf_info("  - Move folder '%s' to '%s' :\n",param->prodos_folder_path,param->new_folder_path);
+
+      /** Déplace le dossier **/
+      if(MoveProdosFolder(current_image,param->prodos_folder_path,param->new_folder_path))
+        application_error = ERROR_MODIFY;
+    }
+  else if(param->action == ACTION_DELETE_FILE)
+    {
       /* Information */
       logf_info("  - Delete file '%s' :\n",param->prodos_file_path);
 
       /** Supprime le fichier **/
-      DeleteProdosFile(current_image,param->prodos_file_path);
-
-      /* Libération mémoire */
-      mem_free_image(current_image);
+      if(DeleteProdosFile(current_image,param->prodos_file_path))
+        application_error = ERROR_MODIFY;
     }
   else if(param->action == ACTION_DELETE_FOLDER)
     {
-      /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
-      if(current_image == NULL)
-        return(ERROR_LOAD);
-
       /* Information */
       logf_info("  - Delete folder '%s' :\n",param->prodos_folder_path);
 
       /** Supprime le dossier **/
-      DeleteProdosFolder(current_image,param->prodos_folder_path);
-
-      /* Libération mémoire */
-      mem_free_image(current_image);
+      if(DeleteProdosFolder(current_image,param->prodos_folder_path))
+        application_error = ERROR_MODIFY;
     }
   else if(param->action == ACTION_DELETE_VOLUME)
     {
-      /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
-      if(current_image == NULL)
-        return(ERROR_LOAD);
-
       /* Information */
       logf_info("  - Delete volume '%s' :\n",current_image->volume_header->volume_name_case);
 
       /** Supprime le volume **/
-      DeleteProdosVolume(current_image);
-
-      /* Libération mémoire */
-      mem_free_image(current_image);
+      if(DeleteProdosVolume(current_image))
+        application_error = ERROR_MODIFY;
     }
   else if(param->action == ACTION_CREATE_FOLDER)
     {
-      /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
-      if(current_image == NULL)
-        return(ERROR_LOAD);
-
       /* Information */
       logf_info("  - Create folder '%s' :\n",param->prodos_folder_path);
 
       /** Création du Folder **/
-      CreateProdosFolder(
-        current_image,
-        param->prodos_folder_path,
-        param->zero_case_bits
-      );
-
-      /* Libération mémoire */
-      mem_free_image(current_image);
-    }
-  else if(param->action == ACTION_CREATE_VOLUME)
-    {
-      /* Information */
-      logf_info("  - Create volume '%s' :\n",param->image_file_path);
-
-      /** Création de l'image 2mg **/
-      current_image = CreateProdosVolume(
-        param->image_file_path,
-        param->new_volume_name,
-        param->new_volume_size_kb,
-        param->zero_case_bits
-      );
-
-      if(current_image == NULL)
-        return(ERROR_LOAD);
-
-      /* Libération mémoire */
-      mem_free_image(current_image);
+      if(CreateProdosFolder(current_image,param->prodos_folder_path,param->zero_case_bits))
+        application_error = ERROR_MODIFY;
     }
   else if(param->action == ACTION_ADD_FILE)
     {
-      /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
-      if(current_image == NULL)
-        return(ERROR_LOAD);
-
       /* Information */
       logf_info("  - Add file '%s' :\n",param->file_path);
 
       /** Ajoute le fichier dans l'archive **/
-      AddFile(
+      int add_error = AddFile(
         current_image,
         param->file_path,
         param->prodos_folder_path,
         param->zero_case_bits,
         1
       );
-      if (current_image->nb_add_error > 0) application_error = ERROR_ADD;
-
-      /* Libération mémoire */
-      mem_free_image(current_image);
+      if (add_error != 0 || current_image->nb_add_error > 0) application_error = ERROR_ADD;
     }
   else if(param->action == ACTION_ADD_FOLDER)
     {
-      /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
-      if(current_image == NULL)
-        return(ERROR_LOAD);
-
       /* Information */
       logf_info("  - Add folder '%s' :\n",param->folder_path);
 
@@ -418,17 +781,9 @@ int main(int argc, char *argv[])
 
       /* Stat */
       logf("    => File(s) : %d,  Folder(s) : %d,  Error(s) : %d\n",current_image->nb_add_file,current_image->nb_add_folder,current_image->nb_add_error);
-
-      /* Libération mémoire */
-      mem_free_image(current_image);
     }
   else if(param->action == ACTION_REPLACE_FILE)
     {
-      /** Charge l'image 2mg **/
-      current_image = LoadProdosImage(param->image_file_path);
-      if(current_image == NULL)
-        return(ERROR_LOAD);
-
       int fcharloc = 0;
       for (int i=strlen(param->file_path); i >= 0; --i) {
         if (!strncmp(&param->file_path[i], FOLDER_CHARACTER, 1))
@@ -466,77 +821,166 @@ int main(int argc, char *argv[])
       if (add_error != 0) application_error = ERROR_ADD;
 
       free(prodos_file_name);
-      mem_free_image(current_image);
     }
-  else if(param->action == ACTION_CLEAR_HIGH_BIT)
+
+  return(application_error);
+}
+
+
+/**
+ * Split a BATCH script line in place into whitespace separated words.
+ * A word may be wrapped in double quotes to keep its spaces.
+ *
+ * @brief SplitBatchLine
+ * @param line
+ * @param word_tab
+ * @param max_word
+ * @return Number of words, -1 if there are too many or a quote is left open
+ */
+int SplitBatchLine(char *line, char **word_tab, int max_word)
+{
+  int nb_word = 0;
+  char *next = line;
+
+  while(*next != '\0')
     {
-      /** Construit la liste des fichiers **/
-      filepath_tab = BuildFileList(param->file_path,&nb_filepath);
+      /* Passe les séparateurs */
+      while(*next == ' ' || *next == '\t' || *next == '\r' || *next == '\n')
+        next++;
+      if(*next == '\0')
+        break;
 
-      /** Met à 0 le bit 7 des octets du fichier **/
-      for(i=0; i<nb_filepath; i++)
+      if(nb_word == max_word)
+        return(-1);
+
+      if(*next == '"')
         {
-          logf_info("  - Clear High bit for file '%s'\n",filepath_tab[i]);
-          ClearFileHighBit(filepath_tab[i]);
+          word_tab[nb_word++] = ++next;
+          while(*next != '\0' && *next != '"')
+            next++;
+          if(*next == '\0')
+            return(-1);
+        }
+      else
+        {
+          word_tab[nb_word++] = next;
+          while(*next != '\0' && *next != ' ' && *next != '\t' && *next != '\r' && *next != '\n')
+            next++;
+          if(*next == '\0')
+            break;
         }
 
-      /* Libération mémoire */
-      mem_free_list(nb_filepath,filepath_tab);
+      /* Termine le mot */
+      *next++ = '\0';
     }
-  else if(param->action == ACTION_SET_HIGH_BIT)
-    {
-      /** Construit la liste des fichiers **/
-      filepath_tab = BuildFileList(param->file_path,&nb_filepath);
 
-      /** Met à 1 le bit 7 des octets du fichier **/
-      for(i=0; i<nb_filepath; i++)
-        {
-          logf_info("  - Set High bit for file '%s'\n",filepath_tab[i]);
-          SetFileHighBit(filepath_tab[i]);
-        }
+  return(nb_word);
+}
 
-      /* Libération mémoire */
-      mem_free_list(nb_filepath,filepath_tab);
+
+/**
+ * Run every command of a BATCH script against an image that is already
+ * loaded. Each line is a regular cadius command without the image path
+ * (e.g. ADDFILE /VOL/FOLDER ./file.bin -C) and goes through GetParamLine
+ * so the syntax is the same as on the command line. Empty lines and lines
+ * starting with '#' or ';' are skipped. The script is read from stdin
+ * when its path is '-'. The first invalid line or failing command stops
+ * the script, and the caller then leaves the image file unchanged.
+ *
+ * @brief RunBatchScript
+ * @param current_image
+ * @param program_path
+ * @param param
+ * @return 0 if every command succeeded, else the first error code
+ */
+int RunBatchScript(struct prodos_image *current_image, char *program_path, struct parameter *param)
+{
+  int c, nb_word, line_number, line_length, error, application_error = 0;
+  FILE *fd;
+  char line[BATCH_LINE_LENGTH];
+  char *word_tab[BATCH_MAX_WORD];
+  char *argv_tab[BATCH_MAX_WORD+2];
+  struct parameter *command_param;
+
+  /* Ouverture du script */
+  if(!strcmp(param->script_file_path,"-"))
+    fd = stdin;
+  else
+    fd = fopen(param->script_file_path,"r");
+  if(fd == NULL)
+    {
+      logf_error("  Error : Impossible to open batch script '%s'.\n",param->script_file_path);
+      return(ERROR_BATCH);
     }
-  else if(param->action == ACTION_INDENT_FILE)
+
+  /** Traite les lignes une à une **/
+  for(line_number=1; fgets(line,BATCH_LINE_LENGTH,fd) != NULL; line_number++)
     {
-      /** Construit la liste des fichiers **/
-      filepath_tab = BuildFileList(param->file_path,&nb_filepath);
+      /* Buffer plein sans fin de ligne : la ligne est trop longue (sauf si elle s'arrête juste là) */
+      line_length = (int) strlen(line);
+      if(line_length == BATCH_LINE_LENGTH-1 && line[line_length-1] != '\n')
+        {
+          c = fgetc(fd);
+          if(c != EOF && c != '\n')
+            {
+              logf_error("  Error : Batch script line %d is too long (%d characters max).\n",line_number,BATCH_LINE_LENGTH-1);
+              application_error = ERROR_BATCH;
+              break;
+            }
+        }
 
-      /** Indente les lignes de code du fichier **/
-      for(i=0; i<nb_filepath; i++)
+      nb_word = SplitBatchLine(line,word_tab,BATCH_MAX_WORD);
+      if(nb_word == 0 || word_tab[0][0] == '#' || word_tab[0][0] == ';')
+        continue;
+      if(nb_word < 0)
         {
-          logf_info("  - Indent file '%s'\n",filepath_tab[i]);
-          IndentFile(filepath_tab[i]);
+          logf_error("  Error : Invalid batch script line %d.\n",line_number);
+          application_error = ERROR_BATCH;
+          break;
         }
 
-      /* Libération mémoire */
-      mem_free_list(nb_filepath,filepath_tab);
-    }
-  else if(param->action == ACTION_OUTDENT_FILE)
-    {
-      /** Construit la liste des fichiers **/
-      filepath_tab = BuildFileList(param->file_path,&nb_filepath);
+      /* Reconstruit la ligne de commande : program COMMAND image param... */
+      argv_tab[0] = program_path;
+      argv_tab[1] = word_tab[0];
+      argv_tab[2] = param->image_file_path;
+      memcpy(&argv_tab[3],&word_tab[1],(nb_word-1)*sizeof(char *));
 
-      /** Dé-Indente les lignes de code du fichier **/
-      for(i=0; i<nb_filepath; i++)
+      param_batch_line = 1;
+      command_param = GetParamLine(nb_word+2,argv_tab);
+      param_batch_line = 0;
+      if(command_param == NULL)
         {
-          logf_info("  - Outdent file '%s'\n",filepath_tab[i]);
-          OutdentFile(filepath_tab[i]);
+          logf_error("  Error : Invalid batch script line %d.\n",line_number);
+          application_error = ERROR_BATCH;
+          break;
+        }
+      if(!IsImageAction(command_param->action))
+        {
+          logf_error("  Error : Command '%s' is not allowed in a batch (line %d).\n",word_tab[0],line_number);
+          mem_free_param(command_param);
+          application_error = ERROR_BATCH;
+          break;
         }
 
-      /* Libération mémoire */
-      mem_free_list(nb_filepath,filepath_tab);
+      /** Exécute la commande, la première erreur arrête le script **/
+      error = RunImageAction(current_image,command_param);
+      mem_free_param(command_param);
+      if(error)
+        {
+          logf_error("  Error : Batch script stopped at line %d.\n",line_number);
+          application_error = error;
+          break;
+        }
     }
 
-  /* Libération mémoire */
-  mem_free_param(param);
-  my_Memory(MEMORY_FREE,NULL,NULL);
+  /* Fermeture du script */
+  if(fd != stdin)
+    fclose(fd);
 
-  /* return final error code, if any */
   return(application_error);
 }
 
+
 /**
  * Parse tail end of args and toggle global settings
  *
@@ -566,11 +1010,176 @@ int apply_global_flags(struct parameter *params, int argc, char **argv)
       params -> output_apple_single = true;
       found += 1;
     }
+
+    if (!my_stricmp(argv[i], "--jobs") && i+1 < argc)
+    {
+      params -> nb_jobs = atoi(argv[++i]);
+      if (params -> nb_jobs < 1) params -> nb_jobs = 1;
+      if (params -> nb_jobs > MAX_JOBS) params -> nb_jobs = MAX_JOBS;
+      found += 2;
+    }
+
+    if (!my_stricmp(argv[i], "--sync"))
+    {
+      params -> sync_image = 1;
+      found += 1;
+    }
+
+    if (!my_stricmp(argv[i], "--cache"))
+    {
+      params -> use_cache = 1;
+      found += 1;
+    }
+
+    if (!my_strnicmp(argv[i], "--format=", strlen("--format=")))
+    {
+      params -> output_format = GetOutputFormat(argc, argv);
+      found += 1;
+    }
+
+    if (!my_stricmp(argv[i], "--stats"))
+    {
+      params -> show_stats = 1;
+      found += 1;
+    }
+
+    if (!my_strnicmp(argv[i], "--stats-file=", strlen("--stats-file=")))
+    {
+      params -> stats_file_path = &argv[i][strlen("--stats-file=")];
+      found += 1;
+    }
   }
 
   return argc-found;
 }
 
+/**
+ * Number of arguments used by the global flag at argv[index] (0 : not a
+ * global flag). Mirrors apply_global_flags.
+ *
+ * @param index
+ * @param argc
+ * @param argv
+ * @return 0, 1 or 2
+ */
+static int GetGlobalFlagSize(int index, int argc, char **argv)
+{
+  if (index < 3)
+    return 0;
+
+  if (!my_stricmp(argv[index], "--quiet") || !my_stricmp(argv[index], "-V") ||
+      !my_stricmp(argv[index], "-A") || !my_stricmp(argv[index], "--sync") ||
+      !my_stricmp(argv[index], "--cache") || !my_strnicmp(argv[index], "--format=", strlen("--format=")) ||
+      !my_stricmp(argv[index], "--stats") || !my_strnicmp(argv[index], "--stats-file=", strlen("--stats-file=")))
+    return 1;
+
+  if (!my_stricmp(argv[index], "--jobs") && index+1 < argc)
+    return 2;
+
+  return 0;
+}
+
+/**
+ * Value of the --format=text|json|csv option. The report formats only
+ * apply to CATALOG and CHECKVOLUME.
+ *
+ * @param argc
+ * @param argv
+ * @return FORMAT_TEXT if the option is absent, -1 if its value is unknown
+ */
+static int GetOutputFormat(int argc, char **argv)
+{
+  for (int i = 3; i < argc; ++i)
+  {
+    if (my_strnicmp(argv[i], "--format=", strlen("--format=")))
+      continue;
+
+    if (!my_stricmp(&argv[i][strlen("--format=")], "text"))
+      return FORMAT_TEXT;
+    if (!my_stricmp(&argv[i][strlen("--format=")], "json"))
+      return FORMAT_JSON;
+    if (!my_stricmp(&argv[i][strlen("--format=")], "csv"))
+      return FORMAT_CSV;
+    return -1;
+  }
+
+  return FORMAT_TEXT;
+}
+
+/**
+ * Build param->tab_image_file_path from the nb_image first parameters
+ * following the command. A parameter containing a '*' or a '?' is
+ * expanded with os_GetMatchingFiles (files of its folder only, sorted by
+ * name), the others are kept as they are.
+ *
+ * @param param
+ * @param argc
+ * @param argv
+ * @param nb_image Number of image parameters
+ * @return Index in argv of the parameter following the images (argc if
+ *         none), -1 on error
+ */
+static int GetImageList(struct parameter *param, int argc, char **argv, int nb_image)
+{
+  int i, j, nb_arg, nb_file, nb_image_max, size;
+  char **tab_file, **tab_image;
+
+  for (i = 2, nb_arg = 0; i < argc && nb_arg < nb_image; nb_arg++)
+  {
+    /* Saute les options globales */
+    while ((size = GetGlobalFlagSize(i, argc, argv)) > 0)
+      i += size;
+    if (i >= argc)
+      break;
+
+    if (strpbrk(argv[i], "*?") != NULL)
+    {
+      tab_file = os_GetMatchingFiles(argv[i], &nb_file);
+      if (tab_file != NULL)
+        qsort(tab_file, nb_file, sizeof(char *), compare_string);
+    }
+    else
+      tab_file = BuildFileList(argv[i], &nb_file);
+    if (tab_file == NULL || nb_file == 0)
+    {
+      logf_error("  Error : No image matching '%s'.\n", argv[i]);
+      free(tab_file);
+      return -1;
+    }
+
+    /* Ajoute les images à la liste */
+    nb_image_max = param->nb_image + nb_file;
+    tab_image = (char **) realloc(param->tab_image_file_path, nb_image_max*sizeof(char *));
+    if (tab_image == NULL)
+    {
+      logf("  Error : Impossible to allocate memory for structure Param.\n");
+      mem_free_list(nb_file, tab_file);
+      return -1;
+    }
+    param->tab_image_file_path = tab_image;
+    for (j = 0; j < nb_file; j++)
+      param->tab_image_file_path[param->nb_image++] = tab_file[j];
+    free(tab_file);
+
+    i++;
+  }
+
+  /* Première image */
+  if (param->nb_image == 0)
+    return -1;
+  param->image_file_path = strdup(param->tab_image_file_path[0]);
+  if (param->image_file_path == NULL)
+  {
+    logf("  Error : Impossible to allocate memory for structure Param.\n");
+    return -1;
+  }
+
+  /* Paramètre suivant */
+  while (i < argc && (size = GetGlobalFlagSize(i, argc, argv)) > 0)
+    i += size;
+  return i;
+}
+
 void apply_command_flags(struct parameter *params, int start, int argc, char **argv)
 {
   for (int i = start; i < argc; i++) {
@@ -598,13 +1207,23 @@ void usage(char *program_path)
 {
   logf("Usage : %s COMMAND <param_1> <param_2> <param_3>... [-V --quiet] : \n",program_path);
   logf("        ----\n");
-  logf("        %s CATALOG       <[2mg|hdv|po]_image_path>   [-V]\n",program_path);
-  logf("        %s CHECKVOLUME   <[2mg|hdv|po]_image_path>   [-V]\n",program_path);
+  logf("        %s CATALOG       <[2mg|hdv|po]_image_path>...   [-V]\n",program_path);
+  logf("        %s CHECKVOLUME   <[2mg|hdv|po]_image_path>...   [-V]\n",program_path);
   logf("        ----\n");
   logf("        %s EXTRACTFILE   <[2mg|hdv|po]_image_path>   <prodos_file_path>    <output_directory>\n",program_path);
   logf("        %s EXTRACTFOLDER <[2mg|hdv|po]_image_path>   <prodos_folder_path>  <output_directory>\n",program_path);
-  logf("        %s EXTRACTVOLUME <[2mg|hdv|po]_image_path>   <output_directory>\n\n",program_path);
+  logf("        %s EXTRACTVOLUME <[2mg|hdv|po]_image_path>... <output_directory>\n\n",program_path);
   logf("        [-A] Extract as AppleSingle\n");
+  logf("        [--jobs N] Decode and write files with N threads (EXTRACTFOLDER, EXTRACTVOLUME)\n");
+  logf("        CATALOG, CHECKVOLUME and EXTRACTVOLUME accept several images or a quoted pattern with '*' or '?'\n");
+  logf("        (e.g. 'disks/*.po', matched in that folder only).\n");
+  logf("        [--jobs N] then processes N images at a time; the output stays in command line order\n");
+  logf("        and EXTRACTVOLUME writes each image in <output_directory>/<image_name>/.\n");
+  logf("        [--cache] Keep the decoded file tree in <image_path>.cadius-idx and reuse it\n");
+  logf("        while the image is unchanged (CATALOG, CHECKVOLUME, EXTRACTVOLUME)\n");
+  logf("        [--format=text|json|csv] Report format of CATALOG and CHECKVOLUME : json writes one\n");
+  logf("        document per image and per line, csv one line per entry (CATALOG) or per error\n");
+  logf("        and block run (CHECKVOLUME, -V), errors go to stderr\n");
   logf("        ----\n");
   logf("        %s RENAMEFILE    <[2mg|hdv|po]_image_path>   <prodos_file_path>    <new_file_name>\n",program_path);
   logf("        %s RENAMEFOLDER  <[2mg|hdv|po]_image_path>   <prodos_folder_path>  <new_folder_name>\n",program_path);
@@ -635,6 +1254,16 @@ void usage(char *program_path)
   logf("        %s CREATEVOLUME  <[2mg|hdv|po]_image_path>   <volume_name>         <volume_size>\n",program_path);
   logf("        [-C | --no-case-bits]\n");
   logf("        ----\n");
+  logf("        %s BATCH         <[2mg|hdv|po]_image_path>   <script_path>\n",program_path);
+  logf("        One command per line without the image path (e.g. ADDFILE /VOL/FOLDER ./FILE.BIN).\n");
+  logf("        Use '-' to read the script from stdin. The image is written once at the end,\n");
+  logf("        only if every command succeeds : the first error stops the script and the image is left unchanged.\n");
+  logf("        ----\n");
+  logf("        [--sync] Wait until the modified blocks are on disk (commands that modify an image)\n");
+  logf("        [--stats] Print block reads/writes/allocations, decoded entries, bytes extracted/added\n");
+  logf("        and the time of each phase (load, directory, bitmap, operation, flush) to stderr at exit\n");
+  logf("        [--stats-file=<path>] Write the same counters to <path> as json\n");
+  logf("        ----\n");
   logf("        %s CLEARHIGHBIT  <source_file_path>\n",program_path);
   logf("        %s SETHIGHBIT    <source_file_path>\n",program_path);
   logf("        %s INDENTFILE    <source_file_path>\n",program_path);
@@ -648,6 +1277,7 @@ void usage(char *program_path)
 /***********************************************************************/
 struct parameter *GetParamLine(int argc, char *argv[])
 {
+  int i;
   struct parameter *param;
   char local_buffer[256];
 
@@ -661,7 +1291,8 @@ struct parameter *GetParamLine(int argc, char *argv[])
   /* Vérifications */
   if(argc < 3)
     {
-      usage(argv[0]);
+      if(param_batch_line == 0)
+        usage(argv[0]);
       return(NULL);
     }
 
@@ -675,16 +1306,31 @@ struct parameter *GetParamLine(int argc, char *argv[])
 
   int argc_no_global_flags = apply_global_flags(param, argc, argv);
 
-  /** CATALOG <image_path> **/
-  if(!my_stricmp(argv[1],"CATALOG") && argc_no_global_flags == 3)
+  /* Rapport json / csv : stdout ne reçoit que le rapport, les erreurs vont sur stderr */
+  if(param->output_format < 0)
+    {
+      logf("  Error : Invalid --format value (text, json or csv).\n");
+      mem_free_param(param);
+      return(NULL);
+    }
+  if(param->output_format != FORMAT_TEXT)
+    {
+      log_set_level(ERROR);
+      log_set_error_stderr(true);
+    }
+
+  /* Compteurs et chronos, affichés sur stderr et/ou écrits en json à la sortie */
+  if(param->show_stats || param->stats_file_path != NULL)
+    stats_Enable(param->show_stats,param->stats_file_path);
+
+  /** CATALOG <image_path>... **/
+  if(!my_stricmp(argv[1],"CATALOG") && argc_no_global_flags >= 3)
     {
       param->action = ACTION_CATALOG;
 
-      /* Chemin du fichier Image */
-      param->image_file_path = strdup(argv[2]);
-      if(param->image_file_path == NULL)
+      /* Chemins des fichiers Image */
+      if(GetImageList(param,argc,argv,argc_no_global_flags-2) < 0)
         {
-          logf("  Error : Impossible to allocate memory for structure Param.\n");
           mem_free_param(param);
           return(NULL);
         }
@@ -693,16 +1339,14 @@ struct parameter *GetParamLine(int argc, char *argv[])
       return(param);
     }
 
-  /** CHECKVOLUME <image_path> **/
-  if(!my_stricmp(argv[1],"CHECKVOLUME") && argc_no_global_flags == 3)
+  /** CHECKVOLUME <image_path>... **/
+  if(!my_stricmp(argv[1],"CHECKVOLUME") && argc_no_global_flags >= 3)
     {
       param->action = ACTION_CHECK_VOLUME;
 
-      /* Chemin du fichier Image */
-      param->image_file_path = strdup(argv[2]);
-      if(param->image_file_path == NULL)
+      /* Chemins des fichiers Image */
+      if(GetImageList(param,argc,argv,argc_no_global_flags-2) < 0)
         {
-          logf("  Error : Impossible to allocate memory for structure Param.\n");
           mem_free_param(param);
           return(NULL);
         }
@@ -763,16 +1407,21 @@ struct parameter *GetParamLine(int argc, char *argv[])
       return(param);
     }
 
-  /** EXTRACTVOLUME <image_path> <output_directory> **/
+  /** EXTRACTVOLUME <image_path>... <output_directory> **/
   if(!my_stricmp(argv[1],"EXTRACTVOLUME") && argc_no_global_flags >= 4)
     {
       param->action = ACTION_EXTRACT_VOLUME;
 
-      /* Chemin du fichier Image */
-      param->image_file_path = strdup(argv[2]);
+      /* Chemins des fichiers Image */
+      i = GetImageList(param,argc,argv,argc_no_global_flags-3);
+      if(i < 0 || i >= argc)
+        {
+          mem_free_param(param);
+          return(NULL);
+        }
 
-      /* Chemin du Répertoire Windows */
-      param->output_directory_path = strdup(argv[3]);
+      /* Chemin du Répertoire Windows : paramètre suivant les images */
+      param->output_directory_path = strdup(argv[i]);
 
       /* Vérification */
       if(param->image_file_path == NULL || param->output_directory_path == NULL)
@@ -1132,6 +1781,29 @@ struct parameter *GetParamLine(int argc, char *argv[])
       return(param);
     }
 
+  /** BATCH <2mg_image_path> <script_path> **/
+  if(!my_stricmp(argv[1],"BATCH") && argc_no_global_flags == 4)
+    {
+      param->action = ACTION_BATCH;
+
+      /* Chemin du fichier Image */
+      param->image_file_path = strdup(argv[2]);
+
+      /* Chemin du script */
+      param->script_file_path = strdup(argv[3]);
+
+      /* Vérification */
+      if(param->image_file_path == NULL || param->script_file_path == NULL)
+        {
+          logf("  Error : Impossible to allocate memory for structure Param.\n");
+          mem_free_param(param);
+          return(NULL);
+        }
+
+      /* OK */
+      return(param);
+    }
+
   /** CLEARHIGHBIT <file_path> **/
   if(!my_stricmp(argv[1],"CLEARHIGHBIT") && argc_no_global_flags == 3)
     {
@@ -1213,7 +1885,8 @@ struct parameter *GetParamLine(int argc, char *argv[])
     }
 
   /* Action inconnue */
-  usage(argv[0]);
+  if(param_batch_line == 0)
+    usage(argv[0]);
 
   /* Libération */
   mem_free_param(param);
@@ -25,18 +25,25 @@
 #include "Prodos_Create.h"
 #include "Prodos_Add.h"
 #include "File_AppleSingle.h"
+#include "Dc_Stats.h"
 #include "log.h"
 
 static struct prodos_file *LoadFile(char *, bool);
 static int GetFileInformation(char *,char *,struct prodos_file *);
 static void GetLineValue(char *,char *,char *);
-static void ComputeFileBlockUsage(struct prodos_file *);
+static int ComputeFileBlockUsage(struct prodos_file *);
+static void SetFileStorageType(struct prodos_file *);
+static int GetFileBlock(struct prodos_file *,int,int,unsigned char *);
 static WORD CreateFileContent(struct prodos_image *,struct prodos_file *);
+static WORD CreateForkContent(struct prodos_image *,struct prodos_file *,int);
+static void FreeForkContent(struct prodos_image *,struct prodos_file *,int);
 static void CreateFileEntry(struct prodos_image *,struct prodos_file *,WORD,struct file_descriptive_entry *,WORD,BYTE,WORD);
 static int CreateMemoryEntry(struct prodos_image *,struct file_descriptive_entry *,WORD,BYTE);
-static WORD CreateSeedlingContent(struct prodos_image *,struct prodos_file *,unsigned char *,int,int,int);
-static WORD CreateSaplingContent(struct prodos_image *,struct prodos_file *,unsigned char *,int,int,int);
-static WORD CreateTreeContent(struct prodos_image *,struct prodos_file *,unsigned char *,int,int,int,int);
+static WORD CreateSeedlingContent(struct prodos_image *,struct prodos_file *,int,int,int);
+static WORD CreateSaplingContent(struct prodos_image *,struct prodos_file *,int,int);
+static WORD CreateTreeContent(struct prodos_image *,struct prodos_file *,int,int,int);
+static int AllocateFileBlock(struct prodos_image *,struct prodos_file *,int,int,int);
+static void ReleaseFileBlock(struct prodos_image *,struct prodos_file *,int,int);
 
 /**
  * @brief      Adds a file.
@@ -55,10 +62,11 @@ int AddFile(
   bool zero_case_bits,
   int update_image
 ) {
-  int i, is_volume_header, error, is_valid;
+  int is_volume_header, error, is_valid;
   WORD file_block_number, directory_block_number, directory_header_pointer;
   BYTE directory_entry_number;
   struct file_descriptive_entry *target_folder;
+  struct file_descriptive_entry *existing_entry;
   struct prodos_file *current_file;
 
   /** Charge le fichier depuis le disque **/
@@ -85,7 +93,13 @@ int AddFile(
     }
 
   /** Calcule le nombre de block nécessaire pour stocker le fichier (gestion du Sparse) **/
-  ComputeFileBlockUsage(current_file);
+  error = ComputeFileBlockUsage(current_file);
+  if(error)
+    {
+      current_image->nb_add_error++;
+      mem_free_file(current_file);
+      return(1);
+    }
   if(current_file->tab_data_block == NULL || current_file->tab_resource_block == NULL)
     {
       logf_error("  Error : Impossible to allocate memory.\n");
@@ -97,7 +111,7 @@ int AddFile(
   /** Vérifie qu'il reste suffisament de place pour stocker le fichier **/
   if(current_file->entry_disk_block > current_image->nb_free_block)
     {
-      logf_error("  Error : No enough space in the image : '%d' bytes required ('%d' bytes available).\n",BLOCK_SIZE*current_file->entry_disk_block,BLOCK_SIZE*current_image->nb_free_block);
+      logf_error("  Error : No enough space in the image : at least '%d' bytes required ('%d' bytes available).\n",BLOCK_SIZE*current_file->entry_disk_block,BLOCK_SIZE*current_image->nb_free_block);
       current_image->nb_add_error++;
       mem_free_file(current_file);
       return(1);
@@ -113,45 +127,13 @@ int AddFile(
     }
 
   /** Vérifie que le nom de fichier ne correspond pas déjà à un nom de fichier/dossier pris **/
-  if(target_folder == NULL)
+  existing_entry = FindFolderEntry(current_image,target_folder,current_file->file_name_case);
+  if(existing_entry != NULL)
     {
-      /* Vérification à la racine du Volume */
-      for(i=0; i<current_image->nb_file; i++)
-        if(!my_stricmp(current_file->file_name_case,current_image->tab_file[i]->file_name))
-          {
-            logf_error("  Error : Invalid target location. A file already exist with the same name '%s'.\n",current_image->tab_file[i]->file_name);
-            current_image->nb_add_error++;
-            mem_free_file(current_file);
-            return(1);
-          }
-      for(i=0; i<current_image->nb_directory; i++)
-        if(!my_stricmp(current_file->file_name_case,current_image->tab_directory[i]->file_name))
-          {
-            logf_error("  Error : Invalid target location. A folder already exist with the same name '%s'.\n",current_image->tab_directory[i]->file_name);
-            current_image->nb_add_error++;
-            mem_free_file(current_file);
-            return(1);
-          }
-    }
-  else
-    {
-      /* Vérification dans le dossier */
-      for(i=0; i<target_folder->nb_file; i++)
-        if(!my_stricmp(current_file->file_name_case,target_folder->tab_file[i]->file_name))
-          {
-            logf_error("  Error : Invalid target location. A file already exist with the same name '%s'.\n",target_folder->tab_file[i]->file_name);
-            current_image->nb_add_error++;
-            mem_free_file(current_file);
-            return(1);
-          }
-      for(i=0; i<target_folder->nb_directory; i++)
-        if(!my_stricmp(current_file->file_name_case,target_folder->tab_directory[i]->file_name))
-          {
-            logf_error("  Error : Invalid target location. A folder already exist with the same name '%s'.\n",target_folder->tab_directory[i]->file_name);
-            current_image->nb_add_error++;
-            mem_free_file(current_file);
-            return(1);
-          }
+      logf_error("  Error : Invalid target location. A %s already exist with the same name '%s'.\n",((existing_entry->storage_type & 0x0F) == 0x0D) ? "folder" : "file",existing_entry->file_name);
+      current_image->nb_add_error++;
+      mem_free_file(current_file);
+      return(1);
     }
 
   /** Recherche d'une entrée libre dans le répertoire **/
@@ -166,7 +148,7 @@ int AddFile(
   /** Vérifie qu'il reste suffisament de place pour stocker le fichier (la réservation du nom dans le directory a peut être consommé 1 block **/
   if(current_file->entry_disk_block > current_image->nb_free_block)
     {
-      logf_error("  Error : No enough space in the image : '%d' bytes required ('%d' bytes available).\n",BLOCK_SIZE*current_file->entry_disk_block,BLOCK_SIZE*current_image->nb_free_block);
+      logf_error("  Error : No enough space in the image : at least '%d' bytes required ('%d' bytes available).\n",BLOCK_SIZE*current_file->entry_disk_block,BLOCK_SIZE*current_image->nb_free_block);
       current_image->nb_add_error++;
       mem_free_file(current_file);
       return(1);
@@ -195,11 +177,16 @@ int AddFile(
     }
 
   /* Libération mémoire */
+  STATS_ADD(STATS_BYTE_ADDED,current_file->data_length+current_file->resource_length);
   mem_free_file(current_file);
 
   /** Ecrit le fichier Image **/
   if(update_image)
-    error = UpdateProdosImage(current_image);
+    if(UpdateProdosImage(current_image))
+      {
+        current_image->nb_add_error++;
+        return(1);
+      }
 
   /* OK */
   current_image->nb_add_file++;
@@ -352,45 +339,79 @@ static struct prodos_file *LoadFile(char *file_path_data, bool zero_case_bits)
     }
   for(i=0; i<(int)strlen(current_file->file_name); i++)
     current_file->file_name[i] = toupper(current_file->file_name[i]);
-  /* Proper Case */
-  current_file->name_case = zero_case_bits ? 0 : BuildProdosCase(current_file->file_name_case);
 
-  // Load data. If an AppleSingle file, parse it.
-  unsigned char *data = LoadBinaryFile(file_path_data, &current_file->data_length);
+  // Open the data fork : only the AppleSingle magic is read here, plain
+  // files are then copied block by block into the image (GetFileBlock)
+  current_file->data_fd = OpenBinaryFile(file_path_data, &current_file->data_length);
 
-  if (data == NULL)
+  if (current_file->data_fd == NULL)
   {
     logf_error("  Error : Cannot load file %s\n", file_path_data);
+    mem_free_file(current_file);
     return NULL;
   }
 
-  bool is_apple_single = ASIsAppleSingle(data, (size_t) current_file->data_length);
+  unsigned char magic[4];
+  size_t magic_length = fread(magic, 1, sizeof(magic), current_file->data_fd);
+  bool is_apple_single = ASIsAppleSingle(magic, magic_length);
+  rewind(current_file->data_fd);
+
+  /** Récupération des Propriétés Date/Time du fichier (AppleSingle : remplacées par ses dates) **/
+  os_GetFileCreationModificationDate(file_path_data,current_file);
 
+  // An AppleSingle container is mapped (or loaded) as a whole, the forks
+  // are then read in place
   if (is_apple_single)
   {
+    fclose(current_file->data_fd);
+    current_file->data_fd = NULL;
+
+    current_file->input_file_data = os_MapFile(file_path_data, &current_file->input_file_length);
+    if (current_file->input_file_data != NULL)
+      current_file->input_mapped = 1;
+    else
+      current_file->input_file_data = LoadBinaryFile(file_path_data, &current_file->input_file_length);
+    if (current_file->input_file_data == NULL)
+    {
+      logf_error("  Error : Cannot load file %s\n", file_path_data);
+      mem_free_file(current_file);
+      return NULL;
+    }
+
     logf_info("      AppleSingle format detected!\n");
-    ASDecorateProdosFile(current_file, data, (size_t) current_file->data_length);
-  }
-  else
-  {
-    current_file->data = data;
+    if (ASDecorateProdosFile(current_file, current_file->input_file_data, (size_t) current_file->input_file_length))
+    {
+      logf_error("  Error : Invalid AppleSingle file %s\n", file_path_data);
+      mem_free_file(current_file);
+      return NULL;
+    }
   }
 
+  /* Proper Case (AppleSingle : son Real Name) */
+  current_file->name_case = zero_case_bits ? 0 : BuildProdosCase(current_file->file_name_case);
+
   if(current_file->data != NULL && current_file->data_length == 0)
+    current_file->data = NULL;
+  if(current_file->data_fd != NULL && current_file->data_length == 0)
     {
-      free(current_file->data);
-      current_file->data = NULL;
+      fclose(current_file->data_fd);
+      current_file->data_fd = NULL;
     }
 
-  /*** Chargement des Resources ***/
-  sprintf(file_path,"%s_ResourceFork.bin",file_path_data);
-  current_file->resource = LoadBinaryFile(file_path,&current_file->resource_length);
-  current_file->has_resource = (current_file->resource == NULL) ? 0 : 1;
-  if(current_file->resource != NULL && current_file->resource_length == 0)
+  /*** Ouverture des Resources (sauf si l'AppleSingle en contient) ***/
+  if(current_file->has_resource == 0)
     {
-      free(current_file->resource);
-      current_file->resource = NULL;
+      sprintf(file_path,"%s_ResourceFork.bin",file_path_data);
+      current_file->resource_fd = OpenBinaryFile(file_path,&current_file->resource_length);
+      current_file->has_resource = (current_file->resource_fd == NULL) ? 0 : 1;
+      if(current_file->resource_fd != NULL && current_file->resource_length == 0)
+        {
+          fclose(current_file->resource_fd);
+          current_file->resource_fd = NULL;
+        }
     }
+  else if(current_file->resource_length == 0)
+    current_file->resource = NULL;
 
   /** Chargement des Informations du fichier contenue dans _FileInformation.txt **/
   sprintf(file_path,"%s_FileInformation.txt",folder_path);
@@ -405,9 +426,6 @@ static struct prodos_file *LoadFile(char *file_path_data, bool zero_case_bits)
       current_file->access = 0xE3;
     }
 
-  /** Récupération des Propriétés Date/Time du fichier **/
-  os_GetFileCreationModificationDate(file_path_data,current_file);
-
   // Override values in _FileInformation.txt if the suffix is present
   if (prodos_meta)
   {
@@ -547,67 +565,47 @@ static void GetLineValue(char *line, char *variable, char *value_rtn)
 
 /********************************************************************************************/
 /*  ComputeFileBlockUsage() :  Détermine le nombre de block utiles pour stocker le fichier. */
+/*                             Les blocks à 0 ne sont connus qu'à la copie : d'ici là, on   */
+/*                             compte 1 block de data par fork (minimum).                   */
 /********************************************************************************************/
-static void ComputeFileBlockUsage(struct prodos_file *current_file)
+static int ComputeFileBlockUsage(struct prodos_file *current_file)
 {
-  int i, result;
-  unsigned char empty_block[BLOCK_SIZE];
-
   /* Init */
-  memset(empty_block,0x00,BLOCK_SIZE);
-  current_file->block_disk_data = 0;      /* Nb de blocks disk utilisés pour les data */
+  current_file->block_disk_data = 1;      /* Nb de blocks disk utilisés pour les data (le 1er n'est jamais Sparse) */
   current_file->empty_data = 0;           /* Tout est à zéro */
   current_file->block_disk_resource = 0;  /* Nb de blocks disk utilisés pour les resource */
   current_file->empty_resource = 0;       /* Tout est à zéro */
 
   /** Nombre de block pour les Data **/
   current_file->block_data = GetContainerNumber(current_file->data_length,BLOCK_SIZE);
-  for(i=0; i<current_file->data_length; i+=BLOCK_SIZE)
-    {
-      /* Recherche les plages de 0 */
-      if(i == 0)
-        result = 1; /* Block 0 ne doit pas être Sparse */
-      else if(i+BLOCK_SIZE <= current_file->data_length)
-        result = memcmp(&current_file->data[i],empty_block,BLOCK_SIZE);
-      else
-        result = memcmp(&current_file->data[i],empty_block,current_file->data_length-i);
-
-      /* Block à réserver ? */
-      current_file->block_disk_data += (result == 0) ? 0 : 1;
-    }
-  if(current_file->block_disk_data == 0)
-    {
-      current_file->block_disk_data = 1;      /* Même pour les fichiers vides, on réserve 1 block de Data */
-      current_file->empty_data = 1;
-    }
 
   /** Nombre de block pour les Resource **/
   if(current_file->has_resource == 1)
     {
       current_file->block_resource = GetContainerNumber(current_file->resource_length,BLOCK_SIZE);
-      for(i=0; i<current_file->resource_length; i+=BLOCK_SIZE)
-        {
-          /* Recherche les plages de 0 */
-          if(i == 0)
-            result = 1; /* Block 0 ne doit pas être Sparse */
-          else if(i+BLOCK_SIZE <= current_file->resource_length)
-            result = memcmp(&current_file->resource[i],empty_block,BLOCK_SIZE);
-          else
-            result = memcmp(&current_file->resource[i],empty_block,current_file->resource_length-i);
-
-          /* Block à réserver ? */
-          current_file->block_disk_resource += (result == 0) ? 0 : 1;
-        }
-      if(current_file->block_disk_resource == 0)
-        {
-          current_file->block_disk_resource = 1;      /* Même pour les fichiers vides, on réserve 1 block de Resources */
-          current_file->empty_resource = 1;
-        }
+      current_file->block_disk_resource = 1;
     }
   else
     current_file->block_resource = 0;
 
   /*** Type de Stockage + Nb Block Index ***/
+  SetFileStorageType(current_file);
+
+  /* Allocation mémoire pour la tableau de block (index + tous les blocks de data) */
+  current_file->tab_data_block = (int *) calloc(current_file->index_data + current_file->block_data + 1,sizeof(int));
+  current_file->tab_resource_block = (int *) calloc(current_file->index_resource + current_file->block_resource + 1,sizeof(int));
+
+  /* OK */
+  return(0);
+}
+
+
+/**************************************************************************/
+/*  SetFileStorageType() :  Type de stockage, blocks index et taille      */
+/*                          totale, d'après les blocks de chaque fork.    */
+/**************************************************************************/
+static void SetFileStorageType(struct prodos_file *current_file)
+{
   if(current_file->has_resource == 0)
     {
       /* Data */
@@ -676,10 +674,51 @@ static void ComputeFileBlockUsage(struct prodos_file *current_file)
       /* Taille totale en block */
       current_file->entry_disk_block = 1 + (current_file->index_data + current_file->index_resource) + (current_file->block_disk_data + current_file->block_disk_resource);
     }
+}
+
+
+/************************************************************************/
+/*  GetFileBlock() :  Lit un block du fork Data ou Resource, complété   */
+/*                    par des 0. Les forks ouverts sont lus en séquence. */
+/************************************************************************/
+static int GetFileBlock(struct prodos_file *current_file, int is_data, int offset, unsigned char *block_rtn)
+{
+  int length, size;
+  unsigned char *data;
+  int *fd_offset;
+  FILE *fd;
+
+  /* Fork */
+  data = (is_data) ? current_file->data : current_file->resource;
+  fd = (is_data) ? current_file->data_fd : current_file->resource_fd;
+  fd_offset = (is_data) ? &current_file->data_fd_offset : &current_file->resource_fd_offset;
+  length = (is_data) ? current_file->data_length : current_file->resource_length;
+
+  /* Taille utile de ce block */
+  memset(block_rtn,0,BLOCK_SIZE);
+  size = (length-offset > BLOCK_SIZE) ? BLOCK_SIZE : length-offset;
+  if(size <= 0)
+    return(0);
 
-  /* Allocation mémoire pour la tableau de block */
-  current_file->tab_data_block = (int *) calloc(current_file->index_data + current_file->block_disk_data + 1,sizeof(int));
-  current_file->tab_resource_block = (int *) calloc(current_file->index_resource + current_file->block_disk_resource + 1,sizeof(int));
+  /** Fork en mémoire (AppleSingle) **/
+  if(data != NULL)
+    memcpy(block_rtn,&data[offset],size);
+  /** Fork sur disque **/
+  else if(fd != NULL)
+    {
+      if(offset != *fd_offset)
+        fseek(fd,(long) offset,SEEK_SET);
+      if((int) fread(block_rtn,1,size,fd) != size)
+        {
+          logf_error("  Error : Can't read file '%s'.\n",current_file->file_name_case);
+          *fd_offset = -1;
+          return(1);
+        }
+      *fd_offset = offset + size;
+    }
+
+  /* OK */
+  return(0);
 }
 
 
@@ -694,110 +733,110 @@ static WORD CreateFileContent(struct prodos_image *current_image, struct prodos_
 
   /** Fichier Data **/
   if(current_file->has_resource == 0)
+    return(CreateForkContent(current_image,current_file,1));
+
+  /** Fichier Resource **/
+  /* Allocation du block Extended */
+  tab_block = AllocateImageBlock(current_image,1);
+  if(tab_block == NULL)
+    return(0);
+  file_block_number = tab_block[0];
+
+  /* Data puis Resource (en cas d'erreur, on rend tous les blocks) */
+  data_block_number = CreateForkContent(current_image,current_file,1);
+  resource_block_number = (data_block_number == 0) ? 0 : CreateForkContent(current_image,current_file,0);
+  if(resource_block_number == 0)
+    {
+      if(data_block_number != 0)
+        FreeForkContent(current_image,current_file,1);
+      FreeImageBlock(current_image,1,tab_block);
+      free(tab_block);
+      return(0);
+    }
+  free(tab_block);
+
+  /** Remplissage de l'Extended block **/
+  memset(extended_block,0,BLOCK_SIZE);
+  /* Data */
+  extended_block[0] = (BYTE) current_file->type_data;
+  SetWordValue(extended_block,0x01,(WORD)data_block_number);
+  SetWordValue(extended_block,0x03,(WORD)current_file->index_data+current_file->block_disk_data);
+  Set24bitValue(extended_block,0x05,current_file->data_length);
+  memcpy(&extended_block[0x08],current_file->resource_finderinfo_1,18);
+  memcpy(&extended_block[0x1A],current_file->resource_finderinfo_2,18);
+  /* Resource */
+  extended_block[BLOCK_SIZE/2+0] = (BYTE) current_file->type_resource;
+  SetWordValue(extended_block,BLOCK_SIZE/2+0x01,(WORD)resource_block_number);
+  SetWordValue(extended_block,BLOCK_SIZE/2+0x03,(WORD)current_file->index_resource+current_file->block_disk_resource);
+  Set24bitValue(extended_block,BLOCK_SIZE/2+0x05,current_file->resource_length);
+  /* Enregistre */
+  SetBlockData(current_image,file_block_number,&extended_block[0]);
+
+  /* Renvoi le numéro de block du contenu du fichier */
+  return(file_block_number);
+}
+
+
+/******************************************************************************/
+/*  CreateForkContent() :  Création du contenu d'un fork (Data ou Resource).  */
+/*                         En cas d'erreur, les blocks déjà alloués pour ce   */
+/*                         fork sont rendus.                                  */
+/******************************************************************************/
+static WORD CreateForkContent(struct prodos_image *current_image, struct prodos_file *current_file, int is_data)
+{
+  WORD block_number;
+
+  if(is_data)
     {
       if(current_file->type_data == TYPE_ENTRY_SEEDLING)
-        {
-          file_block_number = CreateSeedlingContent(current_image,current_file,current_file->data,current_file->data_length,current_file->empty_data,1);
-          if(file_block_number == 0)
-            return(0);
-        }
+        block_number = CreateSeedlingContent(current_image,current_file,current_file->data_length,current_file->empty_data,1);
       else if(current_file->type_data == TYPE_ENTRY_SAPLING)
-        {
-          file_block_number = CreateSaplingContent(current_image,current_file,current_file->data,current_file->data_length,current_file->block_disk_data,1);
-          if(file_block_number == 0)
-            return(0);
-        }
-      else if(current_file->type_data == TYPE_ENTRY_TREE)
-        {
-          file_block_number = CreateTreeContent(current_image,current_file,current_file->data,current_file->data_length,current_file->block_disk_data,current_file->index_data,1);
-          if(file_block_number == 0)
-            return(0);
-        }
+        block_number = CreateSaplingContent(current_image,current_file,current_file->data_length,1);
       else
-        {
-          return(1);
-        }
+        block_number = CreateTreeContent(current_image,current_file,current_file->data_length,current_file->index_data,1);
     }
-  else  /** Fichier Resource **/
+  else
     {
-      /* Allocation du block Extended */
-      tab_block = AllocateImageBlock(current_image,1);
-      if(tab_block == NULL)
-        return(0);
-      file_block_number = tab_block[0];
-      free(tab_block);
-
-      /** Data **/
-      if(current_file->type_data == TYPE_ENTRY_SEEDLING)
-        {
-          data_block_number = CreateSeedlingContent(current_image,current_file,current_file->data,current_file->data_length,current_file->empty_data,1);
-          if(data_block_number == 0)
-            return(0);
-        }
-      else if(current_file->type_data == TYPE_ENTRY_SAPLING)
-        {
-          data_block_number = CreateSaplingContent(current_image,current_file,current_file->data,current_file->data_length,current_file->block_disk_data,1);
-          if(data_block_number == 0)
-            return(0);
-        }
-      else if(current_file->type_data == TYPE_ENTRY_TREE)
-        {
-          data_block_number = CreateTreeContent(current_image,current_file,current_file->data,current_file->data_length,current_file->block_disk_data,current_file->index_data,1);
-          if(data_block_number == 0)
-            return(0);
-        }
-
-      /** Resource **/
       if(current_file->type_resource == TYPE_ENTRY_SEEDLING)
-        {
-          resource_block_number = CreateSeedlingContent(current_image,current_file,current_file->resource,current_file->resource_length,current_file->empty_resource,0);
-          if(resource_block_number == 0)
-            return(0);
-        }
+        block_number = CreateSeedlingContent(current_image,current_file,current_file->resource_length,current_file->empty_resource,0);
       else if(current_file->type_resource == TYPE_ENTRY_SAPLING)
-        {
-          resource_block_number = CreateSaplingContent(current_image,current_file,current_file->resource,current_file->resource_length,current_file->block_disk_resource,0);
-          if(resource_block_number == 0)
-            return(0);
-        }
-      else if(current_file->type_resource == TYPE_ENTRY_TREE)
-        {
-          resource_block_number = CreateTreeContent(current_image,current_file,current_file->resource,current_file->resource_length,current_file->block_disk_resource,current_file->index_resource,0);
-          if(resource_block_number == 0)
-            return(0);
-        }
+        block_number = CreateSaplingContent(current_image,current_file,current_file->resource_length,0);
       else
-        {
-          return(1);
-        }
-
-      /** Remplissage de l'Extended block **/
-      memset(extended_block,0,BLOCK_SIZE);
-      /* Data */
-      extended_block[0] = (BYTE) current_file->type_data;
-      SetWordValue(extended_block,0x01,(WORD)data_block_number);
-      SetWordValue(extended_block,0x03,(WORD)current_file->index_data+current_file->block_disk_data);
-      Set24bitValue(extended_block,0x05,current_file->data_length);
-      memcpy(&extended_block[0x08],current_file->resource_finderinfo_1,18);
-      memcpy(&extended_block[0x1A],current_file->resource_finderinfo_2,18);
-      /* Resource */
-      extended_block[BLOCK_SIZE/2+0] = (BYTE) current_file->type_resource;
-      SetWordValue(extended_block,BLOCK_SIZE/2+0x01,(WORD)resource_block_number);
-      SetWordValue(extended_block,BLOCK_SIZE/2+0x03,(WORD)current_file->index_resource+current_file->block_disk_resource);
-      Set24bitValue(extended_block,BLOCK_SIZE/2+0x05,current_file->resource_length);
-      /* Enregistre */
-      SetBlockData(current_image,file_block_number,&extended_block[0]);
+        block_number = CreateTreeContent(current_image,current_file,current_file->resource_length,current_file->index_resource,0);
     }
 
-  /* Renvoi le numéro de block du contenu du fichier */
-  return(file_block_number);
+  /* Lecture impossible / plus de place : on rend les blocks index+data déjà pris */
+  if(block_number == 0)
+    FreeForkContent(current_image,current_file,is_data);
+  else
+    SetFileStorageType(current_file);   /* Blocks réellement utilisés (plages de 0) */
+
+  return(block_number);
+}
+
+
+/********************************************************************************/
+/*  FreeForkContent() :  Libère les blocks index+data enregistrés pour un fork. */
+/********************************************************************************/
+static void FreeForkContent(struct prodos_image *current_image, struct prodos_file *current_file, int is_data)
+{
+  if(is_data)
+    {
+      FreeImageBlock(current_image,current_file->nb_data_block,current_file->tab_data_block);
+      current_file->nb_data_block = 0;
+    }
+  else
+    {
+      FreeImageBlock(current_image,current_file->nb_resource_block,current_file->tab_resource_block);
+      current_file->nb_resource_block = 0;
+    }
 }
 
 
 /***************************************************************/
 /*  CreateSeedlingContent() :  Création d'une entrée Seedling. */
 /***************************************************************/
-static WORD CreateSeedlingContent(struct prodos_image *current_image, struct prodos_file *current_file, unsigned char *data, int data_length, int empty_data, int is_data)
+static WORD CreateSeedlingContent(struct prodos_image *current_image, struct prodos_file *current_file, int data_length, int empty_data, int is_data)
 {
   WORD file_block_number;
   int *tab_block;
@@ -822,8 +861,9 @@ static WORD CreateSeedlingContent(struct prodos_image *current_image, struct pro
 
   /* Remplissage du block */
   memset(data_block,0,BLOCK_SIZE);
-  if(empty_data == 0)
-    memcpy(&data_block[0],data,data_length);
+  if(empty_data == 0 && data_length > 0)
+    if(GetFileBlock(current_file,is_data,0,&data_block[0]))
+      return(0);
   SetBlockData(current_image,file_block_number,&data_block[0]);
 
   /* Renvoi le block */
@@ -834,88 +874,62 @@ static WORD CreateSeedlingContent(struct prodos_image *current_image, struct pro
 /*************************************************************/
 /*  CreateSaplingContent() :  Création d'une entrée Sapling. */
 /*************************************************************/
-static WORD CreateSaplingContent(struct prodos_image *current_image, struct prodos_file *current_file, unsigned char *data, int data_length, int block_disk_data, int is_data)
+static WORD CreateSaplingContent(struct prodos_image *current_image, struct prodos_file *current_file, int data_length, int is_data)
 {
-  int i,j,k,is_empty;
+  int i, k, nb_reserved_block, nb_disk_block;
+  int *tab_file_block;
   WORD file_block_number, data_block_number;
-  int *tab_block;
   unsigned char data_block[BLOCK_SIZE];
   unsigned char index_block[BLOCK_SIZE];
-  unsigned char empty_block[BLOCK_SIZE];
 
-  /* Init */
-  memset(empty_block,0x00,BLOCK_SIZE);
+  /* Liste des blocks du fork */
+  tab_file_block = (is_data) ? current_file->tab_data_block : current_file->tab_resource_block;
 
   /* Allocation du block Index */
-  tab_block = AllocateImageBlock(current_image,1);
-  if(tab_block == NULL)
+  if(AllocateFileBlock(current_image,current_file,is_data,1,0) != 1)
     return(0);
-  file_block_number = tab_block[0];
-  free(tab_block);
-  if(is_data)
-    {
-      current_file->tab_data_block[0] = (int) file_block_number;
-      current_file->nb_data_block = 1;
-    }
-  else
-    {
-      current_file->tab_resource_block[0] = (int) file_block_number;
-      current_file->nb_resource_block = 1;
-    }
+  file_block_number = tab_file_block[0];
   memset(index_block,0x00,BLOCK_SIZE);
 
-  /* Allocation des block data */
-  tab_block = AllocateImageBlock(current_image,block_disk_data);
-  if(tab_block == NULL)
+  /* Réservation des block data (ceux des plages de 0 seront rendus) */
+  nb_reserved_block = AllocateFileBlock(current_image,current_file,is_data,GetContainerNumber(data_length,BLOCK_SIZE),1);
+  if(nb_reserved_block < 0)
     return(0);
-  for(i=0; i<block_disk_data; i++)
-    {
-      if(is_data)
-        {
-          current_file->tab_data_block[1+i] = tab_block[i];
-          current_file->nb_data_block++;
-        }
-      else
-        {
-          current_file->tab_resource_block[1+i] = tab_block[i];
-          current_file->nb_resource_block++;
-        }
-    }
-  free(tab_block);
 
-  /** Remplissage des block data **/
-  for(i=0,j=1,k=0; i<data_length; i+=BLOCK_SIZE,k++)
+  /** Remplissage des block data, le fichier n'est lu qu'une fois **/
+  for(i=0,k=0,nb_disk_block=0; i<data_length; i+=BLOCK_SIZE,k++)
     {
-      /* Recherche les plages de 0 */
-      if(i == 0)
-        is_empty = 0; /* Block 0 ne doit pas être Sparse */
-      else if(i+BLOCK_SIZE <= data_length)
-        is_empty = !memcmp(&data[i],empty_block,BLOCK_SIZE);
-      else
-        is_empty = !memcmp(&data[i],empty_block,data_length-i);
+      /* Data du block (lu depuis le fichier, complété par des 0) */
+      if(GetFileBlock(current_file,is_data,i,&data_block[0]))
+        return(0);
+
+      /* Plages de 0 : pas de block (le 1er block ne doit pas être Sparse) */
+      if(i > 0 && IsZeroData(data_block,BLOCK_SIZE))
+        continue;
 
       /* Numéro du block */
-      if(is_data)
-        data_block_number = (is_empty == 1) ? 0 : current_file->tab_data_block[j++];
-      else
-        data_block_number = (is_empty == 1) ? 0 : current_file->tab_resource_block[j++];
+      if(nb_disk_block == nb_reserved_block)
+        {
+          logf_error("  Error : No enough space in the image for file '%s'.\n",current_file->file_name_case);
+          return(0);
+        }
+      data_block_number = tab_file_block[1+nb_disk_block++];
 
       /* Place dans l'index */
       index_block[k] = (BYTE) (data_block_number & 0x00FF);
       index_block[BLOCK_SIZE/2+k] = (BYTE) ((data_block_number & 0xFF00) >> 8);
 
-      /* Data du block */
-      if(is_empty == 0)
-        {
-          memset(data_block,0,BLOCK_SIZE);
-          if(i+BLOCK_SIZE <= data_length)
-            memcpy(&data_block[0],&data[i],BLOCK_SIZE);
-          else
-            memcpy(&data_block[0],&data[i],data_length-i);
-          SetBlockData(current_image,data_block_number,&data_block[0]);
-        }
+      /* Stockage du block */
+      SetBlockData(current_image,data_block_number,&data_block[0]);
     }
 
+  /* Libère les block réservés pour les plages de 0 */
+  ReleaseFileBlock(current_image,current_file,is_data,1+nb_disk_block);
+  if(is_data)
+    current_file->block_disk_data = nb_disk_block;
+  else
+    current_file->block_disk_resource = nb_disk_block;
+
   /* Stockage du block index */
   SetBlockData(current_image,file_block_number,&index_block[0]);
 
@@ -927,113 +941,63 @@ static WORD CreateSaplingContent(struct prodos_image *current_image, struct prod
 /*******************************************************/
 /*  CreateTreeContent() :  Création d'une entrée Tree. */
 /*******************************************************/
-static WORD CreateTreeContent(struct prodos_image *current_image, struct prodos_file *current_file, unsigned char *data, int data_length, int block_disk_data, int index_data, int is_data)
+static WORD CreateTreeContent(struct prodos_image *current_image, struct prodos_file *current_file, int data_length, int index_data, int is_data)
 {
   WORD file_block_number, index_block_number, data_block_number;
-  int i, j, k, l, is_empty;
-  int *tab_block;
+  int i, k, l, nb_reserved_block, nb_disk_block;
+  int *tab_file_block;
   unsigned char master_block[BLOCK_SIZE];
   unsigned char index_block[BLOCK_SIZE];
-  unsigned char empty_block[BLOCK_SIZE];
   unsigned char data_block[BLOCK_SIZE];
 
-  /* Init */
-  memset(empty_block,0x00,BLOCK_SIZE);
+  /* Liste des blocks du fork */
+  tab_file_block = (is_data) ? current_file->tab_data_block : current_file->tab_resource_block;
 
-  /* Allocation du block Master Index */
-  tab_block = AllocateImageBlock(current_image,1);
-  if(tab_block == NULL)
+  /* Allocation du block Master Index, puis des block Index */
+  if(AllocateFileBlock(current_image,current_file,is_data,1,0) != 1)
     return(0);
-  file_block_number = tab_block[0];
-  free(tab_block);
-  if(is_data)
-    {
-      current_file->tab_data_block[0] = (int) file_block_number;
-      current_file->nb_data_block = 1;
-    }
-  else
-    {
-      current_file->tab_resource_block[0] = (int) file_block_number;
-      current_file->nb_resource_block = 1;
-    }
-
-  /* Allocation des block Index */
-  tab_block = AllocateImageBlock(current_image,index_data-1);
-  if(tab_block == NULL)
+  file_block_number = tab_file_block[0];
+  if(AllocateFileBlock(current_image,current_file,is_data,index_data-1,0) != index_data-1)
     return(0);
-  for(i=0; i<index_data-1; i++)
-    {
-      if(is_data)
-        {
-          current_file->tab_data_block[1+i] = tab_block[i];
-          current_file->nb_data_block++;
-        }
-      else
-        {
-          current_file->tab_resource_block[1+i] = tab_block[i];
-          current_file->nb_resource_block++;
-        }
-    }
-  free(tab_block);
 
   /** Remplissage du Master Index **/
   memset(master_block,0x00,BLOCK_SIZE);
   for(i=0; i<index_data-1; i++)
     {
-      index_block_number = (is_data) ? current_file->tab_data_block[1+i] : current_file->tab_resource_block[1+i];
+      index_block_number = tab_file_block[1+i];
       master_block[i] = (BYTE) (index_block_number & 0x00FF);
       master_block[BLOCK_SIZE/2+i] = (BYTE) ((index_block_number & 0xFF00) >> 8);
     }
 
-  /* Ecriture du Master Index */
-  SetBlockData(current_image,file_block_number,&master_block[0]);
-
-  /** Allocation des block data **/
-  tab_block = AllocateImageBlock(current_image,block_disk_data);
-  if(tab_block == NULL)
+  /** Réservation des block data (ceux des plages de 0 seront rendus) **/
+  nb_reserved_block = AllocateFileBlock(current_image,current_file,is_data,GetContainerNumber(data_length,BLOCK_SIZE),1);
+  if(nb_reserved_block < 0)
     return(0);
-  for(i=0; i<block_disk_data; i++)
-    {
-      if(is_data)
-        {
-          current_file->tab_data_block[index_data+i] = tab_block[i];
-          current_file->nb_data_block++;
-        }
-      else
-        {
-          current_file->tab_resource_block[index_data+i] = tab_block[i];
-          current_file->nb_resource_block++;
-        }
-    }
-  free(tab_block);
 
-  /** Remplissage des block data **/
+  /** Remplissage des block data, le fichier n'est lu qu'une fois **/
   memset(index_block,0x00,BLOCK_SIZE);
-  for(i=0,j=index_data,k=0,l=0; i<data_length; i+=BLOCK_SIZE,k++)
+  for(i=0,k=0,l=0,nb_disk_block=0; i<data_length; i+=BLOCK_SIZE,k++)
     {
-      /* Recherche les plages de 0 */
-      if(i == 0)
-        is_empty = 0; /* Block 0 ne doit pas être Sparse */
-      else if(i+BLOCK_SIZE <= data_length)
-        is_empty = !memcmp(&data[i],empty_block,BLOCK_SIZE);
-      else
-        is_empty = !memcmp(&data[i],empty_block,data_length-i);
+      /* Data du block (lu depuis le fichier, complété par des 0) */
+      if(GetFileBlock(current_file,is_data,i,&data_block[0]))
+        return(0);
 
-      /* Numéro du block */
-      data_block_number = (is_empty == 1) ? 0 : ((is_data) ? current_file->tab_data_block[j++] : current_file->tab_resource_block[j++]);
+      /* Plages de 0 : pas de block (le 1er block ne doit pas être Sparse) */
+      if(i == 0 || !IsZeroData(data_block,BLOCK_SIZE))
+        {
+          /* Numéro du block */
+          if(nb_disk_block == nb_reserved_block)
+            {
+              logf_error("  Error : No enough space in the image for file '%s'.\n",current_file->file_name_case);
+              return(0);
+            }
+          data_block_number = tab_file_block[index_data+nb_disk_block++];
 
-      /* Place dans l'index */
-      index_block[k] = (BYTE) (data_block_number & 0x00FF);
-      index_block[BLOCK_SIZE/2+k] = (BYTE) ((data_block_number & 0xFF00) >> 8);
+          /* Place dans l'index */
+          index_block[k] = (BYTE) (data_block_number & 0x00FF);
+          index_block[BLOCK_SIZE/2+k] = (BYTE) ((data_block_number & 0xFF00) >> 8);
 
-      /* Data du block */
-      if(is_empty == 0)
-        {
-          memset(data_block,0,BLOCK_SIZE);
-          if(i+BLOCK_SIZE <= data_length)
-            memcpy(&data_block[0],&data[i],BLOCK_SIZE);
-          else
-            memcpy(&data_block[0],&data[i],data_length-i);
+          /* Stockage du block */
           SetBlockData(current_image,data_block_number,&data_block[0]);
         }
 
@@ -1041,8 +1005,7 @@ static WORD CreateTreeContent(struct prodos_image *current_image, struct prodos_
       if(k+1 == BLOCK_SIZE/2)
         {
           /* Ecriture de l'index */
-          index_block_number = (is_data) ? current_file->tab_data_block[1+l] : current_file->tab_resource_block[1+l];
-          SetBlockData(current_image,index_block_number,&index_block[0]);
+          SetBlockData(current_image,tab_file_block[1+l],&index_block[0]);
           l++;
 
           /* k=0 */
@@ -1053,17 +1016,74 @@ static WORD CreateTreeContent(struct prodos_image *current_image, struct prodos_
 
   /* Dernier index block */
   if(k > 0)
-    {
-      /* Ecriture de l'index */
-      index_block_number = (is_data) ? current_file->tab_data_block[1+l] : current_file->tab_resource_block[1+l];
-      SetBlockData(current_image,index_block_number,&index_block[0]);
-    }
+    SetBlockData(current_image,tab_file_block[1+l],&index_block[0]);
+
+  /* Libère les block réservés pour les plages de 0 */
+  ReleaseFileBlock(current_image,current_file,is_data,index_data+nb_disk_block);
+  if(is_data)
+    current_file->block_disk_data = nb_disk_block;
+  else
+    current_file->block_disk_resource = nb_disk_block;
+
+  /* Ecriture du Master Index */
+  SetBlockData(current_image,file_block_number,&master_block[0]);
 
   /* Renvoie le Master block */
   return(file_block_number);
 }
 
 
+/********************************************************************************/
+/*  AllocateFileBlock() :  Alloue des blocks pour un fork et les ajoute à sa    */
+/*                         liste. Avec partial, on se contente de ce qui reste  */
+/*                         de libre. Renvoie le nb de blocks alloués (-1 : err) */
+/********************************************************************************/
+static int AllocateFileBlock(struct prodos_image *current_image, struct prodos_file *current_file, int is_data, int nb_block, int partial)
+{
+  int i;
+  int *tab_block, *tab_file_block, *nb_file_block;
+
+  /* Liste des blocks du fork */
+  tab_file_block = (is_data) ? current_file->tab_data_block : current_file->tab_resource_block;
+  nb_file_block = (is_data) ? &current_file->nb_data_block : &current_file->nb_resource_block;
+
+  /* Il reste moins de place */
+  if(partial && nb_block > current_image->nb_free_block)
+    nb_block = current_image->nb_free_block;
+  if(nb_block <= 0)
+    return(0);
+
+  /* Allocation des blocks */
+  tab_block = AllocateImageBlock(current_image,nb_block);
+  if(tab_block == NULL)
+    return(-1);
+  for(i=0; i<nb_block; i++)
+    tab_file_block[(*nb_file_block)++] = tab_block[i];
+  free(tab_block);
+
+  return(nb_block);
+}
+
+
+/****************************************************************************/
+/*  ReleaseFileBlock() :  Rend les blocks d'un fork au delà des X premiers. */
+/****************************************************************************/
+static void ReleaseFileBlock(struct prodos_image *current_image, struct prodos_file *current_file, int is_data, int nb_keep_block)
+{
+  int *tab_file_block, *nb_file_block;
+
+  /* Liste des blocks du fork */
+  tab_file_block = (is_data) ? current_file->tab_data_block : current_file->tab_resource_block;
+  nb_file_block = (is_data) ? &current_file->nb_data_block : &current_file->nb_resource_block;
+
+  if(*nb_file_block > nb_keep_block)
+    {
+      FreeImageBlock(current_image,*nb_file_block-nb_keep_block,&tab_file_block[nb_keep_block]);
+      *nb_file_block = nb_keep_block;
+    }
+}
+
+
 /****************************************************************************/
 /*  CreateFileEntry() :  Création de l'entrée du fichier dans le Directory. */
 /****************************************************************************/
@@ -1127,13 +1147,13 @@ static void CreateFileEntry(struct prodos_image *current_image, struct prodos_fi
   SetWordValue(directory_block,offset+0x25,(WORD)((target_folder == NULL) ? 2 : target_folder->key_pointer_block));
 
   /* Ecrit les données */
-  SetBlockData(current_image,directory_block_number,&directory_block[0]);
+  SetMetadataBlockData(current_image,directory_block_number,&directory_block[0]);
 
   /** Modifie le nombre d'entrées valides du Target Folder : +1 **/
   GetBlockData(current_image,directory_header_pointer,&directory_block[0]);
   file_count = GetWordValue(directory_block,0x25);
   SetWordValue(directory_block,0x25,(WORD)(file_count+1));
-  SetBlockData(current_image,directory_header_pointer,&directory_block[0]);
+  SetMetadataBlockData(current_image,directory_header_pointer,&directory_block[0]);
 }
 
 
@@ -1145,21 +1165,14 @@ static int CreateMemoryEntry(struct prodos_image *current_image, struct file_des
   int offset, entry_length, error;
   struct file_descriptive_entry *current_entry;
   unsigned char directory_block[BLOCK_SIZE];
-  char folder_path[1024];
 
   /* Lecture du block où est positionnée l'entrée */
   GetBlockData(current_image,directory_block_number,&directory_block[0]);
   entry_length = 0x27;;
   offset = 4 + (directory_entry_number-1)*entry_length;
 
-  /* Chemin du dossier */
-  if(target_folder == NULL)
-    sprintf(folder_path,"/%s",current_image->volume_header->volume_name_case);
-  else
-    strcpy(folder_path,target_folder->file_path);
-
   /* Récupère l'entrée */
-  current_entry = ODSReadFileDescriptiveEntry(current_image,folder_path,&directory_block[offset]);
+  current_entry = ODSReadFileDescriptiveEntry(current_image,target_folder,&directory_block[offset]);
   if(current_entry == NULL)
     return(1);
 
@@ -1174,10 +1187,7 @@ static int CreateMemoryEntry(struct prodos_image *current_image, struct file_des
   my_Memory(MEMORY_BUILD_ENTRY_TAB,NULL,NULL);
 
   /** Met à jour le Dossier Cible (+1 fichier) **/
-  if(target_folder == NULL)
-    error = UpdateEntryTable(UPDATE_ADD,&current_image->nb_file,&current_image->tab_file,current_entry);
-  else
-    error = UpdateEntryTable(UPDATE_ADD,&target_folder->nb_file,&target_folder->tab_file,current_entry);
+  error = UpdateFolderEntry(current_image,target_folder,UPDATE_ADD,current_entry);
   if(error)
     return(1);
 
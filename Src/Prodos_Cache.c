@@ -0,0 +1,444 @@
+/***********************************************************************/
+/*                                                                     */
+/*   Prodos_Cache.c : Cache de l'arbre des fichiers d'une image.       */
+/*                                                                     */
+/***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Dc_Shared.h"
+#include "Dc_Prodos.h"
+#include "Dc_Memory.h"
+#include "os/os.h"
+#include "Prodos_Cache.h"
+#include "log.h"
+
+#define FNV_OFFSET_BASIS  0xCBF29CE484222325ULL
+#define FNV_PRIME         0x00000100000001B3ULL
+
+static void SetCacheEntry(struct image_cache *,int,int *,struct file_descriptive_entry *);
+static char *BuildCachePath(char *,char *);
+static uint64_t HashData(uint64_t,unsigned char *,int);
+static uint64_t HashCacheBlock(struct prodos_image *,struct image_cache *);
+static int compare_cache_entry(const void *,const void *);
+
+/**
+ * Read the sidecar cache of an image (<image>.cadius-idx). The cache is
+ * only used if the image has the same size and modification time as when
+ * it was written, and if the Volume Directory, SubDirectory and Bitmap
+ * blocks still have the same hash.
+ *
+ * @brief LoadImageCache
+ * @param current_image Image with its volume header decoded
+ * @return The cache, or NULL if it is missing or out of date
+ */
+struct image_cache *LoadImageCache(struct prodos_image *current_image)
+{
+  int i, data_length;
+  long long expected_length;
+  int64_t image_mtime;
+  char *cache_path;
+  unsigned char *data;
+  struct cache_header header;
+  struct cache_entry *current_entry;
+  struct image_cache *image_cache;
+
+  /* Date de modification de l'image */
+  if(os_GetFileModificationTime(current_image->image_file_path,&image_mtime))
+    return(NULL);
+
+  /** Lecture du fichier cache **/
+  cache_path = BuildCachePath(current_image->image_file_path,"");
+  if(cache_path == NULL)
+    return(NULL);
+  data = LoadBinaryFile(cache_path,&data_length);
+  free(cache_path);
+  if(data == NULL)
+    return(NULL);
+
+  /** Vérification de l'en-tête **/
+  if(data_length < (int) sizeof(struct cache_header))
+    {
+      free(data);
+      return(NULL);
+    }
+  memcpy(&header,data,sizeof(struct cache_header));
+  if(memcmp(header.magic,CACHE_MAGIC,sizeof(header.magic)) || header.endian_check != CACHE_ENDIAN_CHECK ||
+     header.image_file_length != current_image->image_file_length || header.image_mtime != image_mtime ||
+     header.nb_block != current_image->nb_block || header.nb_entry < 0 || header.nb_used_block < 0 ||
+     header.nb_bitmap_word != GetContainerNumber(current_image->nb_block,BITMAP_WORD_BIT))
+    {
+      free(data);
+      return(NULL);
+    }
+  expected_length = (long long) sizeof(struct cache_header) + (long long) header.nb_entry*sizeof(struct cache_entry) +
+                    (long long) header.nb_used_block*sizeof(int32_t) + (long long) header.nb_bitmap_word*sizeof(uint64_t);
+  if(expected_length != data_length ||
+     HashData(FNV_OFFSET_BASIS,&data[sizeof(struct cache_header)],data_length-sizeof(struct cache_header)) != header.payload_hash)
+    {
+      free(data);
+      return(NULL);
+    }
+
+  /* Allocation mémoire */
+  image_cache = (struct image_cache *) calloc(1,sizeof(struct image_cache));
+  if(image_cache == NULL)
+    {
+      free(data);
+      return(NULL);
+    }
+  image_cache->data = data;
+  image_cache->nb_entry = header.nb_entry;
+  image_cache->tab_entry = (struct cache_entry *) &data[sizeof(struct cache_header)];
+  image_cache->nb_used_block = header.nb_used_block;
+  image_cache->tab_used_block = (int32_t *) &image_cache->tab_entry[header.nb_entry];
+  image_cache->nb_bitmap_word = header.nb_bitmap_word;
+  image_cache->nb_free_block = header.nb_free_block;
+  image_cache->bitmap_data = (unsigned char *) &image_cache->tab_used_block[header.nb_used_block];
+
+  /** Les blocs référencés doivent être dans l'image **/
+  for(i=0; i<image_cache->nb_entry; i++)
+    {
+      current_entry = &image_cache->tab_entry[i];
+      if(current_entry->nb_used_block < 0 || current_entry->first_used_block < 0 ||
+         current_entry->first_used_block > image_cache->nb_used_block - current_entry->nb_used_block)
+        {
+          mem_free_cache(image_cache);
+          return(NULL);
+        }
+    }
+  for(i=0; i<image_cache->nb_used_block; i++)
+    if(image_cache->tab_used_block[i] < 0 || image_cache->tab_used_block[i] >= current_image->nb_block)
+      {
+        mem_free_cache(image_cache);
+        return(NULL);
+      }
+
+  /** Les blocs des répertoires et de la bitmap n'ont pas changé **/
+  if(HashCacheBlock(current_image,image_cache) != header.block_hash)
+    {
+      mem_free_cache(image_cache);
+      return(NULL);
+    }
+
+  /* Renvoie le cache */
+  return(image_cache);
+}
+
+
+/****************************************************************************/
+/*  GetCacheEntry() :  Remplit la taille et les blocs utilisés d'une entrée */
+/*                     depuis le cache (0 : trouvée, 1 : absente).          */
+/****************************************************************************/
+int GetCacheEntry(struct image_cache *image_cache, struct file_descriptive_entry *file_entry)
+{
+  int i, first, last, middle, nb_block_max;
+  struct cache_entry *current_entry;
+
+  /* Les entrées effacées ne sont pas dans le cache */
+  if((file_entry->storage_type & 0x0F) == 0x00)
+    return(1);
+
+  /** Première entrée ayant ce key_pointer_block (recherche dichotomique) **/
+  for(first=0, last=image_cache->nb_entry; first<last; )
+    {
+      middle = (first+last)/2;
+      if(image_cache->tab_entry[middle].key_pointer_block < file_entry->key_pointer_block)
+        first = middle+1;
+      else
+        last = middle;
+    }
+
+  /** L'entrée doit décrire le même fichier **/
+  for(; first<image_cache->nb_entry && image_cache->tab_entry[first].key_pointer_block == file_entry->key_pointer_block; first++)
+    {
+      current_entry = &image_cache->tab_entry[first];
+      if(current_entry->storage_type != file_entry->storage_type || current_entry->blocks_used != file_entry->blocks_used ||
+         current_entry->eof_location != file_entry->eof_location)
+        continue;
+
+      /* Table des blocs utilisés (même capacité qu'au décodage) */
+      nb_block_max = (current_entry->nb_used_block > file_entry->blocks_used) ? current_entry->nb_used_block : file_entry->blocks_used;
+      file_entry->tab_used_block = (int *) mem_alloc_arena(((nb_block_max > 0) ? nb_block_max : 1)*sizeof(int));
+      if(file_entry->tab_used_block == NULL)
+        break;
+      for(i=0; i<current_entry->nb_used_block; i++)
+        file_entry->tab_used_block[i] = image_cache->tab_used_block[current_entry->first_used_block+i];
+      file_entry->nb_used_block = current_entry->nb_used_block;
+
+      /* Répartition des données */
+      file_entry->data_size = current_entry->data_size;
+      file_entry->data_block = current_entry->data_block;
+      file_entry->resource_size = current_entry->resource_size;
+      file_entry->resource_block = current_entry->resource_block;
+      file_entry->index_block = current_entry->index_block;
+      file_entry->nb_sparse = current_entry->nb_sparse;
+
+      /* Trouvée */
+      return(0);
+    }
+
+  /* Absente : le cache sera réécrit */
+  image_cache->nb_miss++;
+  return(1);
+}
+
+
+/*****************************************************************/
+/*  GetCacheBitmap() :  Copie la bitmap mémoire depuis le cache. */
+/*****************************************************************/
+int GetCacheBitmap(struct image_cache *image_cache, struct prodos_image *current_image)
+{
+  if(image_cache->nb_bitmap_word != current_image->nb_bitmap_word)
+    return(1);
+
+  memcpy(current_image->block_allocation_table,image_cache->bitmap_data,image_cache->nb_bitmap_word*sizeof(uint64_t));
+  current_image->nb_free_block = image_cache->nb_free_block;
+
+  return(0);
+}
+
+
+/**
+ * Write the sidecar cache of an image that has just been fully decoded
+ * (LoadProdosImage with IMAGE_ACCESS_CACHE). The file is written next to
+ * the image under a temporary name, then renamed, so a reader never sees
+ * a partial cache.
+ *
+ * @brief SaveImageCache
+ * @param current_image
+ * @return 0 if the cache was written
+ */
+int SaveImageCache(struct prodos_image *current_image)
+{
+  int i, error, nb_file, nb_directory, nb_entry, nb_used_block, data_length;
+  int64_t image_mtime;
+  char *cache_path, *temp_path;
+  unsigned char *data;
+  struct file_descriptive_entry *file_entry;
+  struct cache_header header;
+  struct image_cache image_cache;
+
+  /* Date de modification de l'image */
+  if(os_GetFileModificationTime(current_image->image_file_path,&image_mtime))
+    return(1);
+
+  /** Taille du cache **/
+  my_Memory(MEMORY_GET_ENTRY_NB,&nb_file,NULL);
+  my_Memory(MEMORY_GET_DIRECTORY_NB,&nb_directory,NULL);
+  nb_entry = nb_file + nb_directory;
+  for(i=1,nb_used_block=0; i<=nb_file; i++)
+    {
+      my_Memory(MEMORY_GET_ENTRY,&i,&file_entry);
+      nb_used_block += file_entry->nb_used_block;
+    }
+  for(i=1; i<=nb_directory; i++)
+    {
+      my_Memory(MEMORY_GET_DIRECTORY,&i,&file_entry);
+      nb_used_block += file_entry->nb_used_block;
+    }
+  data_length = sizeof(struct cache_header) + nb_entry*sizeof(struct cache_entry) +
+                nb_used_block*sizeof(int32_t) + current_image->nb_bitmap_word*sizeof(uint64_t);
+
+  /* Allocation mémoire */
+  data = (unsigned char *) calloc(1,data_length);
+  if(data == NULL)
+    return(1);
+  memset(&image_cache,0,sizeof(struct image_cache));
+  image_cache.nb_entry = nb_entry;
+  image_cache.tab_entry = (struct cache_entry *) &data[sizeof(struct cache_header)];
+  image_cache.nb_used_block = nb_used_block;
+  image_cache.tab_used_block = (int32_t *) &image_cache.tab_entry[nb_entry];
+  image_cache.bitmap_data = (unsigned char *) &image_cache.tab_used_block[nb_used_block];
+
+  /** Une entrée par fichier et par répertoire **/
+  for(i=1,nb_entry=0,nb_used_block=0; i<=nb_file; i++)
+    {
+      my_Memory(MEMORY_GET_ENTRY,&i,&file_entry);
+      SetCacheEntry(&image_cache,nb_entry++,&nb_used_block,file_entry);
+    }
+  for(i=1; i<=nb_directory; i++)
+    {
+      my_Memory(MEMORY_GET_DIRECTORY,&i,&file_entry);
+      SetCacheEntry(&image_cache,nb_entry++,&nb_used_block,file_entry);
+    }
+  qsort(image_cache.tab_entry,nb_entry,sizeof(struct cache_entry),compare_cache_entry);
+
+  /** Bitmap mémoire **/
+  memcpy(image_cache.bitmap_data,current_image->block_allocation_table,current_image->nb_bitmap_word*sizeof(uint64_t));
+
+  /** En-tête **/
+  memset(&header,0,sizeof(struct cache_header));
+  memcpy(header.magic,CACHE_MAGIC,sizeof(header.magic));
+  header.image_mtime = image_mtime;
+  header.block_hash = HashCacheBlock(current_image,&image_cache);
+  header.payload_hash = HashData(FNV_OFFSET_BASIS,&data[sizeof(struct cache_header)],data_length-sizeof(struct cache_header));
+  header.endian_check = CACHE_ENDIAN_CHECK;
+  header.image_file_length = current_image->image_file_length;
+  header.nb_block = current_image->nb_block;
+  header.nb_entry = nb_entry;
+  header.nb_used_block = nb_used_block;
+  header.nb_bitmap_word = current_image->nb_bitmap_word;
+  header.nb_free_block = current_image->nb_free_block;
+  memcpy(data,&header,sizeof(struct cache_header));
+
+  /** Ecriture sous un nom temporaire, puis renommage **/
+  cache_path = BuildCachePath(current_image->image_file_path,"");
+  temp_path = BuildCachePath(current_image->image_file_path,".tmp");
+  error = (cache_path == NULL || temp_path == NULL);
+  if(error == 0)
+    error = CreateBinaryFile(temp_path,data,data_length);
+  if(error == 0)
+    error = os_RenameFile(temp_path,cache_path);
+  if(error && temp_path != NULL)
+    os_DeleteFile(temp_path);
+
+  /* Libération mémoire */
+  free(cache_path);
+  free(temp_path);
+  free(data);
+
+  return(error);
+}
+
+
+/****************************************************************************/
+/*  SetCacheEntry() :  Recopie la taille et les blocs d'une entrée décodée. */
+/****************************************************************************/
+static void SetCacheEntry(struct image_cache *image_cache, int index, int *nb_used_block, struct file_descriptive_entry *file_entry)
+{
+  int i;
+  struct cache_entry *current_entry = &image_cache->tab_entry[index];
+
+  current_entry->key_pointer_block = file_entry->key_pointer_block;
+  current_entry->storage_type = file_entry->storage_type;
+  current_entry->blocks_used = file_entry->blocks_used;
+  current_entry->eof_location = file_entry->eof_location;
+  current_entry->data_size = file_entry->data_size;
+  current_entry->data_block = file_entry->data_block;
+  current_entry->resource_size = file_entry->resource_size;
+  current_entry->resource_block = file_entry->resource_block;
+  current_entry->index_block = file_entry->index_block;
+  current_entry->nb_sparse = file_entry->nb_sparse;
+
+  /* Blocs utilisés, à la suite de ceux des entrées précédentes */
+  current_entry->nb_used_block = file_entry->nb_used_block;
+  current_entry->first_used_block = *nb_used_block;
+  for(i=0; i<file_entry->nb_used_block; i++)
+    image_cache->tab_used_block[(*nb_used_block)++] = file_entry->tab_used_block[i];
+}
+
+
+/**********************************************************************/
+/*  BuildCachePath() :  Chemin du fichier cache (<image>.cadius-idx). */
+/**********************************************************************/
+static char *BuildCachePath(char *image_file_path, char *suffix)
+{
+  char *cache_path;
+
+  cache_path = (char *) calloc(strlen(image_file_path)+strlen(CACHE_FILE_EXTENSION)+strlen(suffix)+1,sizeof(char));
+  if(cache_path == NULL)
+    return(NULL);
+  sprintf(cache_path,"%s%s%s",image_file_path,CACHE_FILE_EXTENSION,suffix);
+
+  return(cache_path);
+}
+
+
+/**********************************************************/
+/*  HashData() :  Hash FNV-1a 64 bits d'une zone mémoire. */
+/**********************************************************/
+static uint64_t HashData(uint64_t hash, unsigned char *data, int length)
+{
+  int i;
+
+  for(i=0; i<length; i++)
+    {
+      hash ^= data[i];
+      hash *= FNV_PRIME;
+    }
+
+  return(hash);
+}
+
+
+/**
+ * Hash the blocks the cached tree depends on : the Volume Directory chain,
+ * the blocks of every SubDirectory listed in the cache and the Bitmap.
+ * Any change in a file entry rewrites one of these blocks.
+ *
+ * @brief HashCacheBlock
+ * @param current_image
+ * @param image_cache
+ * @return The hash
+ */
+static uint64_t HashCacheBlock(struct prodos_image *current_image, struct image_cache *image_cache)
+{
+  int i, j, block_number, nb_bitmap_block;
+  uint64_t hash = FNV_OFFSET_BASIS;
+  unsigned char block_data[BLOCK_SIZE];
+
+  /** Volume Directory (Block 2+suivants) **/
+  for(i=0, block_number=2; i<current_image->nb_block && block_number != 0; i++)
+    {
+      GetBlockData(current_image,block_number,block_data);
+      hash = HashData(hash,block_data,BLOCK_SIZE);
+      block_number = GetWordValue(block_data,2);
+    }
+
+  /** SubDirectory **/
+  for(i=0; i<image_cache->nb_entry; i++)
+    if((image_cache->tab_entry[i].storage_type & 0x0F) == 0x0D)
+      for(j=0; j<image_cache->tab_entry[i].nb_used_block; j++)
+        {
+          GetBlockData(current_image,image_cache->tab_used_block[image_cache->tab_entry[i].first_used_block+j],block_data);
+          hash = HashData(hash,block_data,BLOCK_SIZE);
+        }
+
+  /** Bitmap **/
+  nb_bitmap_block = GetContainerNumber(current_image->nb_block,BLOCK_SIZE*8);
+  for(i=0; i<nb_bitmap_block; i++)
+    {
+      GetBlockData(current_image,current_image->volume_header->bitmap_block+i,block_data);
+      hash = HashData(hash,block_data,BLOCK_SIZE);
+    }
+
+  return(hash);
+}
+
+
+/********************************************************************/
+/*  compare_cache_entry() :  Tri des entrées par key_pointer_block. */
+/********************************************************************/
+static int compare_cache_entry(const void *data_1, const void *data_2)
+{
+  struct cache_entry *entry_1 = (struct cache_entry *) data_1;
+  struct cache_entry *entry_2 = (struct cache_entry *) data_2;
+
+  if(entry_1->key_pointer_block != entry_2->key_pointer_block)
+    return((entry_1->key_pointer_block < entry_2->key_pointer_block) ? -1 : 1);
+
+  /* Même bloc (image incohérente) : ordre stable par taille */
+  if(entry_1->eof_location != entry_2->eof_location)
+    return((entry_1->eof_location < entry_2->eof_location) ? -1 : 1);
+  return(0);
+}
+
+
+/*****************************************************/
+/*  mem_free_cache() :  Libération mémoire du cache. */
+/*****************************************************/
+void mem_free_cache(struct image_cache *image_cache)
+{
+  if(image_cache)
+    {
+      if(image_cache->data)
+        free(image_cache->data);
+
+      free(image_cache);
+    }
+}
+
+/***********************************************************************/
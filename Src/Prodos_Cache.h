@@ -0,0 +1,72 @@
+/***********************************************************************/
+/*                                                                     */
+/*   Prodos_Cache.h : Header pour le cache de l'arbre des fichiers.    */
+/*                                                                     */
+/***********************************************************************/
+
+#pragma once
+
+#define CACHE_FILE_EXTENSION  ".cadius-idx"   /* Fichier placé à côté de l'image */
+#define CACHE_MAGIC           "CADIDX01"
+#define CACHE_ENDIAN_CHECK    0x01020304      /* Le cache n'est relu que sur une machine de même endianness */
+
+/** En-tête du fichier cache (champs 64 bits en premier : pas de padding) **/
+struct cache_header
+{
+  char magic[8];
+  int64_t image_mtime;          /* Date de modification du fichier image */
+  uint64_t block_hash;          /* Hash des blocs Volume Directory + SubDirectory + Bitmap */
+  uint64_t payload_hash;        /* Hash de tout ce qui suit l'en-tête */
+  int32_t endian_check;
+  int32_t image_file_length;
+  int32_t nb_block;
+  int32_t nb_entry;
+  int32_t nb_used_block;
+  int32_t nb_bitmap_word;
+  int32_t nb_free_block;
+  int32_t reserved;
+};
+
+/** Résultat de GetFileDataResourceSize() pour une entrée, retrouvée par son key_pointer_block **/
+struct cache_entry
+{
+  int32_t key_pointer_block;
+  int32_t storage_type;
+  int32_t blocks_used;
+  int32_t eof_location;
+
+  int32_t data_size;
+  int32_t data_block;
+  int32_t resource_size;
+  int32_t resource_block;
+  int32_t index_block;
+  int32_t nb_sparse;
+
+  int32_t nb_used_block;
+  int32_t first_used_block;     /* Indice dans tab_used_block du cache */
+};
+
+struct image_cache
+{
+  int nb_entry;
+  struct cache_entry *tab_entry;     /* Trié par key_pointer_block */
+
+  int nb_used_block;
+  int32_t *tab_used_block;
+
+  int nb_bitmap_word;
+  int nb_free_block;
+  unsigned char *bitmap_data;        /* Mots de la bitmap mémoire (non alignés) */
+
+  int nb_miss;                       /* Entrées absentes du cache : il faut le réécrire */
+
+  unsigned char *data;               /* Contenu du fichier cache */
+};
+
+struct image_cache *LoadImageCache(struct prodos_image *);
+int GetCacheEntry(struct image_cache *,struct file_descriptive_entry *);
+int GetCacheBitmap(struct image_cache *,struct prodos_image *);
+int SaveImageCache(struct prodos_image *);
+void mem_free_cache(struct image_cache *);
+
+/***********************************************************************/
@@ -21,24 +21,36 @@
 #include "Prodos_Check.h"
 #include "log.h"
 
-static char *GetObjectInfo(int,struct file_descriptive_entry *);
+static char *GetObjectInfo(struct prodos_image *,int,struct file_descriptive_entry *,char *);
+static void CheckObjectBlocks(struct prodos_image *,struct file_descriptive_entry *,int,int,int);
+static void CheckBlockRun(struct prodos_image *,int,int,int);
 
 /*****************************************************************/
 /*  CheckProdosImage() :  Vérifie le contenu d'une image Prodos. */
 /*****************************************************************/
-void CheckProdosImage(struct prodos_image *current_image, int verbose)
+void CheckProdosImage(struct prodos_image *current_image, int verbose, int format)
 {
-  int i, j, nb_directory, nb_file, nb_error, nb_bitmap_block, first_block_number;
+  int i, nb_directory, nb_file, nb_error, nb_bitmap_block, first_block_number;
   struct file_descriptive_entry *current_directory;
   struct file_descriptive_entry *current_file;
   struct error *current_error;
-  char *object_info;
   char current_block_info[2048];
-  char first_block_info[2048];
-  char error_message[2048];
+  char error_message[4096];   /* Message + description de l'objet (2048) */
+  int text_verbose = (verbose && format == FORMAT_TEXT);
+  int json_verbose = (verbose && format == FORMAT_JSON);
+
+  /** Début du document JSON **/
+  if(format == FORMAT_JSON)
+    {
+      logf("{\"image\":");
+      log_json_string(current_image->image_file_path);
+      logf(",\"volume\":");
+      log_json_string(current_image->volume_header->volume_name_case);
+      logf(",\"blocks\":%d,\"free_blocks\":%d",current_image->nb_block,current_image->nb_free_block);
+    }
 
   /** Blocs de Boot **/
-  if(verbose)
+  if(text_verbose)
     {
       logf("; ---------------------  Boot  ----------------------\n");
       logf("Boot;0000\n");
@@ -48,7 +60,7 @@ void CheckProdosImage(struct prodos_image *current_image, int verbose)
   current_image->block_usage_type[0x0001] = BLOCK_TYPE_BOOT;
 
   /** Volume directory Blocs **/
-  if(verbose)
+  if(text_verbose)
     {
       logf("; ---------------  Volume Directory  ----------------\n");
       logf("Volume;0002\n");
@@ -62,157 +74,214 @@ void CheckProdosImage(struct prodos_image *current_image, int verbose)
   current_image->block_usage_type[0x0005] = BLOCK_TYPE_VOLUME;
 
   /** Bitmap Blocs **/
-  if(verbose)
+  if(text_verbose)
     logf("; --------------------  Bitmap  ---------------------\n");
   nb_bitmap_block = GetContainerNumber(current_image->nb_block,BLOCK_SIZE*8);
   for(i=0; i<nb_bitmap_block; i++)
     {
-      if(verbose)
+      if(text_verbose)
         logf("Bitmap;%04X;\n",0x0006+i);
       current_image->block_usage_type[0x0006+i] = BLOCK_TYPE_BITMAP;
     }
 
   /** Liste des Folders **/
-  if(verbose)
+  if(text_verbose)
     logf("; ------------------  Folder List  ------------------\n");
+  if(json_verbose)
+    logf(",\"folders\":[");
   my_Memory(MEMORY_GET_DIRECTORY_NB,&nb_directory,NULL);
   for(i=1; i<=nb_directory; i++)
     {
       my_Memory(MEMORY_GET_DIRECTORY,&i,&current_directory);
-      if(verbose)
-        logf("Folder;%s",current_directory->file_path);
-      for(j=0; j<current_directory->nb_used_block; j++)
-        if(current_directory->tab_used_block[j] != 0)
-          {
-            /* A qui ce block appartient */
-            if(current_image->block_usage_type[current_directory->tab_used_block[j]] != BLOCK_TYPE_EMPTY)
-              {
-                /* Déjà occupé ! */
-                object_info = GetObjectInfo(current_image->block_usage_type[current_directory->tab_used_block[j]],(struct file_descriptive_entry *)current_image->block_usage_object[current_directory->tab_used_block[j]]);
-                sprintf(error_message,"Block %04X is claimed by Folder %s but it is already used by %s",current_directory->tab_used_block[j],current_directory->file_path,object_info);
-                my_Memory(MEMORY_ADD_ERROR,error_message,NULL);
-              }
-            else
-              {
-                current_image->block_usage_type[current_directory->tab_used_block[j]] = BLOCK_TYPE_FOLDER;
-                current_image->block_usage_object[current_directory->tab_used_block[j]] = current_directory;
-              }
-            /* Numéro du block */
-            if(verbose)
-              logf(";%04X",current_directory->tab_used_block[j]);
-          }
-      if(verbose)
-        logf("\n");
+      CheckObjectBlocks(current_image,current_directory,BLOCK_TYPE_FOLDER,(verbose) ? format : -1,i-1);
     }
 
   /** Liste des Fichiers **/
-  if(verbose)
+  if(text_verbose)
     logf("; -------------------  File List  -------------------\n");
+  if(json_verbose)
+    logf("],\"files\":[");
   my_Memory(MEMORY_GET_ENTRY_NB,&nb_file,NULL);
   for(i=1; i<=nb_file; i++)
     {
       my_Memory(MEMORY_GET_ENTRY,&i,&current_file);
-      if(verbose)
-        logf("File;%s",current_file->file_path);
-      for(j=0; j<current_file->nb_used_block; j++)
-        if(current_file->tab_used_block[j] != 0)
-          {
-            /* A qui ce block appartient */
-            if(current_image->block_usage_type[current_file->tab_used_block[j]] != BLOCK_TYPE_EMPTY)
-              {
-                /* Déjà occupé ! */
-                object_info = GetObjectInfo(current_image->block_usage_type[current_file->tab_used_block[j]],(struct file_descriptive_entry *)current_image->block_usage_object[current_file->tab_used_block[j]]);
-                sprintf(error_message,"Block %04X is claimed by File %s but it is already used by %s",current_file->tab_used_block[j],current_file->file_path,object_info);
-                my_Memory(MEMORY_ADD_ERROR,error_message,NULL);
-              }
-            else
-              {
-                current_image->block_usage_type[current_file->tab_used_block[j]] = BLOCK_TYPE_FILE;
-                current_image->block_usage_object[current_file->tab_used_block[j]] = current_file;
-              }
-
-            /* Numéro du block */
-            if(verbose)
-              logf(";%04X",current_file->tab_used_block[j]);
-          }
-      if(verbose)
-        logf("\n");
+      CheckObjectBlocks(current_image,current_file,BLOCK_TYPE_FILE,(verbose) ? format : -1,i-1);
     }
-  
+
   /** Liste des Blocks **/
-  if(verbose)
+  if(text_verbose)
     logf("; ------------------  Block List  -------------------\n");
-  for(i=0, first_block_number=-1; i<current_image->nb_block; i++)
+  if(json_verbose)
+    logf("],\"block_runs\":[");
+  for(i=0, first_block_number=0; i<current_image->nb_block; i++)
     {
-      /** Décode le block **/
-      if(current_image->block_usage_type[i] == BLOCK_TYPE_BOOT)
-        sprintf(current_block_info,"Boot");
-      else if(current_image->block_usage_type[i] == BLOCK_TYPE_VOLUME)
-        sprintf(current_block_info,"Volume");
-      else if(current_image->block_usage_type[i] == BLOCK_TYPE_BITMAP)
-        sprintf(current_block_info,"Bitmap");
-      else if(current_image->block_usage_type[i] == BLOCK_TYPE_FILE)
-        sprintf(current_block_info,"File;%s",((struct file_descriptive_entry *)(current_image->block_usage_object[i]))->file_path);
-      else if(current_image->block_usage_type[i] == BLOCK_TYPE_FOLDER)
-        sprintf(current_block_info,"Folder;%s",((struct file_descriptive_entry *)(current_image->block_usage_object[i]))->file_path);
-      else
-        sprintf(current_block_info,"Free");
-
       /** Vérifie ce qui est déclaré dans la Bitmap (0=occupé, 1=libre) **/
-      if(current_image->block_allocation_table[i] == 1 && current_image->block_usage_type[i] != 0)
+      if(IsImageBlockFree(current_image,i) == 1 && current_image->block_usage_type[i] != 0)
         {
+          GetObjectInfo(current_image,current_image->block_usage_type[i],(struct file_descriptive_entry *)current_image->block_usage_object[i],current_block_info);
           sprintf(error_message,"Block %04X is declared FREE in the Bitmap, but used by %s",i,current_block_info);
           my_Memory(MEMORY_ADD_ERROR,error_message,NULL);
         }
-      else if(current_image->block_allocation_table[i] == 0 && current_image->block_usage_type[i] == 0)
+      else if(IsImageBlockFree(current_image,i) == 0 && current_image->block_usage_type[i] == 0)
         {  
           sprintf(error_message,"Block %04X is declared IN USE in the Bitmap, but it not referenced by any object",i);
           my_Memory(MEMORY_ADD_ERROR,error_message,NULL);
         }
 
-      /** Teste une continuité **/
-      if(first_block_number == -1)
+      /** Teste une continuité : même type de block et même objet **/
+      if(i > 0 && (current_image->block_usage_type[i] != current_image->block_usage_type[first_block_number] ||
+                   current_image->block_usage_object[i] != current_image->block_usage_object[first_block_number]))
         {
+          /* On produit la série précédente */
+          if(verbose)
+            CheckBlockRun(current_image,first_block_number,i-1,format);
+
+          /* Série suivante */
           first_block_number = i;
-          strcpy(first_block_info,current_block_info);
-        }
-      else
-        {
-          /* Fin d'une série */
-          if(my_stricmp(first_block_info,current_block_info))
-            {
-              /* On produit la série précédente */
-              if(verbose)
-                {
-                  if(i == first_block_number+1)
-                    logf("%04X     ;%s\n",first_block_number,first_block_info);
-                  else
-                    logf("%04X-%04X;%s\n",first_block_number,i-1,first_block_info);
-                }
-
-              /* On stocke les infos pour la série suivante */
-              first_block_number = i;
-              strcpy(first_block_info,current_block_info);
-            }
         }
     }
   /* Fin */
-  if(verbose)
-    {
-      if(current_image->nb_block == first_block_number+1)
-        logf("%04X     ;%s\n",first_block_number,first_block_info);
-      else
-        logf("%04X-%04X;%s\n",first_block_number,current_image->nb_block-1,first_block_info);
-    }
+  if(verbose && current_image->nb_block > 0)
+    CheckBlockRun(current_image,first_block_number,current_image->nb_block-1,format);
 
   /** Liste des erreurs **/
-  if(verbose)
+  if(text_verbose)
     logf("; ------------------  Error List  -------------------\n");
+  if(json_verbose)
+    logf("]");
+  if(format == FORMAT_JSON)
+    logf(",\"errors\":[");
   my_Memory(MEMORY_GET_ERROR_NB,&nb_error,NULL);
   for(i=1; i<=nb_error; i++)
     {
       my_Memory(MEMORY_GET_ERROR,&i,&current_error);
-      logf("    => %s\n",current_error->message);
+      if(format == FORMAT_JSON)
+        {
+          if(i > 1)
+            log_write(",",1);
+          log_json_string(current_error->message);
+        }
+      else if(format == FORMAT_CSV)
+        {
+          log_csv_string(current_image->image_file_path);
+          logf(",error,,,,,");
+          log_csv_string(current_error->message);
+          log_write("\n",1);
+        }
+      else
+        logf("    => %s\n",current_error->message);
+    }
+
+  /** Fin du document JSON (une ligne par image) **/
+  if(format == FORMAT_JSON)
+    logf("]}\n");
+}
+
+
+/**************************************************************/
+/*  CheckVolumeCsvHeader() :  Ligne d'en-tête du rapport CSV. */
+/**************************************************************/
+void CheckVolumeCsvHeader(void)
+{
+  logf("image,record,first_block,last_block,object,path,message\n");
+}
+
+
+/**********************************************************************/
+/*  CheckObjectBlocks() :  Marque les blocks d'un dossier / fichier.  */
+/*                         (format < 0 : pas d'affichage)             */
+/**********************************************************************/
+static void CheckObjectBlocks(struct prodos_image *current_image, struct file_descriptive_entry *current_entry, int type, int format, int index)
+{
+  int j, block_number, nb_block;
+  char object_info[2048];
+  char entry_path[ENTRY_PATH_LENGTH];
+  char error_message[4096];   /* Message + description de l'objet (2048) */
+
+  /* Début de la ligne */
+  if(format == FORMAT_TEXT)
+    logf("%s;%s",(type == BLOCK_TYPE_FOLDER) ? "Folder" : "File",GetEntryPath(current_image,current_entry,entry_path));
+  else if(format == FORMAT_JSON)
+    {
+      logf("%s{\"path\":",(index > 0) ? "," : "");
+      log_json_string(GetEntryPath(current_image,current_entry,entry_path));
+      logf(",\"blocks\":[");
+    }
+
+  for(j=0, nb_block=0; j<current_entry->nb_used_block; j++)
+    if(current_entry->tab_used_block[j] != 0)
+      {
+        block_number = current_entry->tab_used_block[j];
+
+        /* A qui ce block appartient */
+        if(current_image->block_usage_type[block_number] != BLOCK_TYPE_EMPTY)
+          {
+            /* Déjà occupé ! */
+            GetObjectInfo(current_image,current_image->block_usage_type[block_number],(struct file_descriptive_entry *)current_image->block_usage_object[block_number],object_info);
+            snprintf(error_message,sizeof(error_message),"Block %04X is claimed by %s %s but it is already used by %s",block_number,
+                     (type == BLOCK_TYPE_FOLDER) ? "Folder" : "File",GetEntryPath(current_image,current_entry,entry_path),object_info);
+            my_Memory(MEMORY_ADD_ERROR,error_message,NULL);
+          }
+        else
+          {
+            current_image->block_usage_type[block_number] = type;
+            current_image->block_usage_object[block_number] = current_entry;
+          }
+
+        /* Numéro du block */
+        if(format == FORMAT_TEXT)
+          logf(";%04X",block_number);
+        else if(format == FORMAT_JSON)
+          logf((nb_block > 0) ? ",%d" : "%d",block_number);
+        nb_block++;
+      }
+
+  /* Fin de la ligne */
+  if(format == FORMAT_TEXT)
+    logf("\n");
+  else if(format == FORMAT_JSON)
+    logf("]}");
+}
+
+
+/******************************************************************/
+/*  CheckBlockRun() :  Affiche une série de blocks du même objet. */
+/******************************************************************/
+static void CheckBlockRun(struct prodos_image *current_image, int first_block_number, int last_block_number, int format)
+{
+  int type;
+  char block_info[2048];
+  char entry_path[ENTRY_PATH_LENGTH];
+  char *object_name[] = {"Free","Boot","Volume","Bitmap","File","Folder"};
+  struct file_descriptive_entry *current_entry;
+
+  type = current_image->block_usage_type[first_block_number];
+  current_entry = (struct file_descriptive_entry *) current_image->block_usage_object[first_block_number];
+
+  if(format == FORMAT_TEXT)
+    {
+      GetObjectInfo(current_image,type,current_entry,block_info);
+      if(first_block_number == last_block_number)
+        logf("%04X     ;%s\n",first_block_number,block_info);
+      else
+        logf("%04X-%04X;%s\n",first_block_number,last_block_number,block_info);
+    }
+  else if(format == FORMAT_JSON)
+    {
+      logf("%s{\"first_block\":%d,\"last_block\":%d,\"object\":\"%s\",\"path\":",(first_block_number > 0) ? "," : "",first_block_number,last_block_number,object_name[type]);
+      if(type == BLOCK_TYPE_FILE || type == BLOCK_TYPE_FOLDER)
+        log_json_string(GetEntryPath(current_image,current_entry,entry_path));
+      else
+        logf("null");
+      logf("}");
+    }
+  else if(format == FORMAT_CSV)
+    {
+      log_csv_string(current_image->image_file_path);
+      logf(",block_run,%d,%d,%s,",first_block_number,last_block_number,object_name[type]);
+      if(type == BLOCK_TYPE_FILE || type == BLOCK_TYPE_FOLDER)
+        log_csv_string(GetEntryPath(current_image,current_entry,entry_path));
+      log_write(",\n",2);
     }
 }
 
@@ -220,25 +289,27 @@ void CheckProdosImage(struct prodos_image *current_image, int verbose)
 /************************************************************/
 /*  GetObjectInfo() :  Crée la chaine identifiant un objet. */
 /************************************************************/
-static char *GetObjectInfo(int type, struct file_descriptive_entry *current_entry)
+static char *GetObjectInfo(struct prodos_image *current_image, int type, struct file_descriptive_entry *current_entry, char *object_info)
 {
-  static char object_info[2048];
+  char entry_path[ENTRY_PATH_LENGTH];
 
-  if(type == BLOCK_TYPE_BOOT)
+  if(type == BLOCK_TYPE_EMPTY)
+    sprintf(object_info,"Free");
+  else if(type == BLOCK_TYPE_BOOT)
     sprintf(object_info,"Boot");
   else if(type == BLOCK_TYPE_VOLUME)
     sprintf(object_info,"Volume");
   else if(type == BLOCK_TYPE_BITMAP)
     sprintf(object_info,"Bitmap");
   else if(type == BLOCK_TYPE_FILE)
-    sprintf(object_info,"File;%s",current_entry->file_path);
+    sprintf(object_info,"File;%s",GetEntryPath(current_image,current_entry,entry_path));
   else if(type == BLOCK_TYPE_FOLDER)
-    sprintf(object_info,"Folder;%s",current_entry->file_path);
+    sprintf(object_info,"Folder;%s",GetEntryPath(current_image,current_entry,entry_path));
   else
     strcpy(object_info,"Unknown");
 
-  /* Renvoi la description */
-  return(&object_info[0]);
+  /* Renvoi la description (buffer de l'appelant, 2048 octets) */
+  return(object_info);
 }
 
 /***********************************************************************/
\ No newline at end of file
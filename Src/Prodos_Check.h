@@ -6,6 +6,7 @@
 /*  Auteur : Olivier ZARDINI  *  Brutal Deluxe Software  *  Dec 2011   */
 /***********************************************************************/
 
-void CheckProdosImage(struct prodos_image *,int);
+void CheckProdosImage(struct prodos_image *,int,int);
+void CheckVolumeCsvHeader(void);
 
 /***********************************************************************/
@@ -59,7 +59,7 @@ unsigned char bitmap_mask[8] =
 /***********************************************************/
 /*  CreateProdosVolume() :  Création d'un nouveau Dossier. */
 /***********************************************************/
-void CreateProdosFolder(struct prodos_image *current_image, char *prodos_folder_path, bool zero_case_bits)
+int CreateProdosFolder(struct prodos_image *current_image, char *prodos_folder_path, bool zero_case_bits)
 {
   int error, is_volume_header;
   struct file_descriptive_entry *new_folder;
@@ -73,11 +73,13 @@ void CreateProdosFolder(struct prodos_image *current_image, char *prodos_folder_
     0
   );
 
+  /* Le nom du Volume n'est pas une erreur : le dossier existe déjà */
   if(new_folder == NULL)
-    return;
+    return((is_volume_header == 1) ? 0 : 1);
 
   /** Ecrit le fichier Image **/
   error = UpdateProdosImage(current_image);
+  return(error);
 }
 
 
@@ -265,7 +267,7 @@ struct prodos_image *CreateProdosVolume(
   free(image_data);
 
   /** Chargement de l'image **/
-  current_image = LoadProdosImage(image_file_path);
+  current_image = LoadProdosImage(image_file_path,IMAGE_ACCESS_WRITE);
 
   return(current_image);
 }
@@ -288,6 +290,7 @@ struct file_descriptive_entry *BuildProdosFolderPath(
   char volume_name[256];
   char folder_path[2048];
   char target_folder_path[2048];
+  char entry_path[ENTRY_PATH_LENGTH];
   struct file_descriptive_entry *current_folder;
   struct file_descriptive_entry *next_folder;
   struct file_descriptive_entry *new_folder;
@@ -351,7 +354,7 @@ struct file_descriptive_entry *BuildProdosFolderPath(
     }
 
   /** Création de tous les Dossiers **/
-  strcpy(folder_path,&target_folder_path[(current_folder == NULL) ? strlen(current_image->volume_header->volume_name)+2: strlen(current_folder->file_path)+1]);
+  strcpy(folder_path,&target_folder_path[(current_folder == NULL) ? strlen(current_image->volume_header->volume_name)+2: strlen(GetEntryPath(current_image,current_folder,entry_path))+1]);
   begin = folder_path;
   while(begin)
     {
@@ -397,12 +400,12 @@ struct file_descriptive_entry *CreateOneProdosFolder(
   WORD name_case, now_date, now_time, file_count;
   WORD prev_block_number, next_block_number, directory_block_number, subdirectory_block_number, header_block_number;
   BYTE storage_length, directory_entry_number;
-  int i, is_valid, error, offset, entry_length, nb_directory;
+  int i, is_valid, error, offset, entry_length;
   int *tab_block;
   unsigned char name_length;
   struct file_descriptive_entry *new_folder = NULL;
-  struct file_descriptive_entry **new_tab_directory = NULL;
-  char volume_path[256];
+  struct file_descriptive_entry *existing_entry;
+  char entry_path[ENTRY_PATH_LENGTH];
   unsigned char directory_block[BLOCK_SIZE];
   unsigned char subdirectory_block[BLOCK_SIZE];
 
@@ -415,25 +418,11 @@ struct file_descriptive_entry *CreateOneProdosFolder(
     }
 
   /** Vérifie que ce nom de Dossier ne correspond pas déjà à un nom de fichier **/
-  if(current_folder == NULL)
+  existing_entry = FindFolderEntry(current_image,current_folder,folder_name);
+  if(existing_entry != NULL && (existing_entry->storage_type & 0x0F) != 0x0D)
     {
-      /* Vérification à la racine du Volume */
-      for(i=0; i<current_image->nb_file; i++)
-        if(!my_stricmp(folder_name,current_image->tab_file[i]->file_name))
-          {
-            logf_error("  Error : Invalid Prodos Folder name. The name is already used by a File '%s'.\n",folder_name);
-            return(NULL);
-          }
-    }
-  else
-    {
-      /* Vérification dans le dossier */
-      for(i=0; i<current_folder->nb_file; i++)
-        if(!my_stricmp(folder_name,current_folder->tab_file[i]->file_name))
-          {
-            logf_error("  Error : Invalid Prodos Folder name. The name is already used by a File '%s'.\n",folder_name);
-            return(NULL);
-          }
+      logf_error("  Error : Invalid Prodos Folder name. The name is already used by a File '%s'.\n",folder_name);
+      return(NULL);
     }
 
   /* Nom en majuscule */
@@ -518,7 +507,7 @@ struct file_descriptive_entry *CreateOneProdosFolder(
   free(tab_block);
 
   /** Ecriture du bloc **/
-  SetBlockData(current_image,subdirectory_block_number,&subdirectory_block[0]);
+  SetMetadataBlockData(current_image,subdirectory_block_number,&subdirectory_block[0]);
 
   /***********************************************************/
   /*** Modification du Directory ou de la Racine du volume ***/
@@ -568,13 +557,12 @@ struct file_descriptive_entry *CreateOneProdosFolder(
   SetWordValue(directory_block,offset+0x25,(WORD)((current_folder == NULL) ? 2 : current_folder->key_pointer_block));
 
   /* Ecriture : Block contenant l'entrée */
-  SetBlockData(current_image,directory_block_number,&directory_block[0]);
+  SetMetadataBlockData(current_image,directory_block_number,&directory_block[0]);
 
   /*********************************************************/
   /***  Allocation Mémoire pour ce nouveau SubDirectory  ***/
   /** Lecture de l'entrée **/
-  sprintf(volume_path,"/%s",current_image->volume_header->volume_name_case);
-  new_folder = ODSReadFileDescriptiveEntry(current_image,(current_folder==NULL)?volume_path:current_folder->file_path,&directory_block[offset]);
+  new_folder = ODSReadFileDescriptiveEntry(current_image,current_folder,&directory_block[offset]);
   if(new_folder == NULL)
     return(NULL);
   /* Complète l'entrée */
@@ -598,44 +586,20 @@ struct file_descriptive_entry *CreateOneProdosFolder(
   SetWordValue(directory_block,0x25,(WORD)(file_count+1));
 
   /* Ecriture Bloc Header du Directory */
-  SetBlockData(current_image,(current_folder == NULL) ? 2 : current_folder->key_pointer_block,&directory_block[0]);
+  SetMetadataBlockData(current_image,(current_folder == NULL) ? 2 : current_folder->key_pointer_block,&directory_block[0]);
 
   /***************************************************/
   /*** Ajoute ce SubDirectory au Folder en mémoire ***/
-  /** Création du nouveau Tableau des Dossiers **/
-  nb_directory = 1 + ((current_folder==NULL) ? current_image->nb_directory : current_folder->nb_directory);
-  new_tab_directory = (struct file_descriptive_entry **) calloc(nb_directory,sizeof(struct file_descriptive_entry *));
-  if(new_tab_directory == NULL)
+  error = UpdateFolderEntry(current_image,current_folder,UPDATE_ADD,new_folder);
+  if(error)
     {
       logf_error("  Error : Impossible to allocate memory.\n");
       return(NULL);
     }
-  for(i=0; i<nb_directory-1; i++)
-    new_tab_directory[i] = (current_folder==NULL) ? current_image->tab_directory[i] : current_folder->tab_directory[i];
-  new_tab_directory[nb_directory-1] = new_folder;
-  qsort(new_tab_directory,nb_directory,sizeof(struct file_descriptive_entry *),compare_entry);
-
-  /** Met à jour les informations mémoire du Dossier parent **/
-  if(current_folder == NULL)
-    {
-      /* Ajoute ce dossier à la Racine du Volume */
-      if(current_image->tab_directory)
-        free(current_image->tab_directory);
-      current_image->tab_directory = new_tab_directory;
-      current_image->nb_directory = nb_directory;
-    }
-  else
-    {
-      /* Ajoute ce dossier dans le Dossier parent */
-      if(current_folder->tab_directory)
-        free(current_folder->tab_directory);
-      current_folder->tab_directory = new_tab_directory;
-      current_folder->nb_directory = nb_directory;
-    }
 
   /* Stat */
   if(verbose)
-    logf_info("      + Add Folder : %s\n",new_folder->file_path);
+    logf_info("      + Add Folder : %s\n",GetEntryPath(current_image,new_folder,entry_path));
   current_image->nb_add_folder++;
 
   /* Renvoie la nouvelle structure */
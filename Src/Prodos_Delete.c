@@ -20,10 +20,17 @@
 #include "Prodos_Delete.h"
 #include "log.h"
 
-static void DeleteEntryFile(struct prodos_image *,struct file_descriptive_entry *);
-static int EmptyEntryFolder(struct prodos_image *,struct file_descriptive_entry *,int);
-static void DeleteEmptyFolder(struct prodos_image *,struct file_descriptive_entry *);
+static void DeleteEntryFile(struct prodos_image *,struct file_descriptive_entry *,struct delete_batch *);
+static int EmptyEntryFolder(struct prodos_image *,struct file_descriptive_entry *,int,struct delete_batch *);
+static void DeleteEmptyFolder(struct prodos_image *,struct file_descriptive_entry *,struct delete_batch *);
+static void CountEntryFolder(struct file_descriptive_entry *,int *,int *);
+static int NewDeleteBatch(struct delete_batch *,int,int);
+static void AddDeleteEntry(struct delete_batch *,struct file_descriptive_entry *);
+static void ApplyDeleteBatch(struct prodos_image *,struct delete_batch *);
+static void mem_free_delete_batch(struct delete_batch *);
 static int compare_folder(const void *,const void *);
+static int compare_delete_slot(const void *,const void *);
+static int compare_block(const void *,const void *);
 
 /**
  * @brief      Delete a ProDOS file
@@ -31,10 +38,11 @@ static int compare_folder(const void *,const void *);
  * @param      current_image     The current image
  * @param      prodos_file_path  The prodos file path
  */
-void DeleteProdosFile(struct prodos_image *current_image, char *prodos_file_path)
+int DeleteProdosFile(struct prodos_image *current_image, char *prodos_file_path)
 {
   int error;
   struct file_descriptive_entry *current_entry;
+  struct delete_batch batch;
 
   // If there's a type suffix, remove it before continuing
   char *suffix = strchr(prodos_file_path, '#');
@@ -45,34 +53,31 @@ void DeleteProdosFile(struct prodos_image *current_image, char *prodos_file_path
   if(current_entry == NULL)
     {
       logf_error("  Error : Invalid Prodos File path '%s'.\n",prodos_file_path);
-      return;
+      return(1);
     }
 
+  /* Une entrée et ses blocs */
+  error = NewDeleteBatch(&batch,2,current_entry->nb_used_block);
+  if(error)
+    return(1);
+
   /** Supprime une entrée Fichier **/
-  DeleteEntryFile(current_image,current_entry);
+  DeleteEntryFile(current_image,current_entry,&batch);
+  ApplyDeleteBatch(current_image,&batch);
+  mem_free_delete_batch(&batch);
 
   /** Ecrit le fichier **/
   error = UpdateProdosImage(current_image);
+  return(error);
 }
 
 
 /******************************************************************/
 /*  DeleteEntryFile() :  Suppression d'une entrée Fichier Prodos. */
 /******************************************************************/
-static void DeleteEntryFile(struct prodos_image *current_image, struct file_descriptive_entry *current_entry)
+static void DeleteEntryFile(struct prodos_image *current_image, struct file_descriptive_entry *current_entry, struct delete_batch *batch)
 {
-  WORD now_date, now_time, file_count;
-  BYTE storage_type;
-  int i, j, block_number, nb_bitmap_block, modified, total_modified, offset, subdirectory_block, current_block;
   struct file_descriptive_entry *current_directory;
-  unsigned char directory_block[BLOCK_SIZE];
-  unsigned char bitmap_block[BLOCK_SIZE];
-
-  /* Date actuelle */
-  GetCurrentDate(&now_date,&now_time);
-
-  /* Nombre de block nécessaires pour stocker la table */
-  nb_bitmap_block = GetContainerNumber(current_image->nb_block,BLOCK_SIZE*8);
 
   /**********************************************************/
   /** On va supprimer cette entrée de la structure mémoire **/
@@ -85,91 +90,24 @@ static void DeleteEntryFile(struct prodos_image *current_image, struct file_desc
   if(current_directory == NULL)
     {
       /** L'entrée est à la racine du volume **/
-      UpdateEntryTable(UPDATE_REMOVE,&current_image->nb_file,&current_image->tab_file,current_entry);
+      UpdateFolderEntry(current_image,NULL,UPDATE_REMOVE,current_entry);
 
       /** Last Modification date : Volume Header **/
-      GetProdosDate(now_date,&current_image->volume_header->volume_modification_date);
-      GetProdosTime(now_time,&current_image->volume_header->volume_modification_time);
+      GetProdosDate(batch->now_date,&current_image->volume_header->volume_modification_date);
+      GetProdosTime(batch->now_time,&current_image->volume_header->volume_modification_time);
     }
   else
     {
       /** L'entrée est dans un sous répertoire **/
-      UpdateEntryTable(UPDATE_REMOVE,&current_directory->nb_file,&current_directory->tab_file,current_entry);
+      UpdateFolderEntry(current_image,current_directory,UPDATE_REMOVE,current_entry);
 
       /** Last Modification date : Directory **/
-      GetProdosDate(now_date,&current_directory->file_modification_date);
-      GetProdosTime(now_time,&current_directory->file_modification_time);
-    }
-
-  /** Marque les blocs occupés par le fichier comme libres **/
-  for(i=0; i<current_entry->nb_used_block; i++)
-    {
-      block_number = current_entry->tab_used_block[i];
-      current_image->block_allocation_table[block_number] = 1;    /* Libre */
-    }
-  current_image->nb_free_block += current_entry->nb_used_block;
-
-  /***********************************/
-  /** On va modifier l'image disque **/
-  /** Directory Block **/
-  GetBlockData(current_image,current_entry->block_location,&directory_block[0]);
-
-  /** Place les informations dans le Directory : Marque l'entrée comme supprimée **/
-  storage_type = 0x00;
-  memcpy(&directory_block[current_entry->entry_offset+FILE_STORAGETYPE_OFFSET],&storage_type,sizeof(BYTE));
-
-  /* Modifie le block Directory */
-  SetBlockData(current_image,current_entry->block_location,&directory_block[0]);
-
-  /** Sub-Directory Block **/
-  current_block = current_entry->block_location;
-  subdirectory_block = GetWordValue(&directory_block[0],0);
-  while(subdirectory_block != 0)
-    {
-      current_block = subdirectory_block;
-      GetBlockData(current_image,subdirectory_block,&directory_block[0]);
-      subdirectory_block = GetWordValue(&directory_block[0],0);
+      current_directory->file_modification_date = batch->now_date;
+      current_directory->file_modification_time = batch->now_time;
     }
 
-  /* Une entrée en moins dans ce Directory */
-  file_count = GetWordValue(&directory_block[0],DIRECTORY_FILECOUNT_OFFSET);
-  if(file_count > 0)
-    file_count--;
-  SetWordValue(&directory_block[0],DIRECTORY_FILECOUNT_OFFSET,file_count);
-
-  /* Modifie le block Sub-Directory */
-  SetBlockData(current_image,current_block,&directory_block[0]);
-
-  /** Marque les blocs occupés par le fichier comme libres **/
-  total_modified = 0;
-  for(i=0; i<nb_bitmap_block; i++)
-    {
-      /* Bitmap block */
-      GetBlockData(current_image,current_image->volume_header->bitmap_block+i,&bitmap_block[0]);
-      modified = 0;
-
-      /** Passe en revue les blocs utilisés du fichier **/
-      for(j=0; j<current_entry->nb_used_block; j++)
-        if((current_entry->tab_used_block[j] >= i*8*BLOCK_SIZE) && (current_entry->tab_used_block[j] < (i+1)*8*BLOCK_SIZE))
-          {
-            offset = current_entry->tab_used_block[j] - i*8*BLOCK_SIZE;
-            bitmap_block[offset/8] |= (0x01 << (7-(offset%8)));    /* 1 : Libre */
-            modified = 1;
-            total_modified++;
-
-            /* Pas besoin de tout parcourir */
-            if(total_modified == current_entry->nb_used_block)
-              break;
-          }
-
-      /* Modifie le block Bitmap */
-      if(modified)
-        SetBlockData(current_image,current_image->volume_header->bitmap_block+i,&bitmap_block[0]);
-
-      /* Pas besoin de tout parcourir */
-      if(total_modified == current_entry->nb_used_block)
-        break;
-    }
+  /** L'entrée Directory, le compteur du Header et les blocs du fichier sont libérés par ApplyDeleteBatch **/
+  AddDeleteEntry(batch,current_entry);
 
   /* Libération mémoire de la structure */
   mem_free_entry(current_entry);
@@ -179,30 +117,41 @@ static void DeleteEntryFile(struct prodos_image *current_image, struct file_desc
 /*************************************************************/
 /*  DeleteProdosFolder() :  Suppression d'un dossier Prodos. */
 /*************************************************************/
-void DeleteProdosFolder(struct prodos_image *current_image, char *prodos_folder_path)
+int DeleteProdosFolder(struct prodos_image *current_image, char *prodos_folder_path)
 {
-  int i, j, error, nb_folder, nb_directory;
+  int i, j, error, nb_folder, nb_directory, nb_slot, nb_block;
   struct file_descriptive_entry **tab_folder;
   struct file_descriptive_entry *current_entry;
   struct file_descriptive_entry *current_directory;
+  struct delete_batch batch;
 
   /* Recherche le dossier Prodos */
   current_entry = GetProdosFolder(current_image,prodos_folder_path,0);
   if(current_entry == NULL)
     {
       logf_error("  Error : Invalid Prodos Folder path '%s'.\n",prodos_folder_path);
-      return;
+      return(1);
     }
 
+  /** Taille des tables de la suppression (toute l'arborescence) **/
+  nb_slot = 0;
+  nb_block = 0;
+  CountEntryFolder(current_entry,&nb_slot,&nb_block);
+  error = NewDeleteBatch(&batch,nb_slot,nb_block);
+  if(error)
+    return(1);
+
   /** Supprime tous les fichiers (récursivité dans les sous-répertoires) **/
-  nb_folder = EmptyEntryFolder(current_image,current_entry,1);
+  nb_folder = EmptyEntryFolder(current_image,current_entry,1,&batch);
 
   /** Construit la liste des répertoires à supprimer **/
   tab_folder = (struct file_descriptive_entry **) calloc(nb_folder,sizeof(struct file_descriptive_entry *));
   if(tab_folder == NULL)
     {
       logf_error("  Error : Impossible to allocate memory for table 'tab_folder'.\n");
-      return;
+      ApplyDeleteBatch(current_image,&batch);
+      mem_free_delete_batch(&batch);
+      return(1);
     }
   my_Memory(MEMORY_GET_DIRECTORY_NB,&nb_directory,NULL);
   for(i=1, j=0; i<=nb_directory; i++)
@@ -215,20 +164,25 @@ void DeleteProdosFolder(struct prodos_image *current_image, char *prodos_folder_
 
   /** Supprime tous les Sous-répertoires vides, par ordre de niveau **/
   for(i=0; i<nb_folder; i++)
-    DeleteEmptyFolder(current_image,tab_folder[i]);
+    DeleteEmptyFolder(current_image,tab_folder[i],&batch);
+
+  /** Une seule passe sur les blocs Directory et la Bitmap **/
+  ApplyDeleteBatch(current_image,&batch);
 
   /* Libération mémoire */
   free(tab_folder);
+  mem_free_delete_batch(&batch);
 
   /** Ecrit le fichier **/
   error = UpdateProdosImage(current_image);
+  return(error);
 }
 
 
 /*****************************************************************/
 /*  EmptyEntryFolder() :  Suppression des fichiers d'un dossier. */
 /*****************************************************************/
-static int EmptyEntryFolder(struct prodos_image *current_image, struct file_descriptive_entry *current_entry, int depth)
+static int EmptyEntryFolder(struct prodos_image *current_image, struct file_descriptive_entry *current_entry, int depth, struct delete_batch *batch)
 {
   int i, nb_folder;
 
@@ -236,13 +190,13 @@ static int EmptyEntryFolder(struct prodos_image *current_image, struct file_desc
   nb_folder = 1;
   current_entry->delete_folder_depth = depth;
 
-  /** Supprime tous les fichiers du réperoire **/
+  /** Supprime tous les fichiers du réperoire (par la fin : pas de décalage de la table) **/
   while(current_entry->nb_file > 0)
-    DeleteEntryFile(current_image,current_entry->tab_file[0]);
+    DeleteEntryFile(current_image,current_entry->tab_file[current_entry->nb_file-1],batch);
 
   /** Vide tous les sous-répertoires de leurs fichiers (récursivité) **/
   for(i=0; i<current_entry->nb_directory; i++)
-    nb_folder += EmptyEntryFolder(current_image,current_entry->tab_directory[i],depth+1);
+    nb_folder += EmptyEntryFolder(current_image,current_entry->tab_directory[i],depth+1,batch);
 
   /* Renvoi le nombre de sous-dossier */
   return(nb_folder);
@@ -252,25 +206,14 @@ static int EmptyEntryFolder(struct prodos_image *current_image, struct file_desc
 /**********************************************************/
 /*  DeleteEmptyFolder() :  Suppression d'un dossier vide. */
 /**********************************************************/
-void DeleteEmptyFolder(struct prodos_image *current_image, struct file_descriptive_entry *current_entry)
+static void DeleteEmptyFolder(struct prodos_image *current_image, struct file_descriptive_entry *current_entry, struct delete_batch *batch)
 {
-  WORD now_date, now_time, file_count;
-  int i, j, block_number, modified, offset, current_block, subdirectory_block, nb_bitmap_block, total_modified;
-  BYTE storage_type;
   struct file_descriptive_entry *current_directory;
-  unsigned char directory_block[BLOCK_SIZE];
-  unsigned char bitmap_block[BLOCK_SIZE];
 
   /* On vérifie que le répertoire est vide */
   if(current_entry->nb_file != 0 || current_entry->nb_directory != 0)
     return;
 
-  /* Date actuelle */
-  GetCurrentDate(&now_date,&now_time);
-
-  /* Nombre de block nécessaires pour stocker la table */
-  nb_bitmap_block = GetContainerNumber(current_image->nb_block,BLOCK_SIZE*8);
-
   /**********************************************************/
   /** On va supprimer cette entrée de la structure mémoire **/
 
@@ -282,106 +225,181 @@ void DeleteEmptyFolder(struct prodos_image *current_image, struct file_descripti
   if(current_directory == NULL)
     {
       /** Le répertoire est à la racine du volume **/
-      UpdateEntryTable(UPDATE_REMOVE,&current_image->nb_directory,&current_image->tab_directory,current_entry);
+      UpdateFolderEntry(current_image,NULL,UPDATE_REMOVE,current_entry);
 
       /** Last Modification date : Volume Header **/
-      GetProdosDate(now_date,&current_image->volume_header->volume_modification_date);
-      GetProdosTime(now_time,&current_image->volume_header->volume_modification_time);
+      GetProdosDate(batch->now_date,&current_image->volume_header->volume_modification_date);
+      GetProdosTime(batch->now_time,&current_image->volume_header->volume_modification_time);
     }
   else
     {
       /** Le répertoire est dans un sous répertoire **/
-      UpdateEntryTable(UPDATE_REMOVE,&current_directory->nb_directory,&current_directory->tab_directory,current_entry);
+      UpdateFolderEntry(current_image,current_directory,UPDATE_REMOVE,current_entry);
 
       /** Last Modification date : Directory **/
-      GetProdosDate(now_date,&current_directory->file_modification_date);
-      GetProdosTime(now_time,&current_directory->file_modification_time);
+      current_directory->file_modification_date = batch->now_date;
+      current_directory->file_modification_time = batch->now_time;
     }
 
-  /** Marque les blocs occupés par le répertoire comme libres **/
-  for(i=0; i<current_entry->nb_used_block; i++)
+  /** L'entrée Directory, le compteur du Header et les blocs du répertoire sont libérés par ApplyDeleteBatch **/
+  AddDeleteEntry(batch,current_entry);
+
+  /* Libération mémoire de la structure */
+  mem_free_entry(current_entry);
+}
+
+
+/*******************************************************************************/
+/*  CountEntryFolder() :  Nombre de modifications Directory et de blocs libérés */
+/*                        par la suppression d'un dossier et de son contenu.    */
+/*******************************************************************************/
+static void CountEntryFolder(struct file_descriptive_entry *current_entry, int *nb_slot, int *nb_block)
+{
+  int i;
+
+  /* Le dossier lui-même : son entrée, le compteur de son Header, ses blocs */
+  *nb_slot += 2;
+  *nb_block += current_entry->nb_used_block;
+
+  /** Les fichiers **/
+  for(i=0; i<current_entry->nb_file; i++)
     {
-      block_number = current_entry->tab_used_block[i];
-      current_image->block_allocation_table[block_number] = 1;    /* Libre */
+      *nb_slot += 2;
+      *nb_block += current_entry->tab_file[i]->nb_used_block;
     }
-  current_image->nb_free_block += current_entry->nb_used_block;
 
-  /***********************************/
-  /** On va modifier l'image disque **/
-  /** Directory Block **/
-  GetBlockData(current_image,current_entry->block_location,&directory_block[0]);
+  /** Les sous-répertoires (récursivité) **/
+  for(i=0; i<current_entry->nb_directory; i++)
+    CountEntryFolder(current_entry->tab_directory[i],nb_slot,nb_block);
+}
 
-  /** Place les informations dans le Directory : Marque l'entrée comme supprimée **/
-  storage_type = 0x00;
-  memcpy(&directory_block[current_entry->entry_offset+FILE_STORAGETYPE_OFFSET],&storage_type,sizeof(BYTE));
 
-  /* Modifie le block Directory */
-  SetBlockData(current_image,current_entry->block_location,&directory_block[0]);
+/*******************************************************************/
+/*  NewDeleteBatch() :  Alloue les tables d'une suppression, avant */
+/*                      de toucher à l'image.                      */
+/*******************************************************************/
+static int NewDeleteBatch(struct delete_batch *batch, int nb_slot, int nb_block)
+{
+  memset(batch,0,sizeof(struct delete_batch));
+
+  /* Date actuelle, la même pour toutes les entrées */
+  GetCurrentDate(&batch->now_date,&batch->now_time);
 
-  /** Sub-Directory Block **/
-  current_block = current_entry->block_location;
-  subdirectory_block = GetWordValue(&directory_block[0],0);
-  while(subdirectory_block != 0)
+  /* Allocation mémoire */
+  batch->tab_slot = (struct delete_slot *) calloc((nb_slot > 0) ? nb_slot : 1,sizeof(struct delete_slot));
+  batch->tab_block = (int *) calloc((nb_block > 0) ? nb_block : 1,sizeof(int));
+  if(batch->tab_slot == NULL || batch->tab_block == NULL)
     {
-      current_block = subdirectory_block;
-      GetBlockData(current_image,subdirectory_block,&directory_block[0]);
-      subdirectory_block = GetWordValue(&directory_block[0],0);
+      logf_error("  Error : Impossible to allocate memory for table 'tab_slot'.\n");
+      mem_free_delete_batch(batch);
+      return(1);
     }
+  batch->nb_slot_max = nb_slot;
+  batch->nb_block_max = nb_block;
+
+  /* OK */
+  return(0);
+}
+
+
+/*****************************************************************************/
+/*  AddDeleteEntry() :  Enregistre l'entrée à effacer, le compteur de fichiers */
+/*                      à décrémenter et les blocs de l'entrée à libérer.      */
+/*****************************************************************************/
+static void AddDeleteEntry(struct delete_batch *batch, struct file_descriptive_entry *current_entry)
+{
+  int i;
+
+  /* Tables dimensionnées par NewDeleteBatch */
+  if(batch->nb_slot+2 > batch->nb_slot_max || batch->nb_block+current_entry->nb_used_block > batch->nb_block_max)
+    return;
+
+  /** Entrée marquée comme supprimée dans le Directory **/
+  batch->tab_slot[batch->nb_slot].block_number = current_entry->block_location;
+  batch->tab_slot[batch->nb_slot].action = DELETE_CLEAR_ENTRY;
+  batch->tab_slot[batch->nb_slot].entry_offset = current_entry->entry_offset;
+  batch->nb_slot++;
+
+  /** Une entrée en moins dans le Header (Volume Directory : block 2) **/
+  batch->tab_slot[batch->nb_slot].block_number = (current_entry->parent_directory == NULL) ? 2 : current_entry->parent_directory->key_pointer_block;
+  batch->tab_slot[batch->nb_slot].action = DELETE_FILE_COUNT;
+  batch->tab_slot[batch->nb_slot].entry_offset = 0;
+  batch->nb_slot++;
+
+  /** Les blocs de l'entrée **/
+  for(i=0; i<current_entry->nb_used_block; i++)
+    batch->tab_block[batch->nb_block++] = current_entry->tab_used_block[i];
+}
 
-  /* Une entrée en moins dans ce Directory */
-  file_count = GetWordValue(&directory_block[0],DIRECTORY_FILECOUNT_OFFSET);
-  if(file_count > 0)
-    file_count--;
-  SetWordValue(&directory_block[0],DIRECTORY_FILECOUNT_OFFSET,file_count);
 
-  /* Modifie le block Sub-Directory */
-  SetBlockData(current_image,current_block,&directory_block[0]);
+/*********************************************************************************/
+/*  ApplyDeleteBatch() :  Chaque block Directory concerné est lu et écrit une     */
+/*                        fois, puis les blocs sont libérés dans l'ordre (un seul */
+/*                        passage par block de la Bitmap).                        */
+/*********************************************************************************/
+static void ApplyDeleteBatch(struct prodos_image *current_image, struct delete_batch *batch)
+{
+  int i, j;
+  WORD file_count;
+  unsigned char directory_block[BLOCK_SIZE];
 
-  /** Marque les blocs occupés par le répertoire comme libres **/
-  total_modified = 0;
-  for(i=0; i<nb_bitmap_block; i++)
+  /** Blocs Directory **/
+  qsort(batch->tab_slot,batch->nb_slot,sizeof(struct delete_slot),compare_delete_slot);
+  for(i=0; i<batch->nb_slot; i=j)
     {
-      /* Bitmap block */
-      GetBlockData(current_image,current_image->volume_header->bitmap_block+i,&bitmap_block[0]);
-      modified = 0;
-
-      /** Passe en revue les blocs utilisés du répertoire **/
-      for(j=0; j<current_entry->nb_used_block; j++)
-        if((current_entry->tab_used_block[j] >= i*8*BLOCK_SIZE) && (current_entry->tab_used_block[j] < (i+1)*8*BLOCK_SIZE))
-          {
-            offset = current_entry->tab_used_block[j] - i*8*BLOCK_SIZE;
-            bitmap_block[offset/8] |= (0x01 << (7-(offset%8)));    /* 1 : Libre */
-            modified = 1;
-            total_modified++;
-
-            /* Pas besoin de tout parcourir */
-            if(total_modified == current_entry->nb_used_block)
-              break;
-          }
-
-      /* Modifie le block Bitmap */
-      if(modified)
-        SetBlockData(current_image,current_image->volume_header->bitmap_block+i,&bitmap_block[0]);
-
-      /* Pas besoin de tout parcourir */
-      if(total_modified == current_entry->nb_used_block)
-        break;
+      GetBlockData(current_image,batch->tab_slot[i].block_number,&directory_block[0]);
+
+      /* Toutes les modifications de ce block */
+      for(j=i; j<batch->nb_slot && batch->tab_slot[j].block_number == batch->tab_slot[i].block_number; j++)
+        {
+          if(batch->tab_slot[j].action == DELETE_CLEAR_ENTRY)
+            directory_block[batch->tab_slot[j].entry_offset+FILE_STORAGETYPE_OFFSET] = 0x00;
+          else
+            {
+              /* Une entrée en moins dans ce Directory */
+              file_count = GetWordValue(&directory_block[0],DIRECTORY_FILECOUNT_OFFSET);
+              if(file_count > 0)
+                file_count--;
+              SetWordValue(&directory_block[0],DIRECTORY_FILECOUNT_OFFSET,file_count);
+            }
+        }
+
+      /* Modifie le block Directory */
+      SetMetadataBlockData(current_image,batch->tab_slot[i].block_number,&directory_block[0]);
     }
 
-  /* Libération mémoire de la structure */
-  mem_free_entry(current_entry);
+  /** Marque les blocs libérés comme libres (Bitmap mémoire + disque) **/
+  qsort(batch->tab_block,batch->nb_block,sizeof(int),compare_block);
+  FreeImageBlock(current_image,batch->nb_block,batch->tab_block);
+
+  /* Appliqué */
+  batch->nb_slot = 0;
+  batch->nb_block = 0;
+}
+
+
+/*************************************************************/
+/*  mem_free_delete_batch() :  Libération des tables du lot. */
+/*************************************************************/
+static void mem_free_delete_batch(struct delete_batch *batch)
+{
+  if(batch->tab_slot)
+    free(batch->tab_slot);
+  if(batch->tab_block)
+    free(batch->tab_block);
+  batch->tab_slot = NULL;
+  batch->tab_block = NULL;
 }
 
 
 /**********************************************************/
 /*  DeleteProdosVolume() :  Suppression du volume Prodos. */
 /**********************************************************/
-void DeleteProdosVolume(struct prodos_image *current_image)
+int DeleteProdosVolume(struct prodos_image *current_image)
 {
   WORD now_date, now_time, nb_entry;
-  int i, j, error, nb_bitmap_block, block_number;
+  int i, error, nb_bitmap_block, block_number;
   unsigned char volume_block[BLOCK_SIZE];
-  unsigned char bitmap_block[BLOCK_SIZE];
   unsigned char data_block[BLOCK_SIZE];
 
   /* Date actuelle */
@@ -394,24 +412,15 @@ void DeleteProdosVolume(struct prodos_image *current_image)
   /** On va supprimer tous les fichiers la structure mémoire **/
   /* Plus de fichier à la racine */
   current_image->nb_file = 0;
-  if(current_image->tab_file)
-    free(current_image->tab_file);
   current_image->tab_file = NULL;
   /* Plus de fichier à la racine */
   current_image->nb_directory = 0;
-  if(current_image->tab_directory)
-    free(current_image->tab_directory);
   current_image->tab_directory = NULL;
 
   /* Libération mémoire : Plus de fichiers nul part */
   my_Memory(MEMORY_FREE_DIRECTORY,NULL,NULL);
   my_Memory(MEMORY_FREE_ENTRY,NULL,NULL);
 
-  /* Nettoyage de la Bitmap */
-  for(i=0; i<current_image->nb_block; i++)
-    current_image->block_allocation_table[i] = (i < (2+4+nb_bitmap_block)) ? 0 : 1;      /* 0 : Busy / 1 : Free */
-  current_image->nb_free_block = current_image->nb_block - (2 + 4 + nb_bitmap_block);
-
   /** Volume Header **/
   GetProdosDate(now_date,&current_image->volume_header->volume_modification_date);
   GetProdosTime(now_time,&current_image->volume_header->volume_modification_time);
@@ -444,30 +453,12 @@ void DeleteProdosVolume(struct prodos_image *current_image)
         memset(&volume_block[4],0,BLOCK_SIZE-4);
 
       /* Modifie le block */
-      SetBlockData(current_image,2+i,&volume_block[0]);
+      SetMetadataBlockData(current_image,2+i,&volume_block[0]);
     }
 
-  /** Nettoyage de la Bitmap **/
-  /* On vide tous les block */
+  /** Nettoyage de la Bitmap : 0 : Busy (Boot + Volume + Bitmap) / 1 : Free **/
+  ResetImageBitmap(current_image,2+4+nb_bitmap_block);
   block_number = current_image->volume_header->bitmap_block;
-  for(i=0; i<nb_bitmap_block; i++)
-    {
-      /* Récupère le block */
-      GetBlockData(current_image,block_number+i,&bitmap_block[0]);
-
-      /* Nettoyage préliminaire */
-      memset(bitmap_block,0,BLOCK_SIZE);
-
-      /* Marque les bloc libres */
-      for(j=0; j<(8*BLOCK_SIZE); j++)
-        if((i*8*BLOCK_SIZE)+j < current_image->nb_block)
-          if(current_image->block_allocation_table[(i*8*BLOCK_SIZE)+j] == 1)
-            bitmap_block[j/8] |= (0x01 << (7-(j%8)));
-
-
-      /* Modifie le block */
-      SetBlockData(current_image,block_number+i,&bitmap_block[0]);
-    }
 
   /** Vide tous les blocs **/
   memset(&data_block[0],0,BLOCK_SIZE);
@@ -476,6 +467,7 @@ void DeleteProdosVolume(struct prodos_image *current_image)
 
   /** Ecrit le fichier **/
   error = UpdateProdosImage(current_image);
+  return(error);
 }
 
 
@@ -500,4 +492,47 @@ static int compare_folder(const void *data_1, const void *data_2)
     return(-1);
 }
 
+
+/*************************************************************************/
+/*  compare_delete_slot() : Fonction de comparaison pour le Quick Sort.  */
+/*************************************************************************/
+static int compare_delete_slot(const void *data_1, const void *data_2)
+{
+  struct delete_slot *slot_1;
+  struct delete_slot *slot_2;
+
+  /* Récupération des paramètres */
+  slot_1 = (struct delete_slot *) data_1;
+  slot_2 = (struct delete_slot *) data_2;
+
+  /* Comparaison des numéros de block */
+  if(slot_1->block_number == slot_2->block_number)
+    return(0);
+  else if(slot_1->block_number < slot_2->block_number)
+    return(-1);
+  else
+    return(1);
+}
+
+
+/******************************************************************/
+/*  compare_block() : Fonction de comparaison pour le Quick Sort. */
+/******************************************************************/
+static int compare_block(const void *data_1, const void *data_2)
+{
+  int block_1, block_2;
+
+  /* Récupération des paramètres */
+  block_1 = *((int *) data_1);
+  block_2 = *((int *) data_2);
+
+  /* Comparaison des numéros de block */
+  if(block_1 == block_2)
+    return(0);
+  else if(block_1 < block_2)
+    return(-1);
+  else
+    return(1);
+}
+
 /***********************************************************************/
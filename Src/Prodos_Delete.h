@@ -6,8 +6,34 @@
 /*  Auteur : Olivier ZARDINI  *  Brutal Deluxe Software  *  Mar 2012   */
 /***********************************************************************/
 
-void DeleteProdosFile(struct prodos_image *,char *);
-void DeleteProdosFolder(struct prodos_image *,char *);
-void DeleteProdosVolume(struct prodos_image *);
+#define DELETE_CLEAR_ENTRY  0      /* Storage Type de l'entrée à 0 */
+#define DELETE_FILE_COUNT   1      /* Une entrée en moins dans le Header */
+
+/** Modification d'un block Directory **/
+struct delete_slot
+{
+  int block_number;
+  int action;                /* DELETE_CLEAR_ENTRY / DELETE_FILE_COUNT */
+  int entry_offset;
+};
+
+/** Blocs et entrées Directory libérés, appliqués en une passe triée **/
+struct delete_batch
+{
+  WORD now_date;
+  WORD now_time;
+
+  int nb_block;
+  int nb_block_max;
+  int *tab_block;
+
+  int nb_slot;
+  int nb_slot_max;
+  struct delete_slot *tab_slot;
+};
+
+int DeleteProdosFile(struct prodos_image *,char *);
+int DeleteProdosFolder(struct prodos_image *,char *);
+int DeleteProdosVolume(struct prodos_image *);
 
 /***********************************************************************/
\ No newline at end of file
@@ -26,15 +26,77 @@ static void DumpOneDirectory(struct file_descriptive_entry *,int);
 static void DumpOneFile(struct file_descriptive_entry *,int);
 static void DumpDirectoryEntries(struct prodos_image *,struct file_descriptive_entry *);
 static void DumpOneEntry(struct prodos_image *,struct file_descriptive_entry *);
+static char *GetStorageTypeAscii(BYTE,int,char *);
+static char *GetFileTypeAscii(BYTE,char *);
+static char *GetAccessAscii(BYTE,char *);
+static void DumpStructuredFolder(struct prodos_image *,int,struct file_descriptive_entry **,int,struct file_descriptive_entry **,int,int *);
+static void DumpStructuredEntry(struct prodos_image *,struct file_descriptive_entry *,int,int,int);
+static char *GetDateIso(WORD,WORD,char *);
+
+/** Textes des Storage Type (indice : storage_type & 0x0F, NULL : inconnu) **/
+static char *storage_type_ascii[16] =
+{
+  "Deleted",
+  "Seedling (1 data block)",
+  "Sapling (2-256 data blocks)",
+  "Tree (257-32768 data blocks)",
+  NULL,
+  "Extended",
+  NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+  "Subdirectory",
+  "Reserved for Subdirectory Header entry",
+  "Reserved for Volume Directory Header entry"
+};
+static char *storage_type_ascii_short[16] =
+{
+  "Del ", "Seed", "Sapl", "Tree", NULL, "Fork", NULL, NULL, NULL, NULL, NULL, NULL, NULL, "Dir ", "    ", "    "
+};
+
+/** Abréviations des File Type (NULL : $XX) **/
+static char *file_type_ascii[256] =
+{
+  [0x00] = "UNK", [0x01] = "BAD", [0x04] = "TXT", [0x06] = "BIN", [0x0F] = "DIR",
+  [0x19] = "ADB", [0x1A] = "AWP", [0x1B] = "ASP", [0x42] = "FTD", [0x50] = "GWP",
+  [0x52] = "GDB", [0x5A] = "CFG", [0x5E] = "DVU", [0xB0] = "SRC", [0xB3] = "S16",
+  [0xB5] = "EXE", [0xB6] = "PIF", [0xB7] = "TIF", [0xB8] = "NDA", [0xB9] = "CDA",
+  [0xBA] = "TOL", [0xBB] = "DVR", [0xBC] = "LDF", [0xBD] = "FST", [0xBF] = "DOC",
+  [0xC0] = "PNT", [0xC1] = "PIC", [0xC2] = "ANI", [0xC7] = "CDV", [0xC8] = "FON",
+  [0xC9] = "FND", [0xCA] = "ICN", [0xD5] = "MUS", [0xD6] = "INS", [0xD8] = "SND",
+  [0xE0] = "LBR", [0xEF] = "PAS", [0xF0] = "CMD", [0xF9] = "OS ", [0xFC] = "BAS",
+  [0xFD] = "VAR", [0xFE] = "REL", [0xFF] = "SYS"
+};
 
 /*************************************************************/
 /*  DumpProdosImage() :  Dump le contenu d'une image Prodos. */
 /*************************************************************/
-void DumpProdosImage(struct prodos_image *current_image, int dump_structure)
+void DumpProdosImage(struct prodos_image *current_image, int dump_structure, int format)
 {
-  int i, max_depth, nb_directory;
+  int i, max_depth, nb_directory, nb_file, nb_entry;
   struct file_descriptive_entry *current_directory;
 
+  /** Rapport JSON (un document par ligne) ou CSV (une ligne par entrée) **/
+  if(format == FORMAT_JSON || format == FORMAT_CSV)
+    {
+      my_Memory(MEMORY_GET_DIRECTORY_NB,&nb_directory,NULL);
+      my_Memory(MEMORY_GET_ENTRY_NB,&nb_file,NULL);
+      if(format == FORMAT_JSON)
+        {
+          logf("{\"image\":");
+          log_json_string(current_image->image_file_path);
+          logf(",\"volume\":");
+          log_json_string(current_image->volume_header->volume_name_case);
+          logf(",\"blocks\":%d,\"free_blocks\":%d,\"files\":%d,\"folders\":%d,\"entries\":[",current_image->nb_block,current_image->nb_free_block,nb_file,nb_directory);
+        }
+
+      /* Entrées dans l'ordre du catalogue */
+      nb_entry = 0;
+      DumpStructuredFolder(current_image,current_image->nb_file,current_image->tab_file,current_image->nb_directory,current_image->tab_directory,format,&nb_entry);
+
+      if(format == FORMAT_JSON)
+        logf("]}\n");
+      return;
+    }
+
   /** Calcule la profondeur max **/
   max_depth = 1;
   my_Memory(MEMORY_GET_DIRECTORY_NB,&nb_directory,NULL);
@@ -46,9 +108,7 @@ void DumpProdosImage(struct prodos_image *current_image, int dump_structure)
     }
 
   /* Ligne de Label */
-  logf("  Name");
-  for(i=strlen("  Name"); i<max_depth*2+20; i++)
-    logf(" ");
+  logf("  Name%*s",(int) (max_depth*2+20-strlen("  Name")),"");
   logf("Type   Aux      Size     Data     Res  Data   Res  Sparse Index  Struct  Access    Creation Date     Modification Date\n");
 
   /* Volume Name */
@@ -113,6 +173,9 @@ static void DumpOneFile(struct file_descriptive_entry *current_file, int max_dep
 {
   int i;
   char buffer[8192];
+  char ascii[50];
+  struct prodos_date entry_date;
+  struct prodos_time entry_time;
 
   /* Init */
   buffer[0] = '\0';
@@ -130,7 +193,7 @@ static void DumpOneFile(struct file_descriptive_entry *current_file, int max_dep
 
   /** Information fichier **/
   /* Type */
-  sprintf(&buffer[strlen(buffer)],"%s%s  ",current_file->file_type_ascii,!my_stricmp(current_file->storage_type_ascii_short,"Fork")?"+":" ");
+  sprintf(&buffer[strlen(buffer)],"%s%s  ",GetFileTypeAscii(current_file->file_type,ascii),((current_file->storage_type & 0x0F) == 0x05)?"+":" ");
   /* Aux Type */
   sprintf(&buffer[strlen(buffer)],"$%04X  ",current_file->file_aux_type);
   /* Taille Data+Resource */
@@ -148,13 +211,17 @@ static void DumpOneFile(struct file_descriptive_entry *current_file, int max_dep
   /* Index Block */
   sprintf(&buffer[strlen(buffer)],"%4d     ",current_file->index_block);
   /* Encodage */
-  sprintf(&buffer[strlen(buffer)],"%s   ",current_file->storage_type_ascii_short);
+  sprintf(&buffer[strlen(buffer)],"%s   ",GetStorageTypeAscii(current_file->storage_type,1,ascii));
   /* Access */
-  sprintf(&buffer[strlen(buffer)],"%4s   ",current_file->access_ascii);
+  sprintf(&buffer[strlen(buffer)],"%4s   ",GetAccessAscii(current_file->access,ascii));
   /* Creation Date */
-  sprintf(&buffer[strlen(buffer)],"%s %s   ",current_file->file_creation_date.ascii,current_file->file_creation_time.ascii);
+  GetProdosDate(current_file->file_creation_date,&entry_date);
+  GetProdosTime(current_file->file_creation_time,&entry_time);
+  sprintf(&buffer[strlen(buffer)],"%s %s   ",entry_date.ascii,entry_time.ascii);
   /* Modification Date */
-  sprintf(&buffer[strlen(buffer)],"%s %s  ",current_file->file_modification_date.ascii,current_file->file_modification_time.ascii);
+  GetProdosDate(current_file->file_modification_date,&entry_date);
+  GetProdosTime(current_file->file_modification_time,&entry_time);
+  sprintf(&buffer[strlen(buffer)],"%s %s  ",entry_date.ascii,entry_time.ascii);
 
   logf("%s\n",buffer);
 }
@@ -213,6 +280,10 @@ static void DumpOneEntry(struct prodos_image *current_image, struct file_descrip
 {
   int i;
   char prefix[1024];
+  char entry_path[ENTRY_PATH_LENGTH];
+  char ascii[50];
+  struct prodos_date entry_date;
+  struct prodos_time entry_time;
 
   /** On utilise la profondeur du fichier comme décalage **/
   for(i=0; i<2*current_file->depth; i++)
@@ -220,7 +291,7 @@ static void DumpOneEntry(struct prodos_image *current_image, struct file_descrip
   prefix[2*current_file->depth] = '\0';
 
   /* Path */
-  logf("%sFile Path                  : %s\n",prefix,current_file->file_path);
+  logf("%sFile Path                  : %s\n",prefix,GetEntryPath(current_image,current_file,entry_path));
   logf("%sName Length                : %d\n",prefix,current_file->name_length);
   logf("%sFile Name                  : %s\n",prefix,current_file->file_name);
   logf("%sFile Name Case             : %s\n",prefix,current_file->file_name_case);
@@ -229,28 +300,32 @@ static void DumpOneEntry(struct prodos_image *current_image, struct file_descrip
 
   /* Storage Type */
   logf("%sStorage Type               : %02X\n",prefix,current_file->storage_type);
-  logf("%sStorage Type Ascii         : %s\n",prefix,current_file->storage_type_ascii);
-  logf("%sStorage Type Ascii Short   : %s\n",prefix,current_file->storage_type_ascii_short);
+  logf("%sStorage Type Ascii         : %s\n",prefix,GetStorageTypeAscii(current_file->storage_type,0,ascii));
+  logf("%sStorage Type Ascii Short   : %s\n",prefix,GetStorageTypeAscii(current_file->storage_type,1,ascii));
   logf("-----\n");
 
   /* File Type */
   logf("%sFile Type                  : %02X\n",prefix,current_file->file_type);
   logf("%sFile Aux Type              : %04X\n",prefix,current_file->file_aux_type);
-  logf("%sFile Type Ascii            : %s\n",prefix,current_file->file_type_ascii);
+  logf("%sFile Type Ascii            : %s\n",prefix,GetFileTypeAscii(current_file->file_type,ascii));
   logf("-----\n");
 
   /* Création / Modification Date + Version */
-  logf("%sFile Creation Date         : %s\n",prefix,current_file->file_creation_date.ascii);
-  logf("%sFile Creation Time         : %s\n",prefix,current_file->file_creation_time.ascii);
-  logf("%sFile Modification Date     : %s\n",prefix,current_file->file_modification_date.ascii);
-  logf("%sFile Modification Time     : %s\n",prefix,current_file->file_modification_time.ascii);
+  GetProdosDate(current_file->file_creation_date,&entry_date);
+  GetProdosTime(current_file->file_creation_time,&entry_time);
+  logf("%sFile Creation Date         : %s\n",prefix,entry_date.ascii);
+  logf("%sFile Creation Time         : %s\n",prefix,entry_time.ascii);
+  GetProdosDate(current_file->file_modification_date,&entry_date);
+  GetProdosTime(current_file->file_modification_time,&entry_time);
+  logf("%sFile Modification Date     : %s\n",prefix,entry_date.ascii);
+  logf("%sFile Modification Time     : %s\n",prefix,entry_time.ascii);
   logf("%sVersion Created            : %d\n",prefix,current_file->version_created);
   logf("%sMin Version                : %d\n",prefix,current_file->min_version);
   logf("-----\n");
 
   /* Access */
   logf("%sAccess                     : %02X\n",prefix,current_file->access);
-  logf("%sAccess Ascii               : %s\n",prefix,current_file->access_ascii);
+  logf("%sAccess Ascii               : %s\n",prefix,GetAccessAscii(current_file->access,ascii));
   logf("-----\n");
 
   /* Size */
@@ -274,10 +349,164 @@ static void DumpOneEntry(struct prodos_image *current_image, struct file_descrip
   if(current_file->parent_directory == NULL)
     logf("%sParent Directory           : /%s\n",prefix,current_image->volume_header->volume_name_case);
   else
-    logf("%sParent Directory           : %s\n",prefix,current_file->parent_directory->file_path);
+    logf("%sParent Directory           : %s\n",prefix,GetEntryPath(current_image,current_file->parent_directory,entry_path));
 
   /* Fin */
   logf("----------------------------------------------------------------------\n");
 }
 
+
+/**************************************************************/
+/*  DumpCatalogCsvHeader() :  Ligne d'en-tête du rapport CSV. */
+/**************************************************************/
+void DumpCatalogCsvHeader(void)
+{
+  logf("image,path,kind,file_type,file_type_ascii,aux_type,size,data_size,resource_size,"
+       "data_blocks,resource_blocks,sparse_blocks,index_blocks,storage_type,storage,access,access_ascii,created,modified\n");
+}
+
+
+/**************************************************************************/
+/*  DumpStructuredFolder() :  Entrées JSON / CSV d'un dossier (fichiers,  */
+/*                            puis sous-dossiers et leur contenu).        */
+/**************************************************************************/
+static void DumpStructuredFolder(struct prodos_image *current_image, int nb_file, struct file_descriptive_entry **tab_file,
+                                 int nb_directory, struct file_descriptive_entry **tab_directory, int format, int *nb_entry)
+{
+  int i;
+
+  /** All File **/
+  for(i=0; i<nb_file; i++)
+    DumpStructuredEntry(current_image,tab_file[i],0,format,(*nb_entry)++);
+
+  /** All Directory (recursivity) **/
+  for(i=0; i<nb_directory; i++)
+    {
+      DumpStructuredEntry(current_image,tab_directory[i],1,format,(*nb_entry)++);
+      DumpStructuredFolder(current_image,tab_directory[i]->nb_file,tab_directory[i]->tab_file,
+                           tab_directory[i]->nb_directory,tab_directory[i]->tab_directory,format,nb_entry);
+    }
+}
+
+
+/***************************************************************/
+/*  DumpStructuredEntry() :  Une entrée au format JSON ou CSV. */
+/***************************************************************/
+static void DumpStructuredEntry(struct prodos_image *current_image, struct file_descriptive_entry *current_file, int is_folder, int format, int index)
+{
+  char entry_path[ENTRY_PATH_LENGTH];
+  char ascii[50];
+  char *file_type, *storage;
+  char access[50];
+  char creation_date[50];
+  char modification_date[50];
+
+  /* Valeurs Ascii */
+  GetEntryPath(current_image,current_file,entry_path);
+  file_type = GetFileTypeAscii(current_file->file_type,ascii);
+  storage = GetStorageTypeAscii(current_file->storage_type,1,&ascii[10]);
+  GetAccessAscii(current_file->access,access);
+  GetDateIso(current_file->file_creation_date,current_file->file_creation_time,creation_date);
+  GetDateIso(current_file->file_modification_date,current_file->file_modification_time,modification_date);
+
+  if(format == FORMAT_JSON)
+    {
+      logf("%s{\"path\":",(index > 0) ? "," : "");
+      log_json_string(entry_path);
+      logf(",\"kind\":\"%s\",\"file_type\":%d,\"file_type_ascii\":\"%s\",\"aux_type\":%d,",is_folder ? "folder" : "file",
+           current_file->file_type,file_type,current_file->file_aux_type);
+      logf("\"size\":%d,\"data_size\":%d,\"resource_size\":%d,\"data_blocks\":%d,\"resource_blocks\":%d,\"sparse_blocks\":%d,\"index_blocks\":%d,",
+           current_file->data_size+current_file->resource_size,current_file->data_size,current_file->resource_size,
+           current_file->data_block,current_file->resource_block,current_file->nb_sparse,current_file->index_block);
+      logf("\"storage_type\":%d,\"storage\":\"%s\",\"access\":%d,\"access_ascii\":\"%s\",",
+           current_file->storage_type,storage,current_file->access,access);
+      logf((creation_date[0] == '\0') ? "\"created\":null," : "\"created\":\"%s\",",creation_date);
+      logf((modification_date[0] == '\0') ? "\"modified\":null}" : "\"modified\":\"%s\"}",modification_date);
+    }
+  else
+    {
+      log_csv_string(current_image->image_file_path);
+      log_write(",",1);
+      log_csv_string(entry_path);
+      logf(",%s,%d,%s,%d,",is_folder ? "folder" : "file",current_file->file_type,file_type,current_file->file_aux_type);
+      logf("%d,%d,%d,%d,%d,%d,%d,",current_file->data_size+current_file->resource_size,current_file->data_size,current_file->resource_size,
+           current_file->data_block,current_file->resource_block,current_file->nb_sparse,current_file->index_block);
+      logf("%d,%s,%d,%s,%s,%s\n",current_file->storage_type,storage,current_file->access,access,creation_date,modification_date);
+    }
+}
+
+
+/***********************************************************************/
+/*  GetDateIso() :  Date + heure Prodos en AAAA-MM-JJTHH:MM ("" si 0). */
+/***********************************************************************/
+static char *GetDateIso(WORD date_word, WORD time_word, char *date_rtn)
+{
+  struct prodos_date entry_date;
+  struct prodos_time entry_time;
+
+  /* Pas de date */
+  date_rtn[0] = '\0';
+  if(date_word == 0)
+    return(date_rtn);
+
+  GetProdosDate(date_word,&entry_date);
+  GetProdosTime(time_word,&entry_time);
+  sprintf(date_rtn,"%04d-%02d-%02dT%02d:%02d",entry_date.year+((entry_date.year<70)?2000:1900),entry_date.month,entry_date.day,entry_time.hour,entry_time.minute);
+
+  return(date_rtn);
+}
+
+
+/******************************************************************************/
+/*  GetStorageTypeAscii() :  Valeur Ascii (courte ou longue) du Storage Type. */
+/******************************************************************************/
+static char *GetStorageTypeAscii(BYTE storage_type, int is_short, char *ascii_rtn)
+{
+  char *ascii;
+
+  /* Table */
+  ascii = is_short ? storage_type_ascii_short[storage_type & 0x0F] : storage_type_ascii[storage_type & 0x0F];
+  if(ascii != NULL)
+    return(ascii);
+
+  /* Valeur inconnue */
+  if(is_short)
+    sprintf(ascii_rtn,"?%02X?",storage_type & 0x0F);
+  else
+    sprintf(ascii_rtn,"Unkown value (%02X)",storage_type & 0x0F);
+  return(ascii_rtn);
+}
+
+
+/*****************************************************/
+/*  GetFileTypeAscii() :  Valeur Ascii du File Type. */
+/*****************************************************/
+static char *GetFileTypeAscii(BYTE file_type, char *ascii_rtn)
+{
+  /* Table */
+  if(file_type_ascii[file_type] != NULL)
+    return(file_type_ascii[file_type]);
+
+  /* Type sans abréviation */
+  sprintf(ascii_rtn,"$%02X",file_type);
+  return(ascii_rtn);
+}
+
+
+/*********************************************************/
+/*  GetAccessAscii() :  Valeur Ascii de Access (RWBNDH). */
+/*********************************************************/
+static char *GetAccessAscii(BYTE access, char *ascii_rtn)
+{
+  ascii_rtn[0] = (access & 0x01) ? 'R' : ' ';    /* Read */
+  ascii_rtn[1] = (access & 0x02) ? 'W' : ' ';    /* Write */
+  ascii_rtn[2] = (access & 0x20) ? 'B' : ' ';    /* Changed since Last Backup */
+  ascii_rtn[3] = (access & 0x40) ? 'N' : ' ';    /* Rename */
+  ascii_rtn[4] = (access & 0x80) ? 'D' : ' ';    /* Destroy */
+  ascii_rtn[5] = (access & 0x04) ? 'H' : ' ';    /* Hidden (GS/OS) */
+  ascii_rtn[6] = '\0';
+
+  return(ascii_rtn);
+}
+
 /*************************************************************************/
@@ -6,6 +6,7 @@
 /*  Auteur : Olivier ZARDINI  *  Brutal Deluxe Software  *  Dec 2011   */
 /***********************************************************************/
 
-void DumpProdosImage(struct prodos_image *,int);
+void DumpProdosImage(struct prodos_image *,int,int);
+void DumpCatalogCsvHeader(void);
 
 /***********************************************************************/
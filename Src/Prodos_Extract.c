@@ -19,10 +19,24 @@
 #include "os/os.h"
 #include "Prodos_Extract.h"
 #include "File_AppleSingle.h"
+#include "Dc_Stats.h"
 #include "log.h"
 
-static int CreateOutputFile(struct prodos_file *,char *, bool);
-static void SetFileInformation(char *,struct prodos_file *);
+static void ExtractFolderTree(struct prodos_image *,struct file_descriptive_entry *,char *,bool,struct extract_pool *);
+static void ExtractFolderEntry(struct prodos_image *,struct file_descriptive_entry *,char *,bool,struct extract_pool *,struct file_information *);
+static int ExtractEntryFile(struct prodos_image *,struct file_descriptive_entry *,char *,bool,char **);
+static int AddExtractFolder(struct extract_pool *,char *);
+static int AddExtractTask(struct extract_pool *,struct file_descriptive_entry *,char *);
+static void RunExtractPool(struct extract_pool *);
+static void ExtractTaskThread(void *);
+static void mem_free_extract_pool(struct extract_pool *);
+static int CreateOutputFile(struct prodos_image *,struct prodos_file *,char *,bool,char **);
+static void BuildFileInformation(struct prodos_file *,char *);
+static int AddFileInformation(struct file_information *,char *);
+static void WriteFileInformation(char *,struct file_information *);
+static void GetInformationName(char *,char *);
+static void mem_free_file_information(struct file_information *);
+static int compare_information_line(const void *,const void *);
 
 /**
  * Extracts one file
@@ -37,155 +51,174 @@ static void SetFileInformation(char *,struct prodos_file *);
 void ExtractOneFile(struct prodos_image *current_image, char *prodos_file_path, char *output_directory_path, bool output_apple_single)
 {
   int error;
+  char *information_line = NULL;
   struct file_descriptive_entry *current_entry;
-  struct prodos_file *current_file;
+  struct file_information file_information = {0};
 
   /** Recherche l'entrée du fichier **/
   current_entry = GetProdosFile(current_image,prodos_file_path);
   if(current_entry == NULL)
     return;
 
-  /** Allocation mémoire **/
-  current_file = (struct prodos_file *) calloc(1,sizeof(struct prodos_file));
-  if(current_file == NULL)
+  /** Extraction du fichier **/
+  error = ExtractEntryFile(current_image,current_entry,output_directory_path,output_apple_single,&information_line);
+
+  /** Sa ligne remplace la sienne dans le _FileInformation.txt du dossier **/
+  if(error == 0 && information_line != NULL)
     {
-      logf_error("  Error : Can't get file from Image : Memory Allocation impossible.\n");
-      return;
+      if(AddFileInformation(&file_information,information_line) == 0)
+        WriteFileInformation(output_directory_path,&file_information);
+      else
+        free(information_line);
     }
-  current_file->entry = current_entry;
+  mem_free_file_information(&file_information);
+}
 
-  /** Récupère les data de ce fichier **/
-  error = GetDataFile(current_image,current_entry,current_file);
-  if(error)
+
+/******************************************************************/
+/*  ExtractFolderFiles() :  Extraction des fichiers d'un dossier. */
+/******************************************************************/
+void ExtractFolderFiles(struct prodos_image *current_image, struct file_descriptive_entry *folder_entry, char *output_directory_path, bool output_apple_single, int nb_jobs)
+{
+  struct extract_pool *pool = NULL;
+
+  /* Extraction en parallèle */
+  if(nb_jobs > 1)
     {
-      logf_error("  Error : Can't get file from Image : Memory Allocation impossible.\n");
-      mem_free_file(current_file);
-      return;
+      pool = (struct extract_pool *) calloc(1,sizeof(struct extract_pool));
+      if(pool == NULL)
+        {
+          logf_error("  Error : Can't extract folder files from Image : Memory Allocation impossible.\n");
+          current_image->nb_extract_error++;
+          return;
+        }
+      pool->current_image = current_image;
+      pool->output_apple_single = output_apple_single;
+      pool->nb_jobs = nb_jobs;
     }
 
-  /** Création du fichier sur disque **/
-  error = CreateOutputFile(current_file,output_directory_path,output_apple_single);
+  /** Parcours de l'arborescence **/
+  ExtractFolderTree(current_image,folder_entry,output_directory_path,output_apple_single,pool);
 
-  /* Libération mémoire */
-  mem_free_file(current_file);
+  /** Décodage + écriture des fichiers par les threads **/
+  if(pool != NULL)
+    {
+      RunExtractPool(pool);
+      mem_free_extract_pool(pool);
+    }
 }
 
 
-/************************************************************************/
-/*  ExtractFolderFiles() :  Fonction récursive d'extraction de fichier. */
-/************************************************************************/
-void ExtractFolderFiles(struct prodos_image *current_image, struct file_descriptive_entry *folder_entry, char *output_directory_path, bool output_apple_single)
+/****************************************************************************/
+/*  ExtractVolumeFiles() :  Fonction d'extraction des fichiers d'un volume. */
+/****************************************************************************/
+void ExtractVolumeFiles(struct prodos_image *current_image, char *output_directory_path, bool output_apple_single, int nb_jobs)
 {
   int i, error;
   char *windows_folder_path;
+  char entry_path[ENTRY_PATH_LENGTH];
   struct file_descriptive_entry *current_entry;
-  struct prodos_file *current_file;
+  struct extract_pool *pool = NULL;
+  struct file_information file_information = {0};
+
+  /* Extraction en parallèle */
+  if(nb_jobs > 1)
+    {
+      pool = (struct extract_pool *) calloc(1,sizeof(struct extract_pool));
+      if(pool == NULL)
+        {
+          logf_error("  Error : Can't extract files from Image : Memory Allocation impossible.\n");
+          current_image->nb_extract_error++;
+          return;
+        }
+      pool->current_image = current_image;
+      pool->output_apple_single = output_apple_single;
+      pool->nb_jobs = nb_jobs;
+    }
 
   /** Création du dossier sur disque **/
   /* Chemin du dossier */
-  windows_folder_path = (char *) calloc(strlen(output_directory_path) + strlen(folder_entry->file_name_case) + 256,sizeof(char));
+  windows_folder_path = (char *) calloc(strlen(output_directory_path) + strlen(current_image->volume_header->volume_name_case) + 256,sizeof(char));
   if(windows_folder_path == NULL)
     {
-      logf_error("  Error : Can't extract folder files from Image : Memory Allocation impossible.\n");
+      logf_error("  Error : Can't extract files from Image : Memory Allocation impossible.\n");
       current_image->nb_extract_error++;
+      mem_free_extract_pool(pool);
       return;
     }
   strcpy(windows_folder_path,output_directory_path);
   if(strlen(windows_folder_path) > 0)
     if(windows_folder_path[strlen(windows_folder_path)-1] != '\\' && windows_folder_path[strlen(windows_folder_path)-1] != '/')
       strcat(windows_folder_path,FOLDER_CHARACTER);
-  strcat(windows_folder_path,folder_entry->file_name_case);
+  strcat(windows_folder_path,current_image->volume_header->volume_name_case);
   strcat(windows_folder_path,FOLDER_CHARACTER);
 
   /* Création du dossier */
   error = os_CreateDirectory(windows_folder_path);
+  if(error == 0 && pool != NULL)
+    error = AddExtractFolder(pool,windows_folder_path);
   if(error)
     {
       logf_error("  Error : Can't create folder : '%s'.\n",windows_folder_path);
-      current_image->nb_extract_error++;
       free(windows_folder_path);
+      current_image->nb_extract_error++;
+      mem_free_extract_pool(pool);
       return;
     }
-  current_image->nb_extract_folder++;
-
-  /*****************************************************/
-  /**  Traitement de tous les fichiers du répertoire  **/
-  for(i=0; i<folder_entry->nb_file; i++)
-    {
-      /* Entrée du fichier */
-      current_entry = folder_entry->tab_file[i];
-
-      /* Information */
-      logf_info("      o Extract File   : %s\n",current_entry->file_path);
-
-      /** Allocation mémoire **/
-      current_file = (struct prodos_file *) calloc(1,sizeof(struct prodos_file));
-      if(current_file == NULL)
-        {
-          logf_error("  Error : Can't get file from Image : Memory Allocation impossible.\n");
-          current_image->nb_extract_error++;
-          continue;
-        }
-      current_file->entry = current_entry;
-
-      /** Récupère les data de ce fichier **/
-      error = GetDataFile(current_image,current_entry,current_file);
-      if(error)
-        {
-          logf_error("  Error : Can't get file from Image : Memory Allocation impossible.\n");
-          current_image->nb_extract_error++;
-          mem_free_file(current_file);
-          continue;
-        }
-
-      /** Création du fichier sur disque **/
-      error = CreateOutputFile(current_file,windows_folder_path,output_apple_single);
 
-      /* Libération mémoire */
-      mem_free_file(current_file);
+  /****************************************************/
+  /**  Traitement de tous les fichiers de la racine  **/
+  for(i=0; i<current_image->nb_file; i++)
+    ExtractFolderEntry(current_image,current_image->tab_file[i],windows_folder_path,output_apple_single,pool,&file_information);
 
-      /* Stat */
-      if(error)
-        current_image->nb_extract_error++;
-      else
-        current_image->nb_extract_file++;
-    }
+  /* Un seul _FileInformation.txt pour le dossier (avec un pool : après les threads) */
+  WriteFileInformation(windows_folder_path,&file_information);
+  mem_free_file_information(&file_information);
 
-  /*****************************************************/
-  /**  Traitement de tous les dossiers du répertoire  **/
-  for(i=0; i<folder_entry->nb_directory; i++)
+  /****************************************************/
+  /**  Traitement de tous les dossiers de la racine  **/
+  for(i=0; i<current_image->nb_directory; i++)
     {
       /* Entrée du fichier */
-      current_entry = folder_entry->tab_directory[i];
+      current_entry = current_image->tab_directory[i];
 
       /* Information */
-      logf_info("      + Extract Folder : %s\n",current_entry->file_path);
+      logf_info("      + Extract Folder : %s\n",GetEntryPath(current_image,current_entry,entry_path));
 
       /** Récursivité **/
-      ExtractFolderFiles(current_image,current_entry,windows_folder_path,output_apple_single);
+      ExtractFolderTree(current_image,current_entry,windows_folder_path,output_apple_single,pool);
     }
 
-  /** Libération mémoire **/
-  free(windows_folder_path);
+  /** Décodage + écriture des fichiers par les threads **/
+  if(pool != NULL)
+    {
+      RunExtractPool(pool);
+      mem_free_extract_pool(pool);
+    }
+  else
+    free(windows_folder_path);
 }
 
 
 /****************************************************************************/
-/*  ExtractVolumeFiles() :  Fonction d'extraction des fichiers d'un volume. */
+/*  ExtractFolderTree() :  Fonction récursive de parcours d'un dossier.     */
+/*                         Sans pool, les fichiers sont extraits au fur et  */
+/*                         à mesure ; avec, ils sont confiés aux threads.   */
 /****************************************************************************/
-void ExtractVolumeFiles(struct prodos_image *current_image, char *output_directory_path, bool output_apple_single)
+static void ExtractFolderTree(struct prodos_image *current_image, struct file_descriptive_entry *folder_entry, char *output_directory_path, bool output_apple_single, struct extract_pool *pool)
 {
   int i, error;
   char *windows_folder_path;
+  char entry_path[ENTRY_PATH_LENGTH];
   struct file_descriptive_entry *current_entry;
-  struct prodos_file *current_file;
+  struct file_information file_information = {0};
 
   /** Création du dossier sur disque **/
   /* Chemin du dossier */
-  windows_folder_path = (char *) calloc(strlen(output_directory_path) + strlen(current_image->volume_header->volume_name_case) + 256,sizeof(char));
+  windows_folder_path = (char *) calloc(strlen(output_directory_path) + strlen(folder_entry->file_name_case) + 256,sizeof(char));
   if(windows_folder_path == NULL)
     {
-      logf_error("  Error : Can't extract files from Image : Memory Allocation impossible.\n");
+      logf_error("  Error : Can't extract folder files from Image : Memory Allocation impossible.\n");
       current_image->nb_extract_error++;
       return;
     }
@@ -193,95 +226,281 @@ void ExtractVolumeFiles(struct prodos_image *current_image, char *output_directo
   if(strlen(windows_folder_path) > 0)
     if(windows_folder_path[strlen(windows_folder_path)-1] != '\\' && windows_folder_path[strlen(windows_folder_path)-1] != '/')
       strcat(windows_folder_path,FOLDER_CHARACTER);
-  strcat(windows_folder_path,current_image->volume_header->volume_name_case);
+  strcat(windows_folder_path,folder_entry->file_name_case);
   strcat(windows_folder_path,FOLDER_CHARACTER);
 
-  /* Création du dossier */
+  /* Création du dossier (le pool conserve le chemin jusqu'à la fin des threads) */
   error = os_CreateDirectory(windows_folder_path);
+  if(error == 0 && pool != NULL)
+    error = AddExtractFolder(pool,windows_folder_path);
   if(error)
     {
       logf_error("  Error : Can't create folder : '%s'.\n",windows_folder_path);
-      free(windows_folder_path);
       current_image->nb_extract_error++;
+      free(windows_folder_path);
       return;
     }
+  current_image->nb_extract_folder++;
 
-  /****************************************************/
-  /**  Traitement de tous les fichiers de la racine  **/
-  for(i=0; i<current_image->nb_file; i++)
+  /* Décode les entrées du répertoire (image chargée en mode lazy) */
+  LoadFolderEntries(current_image,folder_entry);
+
+  /*****************************************************/
+  /**  Traitement de tous les fichiers du répertoire  **/
+  for(i=0; i<folder_entry->nb_file; i++)
+    ExtractFolderEntry(current_image,folder_entry->tab_file[i],windows_folder_path,output_apple_single,pool,&file_information);
+
+  /* Un seul _FileInformation.txt pour le dossier (avec un pool : après les threads) */
+  WriteFileInformation(windows_folder_path,&file_information);
+  mem_free_file_information(&file_information);
+
+  /*****************************************************/
+  /**  Traitement de tous les dossiers du répertoire  **/
+  for(i=0; i<folder_entry->nb_directory; i++)
     {
       /* Entrée du fichier */
-      current_entry = current_image->tab_file[i];
+      current_entry = folder_entry->tab_directory[i];
 
       /* Information */
-      logf_info("      o Extract File   : %s\n",current_entry->file_path);
+      logf_info("      + Extract Folder : %s\n",GetEntryPath(current_image,current_entry,entry_path));
+
+      /** Récursivité **/
+      ExtractFolderTree(current_image,current_entry,windows_folder_path,output_apple_single,pool);
+    }
+
+  /** Libération mémoire **/
+  if(pool == NULL)
+    free(windows_folder_path);
+}
+
+
+/********************************************************************/
+/*  ExtractFolderEntry() :  Extrait un fichier ou l'ajoute au pool. */
+/********************************************************************/
+static void ExtractFolderEntry(struct prodos_image *current_image, struct file_descriptive_entry *current_entry, char *windows_folder_path, bool output_apple_single, struct extract_pool *pool, struct file_information *file_information)
+{
+  int error;
+  char *information_line = NULL;
+  char entry_path[ENTRY_PATH_LENGTH];
+
+  /* Information */
+  logf_info("      o Extract File   : %s\n",GetEntryPath(current_image,current_entry,entry_path));
 
-      /** Allocation mémoire **/
-      current_file = (struct prodos_file *) calloc(1,sizeof(struct prodos_file));
-      if(current_file == NULL)
+  /** Extraction différée **/
+  if(pool != NULL)
+    {
+      error = AddExtractTask(pool,current_entry,windows_folder_path);
+      if(error)
         {
           logf_error("  Error : Can't get file from Image : Memory Allocation impossible.\n");
           current_image->nb_extract_error++;
-          continue;
         }
-      current_file->entry = current_entry;
+      return;
+    }
 
-      /** Récupère les data de ce fichier **/
-      error = GetDataFile(current_image,current_entry,current_file);
+  /** Extraction immédiate (la ligne du _FileInformation.txt est gardée pour la fin du dossier) **/
+  error = ExtractEntryFile(current_image,current_entry,windows_folder_path,output_apple_single,&information_line);
+  if(error == 0 && information_line != NULL)
+    {
+      error = AddFileInformation(file_information,information_line);
       if(error)
+        free(information_line);
+    }
+
+  /* Stat */
+  if(error)
+    current_image->nb_extract_error++;
+  else
+    current_image->nb_extract_file++;
+}
+
+
+/************************************************************************/
+/*  ExtractEntryFile() :  Décode un fichier de l'image et l'écrit sur   */
+/*                        disque. Ne modifie pas l'image : peut tourner */
+/*                        dans plusieurs threads à la fois.             */
+/************************************************************************/
+static int ExtractEntryFile(struct prodos_image *current_image, struct file_descriptive_entry *current_entry, char *output_directory_path, bool output_apple_single, char **information_line_rtn)
+{
+  int error;
+  struct prodos_file *current_file;
+
+  /** Allocation mémoire **/
+  current_file = (struct prodos_file *) calloc(1,sizeof(struct prodos_file));
+  if(current_file == NULL)
+    {
+      logf_error("  Error : Can't get file from Image : Memory Allocation impossible.\n");
+      return(1);
+    }
+  current_file->entry = current_entry;
+
+  /** Récupère les suites de blocs de ce fichier (les data restent dans l'image) **/
+  error = GetExtentFile(current_image,current_entry,current_file);
+  if(error)
+    {
+      logf_error("  Error : Can't get file from Image : Memory Allocation impossible.\n");
+      mem_free_file(current_file);
+      return(1);
+    }
+
+  /** Création du fichier sur disque **/
+  error = CreateOutputFile(current_image,current_file,output_directory_path,output_apple_single,information_line_rtn);
+
+  /* Libération mémoire */
+  mem_free_file(current_file);
+
+  return(error);
+}
+
+
+/******************************************************************/
+/*  AddExtractFolder() :  Le pool devient propriétaire du chemin. */
+/******************************************************************/
+static int AddExtractFolder(struct extract_pool *pool, char *windows_folder_path)
+{
+  char **tab_folder;
+
+  if(pool->nb_folder == pool->nb_folder_max)
+    {
+      tab_folder = (char **) realloc(pool->tab_folder,(pool->nb_folder_max+EXTRACT_POOL_STEP)*sizeof(char *));
+      if(tab_folder == NULL)
+        return(1);
+      pool->tab_folder = tab_folder;
+      pool->nb_folder_max += EXTRACT_POOL_STEP;
+    }
+  pool->tab_folder[pool->nb_folder++] = windows_folder_path;
+
+  return(0);
+}
+
+
+/**************************************************************/
+/*  AddExtractTask() :  Ajoute un fichier à extraire au pool. */
+/**************************************************************/
+static int AddExtractTask(struct extract_pool *pool, struct file_descriptive_entry *current_entry, char *windows_folder_path)
+{
+  struct extract_task *tab_task;
+
+  if(pool->nb_task == pool->nb_task_max)
+    {
+      tab_task = (struct extract_task *) realloc(pool->tab_task,(pool->nb_task_max+EXTRACT_POOL_STEP)*sizeof(struct extract_task));
+      if(tab_task == NULL)
+        return(1);
+      pool->tab_task = tab_task;
+      pool->nb_task_max += EXTRACT_POOL_STEP;
+    }
+  memset(&pool->tab_task[pool->nb_task],0,sizeof(struct extract_task));
+  pool->tab_task[pool->nb_task].entry = current_entry;
+  pool->tab_task[pool->nb_task].folder_path = windows_folder_path;
+  pool->nb_task++;
+
+  return(0);
+}
+
+
+/**************************************************************************/
+/*  RunExtractPool() :  Lance les threads puis met à jour les fichiers    */
+/*                      _FileInformation.txt dans l'ordre du catalogue.   */
+/**************************************************************************/
+static void RunExtractPool(struct extract_pool *pool)
+{
+  int i;
+  struct file_information file_information = {0};
+
+  /** Les threads se partagent les tâches **/
+  if(pool->nb_task > 0)
+    os_RunThreads((pool->nb_jobs < pool->nb_task) ? pool->nb_jobs : pool->nb_task,ExtractTaskThread,pool);
+
+  /** Un seul écrivain pour les _FileInformation.txt : les tâches d'un dossier se suivent, un fichier par dossier **/
+  for(i=0; i<pool->nb_task; i++)
+    {
+      if(pool->tab_task[i].information_line != NULL)
         {
-          logf_error("  Error : Can't get file from Image : Memory Allocation impossible.\n");
-          current_image->nb_extract_error++;
-          mem_free_file(current_file);
-          continue;
+          /* La ligne passe à file_information */
+          if(AddFileInformation(&file_information,pool->tab_task[i].information_line) == 0)
+            pool->tab_task[i].information_line = NULL;
+        }
+
+      /* Dernière tâche du dossier */
+      if(i == pool->nb_task-1 || pool->tab_task[i+1].folder_path != pool->tab_task[i].folder_path)
+        {
+          WriteFileInformation(pool->tab_task[i].folder_path,&file_information);
+          mem_free_file_information(&file_information);
         }
+    }
+}
 
-      /** Création du fichier sur disque **/
-      error = CreateOutputFile(current_file,windows_folder_path, output_apple_single);
 
-      /* Libération mémoire */
-      mem_free_file(current_file);
+/************************************************************************/
+/*  ExtractTaskThread() :  Boucle d'un thread : prend la tâche suivante */
+/*                         jusqu'à épuisement de la liste.              */
+/************************************************************************/
+static void ExtractTaskThread(void *data)
+{
+  int error, task_index;
+  struct extract_task *current_task;
+  struct extract_pool *pool = (struct extract_pool *) data;
+
+  while(1)
+    {
+      task_index = os_AtomicIncrement(&pool->next_task) - 1;
+      if(task_index >= pool->nb_task)
+        break;
+      current_task = &pool->tab_task[task_index];
+
+      /** Extraction du fichier **/
+      error = ExtractEntryFile(pool->current_image,current_task->entry,current_task->folder_path,pool->output_apple_single,&current_task->information_line);
 
       /* Stat */
       if(error)
-        current_image->nb_extract_error++;
+        os_AtomicIncrement(&pool->current_image->nb_extract_error);
       else
-        current_image->nb_extract_file++;
+        os_AtomicIncrement(&pool->current_image->nb_extract_file);
     }
+}
 
-  /****************************************************/
-  /**  Traitement de tous les dossiers de la racine  **/
-  for(i=0; i<current_image->nb_directory; i++)
-    {
-      /* Entrée du fichier */
-      current_entry = current_image->tab_directory[i];
 
-      /* Information */
-      logf_info("      + Extract Folder : %s\n",current_entry->file_path);
+/***********************************************************/
+/*  mem_free_extract_pool() :  Libération mémoire du pool. */
+/***********************************************************/
+static void mem_free_extract_pool(struct extract_pool *pool)
+{
+  int i;
 
-      /** Récursivité **/
-      ExtractFolderFiles(current_image,current_entry,windows_folder_path,output_apple_single);
-    }
+  if(pool == NULL)
+    return;
 
-  /** Libération mémoire **/
-  free(windows_folder_path);
+  for(i=0; i<pool->nb_task; i++)
+    if(pool->tab_task[i].information_line != NULL)
+      free(pool->tab_task[i].information_line);
+  for(i=0; i<pool->nb_folder; i++)
+    free(pool->tab_folder[i]);
+  if(pool->tab_task)
+    free(pool->tab_task);
+  if(pool->tab_folder)
+    free(pool->tab_folder);
+  free(pool);
 }
 
 /**
  * Writes a file to disk
  *
  * @brief CreateOutputFile
+ * @param current_image Source of the forks located by GetExtentFile
  * @param current_file
  * @param output_directory_path
+ * @param information_line_rtn If not NULL, the _FileInformation.txt line
+ *        is returned here (caller frees), to be written once per folder
+ *        by WriteFileInformation
  * @return
  */
-static int CreateOutputFile(struct prodos_file *current_file, char *output_directory_path, bool output_apple_single)
+static int CreateOutputFile(struct prodos_image *current_image, struct prodos_file *current_file, char *output_directory_path, bool output_apple_single, char **information_line_rtn)
 {
   int error;
+  char information_line[1024];
   char directory_path[1024];
   char file_data_path[1024];
   char file_resource_path[1024];
-  char file_information_path[1024];
 
   /* Création du répertoire de base */
   error = os_CreateDirectory(output_directory_path);
@@ -317,12 +536,11 @@ static int CreateOutputFile(struct prodos_file *current_file, char *output_direc
   /**********************************/
 
   if (output_apple_single)
-  {
-    struct as_from_prodos as_file = ASFromProdosFile(current_file);
-    error = CreateBinaryFile(file_data_path, as_file.data, as_file.length);
-  }
-  else
+    error = ASCreateProdosFile(file_data_path,current_image,current_file);
+  else if(current_file->data != NULL)
     error = CreateBinaryFile(file_data_path,current_file->data,current_file->data_length);
+  else
+    error = CreateExtentFile(file_data_path,current_image,current_file->nb_data_extent,current_file->tab_data_extent,current_file->data_length);
   
   if(error)
     {
@@ -344,17 +562,21 @@ static int CreateOutputFile(struct prodos_file *current_file, char *output_direc
 
   if (!output_apple_single)
   {
-    strcpy(file_information_path,directory_path);
-    strcat(file_information_path,"_FileInformation.txt");
-    SetFileInformation(file_information_path,current_file);
+    BuildFileInformation(current_file,information_line);
+    if (information_line_rtn != NULL)
+      *information_line_rtn = strdup(information_line);
   }
 
   /**************************************/
   /**  Création du Fichier : Resource  **/
   /**************************************/
-  if(current_file->resource_length > 0)
+  /* AppleSingle : le Resource Fork est dans le fichier */
+  if(current_file->resource_length > 0 && !output_apple_single)
     {
-      error = CreateBinaryFile(file_resource_path,current_file->resource,current_file->resource_length);
+      if(current_file->resource != NULL)
+        error = CreateBinaryFile(file_resource_path,current_file->resource,current_file->resource_length);
+      else
+        error = CreateExtentFile(file_resource_path,current_image,current_file->nb_resource_extent,current_file->tab_resource_extent,current_file->resource_length);
       if(error)
         {
           logf_error("  Error : Can't create resource file '%s' on disk at location '%s'.\n",current_file->entry->file_name_case,file_resource_path);
@@ -374,21 +596,17 @@ static int CreateOutputFile(struct prodos_file *current_file, char *output_direc
     }
 
   /* OK */
+  STATS_ADD(STATS_BYTE_EXTRACTED,current_file->data_length+current_file->resource_length);
   return(0);
 }
 
 
-/********************************************************************/
-/*  SetFileInformation() :  Place les informations dans un fichier. */
-/********************************************************************/
-static void SetFileInformation(char *file_information_path, struct prodos_file *current_file)
+/************************************************************************/
+/*  BuildFileInformation() :  Prépare la ligne du _FileInformation.txt. */
+/************************************************************************/
+static void BuildFileInformation(struct prodos_file *current_file, char *local_buffer)
 {
-  FILE *fd;
-  char *next_sep;
-  int i, nb_line;
-  char **line_tab;
-  char file_name[1024];
-  char local_buffer[1024];
+  int i;
   char folder_info1[256];
   char folder_info2[256];
 
@@ -403,61 +621,114 @@ static void SetFileInformation(char *file_information_path, struct prodos_file *
   sprintf(local_buffer,"%s=Type(%02X),AuxType(%04X),VersionCreate(%02X),MinVersion(%02X),Access(%02X),FolderInfo1(%s),FolderInfo2(%s)",current_file->entry->file_name_case,
           current_file->entry->file_type,current_file->entry->file_aux_type,current_file->entry->version_created,current_file->entry->min_version,
           current_file->entry->access,folder_info1,folder_info2);
+}
 
-  /** Charge en mémoire le fichier **/
-  line_tab = BuildUniqueListFromFile(file_information_path,&nb_line);
-  if(line_tab == NULL)
+
+/***************************************************************************/
+/*  AddFileInformation() :  Ajoute une ligne (qui lui appartient ensuite). */
+/***************************************************************************/
+static int AddFileInformation(struct file_information *file_information, char *information_line)
+{
+  char **tab_line;
+
+  if(file_information->nb_line == file_information->nb_line_max)
     {
-      /* Créer le fichier FileInformation */
-      CreateBinaryFile(file_information_path,(unsigned char *)local_buffer,(int)strlen(local_buffer));
+      tab_line = (char **) realloc(file_information->tab_line,(file_information->nb_line_max+EXTRACT_POOL_STEP)*sizeof(char *));
+      if(tab_line == NULL)
+        {
+          logf_error("  Error : Impossible to allocate memory for table 'tab_line'.\n");
+          return(1);
+        }
+      file_information->tab_line = tab_line;
+      file_information->nb_line_max += EXTRACT_POOL_STEP;
+    }
+  file_information->tab_line[file_information->nb_line++] = information_line;
 
-      #ifdef IS_WINDOWS
-      /* Rendre le fichier invisible */
-      os_SetFileAttribute(file_information_path, SET_FILE_HIDDEN);
+  return(0);
+}
+
+
+/*******************************************************************************/
+/*  WriteFileInformation() :  Ecrit le _FileInformation.txt d'un dossier en une */
+/*                            fois : les lignes des autres fichiers déjà dans   */
+/*                            le fichier sont gardées, puis les nouvelles.      */
+/*                            Ecriture sous un nom temporaire, puis renommage.  */
+/*******************************************************************************/
+static void WriteFileInformation(char *output_directory_path, struct file_information *file_information)
+{
+  FILE *fd;
+  int i, error, nb_line;
+  char **line_tab;
+  char **tab_sorted;
+  char file_information_path[1024];
+  char temp_path[1024+8];
+
+  /* Rien à écrire (AppleSingle, dossier sans fichier) */
+  if(file_information->nb_line == 0)
+    return;
+
+  /* Chemin du fichier */
+  strcpy(file_information_path,output_directory_path);
+  if(strlen(file_information_path) > 0 && strncmp(&file_information_path[strlen(file_information_path)-1],FOLDER_CHARACTER,1))
+    strcat(file_information_path,FOLDER_CHARACTER);
+  strcat(file_information_path,"_FileInformation.txt");
+  sprintf(temp_path,"%s.tmp",file_information_path);
+
+  /* Les nouvelles lignes triées par nom, pour écarter les anciennes */
+  tab_sorted = (char **) calloc(file_information->nb_line,sizeof(char *));
+  if(tab_sorted == NULL)
+    {
+      logf_error("  Error : Impossible to allocate memory for table 'tab_sorted'.\n");
       return;
-      #endif
     }
+  memcpy(tab_sorted,file_information->tab_line,file_information->nb_line*sizeof(char *));
+  qsort(tab_sorted,file_information->nb_line,sizeof(char *),compare_information_line);
 
-  #ifdef IS_WINDOWS
-  /* Rendre le fichier visible */
-  os_SetFileAttribute(file_information_path, SET_FILE_VISIBLE);
-  #endif
+  /** Charge en mémoire le fichier existant (s'il y en a un) **/
+  nb_line = 0;
+  line_tab = BuildUniqueListFromFile(file_information_path,&nb_line);
 
-  /** Création du fichier **/
-  fd = fopen(file_information_path,"w");
+  /** Création du fichier temporaire **/
+  fd = fopen(temp_path,"w");
   if(fd == NULL)
     {
+      logf_error("  Error : Can't create file '%s'.\n",temp_path);
       mem_free_list(nb_line,line_tab);
+      free(tab_sorted);
       return;
     }
 
-  /** Ajouts des lignes existantes **/
-  for(i=0; i<nb_line; i++)
-    {
-      if (line_tab == NULL) break;
+  /** Lignes existantes des autres fichiers **/
+  for(i=0; line_tab != NULL && i<nb_line; i++)
+    if(strchr(line_tab[i],'=') != NULL)
+      if(bsearch(&line_tab[i],tab_sorted,file_information->nb_line,sizeof(char *),compare_information_line) == NULL)
+        fprintf(fd,"%s\n",line_tab[i]);
 
-      /* Isole le nom du fichier */
-      next_sep = strchr(line_tab[i],'=');
-      if(next_sep == NULL)
-        continue;
-
-      /* Recherche le fichier actuel */
-      memcpy(file_name,line_tab[i],next_sep-line_tab[i]);
-      file_name[next_sep-line_tab[i]] = '\0';
-
-      /* On ne recopie pas la ligne du fichier */
-      if(my_stricmp(file_name,current_file->entry->file_name_case))
-         logf("%s\n",line_tab[i]);
-    }
-
-  /* Nouvelle ligne */
-   logf("%s\n",local_buffer);
+  /** Nouvelles lignes, dans l'ordre du catalogue **/
+  for(i=0; i<file_information->nb_line; i++)
+    fprintf(fd,"%s\n",file_information->tab_line[i]);
 
   /* Fermeture */
-  fclose(fd);
+  error = fclose(fd);
 
   /* Libération mémoire */
   mem_free_list(nb_line,line_tab);
+  free(tab_sorted);
+
+  #ifdef IS_WINDOWS
+  /* Rendre le fichier visible */
+  os_SetFileAttribute(file_information_path, SET_FILE_VISIBLE);
+  #endif
+
+  /** Remplace l'ancien fichier **/
+  if(error == 0)
+    error = os_RenameFile(temp_path,file_information_path);
+  if(error)
+    {
+      logf_error("  Error : Can't write file '%s'.\n",file_information_path);
+      os_DeleteFile(temp_path);
+      return;
+    }
 
   /* Rendre le fichier invisible */
   #ifdef IS_WINDOWS
@@ -465,4 +736,53 @@ static void SetFileInformation(char *file_information_path, struct prodos_file *
   #endif
 }
 
+
+/***********************************************************************/
+/*  GetInformationName() :  Nom du fichier d'une ligne (avant le '='). */
+/***********************************************************************/
+static void GetInformationName(char *information_line, char *file_name_rtn)
+{
+  int length;
+  char *next_sep;
+
+  next_sep = strchr(information_line,'=');
+  length = (next_sep == NULL) ? (int) strlen(information_line) : (int) (next_sep-information_line);
+  if(length > 1023)
+    length = 1023;
+  memcpy(file_name_rtn,information_line,length);
+  file_name_rtn[length] = '\0';
+}
+
+
+/******************************************************************/
+/*  mem_free_file_information() :  Libération mémoire des lignes. */
+/******************************************************************/
+static void mem_free_file_information(struct file_information *file_information)
+{
+  int i;
+
+  for(i=0; i<file_information->nb_line; i++)
+    free(file_information->tab_line[i]);
+  if(file_information->tab_line)
+    free(file_information->tab_line);
+  memset(file_information,0,sizeof(struct file_information));
+}
+
+
+/*****************************************************************************/
+/*  compare_information_line() : Fonction de comparaison pour le Quick Sort. */
+/*****************************************************************************/
+static int compare_information_line(const void *data_1, const void *data_2)
+{
+  char file_name_1[1024];
+  char file_name_2[1024];
+
+  /* Récupération des paramètres */
+  GetInformationName(*((char **) data_1),file_name_1);
+  GetInformationName(*((char **) data_2),file_name_2);
+
+  /* Comparaison des noms */
+  return(my_stricmp(file_name_1,file_name_2));
+}
+
 /***********************************************************************/
@@ -8,8 +8,42 @@
 
 #include <stdbool.h>
 
+#define EXTRACT_POOL_STEP  256      /* Croissance des tableaux du pool */
+
+struct extract_task
+{
+  struct file_descriptive_entry *entry;
+  char *folder_path;                 /* Appartient au pool (tab_folder) */
+  char *information_line;            /* Ligne du _FileInformation.txt, écrite après les threads */
+};
+
+struct extract_pool
+{
+  struct prodos_image *current_image;
+  bool output_apple_single;
+  int nb_jobs;
+
+  int nb_task;
+  int nb_task_max;
+  struct extract_task *tab_task;
+
+  int nb_folder;
+  int nb_folder_max;
+  char **tab_folder;
+
+  int next_task;                     /* Prochaine tâche à prendre (os_AtomicIncrement) */
+};
+
+/** Lignes du _FileInformation.txt d'un dossier de sortie, écrites en une fois **/
+struct file_information
+{
+  int nb_line;
+  int nb_line_max;
+  char **tab_line;                   /* "Nom=Type(..),AuxType(..),...", dans l'ordre du catalogue */
+};
+
 void ExtractOneFile(struct prodos_image *, char *, char *, bool);
-void ExtractFolderFiles(struct prodos_image *, struct file_descriptive_entry *, char *, bool);
-void ExtractVolumeFiles(struct prodos_image *, char *, bool);
+void ExtractFolderFiles(struct prodos_image *, struct file_descriptive_entry *, char *, bool, int);
+void ExtractVolumeFiles(struct prodos_image *, char *, bool, int);
 
 /***********************************************************************/
@@ -26,14 +26,12 @@
 static int MoveProdosFileToFolder(struct prodos_image *,struct file_descriptive_entry *,struct file_descriptive_entry *);
 static int MoveProdosFolderToFolder(struct prodos_image *,struct file_descriptive_entry *,struct file_descriptive_entry *);
 static void ChangeDirectoryEntriesDepth(struct file_descriptive_entry *,int);
-static void ChangeDirectoryEntriesPath(struct file_descriptive_entry *,char *,char *);
-static char *ChangeEntryPath(char *,char *,char *);
 
 
 /*********************************************************/
 /*  MoveProdosFile() :  Déplacement d'un fichier Prodos. */
 /*********************************************************/
-void MoveProdosFile(struct prodos_image *current_image, char *prodos_file_path, char *target_folder_path)
+int MoveProdosFile(struct prodos_image *current_image, char *prodos_file_path, char *target_folder_path)
 {
   int is_volume_header, error;
   struct file_descriptive_entry *current_entry;
@@ -44,7 +42,7 @@ void MoveProdosFile(struct prodos_image *current_image, char *prodos_file_path,
   if(current_entry == NULL)
     {
       logf_error("  Error : Invalid Prodos File path '%s'.\n",prodos_file_path);
-      return;
+      return(1);
     }
 
   /** Recherche le dossier Prodos Cible où déplacer le fichier **/
@@ -57,22 +55,23 @@ void MoveProdosFile(struct prodos_image *current_image, char *prodos_file_path,
   );
 
   if(target_folder == NULL && is_volume_header == 0)
-    return;
+    return(1);
 
   /** Déplace le fichier dans un Dossier existant ou à la Racine du volume **/
   error = MoveProdosFileToFolder(current_image,target_folder,current_entry);
   if(error)
-    return;
+    return(1);
 
   /** Ecrit le fichier Image **/
   error = UpdateProdosImage(current_image);
+  return(error);
 }
 
 
 /***********************************************************/
 /*  MoveProdosFolder() :  Déplacement d'un dossier Prodos. */
 /***********************************************************/
-void MoveProdosFolder(struct prodos_image *current_image, char *prodos_folder_path, char *target_folder_path)
+int MoveProdosFolder(struct prodos_image *current_image, char *prodos_folder_path, char *target_folder_path)
 {
   int is_volume_header, error;
   struct file_descriptive_entry *current_entry;
@@ -83,7 +82,7 @@ void MoveProdosFolder(struct prodos_image *current_image, char *prodos_folder_pa
   if(current_entry == NULL)
     {
       logf_error("  Error : Invalid Prodos Folder path '%s'.\n",prodos_folder_path);
-      return;
+      return(1);
     }
 
   /** Recherche le dossier Prodos Cible où déplacer le dossier **/
@@ -96,15 +95,16 @@ void MoveProdosFolder(struct prodos_image *current_image, char *prodos_folder_pa
   );
 
   if(target_folder == NULL && is_volume_header == 0)
-    return;
+    return(1);
 
   /** Déplace le dossier dans un Dossier existant ou à la Racine du volume **/
   error = MoveProdosFolderToFolder(current_image,target_folder,current_entry);
   if(error)
-    return;
+    return(1);
 
   /** Ecrit le fichier Image **/
   error = UpdateProdosImage(current_image);
+  return(error);
 }
 
 
@@ -113,45 +113,19 @@ void MoveProdosFolder(struct prodos_image *current_image, char *prodos_folder_pa
 /**************************************************************************************/
 int MoveProdosFileToFolder(struct prodos_image *current_image, struct file_descriptive_entry *target_folder, struct file_descriptive_entry *current_file)
 {
-  int i, error, target_offset, file_block_number, file_block_offset, entry_length, file_header_pointer, file_count;
+  int error, target_offset, file_block_number, file_block_offset, entry_length, file_header_pointer, file_count;
   WORD directory_block_number, directory_header_pointer;
   BYTE directory_entry_number;
-  char *new_path;
+  struct file_descriptive_entry *existing_entry;
   unsigned char directory_block[BLOCK_SIZE];
   unsigned char file_entry_block[BLOCK_SIZE];
 
   /** Vérifie que ce nom de fichier ne correspond pas déjà à un nom de fichier/dossier **/
-  if(target_folder == NULL)
-    {
-      /* Vérification à la racine du Volume */
-      for(i=0; i<current_image->nb_file; i++)
-        if(!my_stricmp(current_file->file_name_case,current_image->tab_file[i]->file_name))
-          {
-            logf_error("  Error : Invalid target location. A file already exist with the same name '%s'.\n",current_image->tab_file[i]->file_name);
-            return(1);
-          }
-      for(i=0; i<current_image->nb_directory; i++)
-        if(!my_stricmp(current_file->file_name_case,current_image->tab_directory[i]->file_name))
-          {
-            logf_error("  Error : Invalid target location. A folder already exist with the same name '%s'.\n",current_image->tab_directory[i]->file_name);
-            return(1);
-          }
-    }
-  else
+  existing_entry = FindFolderEntry(current_image,target_folder,current_file->file_name_case);
+  if(existing_entry != NULL)
     {
-      /* Vérification dans le dossier */
-      for(i=0; i<target_folder->nb_file; i++)
-        if(!my_stricmp(current_file->file_name_case,target_folder->tab_file[i]->file_name))
-          {
-            logf_error("  Error : Invalid target location. A file already exist with the same name '%s'.\n",target_folder->tab_file[i]->file_name);
-            return(1);
-          }
-      for(i=0; i<target_folder->nb_directory; i++)
-        if(!my_stricmp(current_file->file_name_case,target_folder->tab_directory[i]->file_name))
-          {
-            logf_error("  Error : Invalid target location. A folder already exist with the same name '%s'.\n",target_folder->tab_directory[i]->file_name);
-            return(1);
-          }
+      logf_error("  Error : Invalid target location. A %s already exist with the same name '%s'.\n",((existing_entry->storage_type & 0x0F) == 0x0D) ? "folder" : "file",existing_entry->file_name);
+      return(1);
     }
 
   /** Recherche d'une entrée libre dans le répertoire **/
@@ -177,61 +151,38 @@ int MoveProdosFileToFolder(struct prodos_image *current_image, struct file_descr
   /* Modifie le Header Pointer */
   SetWordValue(directory_block,target_offset+0x25,directory_header_pointer);
   /* Ecrit les données */
-  SetBlockData(current_image,directory_block_number,&directory_block[0]);
+  SetMetadataBlockData(current_image,directory_block_number,&directory_block[0]);
 
   /** Efface l'entrée de l'ancien Dossier **/
   memset(&file_entry_block[file_block_offset],0,entry_length);
-  SetBlockData(current_image,file_block_number,&file_entry_block[0]);
+  SetMetadataBlockData(current_image,file_block_number,&file_entry_block[0]);
 
   /* Modifie le nombre d'entrées valides du Target Folder : +1 */
   GetBlockData(current_image,directory_header_pointer,&directory_block[0]);
   file_count = GetWordValue(directory_block,0x25);
   SetWordValue(directory_block,0x25,(WORD)(file_count+1));
-  SetBlockData(current_image,directory_header_pointer,&directory_block[0]);
+  SetMetadataBlockData(current_image,directory_header_pointer,&directory_block[0]);
 
   /* Modifie le nombre d'entrées valides de l'ancien Folder : -1 */
   GetBlockData(current_image,file_header_pointer,&directory_block[0]);
   file_count = GetWordValue(directory_block,0x25);
   SetWordValue(directory_block,0x25,(WORD)(file_count-1));
-  SetBlockData(current_image,file_header_pointer,&directory_block[0]);
+  SetMetadataBlockData(current_image,file_header_pointer,&directory_block[0]);
 
   /***************************************/
   /*** Met à jour la structure mémoire ***/
   /** Met à jour le Dossier source (-1 fichier) **/
-  if(current_file->parent_directory == NULL)
-    UpdateEntryTable(UPDATE_REMOVE,&current_image->nb_file,&current_image->tab_file,current_file);
-  else
-    UpdateEntryTable(UPDATE_REMOVE,&current_file->parent_directory->nb_file,&current_file->parent_directory->tab_file,current_file);
+  UpdateFolderEntry(current_image,current_file->parent_directory,UPDATE_REMOVE,current_file);
 
   /** Met à jour le Dossier Cible (+1 fichier) **/
-  if(target_folder == NULL)
-    error = UpdateEntryTable(UPDATE_ADD,&current_image->nb_file,&current_image->tab_file,current_file);
-  else
-    error = UpdateEntryTable(UPDATE_ADD,&target_folder->nb_file,&target_folder->tab_file,current_file);
+  error = UpdateFolderEntry(current_image,target_folder,UPDATE_ADD,current_file);
   if(error)
     {
       logf_error("  Error : Memory allocation impossible.\n");
       return(1);
     }
 
-  /** Met à jour l'entrée en mémoire **/
-  /* Nouveau Path */
-  new_path = (char *) calloc((target_folder==NULL)?1+strlen(current_image->volume_header->volume_name_case)+1+strlen(current_file->file_name_case)+1:
-                                                   strlen(target_folder->file_path)+1+strlen(current_file->file_name_case)+1,
-                                                   sizeof(char));
-  if(new_path == NULL)
-    {
-      logf_error("  Error : Memory allocation impossible.\n");
-      return(1);
-    }
-  if(target_folder == NULL)
-    sprintf(new_path,"/%s/%s",current_image->volume_header->volume_name_case,current_file->file_name_case);
-  else
-    sprintf(new_path,"%s/%s",target_folder->file_path,current_file->file_name_case);
-  if(current_file->file_path)
-    free(current_file->file_path);
-  current_file->file_path = new_path;
-
+  /** Met à jour l'entrée en mémoire (le chemin découle du Parent Directory) **/
   /* Nouveau Header Pointer Block */
   current_file->header_pointer_block = directory_header_pointer;
 
@@ -255,70 +206,41 @@ int MoveProdosFileToFolder(struct prodos_image *current_image, struct file_descr
 /****************************************************************************************/
 int MoveProdosFolderToFolder(struct prodos_image *current_image, struct file_descriptive_entry *target_folder, struct file_descriptive_entry *current_folder)
 {
-  int i, error, target_offset, file_block_number, file_block_offset, entry_length, file_header_pointer, file_count, depth_delta;
+  int error, target_offset, file_block_number, file_block_offset, entry_length, file_header_pointer, file_count, depth_delta;
   WORD directory_block_number, directory_header_pointer;
   BYTE directory_entry_number;
-  char old_path[2048];
-  char new_path[2048];
+  char *target_name;
+  struct file_descriptive_entry *existing_entry;
+  struct file_descriptive_entry *parent_folder;
   unsigned char directory_block[BLOCK_SIZE];
   unsigned char file_entry_block[BLOCK_SIZE];
 
   /* Ecart de profondeur (1=racine->N) */
   depth_delta = ((target_folder == NULL) ? 1 : target_folder->depth+1) - (current_folder->depth);
 
-  /* Translation de Chemin */
-  strcpy(old_path,current_folder->file_path);
-  if(target_folder == NULL)
-    sprintf(new_path,"/%s/%s",current_image->volume_header->volume_name_case,current_folder->file_name_case);
-  else
-    sprintf(new_path,"%s/%s",target_folder->file_path,current_folder->file_name_case);
+  /* Nom du dossier cible */
+  target_name = (target_folder == NULL) ? current_image->volume_header->volume_name_case : target_folder->file_name_case;
 
   /* On ne peut pas déplacer un Dossier au même endroit */
-  if(!my_stricmp(old_path,new_path))
+  if(target_folder == current_folder->parent_directory)
     {
-      logf_error("  Error : Invalid target location. The Folder is moved at the same location : '%s'.\n",target_folder->file_name_case);
+      logf_error("  Error : Invalid target location. The Folder is moved at the same location : '%s'.\n",target_name);
       return(1);
     }
-  /* On ne peut pas déplacer un Dossier sous lui-même */
-  if(strlen(new_path) > strlen(old_path))
-    if(!my_strnicmp(old_path,new_path,strlen(old_path)))
+  /* On ne peut pas déplacer un Dossier sous lui-même (on remonte les parents du dossier cible) */
+  for(parent_folder=target_folder; parent_folder!=NULL; parent_folder=parent_folder->parent_directory)
+    if(parent_folder == current_folder)
       {
-        logf_error("  Error : Invalid target location. The Folder is moved under itself : '%s'.\n",target_folder->file_name_case);
+        logf_error("  Error : Invalid target location. The Folder is moved under itself : '%s'.\n",target_name);
         return(1);
       }
 
   /** Vérifie que ce nom de fichier ne correspond pas déjà à un nom de fichier/dossier **/
-  if(target_folder == NULL)
+  existing_entry = FindFolderEntry(current_image,target_folder,current_folder->file_name_case);
+  if(existing_entry != NULL)
     {
-      /* Vérification à la racine du Volume */
-      for(i=0; i<current_image->nb_file; i++)
-        if(!my_stricmp(current_folder->file_name_case,current_image->tab_file[i]->file_name))
-          {
-            logf_error("  Error : Invalid target location. A file already exist with the same name '%s'.\n",current_image->tab_file[i]->file_name);
-            return(1);
-          }
-      for(i=0; i<current_image->nb_directory; i++)
-        if(!my_stricmp(current_folder->file_name_case,current_image->tab_directory[i]->file_name))
-          {
-            logf_error("  Error : Invalid target location. A folder already exist with the same name '%s'.\n",current_image->tab_directory[i]->file_name);
-            return(1);
-          }
-    }
-  else
-    {
-      /* Vérification dans le dossier */
-      for(i=0; i<target_folder->nb_file; i++)
-        if(!my_stricmp(current_folder->file_name_case,target_folder->tab_file[i]->file_name))
-          {
-            logf_error("  Error : Invalid target location. A file already exist with the same name '%s'.\n",target_folder->tab_file[i]->file_name);
-            return(1);
-          }
-      for(i=0; i<target_folder->nb_directory; i++)
-        if(!my_stricmp(current_folder->file_name_case,target_folder->tab_directory[i]->file_name))
-          {
-            logf_error("  Error : Invalid target location. A folder already exist with the same name '%s'.\n",target_folder->tab_directory[i]->file_name);
-            return(1);
-          }
+      logf_error("  Error : Invalid target location. A %s already exist with the same name '%s'.\n",((existing_entry->storage_type & 0x0F) == 0x0D) ? "folder" : "file",existing_entry->file_name);
+      return(1);
     }
 
   /** Recherche d'une entrée libre dans le répertoire **/
@@ -344,43 +266,37 @@ int MoveProdosFolderToFolder(struct prodos_image *current_image, struct file_des
   /* Modifie le Header Pointer */
   SetWordValue(directory_block,target_offset+FILE_HEADERPOINTER_OFFSET,directory_header_pointer);
   /* Ecrit les données */
-  SetBlockData(current_image,directory_block_number,&directory_block[0]);
+  SetMetadataBlockData(current_image,directory_block_number,&directory_block[0]);
 
   /** Efface l'entrée de l'ancien Dossier **/
   memset(&file_entry_block[file_block_offset],0,entry_length);
-  SetBlockData(current_image,file_block_number,&file_entry_block[0]);
+  SetMetadataBlockData(current_image,file_block_number,&file_entry_block[0]);
 
   /* Modifie le nombre d'entrées valides du Target Folder : +1 */
   GetBlockData(current_image,directory_header_pointer,&directory_block[0]);
   file_count = GetWordValue(directory_block,DIRECTORY_FILECOUNT_OFFSET);
   SetWordValue(directory_block,DIRECTORY_FILECOUNT_OFFSET,(WORD)(file_count+1));
-  SetBlockData(current_image,directory_header_pointer,&directory_block[0]);
+  SetMetadataBlockData(current_image,directory_header_pointer,&directory_block[0]);
 
   /* Modifie le nombre d'entrées valides de l'ancien Folder : -1 */
   GetBlockData(current_image,file_header_pointer,&directory_block[0]);
   file_count = GetWordValue(directory_block,DIRECTORY_FILECOUNT_OFFSET);
   SetWordValue(directory_block,DIRECTORY_FILECOUNT_OFFSET,(WORD)(file_count-1));
-  SetBlockData(current_image,file_header_pointer,&directory_block[0]);
+  SetMetadataBlockData(current_image,file_header_pointer,&directory_block[0]);
 
   /** Modifie le Parent Pointer Block et le Parent Entry du dossier que l'on déplace **/
   GetBlockData(current_image,current_folder->key_pointer_block,&directory_block[0]);
   SetWordValue(directory_block,DIRECTORY_PARENTPOINTERBLOCK_OFFSET,(WORD)directory_block_number);
   directory_block[DIRECTORY_PARENTENTRY_OFFSET] = (BYTE) directory_entry_number;
-  SetBlockData(current_image,current_folder->key_pointer_block,&directory_block[0]);
+  SetMetadataBlockData(current_image,current_folder->key_pointer_block,&directory_block[0]);
 
   /***************************************/
   /*** Met à jour la structure mémoire ***/
-  /** Met à jour le Dossier source (-1 fichier) **/
-  if(current_folder->parent_directory == NULL)
-    UpdateEntryTable(UPDATE_REMOVE,&current_image->nb_file,&current_image->tab_file,current_folder);
-  else
-    UpdateEntryTable(UPDATE_REMOVE,&current_folder->parent_directory->nb_file,&current_folder->parent_directory->tab_file,current_folder);
+  /** Met à jour le Dossier source (-1 dossier) **/
+  UpdateFolderEntry(current_image,current_folder->parent_directory,UPDATE_REMOVE,current_folder);
 
-  /** Met à jour le Dossier Cible (+1 fichier) **/
-  if(target_folder == NULL)
-    error = UpdateEntryTable(UPDATE_ADD,&current_image->nb_file,&current_image->tab_file,current_folder);
-  else
-    error = UpdateEntryTable(UPDATE_ADD,&target_folder->nb_file,&target_folder->tab_file,current_folder);
+  /** Met à jour le Dossier Cible (+1 dossier) **/
+  error = UpdateFolderEntry(current_image,target_folder,UPDATE_ADD,current_folder);
   if(error)
     {
       logf_error("  Error : Memory allocation impossible.\n");
@@ -399,13 +315,9 @@ int MoveProdosFolderToFolder(struct prodos_image *current_image, struct file_des
   /* Nouveau Parent Directory */
   current_folder->parent_directory = target_folder;
 
-  /** Modifie toutes les entrées de ce Répertoire **/
-  /* Depth */
+  /** Modifie la profondeur de toutes les entrées de ce Répertoire (les chemins découlent des parents) **/
   ChangeDirectoryEntriesDepth(current_folder,depth_delta);
 
-  /* Path */
-  ChangeDirectoryEntriesPath(current_folder,old_path,new_path);
-
   /* OK */
   return(0);
 }
@@ -430,55 +342,4 @@ static void ChangeDirectoryEntriesDepth(struct file_descriptive_entry *current_f
     ChangeDirectoryEntriesDepth(current_folder->tab_directory[i],depth_delta);
 }
 
-
-/******************************************************************/
-/*  ChangeDirectoryEntriesPath() :  Change le chemin des entrées. */
-/******************************************************************/
-static void ChangeDirectoryEntriesPath(struct file_descriptive_entry *current_folder, char *old_path, char *new_path)
-{
-  int i;
-
-  /* Le dossier lui même */
-  current_folder->file_path = ChangeEntryPath(current_folder->file_path,old_path,new_path);
-
-  /* Les File du dossier */
-  for(i=0; i<current_folder->nb_file; i++)
-    current_folder->tab_file[i]->file_path = ChangeEntryPath(current_folder->tab_file[i]->file_path,old_path,new_path);
-
-  /* Les Folder du dossier (récursivité) */
-  for(i=0; i<current_folder->nb_directory; i++)
-    ChangeDirectoryEntriesPath(current_folder->tab_directory[i],old_path,new_path);
-}
-
-
-/*****************************************************/
-/*  ChangeEntryPath() :  Création du nouveau chemin. */
-/*****************************************************/
-static char *ChangeEntryPath(char *current_file_path, char *old_path, char *new_path)
-{
-  int length;
-  char *new_file_path;
-
-  /* Taille du chemin */
-  length = strlen(new_path) + strlen(&current_file_path[strlen(old_path)]);
-
-  /* Allocation mémoire */
-  new_file_path = (char *) calloc(length+1,sizeof(char));
-  if(new_file_path == NULL)
-    {
-      logf_error("  Error : Memory allocation impossible.\n");
-      return(current_file_path);
-    }
-
-  /* Nouveau chemin */
-  strcpy(new_file_path,new_path);
-  strcat(new_file_path,&current_file_path[strlen(old_path)]);
-
-  /* Libératioon mémoire ancien chemin */
-  free(current_file_path);
-
-  /* Renvoi le chemin */
-  return(new_file_path);
-}
-
 /***********************************************************************/
@@ -6,7 +6,7 @@
 /*  Auteur : Olivier ZARDINI  *  Brutal Deluxe Software  *  Mar 2012   */
 /***********************************************************************/
 
-void MoveProdosFile(struct prodos_image *,char *,char *);
-void MoveProdosFolder(struct prodos_image *,char *,char *);
+int MoveProdosFile(struct prodos_image *,char *,char *);
+int MoveProdosFolder(struct prodos_image *,char *,char *);
 
 /***********************************************************************/
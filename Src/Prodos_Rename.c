@@ -24,7 +24,7 @@
 /********************************************************/
 /*  RenameProdosFile() :  Renomage d'un fichier Prodos. */
 /********************************************************/
-void RenameProdosFile(struct prodos_image *current_image, char *prodos_file_path, char *new_file_name)
+int RenameProdosFile(struct prodos_image *current_image, char *prodos_file_path, char *new_file_name)
 {
   char upper_case[256];
   WORD name_case, now_date, now_time;
@@ -32,6 +32,7 @@ void RenameProdosFile(struct prodos_image *current_image, char *prodos_file_path
   int i, is_valid, error;
   unsigned char name_length;
   struct file_descriptive_entry *current_entry;
+  struct file_descriptive_entry *existing_entry;
   unsigned char directory_block[BLOCK_SIZE];
 
   /* Recherche l'entrée Prodos */
@@ -39,7 +40,7 @@ void RenameProdosFile(struct prodos_image *current_image, char *prodos_file_path
   if(current_entry == NULL)
     {
       logf_error("  Error : Invalid Prodos File path '%s'.\n",prodos_file_path);
-      return;
+      return(1);
     }
 
   /* Vérification du nouveau nom */
@@ -47,12 +48,20 @@ void RenameProdosFile(struct prodos_image *current_image, char *prodos_file_path
   if(is_valid == 0)
     {
       logf_error("  Error : Invalid Prodos name '%s'.\n",new_file_name);
-      return;
+      return(1);
     }
 
   /* On vérifie si ce n'est pas le même nom */
   if(!strcmp(current_entry->file_name_case,new_file_name))
-    return;
+    return(0);
+
+  /* Le nouveau nom ne doit pas déjà être pris dans le dossier */
+  existing_entry = FindFolderEntry(current_image,current_entry->parent_directory,new_file_name);
+  if(existing_entry != NULL && existing_entry != current_entry)
+    {
+      logf_error("  Error : Invalid Prodos name. The name is already used by '%s'.\n",existing_entry->file_name_case);
+      return(1);
+    }
 
   /* Nom en majuscule */
   my_strcpy(upper_case,sizeof(upper_case),new_file_name);
@@ -73,10 +82,12 @@ void RenameProdosFile(struct prodos_image *current_image, char *prodos_file_path
 
   /*****************************************************/
   /** On va modifier le nom dans la structure mémoire **/
+  UpdateFolderEntry(current_image,current_entry->parent_directory,UPDATE_REMOVE,current_entry);
   current_entry->name_length = (int) name_length;
   strcpy(current_entry->file_name,upper_case);
   strcpy(current_entry->file_name_case,new_file_name);
   current_entry->lowercase = name_case;
+  UpdateFolderEntry(current_image,current_entry->parent_directory,UPDATE_ADD,current_entry);
 
   /***********************************/
   /** On va modifier l'image disque **/
@@ -89,17 +100,18 @@ void RenameProdosFile(struct prodos_image *current_image, char *prodos_file_path
   memcpy(&directory_block[current_entry->entry_offset+FILE_LOWERCASE_OFFSET],&name_case,sizeof(WORD));
 
   /* Modifie le block Directory */
-  SetBlockData(current_image,current_entry->block_location,&directory_block[0]);
+  SetMetadataBlockData(current_image,current_entry->block_location,&directory_block[0]);
 
   /** Ecrit le fichier **/
   error = UpdateProdosImage(current_image);
+  return(error);
 }
 
 
 /**********************************************************/
 /*  RenameProdosFolder() :  Renomage d'un dossier Prodos. */
 /**********************************************************/
-void RenameProdosFolder(struct prodos_image *current_image, char *prodos_folder_path, char *new_folder_name)
+int RenameProdosFolder(struct prodos_image *current_image, char *prodos_folder_path, char *new_folder_name)
 {
   char upper_case[256];
   WORD name_case, now_date, now_time;
@@ -107,6 +119,7 @@ void RenameProdosFolder(struct prodos_image *current_image, char *prodos_folder_
   int i, is_valid, error;
   unsigned char name_length;
   struct file_descriptive_entry *current_entry;
+  struct file_descriptive_entry *existing_entry;
   unsigned char directory_block[BLOCK_SIZE];
 
   /* Recherche le dossier Prodos */
@@ -114,7 +127,7 @@ void RenameProdosFolder(struct prodos_image *current_image, char *prodos_folder_
   if(current_entry == NULL)
     {
       logf_error("  Error : Invalid Prodos Folder path '%s'.\n",prodos_folder_path);
-      return;
+      return(1);
     }
 
   /* Vérification du nouveau nom */
@@ -122,12 +135,20 @@ void RenameProdosFolder(struct prodos_image *current_image, char *prodos_folder_
   if(is_valid == 0)
     {
       logf_error("  Error : Invalid Prodos name '%s'.\n",new_folder_name);
-      return;
+      return(1);
     }
 
   /* On vérifie si ce n'est pas le même nom */
   if(!strcmp(current_entry->file_name_case,new_folder_name))
-    return;
+    return(0);
+
+  /* Le nouveau nom ne doit pas déjà être pris dans le dossier */
+  existing_entry = FindFolderEntry(current_image,current_entry->parent_directory,new_folder_name);
+  if(existing_entry != NULL && existing_entry != current_entry)
+    {
+      logf_error("  Error : Invalid Prodos name. The name is already used by '%s'.\n",existing_entry->file_name_case);
+      return(1);
+    }
 
   /* Nom en majuscule */
   strcpy(upper_case,new_folder_name);
@@ -148,10 +169,12 @@ void RenameProdosFolder(struct prodos_image *current_image, char *prodos_folder_
 
   /*****************************************************/
   /** On va modifier le nom dans la structure mémoire **/
+  UpdateFolderEntry(current_image,current_entry->parent_directory,UPDATE_REMOVE,current_entry);
   current_entry->name_length = (int) name_length;
   strcpy(current_entry->file_name,upper_case);
   strcpy(current_entry->file_name_case,new_folder_name);
   current_entry->lowercase = name_case;
+  UpdateFolderEntry(current_image,current_entry->parent_directory,UPDATE_ADD,current_entry);
 
   /***********************************/
   /** On va modifier l'image disque **/
@@ -164,7 +187,7 @@ void RenameProdosFolder(struct prodos_image *current_image, char *prodos_folder_
   memcpy(&directory_block[current_entry->entry_offset+FILE_LOWERCASE_OFFSET],&name_case,sizeof(WORD));
 
   /* Modifie le block Directory */
-  SetBlockData(current_image,current_entry->block_location,&directory_block[0]);
+  SetMetadataBlockData(current_image,current_entry->block_location,&directory_block[0]);
 
   /** Sub-Directory Block **/
   GetBlockData(current_image,current_entry->key_pointer_block,&directory_block[0]);
@@ -175,17 +198,18 @@ void RenameProdosFolder(struct prodos_image *current_image, char *prodos_folder_
   memcpy(&directory_block[DIRECTORY_LOWERCASE_OFFSET],&name_case,sizeof(WORD));
 
   /* Modifie le block Sub-Directory */
-  SetBlockData(current_image,current_entry->key_pointer_block,&directory_block[0]);
+  SetMetadataBlockData(current_image,current_entry->key_pointer_block,&directory_block[0]);
 
   /** Ecrit le fichier **/
   error = UpdateProdosImage(current_image);
+  return(error);
 }
 
 
 /*******************************************************/
 /*  RenameProdosVolume() :  Renomage du volume Prodos. */
 /*******************************************************/
-void RenameProdosVolume(struct prodos_image *current_image, char *new_volume_name)
+int RenameProdosVolume(struct prodos_image *current_image, char *new_volume_name)
 {
   char upper_case[256];
   WORD name_case, now_date, now_time;
@@ -199,12 +223,12 @@ void RenameProdosVolume(struct prodos_image *current_image, char *new_volume_nam
   if(is_valid == 0)
     {
       logf_error("  Error : Invalid Prodos name '%s'.\n",new_volume_name);
-      return;
+      return(1);
     }
 
   /* On vérifie si ce n'est pas le même nom */
   if(!strcmp(current_image->volume_header->volume_name_case,new_volume_name))
-    return;
+    return(0);
 
   /* Nom en majuscule */
   strcpy(upper_case,new_volume_name);
@@ -225,6 +249,7 @@ void RenameProdosVolume(struct prodos_image *current_image, char *new_volume_nam
 
   /*****************************************************/
   /** On va modifier le nom dans la structure mémoire **/
+  /* Volume Header (les chemins des entrées en découlent) */
   current_image->volume_header->name_length = (int) name_length;
   strcpy(current_image->volume_header->volume_name,upper_case);
   strcpy(current_image->volume_header->volume_name_case,new_volume_name);
@@ -245,10 +270,11 @@ void RenameProdosVolume(struct prodos_image *current_image, char *new_volume_nam
   memcpy(&volume_block[VOLUME_LOWERCASE_OFFSET],&name_case,sizeof(WORD));
 
   /* Modifie le block */
-  SetBlockData(current_image,2,&volume_block[0]);
+  SetMetadataBlockData(current_image,2,&volume_block[0]);
 
   /** Ecrit le fichier **/
   error = UpdateProdosImage(current_image);
+  return(error);
 }
 
 /***********************************************************************/
@@ -6,8 +6,8 @@
 /*  Auteur : Olivier ZARDINI  *  Brutal Deluxe Software  *  Mar 2012   */
 /***********************************************************************/
 
-void RenameProdosFile(struct prodos_image *,char *,char *);
-void RenameProdosFolder(struct prodos_image *,char *,char *);
-void RenameProdosVolume(struct prodos_image *,char *);
+int RenameProdosFile(struct prodos_image *,char *,char *);
+int RenameProdosFolder(struct prodos_image *,char *,char *);
+int RenameProdosVolume(struct prodos_image *,char *);
 
 /***********************************************************************/
\ No newline at end of file
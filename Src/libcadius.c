@@ -0,0 +1,382 @@
+/***********************************************************************/
+/*                                                                     */
+/*   libcadius.c : API pour utiliser cadius depuis un autre programme. */
+/*                                                                     */
+/***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Dc_Shared.h"
+#include "Dc_Prodos.h"
+#include "Dc_Memory.h"
+#include "os/os.h"
+#include "Prodos_Add.h"
+#include "Prodos_Check.h"
+#include "Prodos_Create.h"
+#include "Prodos_Delete.h"
+#include "Prodos_Extract.h"
+#include "libcadius.h"
+#include "log.h"
+
+/** Une image ouverte et les listes my_Memory() qui la décrivent **/
+struct cadius_context
+{
+  struct memory_context *memory;
+  struct prodos_image *current_image;
+
+  struct memory_context *previous_memory;   /* Contexte du thread avant EnterContext() */
+
+  char entry_path[ENTRY_PATH_LENGTH];       /* Chemin de la dernière entrée décrite par cadius_GetEntry() */
+};
+
+static void EnterContext(struct cadius_context *);
+static void LeaveContext(struct cadius_context *);
+static int ReloadImage(struct cadius_context *);
+
+/*****************************************************************/
+/*  cadius_OpenImage() :  Charge une image dans un nouveau       */
+/*                        contexte (writable = 1 : modifiable).  */
+/*****************************************************************/
+struct cadius_context *cadius_OpenImage(char *image_path, int writable)
+{
+  struct cadius_context *context;
+
+  /* Allocation mémoire */
+  context = (struct cadius_context *) calloc(1,sizeof(struct cadius_context));
+  if(context == NULL)
+    return(NULL);
+  context->memory = mem_alloc_context();
+  if(context->memory == NULL)
+    {
+      free(context);
+      return(NULL);
+    }
+
+  /** Chargement de l'image, les entrées vont dans les listes du contexte **/
+  EnterContext(context);
+  context->current_image = LoadProdosImage(image_path,(writable) ? IMAGE_ACCESS_WRITE : IMAGE_ACCESS_READ);
+  LeaveContext(context);
+  if(context->current_image == NULL)
+    {
+      cadius_CloseImage(context);
+      return(NULL);
+    }
+
+  /* Renvoi le contexte */
+  return(context);
+}
+
+
+/*********************************************************************/
+/*  cadius_CloseImage() :  Libère l'image et les listes du contexte. */
+/*********************************************************************/
+void cadius_CloseImage(struct cadius_context *context)
+{
+  if(context == NULL)
+    return;
+
+  mem_free_image(context->current_image);
+  mem_free_context(context->memory);
+  free(context);
+}
+
+
+/************************************************************************/
+/*  cadius_GetEntryCount() :  Nombre de dossiers + fichiers de l'image. */
+/************************************************************************/
+int cadius_GetEntryCount(struct cadius_context *context)
+{
+  return(context->memory->nb_directory + context->memory->nb_entry);
+}
+
+
+/*************************************************************************/
+/*  cadius_GetEntry() :  Décrit l'entrée index (0 -> GetEntryCount-1) :  */
+/*                       les dossiers d'abord, puis les fichiers.        */
+/*************************************************************************/
+int cadius_GetEntry(struct cadius_context *context, int index, struct cadius_entry *entry_rtn)
+{
+  struct file_descriptive_entry *current_entry;
+
+  /* Dossiers puis fichiers */
+  if(index < 0 || index >= cadius_GetEntryCount(context))
+    return(CADIUS_ERROR_PARAM);
+  if(index < context->memory->nb_directory)
+    current_entry = context->memory->tab_directory[index];
+  else
+    current_entry = context->memory->tab_entry[index-context->memory->nb_directory];
+
+  /* Remplit la structure */
+  entry_rtn->path = GetEntryPath(context->current_image,current_entry,context->entry_path);
+  entry_rtn->is_folder = (index < context->memory->nb_directory);
+  entry_rtn->file_type = current_entry->file_type;
+  entry_rtn->file_aux_type = current_entry->file_aux_type;
+  entry_rtn->data_size = current_entry->data_size;
+  entry_rtn->resource_size = current_entry->resource_size;
+  entry_rtn->blocks_used = current_entry->blocks_used;
+
+  return(CADIUS_OK);
+}
+
+
+/*******************************************************************/
+/*  cadius_ExtractFile() :  Extrait un fichier dans un répertoire. */
+/*******************************************************************/
+int cadius_ExtractFile(struct cadius_context *context, char *prodos_file_path, char *output_directory_path, int output_apple_single)
+{
+  int error;
+
+  EnterContext(context);
+  context->current_image->nb_extract_error = 0;
+
+  /** Extraction du fichier **/
+  if(GetProdosFile(context->current_image,prodos_file_path) == NULL)
+    error = CADIUS_ERROR_GET;
+  else
+    {
+      ExtractOneFile(context->current_image,prodos_file_path,output_directory_path,output_apple_single);
+      error = (context->current_image->nb_extract_error > 0) ? CADIUS_ERROR_EXTRACT : CADIUS_OK;
+    }
+
+  LeaveContext(context);
+  return(error);
+}
+
+
+/***************************************************************************/
+/*  cadius_ExtractFolder() :  Extrait un dossier dans un répertoire, avec  */
+/*                            nb_jobs threads (cf --jobs).                 */
+/***************************************************************************/
+int cadius_ExtractFolder(struct cadius_context *context, char *prodos_folder_path, char *output_directory_path, int output_apple_single, int nb_jobs)
+{
+  int error;
+  struct file_descriptive_entry *folder_entry;
+
+  EnterContext(context);
+  context->current_image->nb_extract_file = 0;
+  context->current_image->nb_extract_folder = 0;
+  context->current_image->nb_extract_error = 0;
+
+  /** Extraction des fichiers du dossier **/
+  folder_entry = GetProdosFolder(context->current_image,prodos_folder_path,1);
+  if(folder_entry == NULL)
+    error = CADIUS_ERROR_GET;
+  else
+    {
+      ExtractFolderFiles(context->current_image,folder_entry,output_directory_path,output_apple_single,(nb_jobs < 1) ? 1 : nb_jobs);
+      error = (context->current_image->nb_extract_error > 0) ? CADIUS_ERROR_EXTRACT : CADIUS_OK;
+    }
+
+  LeaveContext(context);
+  return(error);
+}
+
+
+/*************************************************************************/
+/*  cadius_ExtractVolume() :  Extrait tout le volume dans un répertoire. */
+/*************************************************************************/
+int cadius_ExtractVolume(struct cadius_context *context, char *output_directory_path, int output_apple_single, int nb_jobs)
+{
+  int error;
+
+  EnterContext(context);
+  context->current_image->nb_extract_file = 0;
+  context->current_image->nb_extract_folder = 0;
+  context->current_image->nb_extract_error = 0;
+
+  /** Extraction des fichiers du volume **/
+  ExtractVolumeFiles(context->current_image,output_directory_path,output_apple_single,(nb_jobs < 1) ? 1 : nb_jobs);
+  error = (context->current_image->nb_extract_error > 0) ? CADIUS_ERROR_EXTRACT : CADIUS_OK;
+
+  LeaveContext(context);
+  return(error);
+}
+
+
+/**********************************************************************/
+/*  cadius_AddFile() :  Ajoute un fichier dans un dossier de l'image. */
+/**********************************************************************/
+int cadius_AddFile(struct cadius_context *context, char *file_path, char *prodos_folder_path, int zero_case_bits)
+{
+  int error;
+
+  EnterContext(context);
+  context->current_image->nb_add_file = 0;
+  context->current_image->nb_add_folder = 0;
+  context->current_image->nb_add_error = 0;
+
+  error = AddFile(context->current_image,file_path,prodos_folder_path,zero_case_bits,1);
+  if(error && ReloadImage(context))
+    {
+      LeaveContext(context);
+      return(CADIUS_ERROR_LOAD);
+    }
+
+  LeaveContext(context);
+  return((error) ? CADIUS_ERROR_ADD : CADIUS_OK);
+}
+
+
+/********************************************************************/
+/*  cadius_AddFolder() :  Ajoute un dossier du disque dans l'image. */
+/********************************************************************/
+int cadius_AddFolder(struct cadius_context *context, char *folder_path, char *prodos_folder_path, int zero_case_bits)
+{
+  int error;
+
+  EnterContext(context);
+  context->current_image->nb_add_file = 0;
+  context->current_image->nb_add_folder = 0;
+  context->current_image->nb_add_error = 0;
+
+  AddFolder(context->current_image,folder_path,prodos_folder_path,zero_case_bits);
+  error = (context->current_image->nb_add_error > 0) ? CADIUS_ERROR_ADD : CADIUS_OK;
+
+  LeaveContext(context);
+  return(error);
+}
+
+
+/****************************************************************************/
+/*  cadius_CreateFolder() :  Crée un dossier (et ses parents) dans l'image. */
+/****************************************************************************/
+int cadius_CreateFolder(struct cadius_context *context, char *prodos_folder_path, int zero_case_bits)
+{
+  int error;
+
+  EnterContext(context);
+
+  CreateProdosFolder(context->current_image,prodos_folder_path,zero_case_bits);
+  error = (GetProdosFolder(context->current_image,prodos_folder_path,0) == NULL) ? CADIUS_ERROR_ADD : CADIUS_OK;
+  if(error && ReloadImage(context))
+    error = CADIUS_ERROR_LOAD;
+
+  LeaveContext(context);
+  return(error);
+}
+
+
+/***********************************************************/
+/*  cadius_DeleteFile() :  Supprime un fichier de l'image. */
+/***********************************************************/
+int cadius_DeleteFile(struct cadius_context *context, char *prodos_file_path)
+{
+  int error = CADIUS_OK;
+
+  EnterContext(context);
+
+  if(GetProdosFile(context->current_image,prodos_file_path) == NULL)
+    error = CADIUS_ERROR_GET;
+  else if(DeleteProdosFile(context->current_image,prodos_file_path))
+    error = (ReloadImage(context)) ? CADIUS_ERROR_LOAD : CADIUS_ERROR_GET;
+
+  LeaveContext(context);
+  return(error);
+}
+
+
+/*****************************************************************/
+/*  cadius_DeleteFolder() :  Supprime un dossier et son contenu. */
+/*****************************************************************/
+int cadius_DeleteFolder(struct cadius_context *context, char *prodos_folder_path)
+{
+  int error = CADIUS_OK;
+
+  EnterContext(context);
+
+  if(GetProdosFolder(context->current_image,prodos_folder_path,0) == NULL)
+    error = CADIUS_ERROR_GET;
+  else if(DeleteProdosFolder(context->current_image,prodos_folder_path))
+    error = (ReloadImage(context)) ? CADIUS_ERROR_LOAD : CADIUS_ERROR_GET;
+
+  LeaveContext(context);
+  return(error);
+}
+
+
+/*************************************************************************/
+/*  cadius_CheckImage() :  Vérifie l'image, renvoie le nombre d'erreurs. */
+/*************************************************************************/
+int cadius_CheckImage(struct cadius_context *context)
+{
+  EnterContext(context);
+
+  /* Les erreurs d'une vérification précédente sont oubliées */
+  my_Memory(MEMORY_FREE_ERROR,NULL,NULL);
+  memset(context->current_image->block_usage_type,0,context->current_image->nb_block*sizeof(int));
+  memset(context->current_image->block_usage_object,0,context->current_image->nb_block*sizeof(void *));
+  CheckProdosImage(context->current_image,0,FORMAT_TEXT);
+
+  LeaveContext(context);
+  return(context->memory->nb_error);
+}
+
+
+/***************************************************************************/
+/*  cadius_GetError() :  Message de l'erreur index (cf cadius_CheckImage). */
+/***************************************************************************/
+char *cadius_GetError(struct cadius_context *context, int index)
+{
+  if(index < 0 || index >= context->memory->nb_error)
+    return(NULL);
+
+  return(context->memory->tab_error[index]->message);
+}
+
+
+/***********************************************************************/
+/*  EnterContext() :  Les listes my_Memory() du thread sont celles du  */
+/*                    contexte jusqu'à LeaveContext().                 */
+/***********************************************************************/
+static void EnterContext(struct cadius_context *context)
+{
+  context->previous_memory = my_SetMemoryContext(context->memory);
+}
+
+
+/************************************************************************/
+/*  LeaveContext() :  Remet en place les listes d'avant EnterContext    */
+/*                    et écrit les messages du thread restés en buffer. */
+/************************************************************************/
+static void LeaveContext(struct cadius_context *context)
+{
+  my_SetMemoryContext(context->previous_memory);
+  log_flush();
+}
+
+
+/**************************************************************************/
+/*  ReloadImage() :  Recharge l'image depuis le fichier, après une        */
+/*                   commande qui a échoué et laissé en mémoire des       */
+/*                   modifications qui n'ont pas été écrites.             */
+/**************************************************************************/
+static int ReloadImage(struct cadius_context *context)
+{
+  char *image_path;
+
+  image_path = strdup(context->current_image->image_file_path);
+  if(image_path == NULL)
+    return(1);
+
+  /* Libère l'image et les listes du contexte */
+  mem_free_image(context->current_image);
+  context->current_image = NULL;
+  mem_free_context(context->memory);
+  context->memory = mem_alloc_context();
+  if(context->memory == NULL)
+    {
+      free(image_path);
+      return(1);
+    }
+  my_SetMemoryContext(context->memory);
+
+  /** Nouveau chargement, les entrées vont dans les nouvelles listes **/
+  context->current_image = LoadProdosImage(image_path,IMAGE_ACCESS_WRITE);
+  free(image_path);
+
+  return((context->current_image == NULL) ? 1 : 0);
+}
+
+/***********************************************************************/
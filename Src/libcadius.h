@@ -0,0 +1,65 @@
+/***********************************************************************/
+/*                                                                     */
+/*   libcadius.h : API pour utiliser cadius depuis un autre programme. */
+/*                                                                     */
+/***********************************************************************/
+
+#pragma once
+
+/**
+ * Each image is opened in its own context, which owns the image and the
+ * entry / error lists used while working on it, so several images can be
+ * processed at the same time by different threads of one process.
+ *
+ * Changes are written to the image file at the end of each call. When
+ * cadius_AddFile, cadius_CreateFolder or cadius_Delete* fails, nothing is
+ * written and the image is reloaded from its file, so the context never
+ * holds half done changes ; if that reload fails the call returns
+ * CADIUS_ERROR_LOAD and the context can only be closed. cadius_AddFolder
+ * adds the files it can, like ADDFOLDER.
+ *
+ * A context must not be used by two threads at the same time. Messages
+ * still go through the cadius logger (stdout), whose level is global.
+ */
+
+#define CADIUS_OK              0
+#define CADIUS_ERROR_PARAM     2
+#define CADIUS_ERROR_LOAD      3
+#define CADIUS_ERROR_GET       4
+#define CADIUS_ERROR_EXTRACT   5
+#define CADIUS_ERROR_ADD       6
+
+struct cadius_context;   /* Opaque */
+
+/** One file or folder of the image, see cadius_GetEntry **/
+struct cadius_entry
+{
+  char *path;      /* Full ProDOS path (/VOLUME/FOLDER/FILE), owned by the context, valid until the next cadius_GetEntry */
+  int is_folder;
+  int file_type;
+  int file_aux_type;
+  int data_size;
+  int resource_size;
+  int blocks_used;
+};
+
+struct cadius_context *cadius_OpenImage(char *,int);
+void cadius_CloseImage(struct cadius_context *);
+
+int cadius_GetEntryCount(struct cadius_context *);
+int cadius_GetEntry(struct cadius_context *,int,struct cadius_entry *);
+
+int cadius_ExtractFile(struct cadius_context *,char *,char *,int);
+int cadius_ExtractFolder(struct cadius_context *,char *,char *,int,int);
+int cadius_ExtractVolume(struct cadius_context *,char *,int,int);
+
+int cadius_AddFile(struct cadius_context *,char *,char *,int);
+int cadius_AddFolder(struct cadius_context *,char *,char *,int);
+int cadius_CreateFolder(struct cadius_context *,char *,int);
+int cadius_DeleteFile(struct cadius_context *,char *);
+int cadius_DeleteFolder(struct cadius_context *,char *);
+
+int cadius_CheckImage(struct cadius_context *);
+char *cadius_GetError(struct cadius_context *,int);
+
+/***********************************************************************/
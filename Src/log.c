@@ -1,20 +1,227 @@
 #include "log.h"
+#include "os/os.h"
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 
-static struct logconf LCF = { 
+// Size above which the stdout buffer of a thread is written out
+#define LOG_OUTPUT_SIZE 65536
+
+static struct logconf LCF = {
   true,
   INFO
 };
 
+// Errors go straight to stderr (--format=json|csv keeps stdout parseable)
+static bool LCF_ERROR_STDERR = false;
+
+// Set per thread by log_set_buffer, NULL writes to stdout
+static THREAD_LOCAL logbuffer *LBF = NULL;
+
+// Per thread stdout buffer, written with one fwrite by log_flush
+static THREAD_LOCAL logbuffer LOB = { NULL, 0, 0 };
+
+static int log_buffer_vprintf(logbuffer *buffer, const char *fmt, va_list varargs);
+static int log_buffer_reserve(logbuffer *buffer, int length);
+static logbuffer *log_target(void);
+
 int logf_impl(loglevel level, const char *fmt, ...)
 {
+  int length;
+  logbuffer *buffer = NULL;
+
   if (!LCF.enabled || level > LCF.level) return 0;
 
   va_list varargs;
   va_start(varargs, fmt);
 
-  return vprintf(fmt, varargs);
+  if (level == ERROR && LCF_ERROR_STDERR)
+    length = vfprintf(stderr, fmt, varargs);
+  else if ((buffer = log_target()) != NULL)
+    length = log_buffer_vprintf(buffer, fmt, varargs);
+  else
+    length = vprintf(fmt, varargs);
+
+  va_end(varargs);
+
+  if (buffer == &LOB && LOB.length >= LOG_OUTPUT_SIZE)
+    log_flush();
+  return length;
+}
+
+/**
+ * Append raw characters to the output, without going through a format
+ *
+ * @param data
+ * @param length
+ */
+void log_write(const char *data, int length)
+{
+  logbuffer *buffer;
+
+  if (!LCF.enabled || length <= 0) return;
+
+  buffer = log_target();
+  if (buffer == NULL || log_buffer_reserve(buffer, length)) {
+    fwrite(data, 1, length, stdout);
+    return;
+  }
+
+  memcpy(buffer->data + buffer->length, data, length);
+  buffer->length += length;
+  buffer->data[buffer->length] = '\0';
+
+  if (buffer == &LOB && LOB.length >= LOG_OUTPUT_SIZE)
+    log_flush();
+}
+
+/**
+ * Write value as a quoted JSON string
+ *
+ * @param value
+ */
+void log_json_string(const char *value)
+{
+  int length;
+  char escape[8];
+  const char *start;
+
+  log_write("\"", 1);
+  for (start = value; *value != '\0'; value++) {
+    if (*value != '"' && *value != '\\' && (unsigned char) *value >= 0x20)
+      continue;
+
+    // Flush the plain characters, then the escape sequence
+    log_write(start, (int) (value - start));
+    if (*value == '"' || *value == '\\')
+      length = sprintf(escape, "\\%c", *value);
+    else
+      length = sprintf(escape, "\\u%04X", (unsigned char) *value);
+    log_write(escape, length);
+    start = value + 1;
+  }
+  log_write(start, (int) (value - start));
+  log_write("\"", 1);
+}
+
+/**
+ * Write value as a CSV field, quoted only if it contains a separator,
+ * a quote or a line break
+ *
+ * @param value
+ */
+void log_csv_string(const char *value)
+{
+  const char *start;
+
+  if (strpbrk(value, ",\"\r\n") == NULL) {
+    log_write(value, (int) strlen(value));
+    return;
+  }
+
+  // Quotes are doubled
+  log_write("\"", 1);
+  for (start = value; (value = strchr(value, '"')) != NULL; start = value) {
+    value++;
+    log_write(start, (int) (value - start));
+    log_write("\"", 1);
+  }
+  log_write(start, (int) strlen(start));
+  log_write("\"", 1);
+}
+
+/**
+ * Write the stdout buffer of the calling thread. Called when the buffer is
+ * full, at exit (registered by main, before any thread starts), when a
+ * thread started by os_RunThreads ends and at the end of each libcadius
+ * call.
+ */
+void log_flush(void)
+{
+  if (LOB.length == 0) return;
+
+  fwrite(LOB.data, 1, LOB.length, stdout);
+  fflush(stdout);
+  LOB.length = 0;
+}
+
+/**
+ * Buffer receiving the messages of the calling thread : the one set by
+ * log_set_buffer, else the stdout buffer (NULL : write to stdout directly,
+ * for a terminal or if the buffer can't be allocated)
+ *
+ * @return
+ */
+static logbuffer *log_target(void)
+{
+  if (LBF != NULL) return LBF;
+
+  // A terminal keeps the line buffering of stdio
+  if (LOB.data == NULL && isatty(fileno(stdout))) return NULL;
+
+  if (LOB.data == NULL) {
+    LOB.data = malloc(2 * LOG_OUTPUT_SIZE);
+    if (LOB.data == NULL) return NULL;
+    LOB.length_max = 2 * LOG_OUTPUT_SIZE;
+  }
+  return &LOB;
+}
+
+/**
+ * Make room for length characters (plus the final 0) in the buffer
+ *
+ * @param buffer
+ * @param length
+ * @return 0 on success, -1 if memory is missing
+ */
+static int log_buffer_reserve(logbuffer *buffer, int length)
+{
+  int length_max;
+  char *data;
+
+  if (buffer->length + length + 1 <= buffer->length_max) return 0;
+
+  length_max = (buffer->length_max == 0) ? 1024 : buffer->length_max;
+  while (length_max < buffer->length + length + 1)
+    length_max *= 2;
+
+  data = realloc(buffer->data, length_max);
+  if (data == NULL) return -1;
+  buffer->data = data;
+  buffer->length_max = length_max;
+  return 0;
+}
+
+/**
+ * Append a formatted message to a buffer, growing it as needed. The
+ * message is formatted directly in the free space, and again only if it
+ * did not fit.
+ *
+ * @param buffer
+ * @param fmt
+ * @param varargs
+ * @return Number of characters appended, or -1
+ */
+static int log_buffer_vprintf(logbuffer *buffer, const char *fmt, va_list varargs)
+{
+  int length;
+  va_list copy;
+
+  va_copy(copy, varargs);
+  if (buffer->data == NULL)
+    length = vsnprintf(NULL, 0, fmt, copy);
+  else
+    length = vsnprintf(buffer->data + buffer->length, buffer->length_max - buffer->length, fmt, copy);
+  va_end(copy);
+  if (length < 0) return -1;
+
+  if (buffer->length + length + 1 > buffer->length_max) {
+    if (log_buffer_reserve(buffer, length)) return -1;
+    vsnprintf(buffer->data + buffer->length, length + 1, fmt, varargs);
+  }
+
+  buffer->length += length;
+  return length;
 }
 
 void log_off()
@@ -27,7 +234,27 @@ void log_on()
   LCF.enabled = true;
 }
 
-void log_set_level(loglevel level) 
+void log_set_level(loglevel level)
 {
   LCF.level = level;
-}
\ No newline at end of file
+}
+
+/**
+ * Send the error messages to stderr instead of stdout or the thread buffer
+ *
+ * @param error_stderr
+ */
+void log_set_error_stderr(bool error_stderr)
+{
+  LCF_ERROR_STDERR = error_stderr;
+}
+
+/**
+ * Send the messages of the calling thread to buffer (NULL : stdout)
+ *
+ * @param buffer
+ */
+void log_set_buffer(logbuffer *buffer)
+{
+  LBF = buffer;
+}
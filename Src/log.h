@@ -17,6 +17,20 @@ typedef struct logconf {
   loglevel level;
 } logconf;
 
+// Format of the CATALOG / CHECKVOLUME reports (--format=text|json|csv)
+typedef enum logformat {
+  FORMAT_TEXT,
+  FORMAT_JSON,
+  FORMAT_CSV
+} logformat;
+
+// Output of one thread kept in memory instead of going to stdout
+typedef struct logbuffer {
+  char *data;
+  int length;
+  int length_max;
+} logbuffer;
+
 int logf_impl(loglevel level, const char *fmt, ...);
 
 #define logf(fmt, ...) logf_impl(ALWAYS, fmt, ##__VA_ARGS__)
@@ -25,4 +39,10 @@ int logf_impl(loglevel level, const char *fmt, ...);
 
 void log_off();
 void log_on();
-void log_set_level(loglevel level);
\ No newline at end of file
+void log_set_level(loglevel level);
+void log_set_buffer(logbuffer *buffer);
+void log_set_error_stderr(bool error_stderr);
+void log_write(const char *data, int length);
+void log_json_string(const char *value);
+void log_csv_string(const char *value);
+void log_flush(void);
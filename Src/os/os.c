@@ -36,27 +36,29 @@ void os_DeleteFile(char *file_path)
 int os_CreateDirectory(char *directory)
 {
 	int error = 0;
+	size_t i, length;
 	struct stat dirstat;
 
-	char *dir_tokenize = strdup(directory);
+	// Walks the path in place rather than with strtok(), whose hidden
+	// state is not safe once extraction workers create files concurrently
+	length = strlen(directory);
+	char *buffer = strdup(directory);
+	if (buffer == NULL) return(-1);
 
-	char *buffer = calloc(1, 1024);
-	if (dir_tokenize[0] == FOLDER_CHARACTER[0])
-		strcat(buffer, FOLDER_CHARACTER);
-	char *token = strtok(dir_tokenize, FOLDER_CHARACTER);
-
-	while (token) {
-		if (strlen(buffer) + strlen(token) > 1024) return(-1);
-		strcat(buffer, token);
+	for (i = 1; i <= length; i++) {
+		if (buffer[i] != FOLDER_CHARACTER[0] && buffer[i] != '\0')
+			continue;
+		if (buffer[i-1] == FOLDER_CHARACTER[0])
+			continue;
 
+		buffer[i] = '\0';
 		if (stat(buffer, &dirstat) != 0)
 			error = my_mkdir(buffer);
 		else if (!S_ISDIR(dirstat.st_mode))
 			error = my_mkdir(buffer);
-
-		strcat(buffer, FOLDER_CHARACTER);
-		token = strtok(NULL, FOLDER_CHARACTER);
+		buffer[i] = directory[i];
 	}
 
+	free(buffer);
 	return error;
 }
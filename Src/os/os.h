@@ -33,6 +33,11 @@
 
 #include <dirent.h>
 #include <utime.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <glob.h>
+
+#define THREAD_LOCAL __thread
 
 #endif
 
@@ -47,6 +52,8 @@
 #include <direct.h>
 #include <windows.h>
 
+#define THREAD_LOCAL __declspec(thread)
+
 #endif
 
 
@@ -64,6 +71,9 @@
 int os_GetFolderFiles(char *,char *);
 int os_CreateDirectory(char *directory);
 void os_DeleteFile(char *file_path);
+int os_RenameFile(char *,char *);
+int os_GetFileModificationTime(char *,int64_t *);
+char **os_GetMatchingFiles(char *,int *);
 void os_SetFileCreationModificationDate(char *,struct file_descriptive_entry *);
 void os_GetFileCreationModificationDate(char *,struct prodos_file *);
 void os_SetFileAttribute(char *,int);
@@ -71,6 +81,23 @@ int my_stricmp(char *,char *);
 int my_strnicmp(char *,char *,size_t);
 int my_mkdir(char *path);
 
+unsigned char *os_MapFile(char *,int *);
+void os_UnmapFile(unsigned char *,int);
+
+int os_OpenFileWrite(char *);
+int os_WriteFileAt(int,unsigned char *,int,int);
+int os_SyncFile(int);
+int os_CloseFile(int);
+
+double os_GetTime(void);
+
+int os_RunThreads(int,void (*)(void *),void *);
+int os_AtomicIncrement(int *);
+void *os_CreateLock(void);
+void os_Lock(void *);
+void os_Unlock(void *);
+void os_FreeLock(void *);
+
 char *my_strcpy(char *s1, int s1_size, char *s2);
 char *my_strdup(const char *s);
 
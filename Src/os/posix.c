@@ -6,6 +6,8 @@
  */
 
 #include "os.h"
+#include "../log.h"
+#include "../Dc_Stats.h"
 
 #ifdef BUILD_POSIX
 
@@ -129,14 +131,21 @@ void os_SetFileCreationModificationDate(char *path, struct file_descriptive_entr
   if(stat(path, &filestat)) return;
 
   time_t curtime;
+  struct tm local_time;
   time(&curtime);
-  struct tm *time = localtime(&curtime);
+  struct tm *time = localtime_r(&curtime, &local_time);
+  if (time == NULL) return;
+
+  struct prodos_date creation_date;
+  struct prodos_time creation_time;
+  GetProdosDate(entry->file_creation_date, &creation_date);
+  GetProdosTime(entry->file_creation_time, &creation_time);
 
-  time->tm_mday = entry->file_creation_date.day;
-  time->tm_mon = entry->file_creation_date.month;
-  time->tm_year = entry->file_creation_date.year;
-  time->tm_hour = entry->file_creation_time.hour;
-  time->tm_min = entry->file_creation_time.minute;
+  time->tm_mday = creation_date.day;
+  time->tm_mon = creation_date.month;
+  time->tm_year = creation_date.year;
+  time->tm_hour = creation_time.hour;
+  time->tm_min = creation_time.minute;
 
   time_t modtime = mktime(time);
 
@@ -161,7 +170,8 @@ void os_GetFileCreationModificationDate(char *path, struct prodos_file *file) {
   if (stat(path, &filestat)) return;
 
   // TODO: Apply TZ transformations?
-  struct tm *time = localtime(&filestat.st_mtime);
+  struct tm local_time;
+  struct tm *time = localtime_r(&filestat.st_mtime, &local_time);
   if (time == NULL) return;
 
   file->file_creation_date = BuildProdosDate(time->tm_mday, time->tm_mon + 1, time->tm_year + 1900);
@@ -170,6 +180,305 @@ void os_GetFileCreationModificationDate(char *path, struct prodos_file *file) {
   file->file_modification_time = BuildProdosTime(time->tm_min, time->tm_hour);
 }
 
+/**
+ * Map a whole file into memory. The mapping is MAP_PRIVATE (PROT_WRITE,
+ * copy-on-write) : SetBlockData never reaches the file, modified blocks
+ * are written back by the caller, so a command that fails half way leaves
+ * the file as it was.
+ *
+ * @brief os_MapFile
+ * @param file_path
+ * @param data_length_rtn
+ * @return The mapping, or NULL if the file could not be mapped
+ */
+unsigned char *os_MapFile(char *file_path, int *data_length_rtn)
+{
+  int fd;
+  struct stat filestat;
+  void *data;
+
+  *data_length_rtn = 0;
+  fd = open(file_path, O_RDONLY);
+  if (fd < 0) return(NULL);
+
+  if (fstat(fd, &filestat) || !S_ISREG(filestat.st_mode) ||
+      filestat.st_size <= 0 || filestat.st_size > INT32_MAX) {
+    close(fd);
+    return(NULL);
+  }
+
+  data = mmap(NULL, (size_t) filestat.st_size, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE, fd, 0);
+
+  // The mapping holds its own reference to the file
+  close(fd);
+  if (data == MAP_FAILED) return(NULL);
+
+  *data_length_rtn = (int) filestat.st_size;
+  return((unsigned char *) data);
+}
+
+/**
+ * @brief os_UnmapFile Release a mapping obtained from os_MapFile
+ * @param data
+ * @param data_length
+ */
+void os_UnmapFile(unsigned char *data, int data_length)
+{
+  munmap(data, (size_t) data_length);
+}
+
+/**
+ * @brief os_OpenFileWrite Open an existing file for positioned writes
+ * @param file_path
+ * @return A file descriptor, or -1
+ */
+int os_OpenFileWrite(char *file_path)
+{
+  return(open(file_path, O_RDWR));
+}
+
+/**
+ * Write data_length bytes at offset with pwrite, without moving the file
+ * position. Short writes and EINTR are retried.
+ *
+ * @brief os_WriteFileAt
+ * @param fd
+ * @param data
+ * @param data_length
+ * @param offset
+ * @return 0 on success
+ */
+int os_WriteFileAt(int fd, unsigned char *data, int data_length, int offset)
+{
+  ssize_t nb_write;
+
+  while (data_length > 0) {
+    nb_write = pwrite(fd, data, (size_t) data_length, (off_t) offset);
+    if (nb_write < 0 && errno == EINTR) continue;
+    if (nb_write <= 0) return(1);
+
+    data += nb_write;
+    data_length -= (int) nb_write;
+    offset += (int) nb_write;
+  }
+
+  return(0);
+}
+
+/**
+ * @brief os_SyncFile Wait until the data written to fd is on disk
+ * @param fd
+ * @return 0 on success
+ */
+int os_SyncFile(int fd)
+{
+#if defined(__APPLE__)
+  // No fdatasync in the macOS headers
+  return(fsync(fd));
+#else
+  return(fdatasync(fd));
+#endif
+}
+
+/**
+ * @brief os_CloseFile
+ * @param fd
+ * @return 0 on success
+ */
+int os_CloseFile(int fd)
+{
+  return(close(fd));
+}
+
+/**
+ * @brief os_GetTime Monotonic clock, for the --stats timers
+ * @return Seconds since an unspecified start point
+ */
+double os_GetTime(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return((double) now.tv_sec + (double) now.tv_nsec / 1e9);
+}
+
+struct thread_call {
+  void (*thread_function)(void *);
+  void *thread_data;
+};
+
+static void *os_ThreadStart(void *arg)
+{
+  struct thread_call *call = arg;
+  call->thread_function(call->thread_data);
+  log_flush();
+  stats_MergeThread();
+  return(NULL);
+}
+
+/**
+ * Start nb_thread threads running thread_function(thread_data) and wait
+ * for all of them. The function is expected to pull its work from a
+ * shared cursor, so if a thread can't be started the caller simply runs
+ * one more copy itself and the work still gets done.
+ *
+ * @brief os_RunThreads
+ * @param nb_thread
+ * @param thread_function
+ * @param thread_data
+ * @return Number of threads actually started
+ */
+int os_RunThreads(int nb_thread, void (*thread_function)(void *), void *thread_data)
+{
+  int i, nb_started = 0;
+  pthread_t *tab_thread;
+  struct thread_call call = { thread_function, thread_data };
+
+  // Messages of this thread come before the ones of the new threads
+  log_flush();
+
+  tab_thread = calloc(nb_thread, sizeof(pthread_t));
+  if (tab_thread != NULL) {
+    for (i = 0; i < nb_thread; i++) {
+      if (pthread_create(&tab_thread[nb_started], NULL, os_ThreadStart, &call))
+        break;
+      nb_started++;
+    }
+  }
+
+  // Nothing could be started : do the work on this thread
+  if (nb_started == 0)
+    thread_function(thread_data);
+
+  for (i = 0; i < nb_started; i++)
+    pthread_join(tab_thread[i], NULL);
+
+  free(tab_thread);
+  return(nb_started);
+}
+
+/**
+ * @brief os_AtomicIncrement Thread safe ++(*value)
+ * @param value
+ * @return The incremented value
+ */
+int os_AtomicIncrement(int *value)
+{
+  return(__atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST));
+}
+
+/**
+ * @brief os_CreateLock Allocate a mutex for os_Lock / os_Unlock
+ * @return The lock, or NULL
+ */
+void *os_CreateLock(void)
+{
+  pthread_mutex_t *lock;
+
+  lock = calloc(1, sizeof(pthread_mutex_t));
+  if (lock == NULL)
+    return(NULL);
+  if (pthread_mutex_init(lock, NULL)) {
+    free(lock);
+    return(NULL);
+  }
+  return(lock);
+}
+
+void os_Lock(void *lock)
+{
+  pthread_mutex_lock((pthread_mutex_t *) lock);
+}
+
+void os_Unlock(void *lock)
+{
+  pthread_mutex_unlock((pthread_mutex_t *) lock);
+}
+
+void os_FreeLock(void *lock)
+{
+  if (lock == NULL)
+    return;
+  pthread_mutex_destroy((pthread_mutex_t *) lock);
+  free(lock);
+}
+
+/**
+ * @brief os_RenameFile Replace new_path by old_path in one step
+ * @param old_path
+ * @param new_path
+ * @return 0 on success
+ */
+int os_RenameFile(char *old_path, char *new_path)
+{
+  return(rename(old_path, new_path) ? 1 : 0);
+}
+
+/**
+ * @brief os_GetFileModificationTime
+ * @param path
+ * @param mtime_rtn Seconds since the epoch
+ * @return 0 on success
+ */
+int os_GetFileModificationTime(char *path, int64_t *mtime_rtn)
+{
+  struct stat filestat;
+
+  if (stat(path, &filestat))
+    return(1);
+
+  *mtime_rtn = (int64_t) filestat.st_mtime;
+  return(0);
+}
+
+/**
+ * Expand a shell pattern ('*', '?') with glob(3). The wildcards only
+ * match inside the folder part of the pattern, and only regular files
+ * are kept.
+ *
+ * @brief os_GetMatchingFiles
+ * @param pattern
+ * @param nb_file_rtn Number of paths returned
+ * @return Table of allocated paths (free with mem_free_list), NULL if
+ *         nothing matches
+ */
+char **os_GetMatchingFiles(char *pattern, int *nb_file_rtn)
+{
+  glob_t result;
+  struct stat filestat;
+  char **tab_file;
+  size_t i;
+  int nb_file = 0;
+
+  *nb_file_rtn = 0;
+  if (glob(pattern, 0, NULL, &result) != 0) {
+    globfree(&result);
+    return(NULL);
+  }
+
+  tab_file = (char **) calloc(result.gl_pathc, sizeof(char *));
+  if (tab_file == NULL) {
+    globfree(&result);
+    return(NULL);
+  }
+  for (i = 0; i < result.gl_pathc; i++) {
+    if (stat(result.gl_pathv[i], &filestat) || !S_ISREG(filestat.st_mode))
+      continue;
+    tab_file[nb_file] = strdup(result.gl_pathv[i]);
+    if (tab_file[nb_file] == NULL)
+      break;
+    nb_file++;
+  }
+  globfree(&result);
+
+  if (nb_file == 0) {
+    free(tab_file);
+    return(NULL);
+  }
+  *nb_file_rtn = nb_file;
+  return(tab_file);
+}
 
 char *my_strcpy(char *s1, int s1_size, char *s2)
 {
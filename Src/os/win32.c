@@ -6,6 +6,8 @@
  */
 
 #include "os.h"
+#include "../log.h"
+#include "../Dc_Stats.h"
 
 #ifdef BUILD_WINDOWS
 
@@ -156,6 +158,8 @@ void os_SetFileCreationModificationDate(char *file_data_path, struct file_descri
   SYSTEMTIME system_utc;
   FILETIME creation_date;
   FILETIME modification_date;
+  struct prodos_date entry_date;
+  struct prodos_time entry_time;
 
   /* Init */
   memset(&creation_date,0,sizeof(FILETIME));
@@ -169,20 +173,24 @@ void os_SetFileCreationModificationDate(char *file_data_path, struct file_descri
   /** Création des dates au format Windows **/
   /* Création Date */
   memset(&system_date,0,sizeof(SYSTEMTIME));
-  system_date.wYear = current_entry->file_creation_date.year + ((current_entry->file_creation_date.year < 70) ? 2000 : 1900);
-  system_date.wMonth = current_entry->file_creation_date.month;
-  system_date.wDay = current_entry->file_creation_date.day;
-  system_date.wHour = current_entry->file_creation_time.hour;
-  system_date.wMinute = current_entry->file_creation_time.minute;
+  GetProdosDate(current_entry->file_creation_date,&entry_date);
+  GetProdosTime(current_entry->file_creation_time,&entry_time);
+  system_date.wYear = entry_date.year + ((entry_date.year < 70) ? 2000 : 1900);
+  system_date.wMonth = entry_date.month;
+  system_date.wDay = entry_date.day;
+  system_date.wHour = entry_time.hour;
+  system_date.wMinute = entry_time.minute;
   TzSpecificLocalTimeToSystemTime(NULL,&system_date,&system_utc);
   result = SystemTimeToFileTime(&system_utc,&creation_date);
   /* Modification Date */
   memset(&system_date,0,sizeof(SYSTEMTIME));
-  system_date.wYear = current_entry->file_modification_date.year + ((current_entry->file_modification_date.year < 70) ? 2000 : 1900);
-  system_date.wMonth = current_entry->file_modification_date.month;
-  system_date.wDay = current_entry->file_modification_date.day;
-  system_date.wHour = current_entry->file_modification_time.hour;
-  system_date.wMinute = current_entry->file_modification_time.minute;
+  GetProdosDate(current_entry->file_modification_date,&entry_date);
+  GetProdosTime(current_entry->file_modification_time,&entry_time);
+  system_date.wYear = entry_date.year + ((entry_date.year < 70) ? 2000 : 1900);
+  system_date.wMonth = entry_date.month;
+  system_date.wDay = entry_date.day;
+  system_date.wHour = entry_time.hour;
+  system_date.wMinute = entry_time.minute;
   TzSpecificLocalTimeToSystemTime(NULL,&system_date,&system_utc);
   result = SystemTimeToFileTime(&system_utc,&modification_date);
 
@@ -264,11 +272,243 @@ int my_mkdir(char *path)
 	return mkdir(path);
 }
 
-uint32_t swap32(uint32_t num)
-{
-  return _byteswap_ulong(num);
-}
-
+/**
+ * No mapping on Win32 : returning NULL makes LoadProdosImage fall back
+ * to LoadBinaryFile and UpdateProdosImage to its block by block write.
+ *
+ * @brief os_MapFile
+ * @param file_path
+ * @param data_length_rtn
+ * @return NULL
+ */
+unsigned char *os_MapFile(char *file_path, int *data_length_rtn)
+{
+  *data_length_rtn = 0;
+  return(NULL);
+}
+
+int os_OpenFileWrite(char *file_path)
+{
+  return(_open(file_path, _O_RDWR | _O_BINARY));
+}
+
+/**
+ * No pwrite on Win32 : seek then write.
+ *
+ * @brief os_WriteFileAt
+ * @param fd
+ * @param data
+ * @param data_length
+ * @param offset
+ * @return 0 on success
+ */
+int os_WriteFileAt(int fd, unsigned char *data, int data_length, int offset)
+{
+  int nb_write;
+
+  if (_lseek(fd, (long) offset, SEEK_SET) != (long) offset)
+    return(1);
+
+  while (data_length > 0) {
+    nb_write = _write(fd, data, (unsigned int) data_length);
+    if (nb_write <= 0) return(1);
+
+    data += nb_write;
+    data_length -= nb_write;
+  }
+
+  return(0);
+}
+
+int os_SyncFile(int fd)
+{
+  return(_commit(fd));
+}
+
+int os_CloseFile(int fd)
+{
+  return(_close(fd));
+}
+
+double os_GetTime(void)
+{
+  LARGE_INTEGER counter, frequency;
+
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return((double) counter.QuadPart / (double) frequency.QuadPart);
+}
+
+void os_UnmapFile(unsigned char *data, int data_length)
+{
+}
+
+struct thread_call {
+  void (*thread_function)(void *);
+  void *thread_data;
+};
+
+static DWORD WINAPI os_ThreadStart(LPVOID arg)
+{
+  struct thread_call *call = (struct thread_call *) arg;
+  call->thread_function(call->thread_data);
+  log_flush();
+  stats_MergeThread();
+  return(0);
+}
+
+/**
+ * Win32 thread start / join. See the POSIX version for the contract.
+ *
+ * @brief os_RunThreads
+ * @param nb_thread
+ * @param thread_function
+ * @param thread_data
+ * @return Number of threads actually started
+ */
+int os_RunThreads(int nb_thread, void (*thread_function)(void *), void *thread_data)
+{
+  int i, nb_started = 0;
+  HANDLE *tab_thread;
+  struct thread_call call = { thread_function, thread_data };
+
+  /* Les messages de ce thread passent avant ceux des nouveaux threads */
+  log_flush();
+
+  tab_thread = (HANDLE *) calloc(nb_thread,sizeof(HANDLE));
+  if(tab_thread != NULL)
+    for(i=0; i<nb_thread; i++)
+      {
+        tab_thread[nb_started] = CreateThread(NULL,0,os_ThreadStart,&call,0,NULL);
+        if(tab_thread[nb_started] == NULL)
+          break;
+        nb_started++;
+      }
+
+  /* Aucun thread : on fait le travail ici */
+  if(nb_started == 0)
+    thread_function(thread_data);
+
+  for(i=0; i<nb_started; i++)
+    {
+      WaitForSingleObject(tab_thread[i],INFINITE);
+      CloseHandle(tab_thread[i]);
+    }
+
+  free(tab_thread);
+  return(nb_started);
+}
+
+int os_AtomicIncrement(int *value)
+{
+  return((int) InterlockedIncrement((LONG volatile *) value));
+}
+
+void *os_CreateLock(void)
+{
+  CRITICAL_SECTION *lock;
+
+  lock = calloc(1, sizeof(CRITICAL_SECTION));
+  if (lock == NULL)
+    return(NULL);
+  InitializeCriticalSection(lock);
+  return(lock);
+}
+
+void os_Lock(void *lock)
+{
+  EnterCriticalSection((CRITICAL_SECTION *) lock);
+}
+
+void os_Unlock(void *lock)
+{
+  LeaveCriticalSection((CRITICAL_SECTION *) lock);
+}
+
+void os_FreeLock(void *lock)
+{
+  if (lock == NULL)
+    return;
+  DeleteCriticalSection((CRITICAL_SECTION *) lock);
+  free(lock);
+}
+
+int os_RenameFile(char *old_path, char *new_path)
+{
+  return(MoveFileExA(old_path, new_path, MOVEFILE_REPLACE_EXISTING) ? 0 : 1);
+}
+
+int os_GetFileModificationTime(char *path, int64_t *mtime_rtn)
+{
+  struct _stat64 filestat;
+
+  if (_stat64(path, &filestat))
+    return(1);
+
+  *mtime_rtn = (int64_t) filestat.st_mtime;
+  return(0);
+}
+
+char **os_GetMatchingFiles(char *pattern, int *nb_file_rtn)
+{
+  WIN32_FIND_DATAA find_data;
+  HANDLE find_handle;
+  char **tab_file, **tab_new;
+  int i, folder_length, nb_file, nb_file_max;
+
+  *nb_file_rtn = 0;
+
+  /* FindFirstFile ne renvoie que le nom : on garde le dossier du motif */
+  for (i = (int) strlen(pattern) - 1; i >= 0; i--)
+    if (pattern[i] == '\\' || pattern[i] == '/' || pattern[i] == ':')
+      break;
+  folder_length = i + 1;
+
+  find_handle = FindFirstFileA(pattern, &find_data);
+  if (find_handle == INVALID_HANDLE_VALUE)
+    return(NULL);
+
+  tab_file = NULL;
+  nb_file = 0;
+  nb_file_max = 0;
+  do
+    {
+      /* Les fichiers seulement */
+      if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        continue;
+
+      if (nb_file == nb_file_max)
+        {
+          nb_file_max = (nb_file_max == 0) ? 16 : 2*nb_file_max;
+          tab_new = (char **) realloc(tab_file, nb_file_max*sizeof(char *));
+          if (tab_new == NULL)
+            break;
+          tab_file = tab_new;
+        }
+      tab_file[nb_file] = (char *) calloc(1, folder_length+strlen(find_data.cFileName)+1);
+      if (tab_file[nb_file] == NULL)
+        break;
+      memcpy(tab_file[nb_file], pattern, folder_length);
+      strcpy(&tab_file[nb_file][folder_length], find_data.cFileName);
+      nb_file++;
+    }
+  while (FindNextFileA(find_handle, &find_data));
+  FindClose(find_handle);
+
+  if (nb_file == 0)
+    {
+      free(tab_file);
+      return(NULL);
+    }
+  *nb_file_rtn = nb_file;
+  return(tab_file);
+}
+
+uint32_t swap32(uint32_t num)
+{
+  return _byteswap_ulong(num);
+}
+
 uint16_t swap16(uint16_t num)
 {
   return _byteswap_ushort(num);
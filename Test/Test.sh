@@ -0,0 +1,92 @@
+#!/bin/bash
+# Command line regression tests, run by 'make test'
+# Usage: Test.sh <cadius_path> <work_dir>
+
+CADIUS=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+WORK_DIR=$2
+NB_FAIL=0
+
+# check <description> <command...> : the command must succeed
+check() {
+	local desc=$1
+	shift
+	if "$@" > /dev/null 2>&1 ; then
+		echo "  ok   : $desc"
+	else
+		echo "  FAIL : $desc"
+		NB_FAIL=$((NB_FAIL + 1))
+	fi
+}
+
+# check_not <description> <command...> : the command must fail
+check_not() {
+	local desc=$1
+	shift
+	if "$@" > /dev/null 2>&1 ; then
+		echo "  FAIL : $desc"
+		NB_FAIL=$((NB_FAIL + 1))
+	else
+		echo "  ok   : $desc"
+	fi
+}
+
+# has_entry <image> <name> : the catalog of the image lists the entry
+has_entry() {
+	"$CADIUS" CATALOG "$1" | grep -q "$2"
+}
+
+rm -rf "$WORK_DIR"
+mkdir -p "$WORK_DIR"
+cd "$WORK_DIR" || exit 1
+"$CADIUS" CREATEVOLUME batch.po VOL 140KB > /dev/null || exit 1
+
+echo "BATCH :"
+# A line longer than the buffer must not be split into two commands
+{ printf '#%01022d' 0 | tr 0 x ; echo "CREATEFOLDER /VOL/SNEAK" ; } > long.txt
+check_not "line too long is rejected" "$CADIUS" BATCH batch.po long.txt
+check_not "line too long is not split" has_entry batch.po SNEAK
+
+# An unknown command reports its line without dumping the usage
+echo "FOO /VOL/X" > unknown.txt
+check_not "unknown command is rejected" "$CADIUS" BATCH batch.po unknown.txt
+check_not "unknown command does not print the usage" \
+	bash -c "'$CADIUS' BATCH batch.po unknown.txt | grep -q Usage"
+
+# The first failing command stops the script and the image is not written
+cp batch.po before.po
+printf 'CREATEFOLDER /VOL/A\nDELETEFILE /VOL/NOPE\nCREATEFOLDER /VOL/B\n' > fail.txt
+check_not "failing command is reported" "$CADIUS" BATCH batch.po fail.txt
+check "failing script leaves the image unchanged" cmp -s batch.po before.po
+printf 'CREATEFOLDER /VOL/A\nCREATEFOLDER /VOL/B\n' > ok.txt
+check "valid script succeeds" "$CADIUS" BATCH batch.po ok.txt
+check "valid script writes the image" has_entry batch.po /B/
+
+echo "ADDFILE :"
+# The file fits in the free blocks, but not once its new folder is created
+"$CADIUS" CREATEVOLUME add.po VOL 140KB > /dev/null || exit 1
+cp add.po before.po
+yes | head -c $((270 * 512)) > BIG
+check_not "file too big is rejected" "$CADIUS" ADDFILE add.po /VOL/NEWF BIG
+check "failing ADDFILE leaves the image unchanged" cmp -s add.po before.po
+
+echo "Image patterns :"
+mkdir -p disks/sub
+"$CADIUS" CREATEVOLUME disks/a.po AAA 140KB > /dev/null
+"$CADIUS" CREATEVOLUME disks/sub/b.po BBB 140KB > /dev/null
+# A pattern only matches in its own folder
+check "folder pattern matches its images" \
+	bash -c "'$CADIUS' CATALOG 'disks/*.po' | grep -q AAA"
+check_not "folder pattern does not match in subfolders" \
+	bash -c "'$CADIUS' CATALOG 'disks/*.po' | grep -q BBB"
+# A pattern without folder part matches in the current folder
+check "pattern without folder matches" \
+	bash -c "cd disks && '$CADIUS' CATALOG '*.po' | grep -q AAA"
+check_not "pattern without folder does not match in subfolders" \
+	bash -c "cd disks && '$CADIUS' CATALOG '*.po' | grep -q BBB"
+check_not "pattern without match is an error" "$CADIUS" CATALOG 'disks/x*.po'
+
+if [ $NB_FAIL -ne 0 ] ; then
+	echo "$NB_FAIL test(s) failed"
+	exit 1
+fi
+echo "All tests passed"
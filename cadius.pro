@@ -13,7 +13,9 @@ HEADERS = \
    $$PWD/Src/Dc_Memory.h \
    $$PWD/Src/Dc_Prodos.h \
    $$PWD/Src/Dc_Shared.h \
+   $$PWD/Src/Dc_Stats.h \
    $$PWD/Src/Prodos_Add.h \
+   $$PWD/Src/Prodos_Cache.h \
    $$PWD/Src/Prodos_Check.h \
    $$PWD/Src/Prodos_Create.h \
    $$PWD/Src/Prodos_Delete.h \
@@ -28,8 +30,10 @@ SOURCES = \
    $$PWD/Src/Dc_Memory.c \
    $$PWD/Src/Dc_Prodos.c \
    $$PWD/Src/Dc_Shared.c \
+   $$PWD/Src/Dc_Stats.c \
    $$PWD/Src/Main.c \
    $$PWD/Src/Prodos_Add.c \
+   $$PWD/Src/Prodos_Cache.c \
    $$PWD/Src/Prodos_Check.c \
    $$PWD/Src/Prodos_Create.c \
    $$PWD/Src/Prodos_Delete.c \